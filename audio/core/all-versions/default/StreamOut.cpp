@@ -22,12 +22,16 @@
 //#define LOG_NDEBUG 0
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <memory>
 
 #include <android/log.h>
+#include <cutils/properties.h>
 #include <hardware/audio.h>
+#include <utils/Timers.h>
 #include <utils/Trace.h>
 
 namespace android {
@@ -38,12 +42,19 @@ namespace implementation {
 
 namespace {
 
+// Set to true to have the legacy HAL write straight out of the data MQ, instead of out of a copy
+// of the data taken when the write command is received.  The legacy HAL must not keep using
+// the buffer after write() returns, which is true for any HAL working with the copying write
+// thread too, since the copy is overwritten by the next command.
+const char kZeroCopyWriteProperty[] = "ro.vendor.audio.hal.zero_copy_write";
+
 class WriteThread : public Thread {
    public:
     // WriteThread's lifespan never exceeds StreamOut's lifespan.
     WriteThread(std::atomic<bool>* stop, audio_stream_out_t* stream,
                 StreamOut::CommandMQ* commandMQ, StreamOut::DataMQ* dataMQ,
-                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup)
+                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup, bool zeroCopy,
+                StreamOut::WriteStats* stats)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -51,6 +62,8 @@ class WriteThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
+          mZeroCopy(zeroCopy),
+          mStats(stats),
           mBuffer(nullptr) {}
     bool init() {
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
@@ -65,28 +78,86 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
+    const bool mZeroCopy;
+    StreamOut::WriteStats* mStats;
+    std::unique_ptr<uint8_t[]> mBuffer;  // In zero copy mode, only used for data wrapping around
     IStreamOut::WriteStatus mStatus;
+    nsecs_t mLastWriteEnd = 0;
+    nsecs_t mLastWriteDuration = 0;  // Play time of the data written last
 
     bool threadLoop() override;
 
     void doGetLatency();
     void doGetPresentationPosition();
     void doWrite();
+    void updateStats(nsecs_t start, nsecs_t end, size_t queued, ssize_t writeResult);
 };
 
 void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
+
+    const uint8_t* data = &mBuffer[0];
+    StreamOut::DataMQ::MemTransaction tx;
+    if (mZeroCopy) {
+        if (!mDataMQ->beginRead(availToRead, &tx)) {
+            return;
+        }
+        // The legacy HAL takes a single buffer, so data split by the end of the MQ is copied
+        const auto first = tx.getFirstRegion();
+        if (first.getLength() == availToRead) {
+            data = first.getAddress();
         } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
+            tx.copyFrom(&mBuffer[0], 0, availToRead);
+            mStats->wrappedWrites.fetch_add(1, std::memory_order_relaxed);
         }
+    } else if (!mDataMQ->read(&mBuffer[0], availToRead)) {
+        return;
+    }
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    ssize_t writeResult = mStream->write(mStream, data, availToRead);
+    const nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    // The client can only reuse the data once it's been written out
+    if (mZeroCopy) {
+        mDataMQ->commitRead(availToRead);
+    }
+
+    if (writeResult >= 0) {
+        mStatus.reply.written = writeResult;
+    } else {
+        mStatus.retval = Stream::analyzeStatus("write", writeResult);
+    }
+    updateStats(start, end, availToRead, writeResult);
+}
+
+void WriteThread::updateStats(nsecs_t start, nsecs_t end, size_t queued, ssize_t writeResult) {
+    mStats->writes.fetch_add(1, std::memory_order_relaxed);
+    mStats->recordLatency((end - start) / 1000);
+    if (queued == 0) {
+        mStats->emptyWrites.fetch_add(1, std::memory_order_relaxed);
+    } else if (writeResult < 0 || static_cast<size_t>(writeResult) < queued) {
+        mStats->shortWrites.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (writeResult <= 0) {
+        return;
+    }
+    mStats->bytes.fetch_add(writeResult, std::memory_order_relaxed);
+
+    // The legacy HAL returns once its buffer has room for the data.  If the next write comes
+    // later than the data written before takes to play, its buffer has most likely run dry.
+    if (!mStats->restarted.exchange(false, std::memory_order_relaxed) &&
+        start - mLastWriteEnd > mLastWriteDuration) {
+        mStats->underruns.fetch_add(1, std::memory_order_relaxed);
     }
+    const size_t frameSize = audio_stream_out_frame_size(mStream);
+    const uint32_t sampleRate = mStream->common.get_sample_rate(&mStream->common);
+    mLastWriteEnd = end;
+    mLastWriteDuration = frameSize != 0 && sampleRate != 0
+                                 ? seconds_to_nanoseconds(writeResult / frameSize) / sampleRate
+                                 : 0;
 }
 
 void WriteThread::doGetPresentationPosition() {
@@ -241,6 +312,7 @@ Return<Result> StreamOut::removeEffect(uint64_t effectId) {
 }
 
 Return<Result> StreamOut::standby() {
+    mWriteStats.restarted = true;
     return mStreamCommon->standby();
 }
 
@@ -376,9 +448,10 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     }
 
     // Create and launch the thread.
+    const bool zeroCopy = property_get_bool(kZeroCopyWriteProperty, false);
     sp<WriteThread> tempWriteThread =
             new WriteThread(&mStopWriteThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
-                            tempStatusMQ.get(), tempElfGroup.get());
+                            tempStatusMQ.get(), tempElfGroup.get(), zeroCopy, &mWriteStats);
     if (!tempWriteThread->init()) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
@@ -480,6 +553,7 @@ Return<void> StreamOut::supportsPauseAndResume(supportsPauseAndResume_cb _hidl_c
 }
 
 Return<Result> StreamOut::pause() {
+    mWriteStats.restarted = true;
     return mStream->pause != NULL
                    ? Stream::analyzeStatus("pause", mStream->pause(mStream), {ENOSYS} /*ignore*/)
                    : Result::NOT_SUPPORTED;
@@ -505,11 +579,43 @@ Return<Result> StreamOut::drain(AudioDrain type) {
 }
 
 Return<Result> StreamOut::flush() {
+    mWriteStats.restarted = true;
     return mStream->flush != NULL
                    ? Stream::analyzeStatus("flush", mStream->flush(mStream), {ENOSYS} /*ignore*/)
                    : Result::NOT_SUPPORTED;
 }
 
+void StreamOut::WriteStats::recordLatency(uint64_t us) {
+    size_t bucket = 0;
+    while (bucket + 1 < kLatencyBuckets && us >= (uint64_t{1} << bucket)) {
+        bucket++;
+    }
+    latencyUs[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (us > maxLatencyUs.load(std::memory_order_relaxed)) {
+        // Only the write thread updates the maximum
+        maxLatencyUs.store(us, std::memory_order_relaxed);
+    }
+}
+
+void StreamOut::WriteStats::dump(int fd) const {
+    dprintf(fd, "Writes: %" PRIu64 ", %" PRIu64 " bytes\n", writes.load(), bytes.load());
+    dprintf(fd, "Empty writes: %" PRIu64 ", short writes: %" PRIu64 ", underruns: %" PRIu64
+            ", wrapped writes: %" PRIu64 "\n",
+            emptyWrites.load(), shortWrites.load(), underruns.load(), wrappedWrites.load());
+    dprintf(fd, "Write latency, max %" PRIu64 " us:\n", maxLatencyUs.load());
+    for (size_t i = 0; i < kLatencyBuckets; i++) {
+        const uint64_t count = latencyUs[i].load();
+        if (count == 0) {
+            continue;
+        }
+        if (i + 1 < kLatencyBuckets) {
+            dprintf(fd, "  < %6" PRIu64 " us: %" PRIu64 "\n", uint64_t{1} << i, count);
+        } else {
+            dprintf(fd, "  >=%6" PRIu64 " us: %" PRIu64 "\n", uint64_t{1} << (i - 1), count);
+        }
+    }
+}
+
 // static
 Result StreamOut::getPresentationPositionImpl(audio_stream_out_t* stream, uint64_t* frames,
                                               TimeSpec* timeStamp) {
@@ -557,7 +663,11 @@ Return<void> StreamOut::getMmapPosition(getMmapPosition_cb _hidl_cb) {
 }
 
 Return<void> StreamOut::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
-    return mStreamCommon->debug(fd, options);
+    mStreamCommon->debug(fd, options);
+    if (fd.getNativeHandle() != nullptr && fd->numFds == 1 && mWriteThread.get()) {
+        mWriteStats.dump(fd->data[0]);
+    }
+    return Void();
 }
 
 #if MAJOR_VERSION >= 4
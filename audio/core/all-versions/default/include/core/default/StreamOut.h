@@ -50,6 +50,27 @@ struct StreamOut : public IStreamOut {
     typedef MessageQueue<uint8_t, kSynchronizedReadWrite> DataMQ;
     typedef MessageQueue<WriteStatus, kSynchronizedReadWrite> StatusMQ;
 
+    // Statistics of the writes to the legacy HAL, updated by the write thread and dumped by
+    // debug().
+    struct WriteStats {
+        static constexpr size_t kLatencyBuckets = 16;  // Powers of two microseconds
+
+        std::atomic<uint64_t> writes{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> emptyWrites{0};    // Nothing was queued by the client
+        std::atomic<uint64_t> shortWrites{0};    // The HAL took less than was queued, or failed
+        std::atomic<uint64_t> underruns{0};      // The previous write had played out already
+        std::atomic<uint64_t> wrappedWrites{0};  // Copied because the data wrapped around the MQ
+        std::atomic<uint64_t> latencyUs[kLatencyBuckets] = {};
+        std::atomic<uint64_t> maxLatencyUs{0};
+        // Set when the stream is paused, flushed or put in standby, so that the gap before the
+        // next write isn't taken for an underrun.
+        std::atomic<bool> restarted{true};
+
+        void recordLatency(uint64_t us);
+        void dump(int fd) const;
+    };
+
     StreamOut(const sp<Device>& device, audio_stream_out_t* stream);
 
     // Methods from ::android::hardware::audio::CPP_VERSION::IStream follow.
@@ -152,6 +173,7 @@ struct StreamOut : public IStreamOut {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopWriteThread;
     sp<Thread> mWriteThread;
+    WriteStats mWriteStats;
 
     virtual ~StreamOut();
 
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the overhead of the HIDL stream data path: the message queues and the threads of
+// StreamOut and StreamIn between a client and the legacy HAL, with the legacy HAL replaced by
+// NullAudioHw.  Each benchmark takes the number of frames per buffer and the sample rate as
+// arguments, and runs in real time, one buffer per iteration.  Reported per buffer:
+//   wakeup_us      from the client waking the stream thread to the legacy call starting
+//   return_us      from the legacy call returning to the client reading the status
+//   jitter_us      standard deviation of the time between the starts of legacy calls
+//   cpu_us         CPU time of the whole process
+//   hal_cpu_us     CPU time of the process outside of the client threads
+// along with the 99th percentile and maximum of the wakeup latency, and the number of xruns
+// the null device saw.
+
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmq/EventFlag.h>
+
+#include <common/all-versions/VersionUtils.h>
+#include "core/default/Device.h"
+#include "core/default/StreamIn.h"
+#include "core/default/StreamOut.h"
+
+#include "NullAudioHw.h"
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::audio::NullAudioHw;
+using ::android::hardware::audio::common::utils::mkEnumBitfield;
+using ::android::hardware::audio::CPP_VERSION::implementation::Device;
+using ::android::hardware::audio::CPP_VERSION::implementation::StreamIn;
+using ::android::hardware::audio::CPP_VERSION::implementation::StreamOut;
+using namespace ::android::hardware::audio::common::CPP_VERSION;
+using namespace ::android::hardware::audio::CPP_VERSION;
+
+namespace {
+
+// 16 bit stereo
+constexpr uint32_t kFrameSize = 4;
+
+// Buffers written or read before measuring, for the stream threads and the null device to
+// reach their steady state
+constexpr int kWarmUpBuffers = 8;
+
+nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+nsecs_t cpuTime(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+}
+
+AudioConfig makeConfig(uint32_t sampleRate, AudioChannelMask channelMask) {
+    AudioConfig config{};
+    config.sampleRateHz = sampleRate;
+    config.channelMask = mkEnumBitfield(channelMask);
+    config.format = AudioFormat::PCM_16_BIT;
+    return config;
+}
+
+// Timings of the buffers going one way through the data path
+class PathStats {
+  public:
+    explicit PathStats(size_t buffers) {
+        mWakeupUs.reserve(buffers);
+        mReturnUs.reserve(buffers);
+        mIntervalUs.reserve(buffers);
+    }
+
+    // Record a buffer, given when the client woke up the stream thread and when it got the
+    // status back.  The legacy call for the buffer must have been the last one in times.
+    void add(nsecs_t wake, nsecs_t done, const NullAudioHw::CallTimes& times) {
+        const nsecs_t start = times.start;
+        const nsecs_t end = times.end;
+        mWakeupUs.push_back((start - wake) / 1000.);
+        mReturnUs.push_back((done - end) / 1000.);
+        if (mLastStart != 0) {
+            mIntervalUs.push_back((start - mLastStart) / 1000.);
+        }
+        mLastStart = start;
+    }
+
+    void report(benchmark::State& state, const std::string& prefix) {
+        if (mWakeupUs.empty()) {
+            return;
+        }
+        std::sort(mWakeupUs.begin(), mWakeupUs.end());
+        state.counters[prefix + "wakeup_us"] = mean(mWakeupUs);
+        state.counters[prefix + "wakeup_p99_us"] = mWakeupUs[mWakeupUs.size() * 99 / 100];
+        state.counters[prefix + "wakeup_max_us"] = mWakeupUs.back();
+        state.counters[prefix + "return_us"] = mean(mReturnUs);
+
+        double variance = 0;
+        const double interval = mean(mIntervalUs);
+        for (double i : mIntervalUs) {
+            variance += (i - interval) * (i - interval);
+        }
+        state.counters[prefix + "jitter_us"] =
+                mIntervalUs.empty() ? 0 : sqrt(variance / mIntervalUs.size());
+    }
+
+  private:
+    static double mean(const std::vector<double>& values) {
+        return values.empty() ? 0
+                              : std::accumulate(values.begin(), values.end(), 0.) / values.size();
+    }
+
+    std::vector<double> mWakeupUs;
+    std::vector<double> mReturnUs;
+    std::vector<double> mIntervalUs;
+    nsecs_t mLastStart = 0;
+};
+
+// The client side of an output stream, writing to it the way the audio server does.
+class OutputPath {
+  public:
+    ~OutputPath() {
+        if (mStream) {
+            mStream->close();
+        }
+        if (mEfGroup) {
+            EventFlag::deleteEventFlag(&mEfGroup);
+        }
+    }
+
+    bool open(const sp<Device>& device, uint32_t sampleRate, uint32_t framesPerBuffer) {
+        const AudioConfig config = makeConfig(sampleRate, AudioChannelMask::OUT_STEREO);
+        const DeviceAddress address{.device = AudioDevice::OUT_SPEAKER};
+        Result result = Result::NOT_INITIALIZED;
+        auto cb = [&](Result r, const sp<IStreamOut>& stream, const AudioConfig&) {
+            result = r;
+            mStream = stream;
+        };
+#if MAJOR_VERSION == 2
+        device->openOutputStream(1, address, config, {}, cb);
+#elif MAJOR_VERSION >= 4
+        const SourceMetadata metadata = {{{AudioUsage::MEDIA, AudioContentType::MUSIC, 1}}};
+        device->openOutputStream(1, address, config, {}, metadata, cb);
+#endif
+        if (result != Result::OK) {
+            return false;
+        }
+
+        mStream->prepareForWriting(
+                kFrameSize, framesPerBuffer,
+                [&](Result r, const StreamOut::CommandMQ::Descriptor& commandDesc,
+                    const StreamOut::DataMQ::Descriptor& dataDesc,
+                    const StreamOut::StatusMQ::Descriptor& statusDesc, const ThreadInfo&) {
+                    result = r;
+                    if (r == Result::OK) {
+                        mCommandMQ = std::make_unique<StreamOut::CommandMQ>(commandDesc);
+                        mDataMQ = std::make_unique<StreamOut::DataMQ>(dataDesc);
+                        mStatusMQ = std::make_unique<StreamOut::StatusMQ>(statusDesc);
+                    }
+                });
+        return result == Result::OK &&
+               EventFlag::createEventFlag(mDataMQ->getEventFlagWord(), &mEfGroup) == android::OK;
+    }
+
+    // Write a buffer, setting wake to when the stream thread was woken up.
+    bool write(const void* data, size_t bytes, nsecs_t* wake) {
+        const IStreamOut::WriteCommand command = IStreamOut::WriteCommand::WRITE;
+        if (!mDataMQ->write(static_cast<const uint8_t*>(data), bytes) ||
+            !mCommandMQ->write(&command)) {
+            return false;
+        }
+        *wake = now();
+        mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY));
+
+        IStreamOut::WriteStatus status;
+        while (!mStatusMQ->read(&status)) {
+            uint32_t efState = 0;
+            mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
+        }
+        return status.retval == Result::OK && status.reply.written == bytes;
+    }
+
+  private:
+    sp<IStreamOut> mStream;
+    std::unique_ptr<StreamOut::CommandMQ> mCommandMQ;
+    std::unique_ptr<StreamOut::DataMQ> mDataMQ;
+    std::unique_ptr<StreamOut::StatusMQ> mStatusMQ;
+    EventFlag* mEfGroup = nullptr;
+};
+
+// The client side of an input stream, reading from it the way the audio server does.
+class InputPath {
+  public:
+    ~InputPath() {
+        if (mStream) {
+            mStream->close();
+        }
+        if (mEfGroup) {
+            EventFlag::deleteEventFlag(&mEfGroup);
+        }
+    }
+
+    bool open(const sp<Device>& device, uint32_t sampleRate, uint32_t framesPerBuffer) {
+        const AudioConfig config = makeConfig(sampleRate, AudioChannelMask::IN_STEREO);
+        const DeviceAddress address{.device = AudioDevice::IN_BUILTIN_MIC};
+        Result result = Result::NOT_INITIALIZED;
+        auto cb = [&](Result r, const sp<IStreamIn>& stream, const AudioConfig&) {
+            result = r;
+            mStream = stream;
+        };
+#if MAJOR_VERSION == 2
+        device->openInputStream(2, address, config, {}, AudioSource::DEFAULT, cb);
+#elif MAJOR_VERSION >= 4
+        const SinkMetadata metadata = {{{.source = AudioSource::DEFAULT, .gain = 1}}};
+        device->openInputStream(2, address, config, {}, metadata, cb);
+#endif
+        if (result != Result::OK) {
+            return false;
+        }
+
+        mStream->prepareForReading(
+                kFrameSize, framesPerBuffer,
+                [&](Result r, const StreamIn::CommandMQ::Descriptor& commandDesc,
+                    const StreamIn::DataMQ::Descriptor& dataDesc,
+                    const StreamIn::StatusMQ::Descriptor& statusDesc, const ThreadInfo&) {
+                    result = r;
+                    if (r == Result::OK) {
+                        mCommandMQ = std::make_unique<StreamIn::CommandMQ>(commandDesc);
+                        mDataMQ = std::make_unique<StreamIn::DataMQ>(dataDesc);
+                        mStatusMQ = std::make_unique<StreamIn::StatusMQ>(statusDesc);
+                    }
+                });
+        return result == Result::OK &&
+               EventFlag::createEventFlag(mDataMQ->getEventFlagWord(), &mEfGroup) == android::OK;
+    }
+
+    // Read a buffer, setting wake to when the stream thread was woken up.
+    bool read(void* data, size_t bytes, nsecs_t* wake) {
+        IStreamIn::ReadParameters parameters;
+        parameters.command = IStreamIn::ReadCommand::READ;
+        parameters.params.read = bytes;
+        if (!mCommandMQ->write(&parameters)) {
+            return false;
+        }
+        *wake = now();
+        mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL));
+
+        IStreamIn::ReadStatus status;
+        while (!mStatusMQ->read(&status)) {
+            uint32_t efState = 0;
+            mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY), &efState);
+        }
+        return status.retval == Result::OK && status.reply.read == bytes &&
+               mDataMQ->read(static_cast<uint8_t*>(data), bytes);
+    }
+
+  private:
+    sp<IStreamIn> mStream;
+    std::unique_ptr<StreamIn::CommandMQ> mCommandMQ;
+    std::unique_ptr<StreamIn::DataMQ> mDataMQ;
+    std::unique_ptr<StreamIn::StatusMQ> mStatusMQ;
+    EventFlag* mEfGroup = nullptr;
+};
+
+// Both the arguments of a benchmark, and the buffer size of the null device, which holds two
+// buffers like a sound card with two periods.
+struct Config {
+    explicit Config(const benchmark::State& state)
+        : framesPerBuffer(state.range(0)),
+          sampleRate(state.range(1)),
+          bytes(framesPerBuffer * kFrameSize),
+          deviceFrames(2 * framesPerBuffer) {}
+
+    const uint32_t framesPerBuffer;
+    const uint32_t sampleRate;
+    const size_t bytes;
+    const size_t deviceFrames;
+};
+
+void reportCpu(benchmark::State& state, nsecs_t processCpu, nsecs_t clientCpu) {
+    const double buffers = state.iterations();
+    state.counters["cpu_us"] = processCpu / 1000. / buffers;
+    state.counters["hal_cpu_us"] = (processCpu - clientCpu) / 1000. / buffers;
+}
+
+void BM_WriteDataPath(benchmark::State& state) {
+    const Config config(state);
+    NullAudioHw hw(config.deviceFrames, false /*loopback*/);
+    sp<Device> device = new Device(hw.getDevice());
+    std::vector<uint8_t> buffer(config.bytes);
+    {
+        OutputPath output;
+        if (!output.open(device, config.sampleRate, config.framesPerBuffer)) {
+            state.SkipWithError("Failed to open the output stream");
+            return;
+        }
+
+        nsecs_t wake;
+        for (int i = 0; i < kWarmUpBuffers; i++) {
+            output.write(buffer.data(), config.bytes, &wake);
+        }
+        const uint64_t xruns = hw.getWriteTimes().xruns;
+
+        PathStats stats(state.max_iterations);
+        const nsecs_t processCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+        const nsecs_t clientCpu = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+        for (auto _ : state) {
+            if (!output.write(buffer.data(), config.bytes, &wake)) {
+                state.SkipWithError("Write failed");
+                break;
+            }
+            stats.add(wake, now(), hw.getWriteTimes());
+        }
+        reportCpu(state, cpuTime(CLOCK_PROCESS_CPUTIME_ID) - processCpu,
+                  cpuTime(CLOCK_THREAD_CPUTIME_ID) - clientCpu);
+        stats.report(state, "");
+        state.counters["xruns"] = hw.getWriteTimes().xruns - xruns;
+    }
+    state.SetBytesProcessed(state.iterations() * config.bytes);
+}
+
+void BM_ReadDataPath(benchmark::State& state) {
+    const Config config(state);
+    NullAudioHw hw(config.deviceFrames, false /*loopback*/);
+    sp<Device> device = new Device(hw.getDevice());
+    std::vector<uint8_t> buffer(config.bytes);
+    {
+        InputPath input;
+        if (!input.open(device, config.sampleRate, config.framesPerBuffer)) {
+            state.SkipWithError("Failed to open the input stream");
+            return;
+        }
+
+        nsecs_t wake;
+        for (int i = 0; i < kWarmUpBuffers; i++) {
+            input.read(buffer.data(), config.bytes, &wake);
+        }
+        const uint64_t xruns = hw.getReadTimes().xruns;
+
+        PathStats stats(state.max_iterations);
+        const nsecs_t processCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+        const nsecs_t clientCpu = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+        for (auto _ : state) {
+            if (!input.read(buffer.data(), config.bytes, &wake)) {
+                state.SkipWithError("Read failed");
+                break;
+            }
+            stats.add(wake, now(), hw.getReadTimes());
+        }
+        reportCpu(state, cpuTime(CLOCK_PROCESS_CPUTIME_ID) - processCpu,
+                  cpuTime(CLOCK_THREAD_CPUTIME_ID) - clientCpu);
+        stats.report(state, "");
+        state.counters["xruns"] = hw.getReadTimes().xruns - xruns;
+    }
+    state.SetBytesProcessed(state.iterations() * config.bytes);
+}
+
+// Play and capture at the same time, with the capture running on a second client thread, as
+// for an application doing echo cancellation.  Counters of the capture path are prefixed with
+// "in_".
+void BM_LoopbackDataPath(benchmark::State& state) {
+    const Config config(state);
+    NullAudioHw hw(config.deviceFrames, true /*loopback*/);
+    sp<Device> device = new Device(hw.getDevice());
+    std::vector<uint8_t> buffer(config.bytes);
+    {
+        OutputPath output;
+        InputPath input;
+        if (!output.open(device, config.sampleRate, config.framesPerBuffer) ||
+            !input.open(device, config.sampleRate, config.framesPerBuffer)) {
+            state.SkipWithError("Failed to open the streams");
+            return;
+        }
+
+        nsecs_t wake;
+        for (int i = 0; i < kWarmUpBuffers; i++) {
+            output.write(buffer.data(), config.bytes, &wake);
+        }
+        const uint64_t writeXruns = hw.getWriteTimes().xruns;
+
+        // Captures as many buffers as are played, plus the one in flight
+        std::atomic<bool> stop{false};
+        PathStats inStats(state.max_iterations + 1);
+        nsecs_t inClientCpu = 0;
+        std::thread capture([&]() {
+            std::vector<uint8_t> inBuffer(config.bytes);
+            const nsecs_t cpu = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+            nsecs_t inWake;
+            while (!stop && input.read(inBuffer.data(), config.bytes, &inWake)) {
+                inStats.add(inWake, now(), hw.getReadTimes());
+            }
+            inClientCpu = cpuTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        });
+
+        PathStats stats(state.max_iterations);
+        const nsecs_t processCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+        const nsecs_t clientCpu = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+        for (auto _ : state) {
+            if (!output.write(buffer.data(), config.bytes, &wake)) {
+                state.SkipWithError("Write failed");
+                break;
+            }
+            stats.add(wake, now(), hw.getWriteTimes());
+        }
+        stop = true;
+        capture.join();
+        reportCpu(state, cpuTime(CLOCK_PROCESS_CPUTIME_ID) - processCpu,
+                  cpuTime(CLOCK_THREAD_CPUTIME_ID) - clientCpu + inClientCpu);
+        stats.report(state, "");
+        inStats.report(state, "in_");
+        state.counters["xruns"] = hw.getWriteTimes().xruns - writeXruns;
+    }
+    state.SetBytesProcessed(state.iterations() * config.bytes * 2);
+}
+
+// Buffers from 1 to 20 ms at 48 kHz, and the same sizes at 96 kHz
+void dataPathArgs(benchmark::internal::Benchmark* b) {
+    for (int sampleRate : {48000, 96000}) {
+        for (int frames : {48, 96, 192, 240, 480, 960}) {
+            b->Args({frames, sampleRate});
+        }
+    }
+    b->ArgNames({"frames", "rate"});
+    b->UseRealTime();
+}
+
+}  // namespace
+
+BENCHMARK(BM_WriteDataPath)->Apply(dataPathArgs);
+BENCHMARK(BM_ReadDataPath)->Apply(dataPathArgs);
+BENCHMARK(BM_LoopbackDataPath)->Apply(dataPathArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NullAudioHw.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace audio {
+
+namespace {
+
+// Enough for a second of 8 channels of 32 bit samples at 48 kHz
+constexpr size_t kLoopbackBytes = 48000 * 8 * 4;
+
+nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+void sleepUntil(nsecs_t time) {
+    struct timespec ts = {.tv_sec = static_cast<time_t>(time / 1000000000),
+                          .tv_nsec = static_cast<long>(time % 1000000000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+nsecs_t framesToNs(uint64_t frames, uint32_t sampleRate) {
+    return static_cast<nsecs_t>(frames * 1000000000ull / sampleRate);
+}
+
+uint64_t nsToFrames(nsecs_t duration, uint32_t sampleRate) {
+    return duration > 0 ? static_cast<uint64_t>(duration) * sampleRate / 1000000000ull : 0;
+}
+
+bool isValidConfig(const audio_config_t& config, uint32_t channelCount) {
+    return config.sample_rate > 0 && audio_is_linear_pcm(config.format) && channelCount > 0;
+}
+
+void setDefaultConfig(audio_config_t* config, audio_channel_mask_t channelMask) {
+    config->sample_rate = 48000;
+    config->channel_mask = channelMask;
+    config->format = AUDIO_FORMAT_PCM_16_BIT;
+}
+
+// State common to both directions.  Kept after the legacy stream, so the functions of
+// audio_stream can find it from a pointer to the legacy stream, given its direction.
+struct StreamState {
+    NullAudioHw* hw;
+    audio_config_t config;
+    size_t frameSize;
+    uint32_t bufferFrames;
+};
+
+void timeCall(NullAudioHw::CallTimes* times, nsecs_t start) {
+    times->start = start;
+    times->calls++;
+}
+
+}  // namespace
+
+struct NullAudioHw::StreamOut {
+    audio_stream_out_t stream;  // First, so the legacy stream can be cast back to this
+    StreamState state;
+    nsecs_t playedUntil;  // When all the data written so far will have been played, 0 if idle
+    uint64_t framesWritten;
+
+    static StreamOut* from(const audio_stream* s) {
+        return reinterpret_cast<StreamOut*>(const_cast<audio_stream*>(s));
+    }
+    static StreamOut* from(const audio_stream_out_t* s) {
+        return reinterpret_cast<StreamOut*>(const_cast<audio_stream_out_t*>(s));
+    }
+
+    uint64_t framesPlayed(nsecs_t time) const {
+        return framesWritten -
+               std::min(framesWritten, nsToFrames(playedUntil - time, state.config.sample_rate));
+    }
+};
+
+struct NullAudioHw::StreamIn {
+    audio_stream_in_t stream;  // First, so the legacy stream can be cast back to this
+    StreamState state;
+    nsecs_t capturedUntil;  // When the data read so far was captured, 0 if idle
+    uint64_t framesRead;
+
+    static StreamIn* from(const audio_stream* s) {
+        return reinterpret_cast<StreamIn*>(const_cast<audio_stream*>(s));
+    }
+    static StreamIn* from(const audio_stream_in_t* s) {
+        return reinterpret_cast<StreamIn*>(const_cast<audio_stream_in_t*>(s));
+    }
+};
+
+namespace {
+
+// Functions of audio_stream, for either direction.
+
+template <typename S>
+uint32_t getSampleRate(const audio_stream* s) {
+    return S::from(s)->state.config.sample_rate;
+}
+
+template <typename S>
+audio_channel_mask_t getChannels(const audio_stream* s) {
+    return S::from(s)->state.config.channel_mask;
+}
+
+template <typename S>
+audio_format_t getFormat(const audio_stream* s) {
+    return S::from(s)->state.config.format;
+}
+
+template <typename S>
+size_t getBufferSize(const audio_stream* s) {
+    const StreamState& state = S::from(s)->state;
+    return state.bufferFrames * state.frameSize;
+}
+
+int setSampleRate(audio_stream*, uint32_t) {
+    return -ENOSYS;
+}
+
+int setFormat(audio_stream*, audio_format_t) {
+    return -ENOSYS;
+}
+
+template <typename S>
+int dump(const audio_stream* s, int fd) {
+    const StreamState& state = S::from(s)->state;
+    dprintf(fd, "Null stream: %u Hz, %zu bytes per frame, %u frames of buffer\n",
+            state.config.sample_rate, state.frameSize, state.bufferFrames);
+    return 0;
+}
+
+int setParameters(audio_stream*, const char*) {
+    return 0;
+}
+
+char* getParameters(const audio_stream*, const char*) {
+    return strdup("");
+}
+
+int addAudioEffect(const audio_stream*, effect_handle_t) {
+    return 0;
+}
+
+int removeAudioEffect(const audio_stream*, effect_handle_t) {
+    return 0;
+}
+
+template <typename S>
+void initCommon(audio_stream* common) {
+    common->get_sample_rate = getSampleRate<S>;
+    common->set_sample_rate = setSampleRate;
+    common->get_buffer_size = getBufferSize<S>;
+    common->get_channels = getChannels<S>;
+    common->get_format = getFormat<S>;
+    common->set_format = setFormat;
+    common->dump = dump<S>;
+    common->set_parameters = setParameters;
+    common->get_parameters = getParameters;
+    common->add_audio_effect = addAudioEffect;
+    common->remove_audio_effect = removeAudioEffect;
+}
+
+}  // namespace
+
+NullAudioHw::NullAudioHw(size_t bufferFrames, bool loopback)
+    : mBufferFrames(bufferFrames), mLoopback(loopback) {
+    memset(&mDevice.hw, 0, sizeof(mDevice.hw));
+    mDevice.owner = this;
+    mDevice.hw.common.tag = HARDWARE_DEVICE_TAG;
+    mDevice.hw.common.version = AUDIO_DEVICE_API_VERSION_3_0;
+    mDevice.hw.common.close = [](hw_device_t*) { return 0; };
+    mDevice.hw.init_check = [](const audio_hw_device_t*) { return 0; };
+    mDevice.hw.set_parameters = [](audio_hw_device_t*, const char*) { return 0; };
+    mDevice.hw.get_parameters = [](const audio_hw_device_t*, const char*) { return strdup(""); };
+    mDevice.hw.open_output_stream = openOutputStream;
+    mDevice.hw.close_output_stream = closeOutputStream;
+    mDevice.hw.open_input_stream = openInputStream;
+    mDevice.hw.close_input_stream = closeInputStream;
+    mDevice.hw.dump = [](const audio_hw_device_t*, int) { return 0; };
+
+    if (mLoopback) {
+        mLoopbackData.resize(kLoopbackBytes);
+    }
+}
+
+NullAudioHw::~NullAudioHw() = default;
+
+int NullAudioHw::openOutputStream(audio_hw_device_t* dev, audio_io_handle_t, audio_devices_t,
+                                  audio_output_flags_t, audio_config_t* config,
+                                  audio_stream_out_t** streamOut, const char*) {
+    const uint32_t channelCount = audio_channel_count_from_out_mask(config->channel_mask);
+    if (!isValidConfig(*config, channelCount)) {
+        setDefaultConfig(config, AUDIO_CHANNEL_OUT_STEREO);
+        return -EINVAL;
+    }
+
+    NullAudioHw* hw = reinterpret_cast<Device*>(dev)->owner;
+    StreamOut* out = new StreamOut{};
+    out->state.hw = hw;
+    out->state.config = *config;
+    out->state.frameSize = channelCount * audio_bytes_per_sample(config->format);
+    out->state.bufferFrames = hw->mBufferFrames;
+
+    initCommon<StreamOut>(&out->stream.common);
+    out->stream.common.standby = [](audio_stream* s) {
+        StreamOut::from(s)->playedUntil = 0;
+        return 0;
+    };
+    out->stream.get_latency = [](const audio_stream_out_t* s) {
+        const StreamState& state = StreamOut::from(s)->state;
+        return static_cast<uint32_t>(state.bufferFrames * 1000ull / state.config.sample_rate);
+    };
+    out->stream.set_volume = [](audio_stream_out_t*, float, float) { return 0; };
+    out->stream.write = [](audio_stream_out_t* s, const void* buffer, size_t bytes) {
+        StreamOut* out = StreamOut::from(s);
+        NullAudioHw* hw = out->state.hw;
+        const uint32_t sampleRate = out->state.config.sample_rate;
+        const nsecs_t start = now();
+        timeCall(&hw->mWriteTimes, start);
+
+        if (out->playedUntil < start) {
+            // Everything written was played, so the card has been playing silence since
+            if (out->playedUntil != 0) {
+                hw->mWriteTimes.xruns++;
+            }
+            out->playedUntil = start;
+        }
+        const size_t frames = bytes / out->state.frameSize;
+        out->playedUntil += framesToNs(frames, sampleRate);
+        out->framesWritten += frames;
+        hw->play(buffer, bytes);
+
+        // Block until whatever doesn't fit in the buffer has been played
+        sleepUntil(out->playedUntil - framesToNs(out->state.bufferFrames, sampleRate));
+
+        hw->mWriteTimes.end = now();
+        return static_cast<ssize_t>(bytes);
+    };
+    out->stream.get_render_position = [](const audio_stream_out_t* s, uint32_t* dspFrames) {
+        *dspFrames = static_cast<uint32_t>(StreamOut::from(s)->framesPlayed(now()));
+        return 0;
+    };
+    out->stream.get_presentation_position = [](const audio_stream_out_t* s, uint64_t* frames,
+                                               struct timespec* timestamp) {
+        const nsecs_t time = now();
+        *frames = StreamOut::from(s)->framesPlayed(time);
+        timestamp->tv_sec = time / 1000000000;
+        timestamp->tv_nsec = time % 1000000000;
+        return 0;
+    };
+
+    *streamOut = &out->stream;
+    return 0;
+}
+
+void NullAudioHw::closeOutputStream(audio_hw_device_t*, audio_stream_out_t* streamOut) {
+    delete StreamOut::from(streamOut);
+}
+
+int NullAudioHw::openInputStream(audio_hw_device_t* dev, audio_io_handle_t, audio_devices_t,
+                                 audio_config_t* config, audio_stream_in_t** streamIn,
+                                 audio_input_flags_t, const char*, audio_source_t) {
+    const uint32_t channelCount = audio_channel_count_from_in_mask(config->channel_mask);
+    if (!isValidConfig(*config, channelCount)) {
+        setDefaultConfig(config, AUDIO_CHANNEL_IN_STEREO);
+        return -EINVAL;
+    }
+
+    NullAudioHw* hw = reinterpret_cast<Device*>(dev)->owner;
+    StreamIn* in = new StreamIn{};
+    in->state.hw = hw;
+    in->state.config = *config;
+    in->state.frameSize = channelCount * audio_bytes_per_sample(config->format);
+    in->state.bufferFrames = hw->mBufferFrames;
+
+    initCommon<StreamIn>(&in->stream.common);
+    in->stream.common.standby = [](audio_stream* s) {
+        StreamIn::from(s)->capturedUntil = 0;
+        return 0;
+    };
+    in->stream.set_gain = [](audio_stream_in_t*, float) { return 0; };
+    in->stream.get_input_frames_lost = [](audio_stream_in_t*) { return 0u; };
+    in->stream.read = [](audio_stream_in_t* s, void* buffer, size_t bytes) {
+        StreamIn* in = StreamIn::from(s);
+        NullAudioHw* hw = in->state.hw;
+        const uint32_t sampleRate = in->state.config.sample_rate;
+        const nsecs_t start = now();
+        timeCall(&hw->mReadTimes, start);
+
+        const nsecs_t bufferDuration = framesToNs(in->state.bufferFrames, sampleRate);
+        if (in->capturedUntil + bufferDuration < start) {
+            // The buffer filled up while nobody was reading, so captured data was lost
+            if (in->capturedUntil != 0) {
+                hw->mReadTimes.xruns++;
+            }
+            in->capturedUntil = start;
+        }
+        const size_t frames = bytes / in->state.frameSize;
+        in->capturedUntil += framesToNs(frames, sampleRate);
+        in->framesRead += frames;
+
+        // Block until the data has been captured
+        sleepUntil(in->capturedUntil);
+        hw->capture(buffer, bytes);
+
+        hw->mReadTimes.end = now();
+        return static_cast<ssize_t>(bytes);
+    };
+    in->stream.get_capture_position = [](const audio_stream_in_t* s, int64_t* frames,
+                                         int64_t* time) {
+        const StreamIn* in = StreamIn::from(s);
+        if (in->capturedUntil == 0) {
+            return -ENOSYS;
+        }
+        *frames = static_cast<int64_t>(in->framesRead);
+        *time = in->capturedUntil;
+        return 0;
+    };
+
+    *streamIn = &in->stream;
+    return 0;
+}
+
+void NullAudioHw::closeInputStream(audio_hw_device_t*, audio_stream_in_t* streamIn) {
+    delete StreamIn::from(streamIn);
+}
+
+void NullAudioHw::play(const void* buffer, size_t bytes) {
+    if (!mLoopback) {
+        return;
+    }
+
+    // Keep the newest data if nobody captures it fast enough
+    const uint8_t* data = static_cast<const uint8_t*>(buffer);
+    const size_t capacity = mLoopbackData.size();
+    if (bytes > capacity) {
+        data += bytes - capacity;
+        bytes = capacity;
+    }
+
+    std::lock_guard<std::mutex> lock(mLoopbackLock);
+    const size_t dropped = std::max(mLoopbackSize + bytes, capacity) - capacity;
+    mLoopbackStart = (mLoopbackStart + dropped) % capacity;
+    mLoopbackSize -= dropped;
+
+    size_t end = (mLoopbackStart + mLoopbackSize) % capacity;
+    const size_t first = std::min(bytes, capacity - end);
+    memcpy(&mLoopbackData[end], data, first);
+    memcpy(&mLoopbackData[0], data + first, bytes - first);
+    mLoopbackSize += bytes;
+}
+
+void NullAudioHw::capture(void* buffer, size_t bytes) {
+    uint8_t* data = static_cast<uint8_t*>(buffer);
+    size_t copied = 0;
+
+    if (mLoopback) {
+        std::lock_guard<std::mutex> lock(mLoopbackLock);
+        const size_t capacity = mLoopbackData.size();
+        copied = std::min(bytes, mLoopbackSize);
+        const size_t first = std::min(copied, capacity - mLoopbackStart);
+        memcpy(data, &mLoopbackData[mLoopbackStart], first);
+        memcpy(data + first, &mLoopbackData[0], copied - first);
+        mLoopbackStart = (mLoopbackStart + copied) % capacity;
+        mLoopbackSize -= copied;
+    }
+
+    // Silence for whatever wasn't played
+    memset(data + copied, 0, bytes - copied);
+}
+
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
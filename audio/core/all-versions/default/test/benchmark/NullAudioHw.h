@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUDIO_NULLAUDIOHW_H
+#define ANDROID_HARDWARE_AUDIO_NULLAUDIOHW_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <hardware/audio.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace hardware {
+namespace audio {
+
+// A legacy audio HAL device without any hardware behind it, to measure the overhead of the
+// HIDL stream implementation wrapping it.
+//
+// Streams take and produce data in real time, like a sound card with a buffer of the given
+// number of frames: write() blocks while the buffer is full and read() while the data hasn't
+// been captured yet.  In loopback mode, inputs capture what outputs play, otherwise silence.
+// Only the stream functions used by the data path are implemented.
+class NullAudioHw {
+  public:
+    // When the last call to write() or read() on any stream started and returned.
+    struct CallTimes {
+        std::atomic<nsecs_t> start{0};
+        std::atomic<nsecs_t> end{0};
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> xruns{0};  // Underruns of outputs, overruns of inputs
+    };
+
+    NullAudioHw(size_t bufferFrames, bool loopback);
+    ~NullAudioHw();
+
+    NullAudioHw(const NullAudioHw&) = delete;
+    NullAudioHw& operator=(const NullAudioHw&) = delete;
+
+    // The device, which stays owned by this object even once it is closed.
+    audio_hw_device_t* getDevice() { return &mDevice.hw; }
+
+    const CallTimes& getWriteTimes() const { return mWriteTimes; }
+    const CallTimes& getReadTimes() const { return mReadTimes; }
+
+  private:
+    struct Device {
+        audio_hw_device_t hw;  // First, so the legacy device can be cast back to this
+        NullAudioHw* owner;
+    };
+    struct StreamOut;
+    struct StreamIn;
+
+    static int openOutputStream(audio_hw_device_t* dev, audio_io_handle_t handle,
+                                audio_devices_t devices, audio_output_flags_t flags,
+                                audio_config_t* config, audio_stream_out_t** streamOut,
+                                const char* address);
+    static void closeOutputStream(audio_hw_device_t* dev, audio_stream_out_t* streamOut);
+    static int openInputStream(audio_hw_device_t* dev, audio_io_handle_t handle,
+                               audio_devices_t devices, audio_config_t* config,
+                               audio_stream_in_t** streamIn, audio_input_flags_t flags,
+                               const char* address, audio_source_t source);
+    static void closeInputStream(audio_hw_device_t* dev, audio_stream_in_t* streamIn);
+
+    void play(const void* buffer, size_t bytes);
+    void capture(void* buffer, size_t bytes);
+
+    Device mDevice;
+    const size_t mBufferFrames;
+    const bool mLoopback;
+    CallTimes mWriteTimes;
+    CallTimes mReadTimes;
+
+    // Data played but not captured yet in loopback mode, as a ring buffer
+    std::mutex mLoopbackLock;
+    std::vector<uint8_t> mLoopbackData;
+    size_t mLoopbackStart = 0;
+    size_t mLoopbackSize = 0;
+};
+
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_AUDIO_NULLAUDIOHW_H
@@ -23,7 +23,9 @@
 #include "Effect.h"
 #include "common/all-versions/default/EffectMap.h"
 
+#include <inttypes.h>
 #include <memory.h>
+#include <stdio.h>
 
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
@@ -49,7 +51,8 @@ class ProcessThread : public Thread {
     // ProcessThread's lifespan never exceeds Effect's lifespan.
     ProcessThread(std::atomic<bool>* stop, effect_handle_t effect,
                   std::atomic<audio_buffer_t*>* inBuffer, std::atomic<audio_buffer_t*>* outBuffer,
-                  Effect::StatusMQ* statusMQ, EventFlag* efGroup)
+                  Effect::StatusMQ* statusMQ, EventFlag* efGroup, Effect::ProcessStats* stats,
+                  std::mutex* processLock, EffectChain* chain)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mEffect(effect),
@@ -57,7 +60,10 @@ class ProcessThread : public Thread {
           mInBuffer(inBuffer),
           mOutBuffer(outBuffer),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup) {}
+          mEfGroup(efGroup),
+          mStats(stats),
+          mProcessLock(processLock),
+          mChain(chain) {}
     virtual ~ProcessThread() {}
 
    private:
@@ -68,6 +74,9 @@ class ProcessThread : public Thread {
     std::atomic<audio_buffer_t*>* mOutBuffer;
     Effect::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    Effect::ProcessStats* mStats;
+    std::mutex* mProcessLock;
+    EffectChain* mChain;
 
     bool threadLoop() override;
 };
@@ -97,10 +106,20 @@ bool ProcessThread::threadLoop() {
             audio_buffer_t* outBuffer =
                 std::atomic_load_explicit(mOutBuffer, std::memory_order_relaxed);
             if (inBuffer != nullptr && outBuffer != nullptr) {
+                const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
                 if (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS)) {
-                    processResult = (*mEffect)->process(mEffect, inBuffer, outBuffer);
+                    {
+                        std::lock_guard<std::mutex> lock(*mProcessLock);
+                        processResult = (*mEffect)->process(mEffect, inBuffer, outBuffer);
+                    }
+                    mStats->record(systemTime(SYSTEM_TIME_MONOTONIC) - start, processResult);
+                    if (processResult == 0) {
+                        processResult = mChain->process(outBuffer);
+                    }
                 } else {
+                    std::lock_guard<std::mutex> lock(*mProcessLock);
                     processResult = (*mEffect)->process_reverse(mEffect, inBuffer, outBuffer);
+                    mStats->record(systemTime(SYSTEM_TIME_MONOTONIC) - start, processResult);
                 }
                 std::atomic_thread_fence(std::memory_order_release);
             } else {
@@ -138,7 +157,9 @@ const char* Effect::sContextCallToCommand = "error";
 const char* Effect::sContextCallFunction = sContextCallToCommand;
 
 Effect::Effect(effect_handle_t handle)
-    : mHandle(handle), mEfGroup(nullptr), mStopProcessThread(false) {}
+    : mHandle(handle), mEfGroup(nullptr), mStopProcessThread(false), mChain(this) {
+    EffectChainManager::getInstance().addEffect(mHandle, this);
+}
 
 Effect::~Effect() {
     ATRACE_CALL();
@@ -372,7 +393,8 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
 
     // Create and launch the thread.
     mProcessThread = new ProcessThread(&mStopProcessThread, mHandle, &mHalInBufferPtr,
-                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup);
+                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup,
+                                       &mProcessStats, &mProcessLock, &mChain);
     status = mProcessThread->run("effect", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start effect processing thread: %s", strerror(-status));
@@ -406,6 +428,62 @@ Return<Result> Effect::setProcessBuffers(const AudioBuffer& inBuffer,
     return Result::OK;
 }
 
+int Effect::processInChain(audio_buffer_t* buffer) {
+    // The chain runs in place on the output buffer of its first effect, so an effect processing
+    // any other buffer is not part of it yet, or anymore.
+    if (mHalInBufferPtr.load(std::memory_order_acquire) != buffer ||
+        mHalOutBufferPtr.load(std::memory_order_acquire) != buffer) {
+        return -EINVAL;
+    }
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    int result;
+    {
+        std::lock_guard<std::mutex> lock(mProcessLock);
+        result = (*mHandle)->process(mHandle, buffer, buffer);
+    }
+    mProcessStats.record(systemTime(SYSTEM_TIME_MONOTONIC) - start, result);
+    return result;
+}
+
+status_t Effect::setChain(const hidl_vec<uint8_t>& data) {
+    if (mStopProcessThread.load(std::memory_order_relaxed)) {
+        ALOGE("Effect %p is closed, it can't start a chain", mHandle);
+        return -ENODEV;
+    }
+    if (data.size() % sizeof(uint64_t) != 0) {
+        ALOGE("Invalid effect chain data size %zu", data.size());
+        return -EINVAL;
+    }
+    std::vector<uint64_t> effectIds(data.size() / sizeof(uint64_t));
+    if (!effectIds.empty()) {
+        memcpy(effectIds.data(), data.data(), data.size());
+    }
+    return EffectChainManager::getInstance().setChain(&mChain, effectIds);
+}
+
+void Effect::ProcessStats::record(nsecs_t ns, int result) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    if (result != 0 && result != -ENODATA) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    totalNs.fetch_add(ns, std::memory_order_relaxed);
+    // Both the processing thread of this effect and the one of the first effect of its chain can
+    // record at the same time, only their process calls are serialized.
+    uint64_t max = maxNs.load(std::memory_order_relaxed);
+    while (static_cast<uint64_t>(ns) > max &&
+           !maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void Effect::ProcessStats::dump(int fd) const {
+    const uint64_t count = calls.load();
+    dprintf(fd, "Process calls: %" PRIu64 ", errors: %" PRIu64 "\n", count, errors.load());
+    if (count > 0) {
+        dprintf(fd, "Process time, average %" PRIu64 " us, max %" PRIu64 " us\n",
+                totalNs.load() / count / 1000, maxNs.load() / 1000);
+    }
+}
+
 Result Effect::sendCommand(int commandCode, const char* commandName) {
     return sendCommand(commandCode, commandName, 0, NULL);
 }
@@ -625,6 +703,10 @@ Return<void> Effect::getDescriptor(getDescriptor_cb _hidl_cb) {
 
 Return<void> Effect::command(uint32_t commandId, const hidl_vec<uint8_t>& data,
                              uint32_t resultMaxSize, command_cb _hidl_cb) {
+    if (commandId == EffectChain::kSetChainCommand) {
+        _hidl_cb(setChain(data), hidl_vec<uint8_t>());
+        return Void();
+    }
     uint32_t halDataSize;
     std::unique_ptr<uint8_t[]> halData = hidlVecToHal(data, &halDataSize);
     uint32_t halResultSize = resultMaxSize;
@@ -704,6 +786,8 @@ Return<Result> Effect::close() {
     if (mEfGroup) {
         mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_QUIT));
     }
+    // Takes the effect out of any chain before its handle can be released.
+    EffectChainManager::getInstance().removeEffect(this);
 #if MAJOR_VERSION <= 5
     return Result::OK;
 #elif MAJOR_VERSION >= 6
@@ -718,6 +802,10 @@ Return<Result> Effect::close() {
 
 Return<void> Effect::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
     if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        mProcessStats.dump(fd->data[0]);
+        if (mChain.size() > 0) {
+            dprintf(fd->data[0], "Chained effects: %zu\n", mChain.size());
+        }
         uint32_t cmdData = fd->data[0];
         (void)sendCommand(EFFECT_CMD_DUMP, "DUMP", sizeof(cmdData), &cmdData);
     }
@@ -20,9 +20,11 @@
 #include PATH(android/hardware/audio/effect/FILE_VERSION/IEffect.h)
 
 #include "AudioBufferManager.h"
+#include "EffectChain.h"
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <fmq/EventFlag.h>
@@ -30,6 +32,7 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <utils/Thread.h>
+#include <utils/Timers.h>
 
 #include <hardware/audio_effect.h>
 
@@ -56,6 +59,18 @@ struct Effect : public IEffect {
     using GetParameterSuccessCallback =
         std::function<void(uint32_t valueSize, const void* valueData)>;
 
+    // Timing of the calls to the process functions of the effect library, made by the
+    // processing thread of this effect or the one of the first effect of its chain.
+    struct ProcessStats {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};  // Other than -ENODATA, which is returned when disabled
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> maxNs{0};
+
+        void record(nsecs_t ns, int result);
+        void dump(int fd) const;
+    };
+
     explicit Effect(effect_handle_t handle);
 
     // Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffect follow.
@@ -87,6 +102,8 @@ struct Effect : public IEffect {
     Return<void> prepareForProcessing(prepareForProcessing_cb _hidl_cb) override;
     Return<Result> setProcessBuffers(const AudioBuffer& inBuffer,
                                      const AudioBuffer& outBuffer) override;
+    // EffectChain::kSetChainCommand is reserved and handled here, see EffectChain.h. Other
+    // commands are passed to the effect library.
     Return<void> command(uint32_t commandId, const hidl_vec<uint8_t>& data, uint32_t resultMaxSize,
                          command_cb _hidl_cb) override;
     Return<Result> setParameter(const hidl_vec<uint8_t>& parameter,
@@ -157,6 +174,7 @@ struct Effect : public IEffect {
                             const void* valueData);
 
    private:
+    friend class EffectChain;         // to process chained effects
     friend struct VirtualizerEffect;  // for getParameterImpl
     friend struct VisualizerEffect;   // to allow executing commands
 
@@ -179,6 +197,13 @@ struct Effect : public IEffect {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopProcessThread;
     sp<Thread> mProcessThread;
+    ProcessStats mProcessStats;
+    // Serializes the calls to the process functions of the library made by the processing
+    // thread of this effect and the one of the first effect of its chain, as libraries aren't
+    // reentrant. Only contended while a client still makes processing requests to a chained
+    // effect.
+    std::mutex mProcessLock;
+    EffectChain mChain;  // The effects processed after this one
 
     virtual ~Effect();
 
@@ -201,6 +226,9 @@ struct Effect : public IEffect {
     static std::vector<uint8_t> parameterToHal(uint32_t paramSize, const void* paramData,
                                                uint32_t valueSize, const void** valueData);
 
+    int processInChain(audio_buffer_t* buffer);
+    status_t setChain(const hidl_vec<uint8_t>& data);
+
     Result analyzeCommandStatus(const char* commandName, const char* context, status_t status);
     Result analyzeStatus(const char* funcName, const char* subFuncName,
                          const char* contextDescription, status_t status);
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectHAL"
+
+#include "EffectChain.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <android/log.h>
+
+#include "Effect.h"
+#include "common/all-versions/default/EffectMap.h"
+
+namespace android {
+
+ANDROID_SINGLETON_STATIC_INSTANCE(EffectChainManager);
+
+void EffectChainManager::addEffect(effect_handle_t handle, Effect* effect) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mEffects.add(handle, effect);
+}
+
+void EffectChainManager::setSession(effect_handle_t handle, int32_t session) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSessions.add(handle, session);
+}
+
+void EffectChainManager::removeEffect(Effect* effect) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (size_t i = 0; i < mEffects.size(); ++i) {
+        if (mEffects[i] == effect) {
+            mSessions.removeItem(mEffects.keyAt(i));
+            mEffects.removeItemsAt(i);
+            break;
+        }
+    }
+    for (EffectChain* chain : mChains) {
+        // Waits for the chain to finish processing the effect, if it is.
+        std::lock_guard<std::mutex> chainLock(chain->mLock);
+        auto& effects = chain->mEffects;
+        if (chain->mLead == effect) {
+            effects.clear();
+        } else {
+            effects.erase(std::remove(effects.begin(), effects.end(), effect), effects.end());
+        }
+        chain->mSize.store(effects.size(), std::memory_order_release);
+    }
+}
+
+status_t EffectChainManager::setChain(EffectChain* chain, const std::vector<uint64_t>& effectIds) {
+    std::lock_guard<std::mutex> lock(mLock);
+    ssize_t leadSessionIdx = -1;
+    for (size_t i = 0; i < mEffects.size(); ++i) {
+        if (mEffects[i] == chain->mLead) {
+            leadSessionIdx = mSessions.indexOfKey(mEffects.keyAt(i));
+            break;
+        }
+    }
+    if (leadSessionIdx < 0 && !effectIds.empty()) {
+        ALOGE("The session of the first effect of the chain is unknown");
+        return -EINVAL;
+    }
+    std::vector<Effect*> effects;
+    for (uint64_t id : effectIds) {
+        effect_handle_t handle = EffectMap::getInstance().get(id);
+        ssize_t idx = handle != NULL ? mEffects.indexOfKey(handle) : -1;
+        if (idx < 0) {
+            ALOGE("Effect id %" PRIu64 " is not an open effect", id);
+            return -EINVAL;
+        }
+        ssize_t sessionIdx = mSessions.indexOfKey(handle);
+        if (sessionIdx < 0 || mSessions[sessionIdx] != mSessions[leadSessionIdx]) {
+            ALOGE("Effect id %" PRIu64 " is not of the session of the first effect", id);
+            return -EINVAL;
+        }
+        Effect* effect = mEffects[idx];
+        if (effect == chain->mLead ||
+            std::find(effects.begin(), effects.end(), effect) != effects.end()) {
+            ALOGE("Effect id %" PRIu64 " is already in this chain", id);
+            return -EINVAL;
+        }
+        for (EffectChain* other : mChains) {
+            if (other == chain) continue;
+            std::lock_guard<std::mutex> chainLock(other->mLock);
+            if (std::find(other->mEffects.begin(), other->mEffects.end(), effect) !=
+                other->mEffects.end()) {
+                ALOGE("Effect id %" PRIu64 " is already in another chain", id);
+                return -EINVAL;
+            }
+        }
+        effects.push_back(effect);
+    }
+    std::lock_guard<std::mutex> chainLock(chain->mLock);
+    chain->mEffects = std::move(effects);
+    chain->mSize.store(chain->mEffects.size(), std::memory_order_release);
+    return OK;
+}
+
+void EffectChainManager::addChain(EffectChain* chain) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mChains.push_back(chain);
+}
+
+void EffectChainManager::removeChain(EffectChain* chain) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mChains.erase(std::remove(mChains.begin(), mChains.end(), chain), mChains.end());
+}
+
+namespace hardware {
+namespace audio {
+namespace effect {
+namespace CPP_VERSION {
+namespace implementation {
+
+EffectChain::EffectChain(Effect* lead) : mLead(lead) {
+    EffectChainManager::getInstance().addChain(this);
+}
+
+EffectChain::~EffectChain() {
+    EffectChainManager::getInstance().removeChain(this);
+}
+
+int EffectChain::process(audio_buffer_t* buffer) {
+    if (mSize.load(std::memory_order_acquire) == 0) {
+        return 0;
+    }
+    int result = 0;
+    std::lock_guard<std::mutex> lock(mLock);
+    for (Effect* effect : mEffects) {
+        int effectResult = effect->processInChain(buffer);
+        if (effectResult != 0 && effectResult != -ENODATA && result == 0) {
+            result = effectResult;
+        }
+    }
+    return result;
+}
+
+size_t EffectChain::size() const {
+    return mSize.load(std::memory_order_relaxed);
+}
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace effect
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
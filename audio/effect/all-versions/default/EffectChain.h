@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H_
+#define ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <hardware/audio_effect.h>
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Singleton.h>
+
+namespace android {
+
+class EffectChainManager;
+
+namespace hardware {
+namespace audio {
+namespace effect {
+namespace CPP_VERSION {
+namespace implementation {
+
+struct Effect;
+
+// Effects processed by the processing thread of another effect right after it, one after
+// another and in place on its output buffer. A client that runs several effects of a session
+// over the same buffer then makes a single processing request per buffer, instead of waking up
+// the processing thread of each effect in turn.
+//
+// The client sets up the chain with the vendor specific command below on the first effect. Its
+// data is the ids, as returned by IEffectsFactory::createEffect, of the effects to process after
+// it, in order, as uint64_t. They must have been created for the same session as the first
+// effect. Empty data clears the chain. An effect of the chain is only
+// processed while both of its process buffers are the output buffer of the first effect.
+//
+// Reserved command id: IEffect::command() calls with kSetChainCommand are handled by this
+// implementation for every effect and never reach the effect library, so libraries loaded by it
+// must not define a proprietary command with that id. A vendor whose library does has to change
+// kSetChainCommand to another unused id, along with the clients that send it.
+class EffectChain {
+   public:
+    // At the end of the vendor specific range, away from the commands of effect libraries.
+    // Reserved, see above.
+    static constexpr uint32_t kSetChainCommand = 0xffffff00;
+
+    explicit EffectChain(Effect* lead);
+    ~EffectChain();
+
+    EffectChain(const EffectChain&) = delete;
+    void operator=(const EffectChain&) = delete;
+
+    // Processes the effects of the chain on 'buffer', after the lead effect has processed it
+    // successfully. Called on the processing thread of the lead effect.
+    // @return 0, or the first error of an effect other than -ENODATA, which only means that the
+    //         effect is disabled.
+    int process(audio_buffer_t* buffer);
+
+    // @return the number of effects in the chain
+    size_t size() const;
+
+   private:
+    friend class ::android::EffectChainManager;
+
+    Effect* const mLead;
+    std::mutex mLock;  // Only contended while the chain or one of its effects changes
+    std::vector<Effect*> mEffects;
+    std::atomic<size_t> mSize{0};  // Lets the processing thread skip the lock when empty
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace effect
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
+
+using ::android::hardware::audio::effect::CPP_VERSION::implementation::Effect;
+using ::android::hardware::audio::effect::CPP_VERSION::implementation::EffectChain;
+
+namespace android {
+
+// Tracks the open effects and the chains, so that an effect is taken out of any chain before
+// its handle is released.
+// This class needs to be in 'android' ns because Singleton macros require that.
+class EffectChainManager : public Singleton<EffectChainManager> {
+   public:
+    void addEffect(effect_handle_t handle, Effect* effect);
+    // Records the audio session the effect was created for, only effects of the same session
+    // can be chained.
+    void setSession(effect_handle_t handle, int32_t session);
+    // Returns once no chain is processing the effect anymore.
+    void removeEffect(Effect* effect);
+
+    // @return -EINVAL if an id is not the one of another open effect of the same session, is
+    //         repeated, or the effect is in another chain already, leaving the chain unchanged.
+    status_t setChain(EffectChain* chain, const std::vector<uint64_t>& effectIds);
+
+   private:
+    friend class hardware::audio::effect::CPP_VERSION::implementation::EffectChain;
+
+    // Called by EffectChain.
+    void addChain(EffectChain* chain);
+    void removeChain(EffectChain* chain);
+
+    std::mutex mLock;  // Taken before the lock of any chain
+    KeyedVector<effect_handle_t, Effect*> mEffects;
+    KeyedVector<effect_handle_t, int32_t> mSessions;
+    std::vector<EffectChain*> mChains;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H_
@@ -187,6 +187,7 @@ Return<void> EffectsFactory::createEffectImpl(const Uuid& uuid, int32_t session,
         status = (*handle)->get_descriptor(handle, &halDescriptor);
         if (status == OK) {
             effect = dispatchEffectInstanceCreation(halDescriptor, handle);
+            EffectChainManager::getInstance().setSession(handle, session);
             effectId = EffectMap::getInstance().add(handle);
         } else {
             ALOGE("Error querying effect descriptor for %s: %s", uuidToString(halUuid).c_str(),
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CanBcmSocket.h"
+
+#include <android-base/logging.h>
+#include <libnetdevice/can.h>
+#include <linux/can/bcm.h>
+#include <sys/uio.h>
+
+#include <cstring>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+std::unique_ptr<CanBcmSocket> CanBcmSocket::open(const std::string& ifname) {
+    auto sock = netdevice::can::bcmSocket(ifname);
+    if (!sock.ok()) {
+        LOG(ERROR) << "Can't open CAN broadcast manager socket on " << ifname;
+        return nullptr;
+    }
+
+    // Can't use std::make_unique due to private CanBcmSocket constructor.
+    return std::unique_ptr<CanBcmSocket>(new CanBcmSocket(std::move(sock)));
+}
+
+CanBcmSocket::CanBcmSocket(base::unique_fd socket) : mSocket(std::move(socket)) {}
+
+bool CanBcmSocket::startCyclic(const struct canfd_frame& frame, std::chrono::microseconds period) {
+    if (frame.len > CAN_MAX_DLEN) {
+        LOG(ERROR) << "Cyclic frames can't carry more than " << CAN_MAX_DLEN << " bytes";
+        return false;
+    }
+
+    struct bcm_msg_head head = {};
+    head.opcode = TX_SETUP;
+    head.flags = SETTIMER | STARTTIMER;
+    head.count = 0;  // just the period of ival2, from the start
+    head.ival2.tv_sec = period.count() / 1000000;
+    head.ival2.tv_usec = period.count() % 1000000;
+    head.can_id = frame.can_id;
+    head.nframes = 1;
+
+    struct can_frame canFrame = {};
+    canFrame.can_id = frame.can_id;
+    canFrame.can_dlc = frame.len;
+    memcpy(canFrame.data, frame.data, frame.len);
+
+    // Frames follow the header in the same message.
+    const struct iovec iov[] = {{&head, sizeof(head)}, {&canFrame, sizeof(canFrame)}};
+    const auto size = sizeof(head) + sizeof(canFrame);
+    if (writev(mSocket.get(), iov, std::size(iov)) != static_cast<ssize_t>(size)) {
+        PLOG(ERROR) << "Can't start sending frame " << std::hex << frame.can_id << " periodically";
+        return false;
+    }
+    return true;
+}
+
+bool CanBcmSocket::stopCyclic(canid_t canId) {
+    struct bcm_msg_head head = {};
+    head.opcode = TX_DELETE;
+    head.can_id = canId;
+
+    if (write(mSocket.get(), &head, sizeof(head)) != static_cast<ssize_t>(sizeof(head))) {
+        PLOG(ERROR) << "Can't stop sending frame " << std::hex << canId << " periodically";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
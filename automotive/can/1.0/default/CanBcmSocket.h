@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <linux/can.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Wrapper around SocketCAN broadcast manager socket, for frames sent periodically by the kernel.
+ *
+ * All cyclic transmissions are stopped when the socket is closed.
+ */
+struct CanBcmSocket {
+    /**
+     * Open and connect SocketCAN broadcast manager socket.
+     *
+     * \param ifname SocketCAN network interface name (such as can0)
+     * \return Socket instance, or nullptr if it wasn't possible to open one
+     */
+    static std::unique_ptr<CanBcmSocket> open(const std::string& ifname);
+
+    /**
+     * Start sending a frame periodically.
+     *
+     * If a frame with the same id is already being sent, its payload and period are replaced.
+     *
+     * \param frame Frame to send, with up to CAN_MAX_DLEN bytes of payload
+     * \param period Time between two frames
+     * \return true in case of success, false otherwise
+     */
+    bool startCyclic(const struct canfd_frame& frame, std::chrono::microseconds period);
+
+    /**
+     * Stop sending a frame.
+     *
+     * \param canId Id of the frame, including CAN_EFF_FLAG and CAN_RTR_FLAG, as it was started
+     * \return true in case of success, false otherwise (e.g. it wasn't being sent)
+     */
+    bool stopCyclic(canid_t canId);
+
+  private:
+    explicit CanBcmSocket(base::unique_fd socket);
+
+    const base::unique_fd mSocket;
+
+    DISALLOW_COPY_AND_ASSIGN(CanBcmSocket);
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
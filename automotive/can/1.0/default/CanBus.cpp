@@ -19,17 +19,43 @@
 #include "CloseHandle.h"
 
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <libnetdevice/can.h>
 #include <libnetdevice/libnetdevice.h>
 #include <linux/can.h>
 #include <linux/can/error.h>
 #include <linux/can/raw.h>
 
+#include <cinttypes>
+#include <optional>
+
 namespace android::hardware::automotive::can::V1_0::implementation {
 
+using namespace std::chrono_literals;
+
 /** Whether to log sent/received packets. */
 static constexpr bool kSuperVerbose = false;
 
+/** Maximum number of messages in a single --send-burst debug command. */
+static constexpr size_t kMaxBurstSize = 100000;
+
+/* How long to wait between attempts to send a burst of messages while the transmit queue is full,
+ * and for how long at most since the last progress. */
+static constexpr auto kSendRetryDelay = 500us;
+static constexpr auto kSendTimeout = 100ms;
+
+static Result toCanFrame(const CanMessage& message, struct canfd_frame* frame) {
+    if (message.payload.size() > CAN_MAX_DLEN) return Result::PAYLOAD_TOO_LONG;
+
+    *frame = {};
+    frame->can_id = message.id;
+    if (message.isExtendedId) frame->can_id |= CAN_EFF_FLAG;
+    if (message.remoteTransmissionRequest) frame->can_id |= CAN_RTR_FLAG;
+    frame->len = message.payload.size();
+    memcpy(frame->data, message.payload.data(), message.payload.size());
+    return Result::OK;
+}
+
 Return<Result> CanBus::send(const CanMessage& message) {
     std::lock_guard<std::mutex> lck(mIsUpGuard);
     if (!mIsUp) return Result::INTERFACE_DOWN;
@@ -38,20 +64,85 @@ Return<Result> CanBus::send(const CanMessage& message) {
         LOG(VERBOSE) << "Sending " << toString(message);
     }
 
-    if (message.payload.size() > CAN_MAX_DLEN) return Result::PAYLOAD_TOO_LONG;
-
-    struct canfd_frame frame = {};
-    frame.can_id = message.id;
-    if (message.isExtendedId) frame.can_id |= CAN_EFF_FLAG;
-    if (message.remoteTransmissionRequest) frame.can_id |= CAN_RTR_FLAG;
-    frame.len = message.payload.size();
-    memcpy(frame.data, message.payload.data(), message.payload.size());
+    struct canfd_frame frame;
+    const auto result = toCanFrame(message, &frame);
+    if (result != Result::OK) return result;
 
     if (!mSocket->send(frame)) return Result::TRANSMISSION_FAILURE;
 
     return Result::OK;
 }
 
+Result CanBus::sendBurst(const std::vector<CanMessage>& messages, size_t* sent) {
+    *sent = 0;
+    std::vector<struct canfd_frame> frames(messages.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        const auto result = toCanFrame(messages[i], &frames[i]);
+        if (result != Result::OK) return result;
+    }
+
+    /* The interface is only locked while handing frames to the socket, not while waiting for the
+     * transmit queue to drain, so that sending other messages or bringing the bus down doesn't
+     * have to wait for the whole burst. */
+    auto waitingSince = std::chrono::steady_clock::now();
+    while (*sent < frames.size()) {
+        bool queueFull;
+        {
+            std::lock_guard<std::mutex> lck(mIsUpGuard);
+            if (!mIsUp) return Result::INTERFACE_DOWN;
+            const auto res = mSocket->send(frames.data() + *sent, frames.size() - *sent, &queueFull);
+            if (res > 0) {
+                *sent += res;
+                waitingSince = std::chrono::steady_clock::now();
+            }
+        }
+        if (*sent == frames.size()) break;
+
+        if (!queueFull || std::chrono::steady_clock::now() - waitingSince >= kSendTimeout) {
+            return Result::TRANSMISSION_FAILURE;
+        }
+        std::this_thread::sleep_for(kSendRetryDelay);
+    }
+
+    return Result::OK;
+}
+
+CanBcmSocket* CanBus::getBcmSocket() {
+    if (!mBcmSocket) mBcmSocket = CanBcmSocket::open(mIfname);
+    return mBcmSocket.get();
+}
+
+Result CanBus::startCyclicSend(const CanMessage& message, std::chrono::microseconds period) {
+    std::lock_guard<std::mutex> lck(mIsUpGuard);
+    if (!mIsUp) return Result::INTERFACE_DOWN;
+    if (period.count() <= 0) return Result::INVALID_ARGUMENTS;
+
+    struct canfd_frame frame;
+    const auto result = toCanFrame(message, &frame);
+    if (result != Result::OK) return result;
+
+    auto bcmSocket = getBcmSocket();
+    if (bcmSocket == nullptr) return Result::UNKNOWN_ERROR;
+    if (!bcmSocket->startCyclic(frame, period)) return Result::TRANSMISSION_FAILURE;
+
+    return Result::OK;
+}
+
+Result CanBus::stopCyclicSend(const CanMessage& message) {
+    std::lock_guard<std::mutex> lck(mIsUpGuard);
+    if (!mIsUp) return Result::INTERFACE_DOWN;
+
+    // Only the id and flags identify the message, the payload doesn't matter here.
+    canid_t canId = message.id;
+    if (message.isExtendedId) canId |= CAN_EFF_FLAG;
+    if (message.remoteTransmissionRequest) canId |= CAN_RTR_FLAG;
+
+    // Nothing was started if there is no socket yet.
+    if (!mBcmSocket || !mBcmSocket->stopCyclic(canId)) return Result::INVALID_ARGUMENTS;
+
+    return Result::OK;
+}
+
 Return<void> CanBus::listen(const hidl_vec<CanMessageFilter>& filter,
                             const sp<ICanMessageListener>& listenerCb, listen_cb _hidl_cb) {
     std::lock_guard<std::mutex> lck(mIsUpGuard);
@@ -67,17 +158,43 @@ Return<void> CanBus::listen(const hidl_vec<CanMessageFilter>& filter,
 
     std::lock_guard<std::mutex> lckListeners(mMsgListenersGuard);
 
-    sp<CloseHandle> closeHandle = new CloseHandle([this, listenerCb]() {
-        std::lock_guard<std::mutex> lck(mMsgListenersGuard);
-        std::erase_if(mMsgListeners, [&](const auto& e) { return e.callback == listenerCb; });
-    });
-    mMsgListeners.emplace_back(CanMessageListener{listenerCb, filter, closeHandle});
-    auto& listener = mMsgListeners.back();
-
     // fix message IDs to have all zeros on bits not covered by mask
-    std::for_each(listener.filter.begin(), listener.filter.end(),
+    auto maskedFilter = filter;
+    std::for_each(maskedFilter.begin(), maskedFilter.end(),
                   [](auto& rule) { rule.id &= rule.mask; });
 
+    auto filters = getListenerFilters();
+    filters.push_back(maskedFilter);
+    CanFilterIndex filterIndex(filters);
+    if (!mSocket->setFilters(filterIndex.getKernelFilters())) {
+        _hidl_cb(Result::UNKNOWN_ERROR, nullptr);
+        return {};
+    }
+
+    sp<CloseHandle> closeHandle = new CloseHandle([this, listenerCb]() {
+        /* Delivery queues are destroyed after releasing the lock, since it has to wait for the
+         * message being delivered, if any. */
+        std::vector<std::shared_ptr<ListenerQueue>> closedQueues;
+        {
+            std::lock_guard<std::mutex> lck(mMsgListenersGuard);
+            std::erase_if(mMsgListeners, [&](const auto& e) {
+                if (e.callback != listenerCb) return false;
+                closedQueues.push_back(e.queue);
+                return true;
+            });
+            mFilterIndex = CanFilterIndex(getListenerFilters());
+        }
+        /* The reader thread may still hold a queue for the burst it's pushing. Stopping releases
+         * its pushes, then waiting for the burst to end leaves the last references here, so that
+         * the queues are destroyed on this thread rather than the reader joining their delivery
+         * threads. */
+        for (const auto& queue : closedQueues) queue->stop();
+        std::lock_guard<std::mutex> readLck(mReadQueuesGuard);
+    });
+    auto queue = std::make_shared<ListenerQueue>(listenerCb, mQueueConfig);
+    mMsgListeners.emplace_back(CanMessageListener{listenerCb, maskedFilter, closeHandle, queue});
+    mFilterIndex = std::move(filterIndex);
+
     _hidl_cb(Result::OK, closeHandle);
     return {};
 }
@@ -134,7 +251,7 @@ ICanController::Result CanBus::up() {
     mDownAfterUse = !*isUp;
 
     using namespace std::placeholders;
-    CanSocket::ReadCallback rdcb = std::bind(&CanBus::onRead, this, _1, _2);
+    CanSocket::ReadCallback rdcb = std::bind(&CanBus::onRead, this, _1);
     CanSocket::ErrorCallback errcb = std::bind(&CanBus::onError, this, _1);
     mSocket = CanSocket::open(mIfname, rdcb, errcb);
     if (!mSocket) {
@@ -142,10 +259,23 @@ ICanController::Result CanBus::up() {
         return ICanController::Result::UNKNOWN_ERROR;
     }
 
+    {
+        // There are no listeners yet, so no frames have to be received until the first one.
+        std::lock_guard<std::mutex> lckListeners(mMsgListenersGuard);
+        mSocket->setFilters(mFilterIndex.getKernelFilters());
+    }
+
     mIsUp = true;
     return ICanController::Result::OK;
 }
 
+std::vector<hidl_vec<CanMessageFilter>> CanBus::getListenerFilters() {
+    std::vector<hidl_vec<CanMessageFilter>> filters;
+    std::transform(mMsgListeners.begin(), mMsgListeners.end(), std::back_inserter(filters),
+                   [](const auto& e) { return e.filter; });
+    return filters;
+}
+
 void CanBus::clearMsgListeners() {
     std::vector<wp<ICloseHandle>> listenersToClose;
     {
@@ -192,6 +322,177 @@ Return<sp<ICloseHandle>> CanBus::listenForErrors(const sp<ICanErrorListener>& li
     });
 }
 
+Return<void> CanBus::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        LOG(ERROR) << "Invalid parameters passed to debug()";
+        return {};
+    }
+    const int out = fd->data[0];
+
+    if (options.size() == 0) {
+        cmdDumpListeners(out);
+        return {};
+    }
+
+    const std::string option = options[0];
+    if (option == "--help") {
+        cmdHelp(out);
+    } else if (option == "--queue") {
+        cmdSetQueue(out, options);
+    } else if (option == "--send-burst") {
+        dprintf(out, "%s", libcanhaltools::formatSendStatus(cmdSendBurst(out, options)).c_str());
+    } else if (option == "--send-cyclic") {
+        dprintf(out, "%s", libcanhaltools::formatSendStatus(cmdSendCyclic(out, options)).c_str());
+    } else if (option == "--stop-cyclic") {
+        dprintf(out, "%s", libcanhaltools::formatSendStatus(cmdStopCyclic(out, options)).c_str());
+    } else {
+        dprintf(out, "Invalid option: %s\n", option.c_str());
+        cmdHelp(out);
+    }
+    return {};
+}
+
+void CanBus::cmdHelp(int fd) const {
+    dprintf(fd, "Usage:\n\n");
+    dprintf(fd, "[no args]: dumps message listeners with their delivery statistics\n");
+    dprintf(fd, "--help: shows this help\n");
+    dprintf(fd,
+            "--queue <capacity> <drop-oldest|drop-newest|block>: sets the size of delivery queues "
+            "of all listeners and what happens to messages that don't fit\n");
+    dprintf(fd, "--send-burst <can id>#<data> <count>: sends a message count times in a burst\n");
+    dprintf(fd,
+            "--send-cyclic <can id>#<data> <period ms>: has the kernel send a message "
+            "periodically\n");
+    dprintf(fd, "--stop-cyclic <can id>[#R]: stops sending a message periodically\n");
+    dprintf(fd,
+            "  where can id is hex, such as 1a5 or 1fab5982, and data is hex, such as 010203, or R "
+            "for a remote frame\n");
+}
+
+void CanBus::cmdDumpListeners(int fd) {
+    ListenerQueue::Config config;
+    std::vector<std::pair<size_t, ListenerQueue::Stats>> listeners;
+    {
+        // Don't hold up message delivery while writing the output.
+        std::lock_guard<std::mutex> lck(mMsgListenersGuard);
+        config = mQueueConfig;
+        for (const auto& listener : mMsgListeners) {
+            listeners.emplace_back(listener.filter.size(), listener.queue->getStats());
+        }
+    }
+
+    using std::chrono::microseconds;
+    const auto us = [](std::chrono::nanoseconds time) -> int64_t {
+        return std::chrono::duration_cast<microseconds>(time).count();
+    };
+
+    dprintf(fd, "Delivery queue capacity: %zu, overflow policy: %s\n", config.capacity,
+            toString(config.overflowPolicy).c_str());
+    dprintf(fd, "Message listeners: %zu\n", listeners.size());
+    for (size_t i = 0; i < listeners.size(); i++) {
+        const auto& [rules, stats] = listeners[i];
+        const auto avgLatency =
+                stats.delivered > 0 ? stats.totalLatency / static_cast<int64_t>(stats.delivered)
+                                    : std::chrono::nanoseconds(0);
+        dprintf(fd,
+                "  #%zu: filter rules: %zu, queued: %zu (max %zu), delivered: %" PRIu64
+                ", dropped: %" PRIu64 ", failed: %" PRIu64 ", latency avg/max: %" PRId64
+                "/%" PRId64 "us, max callback time: %" PRId64 "us\n",
+                i, rules, stats.depth, stats.maxDepth, stats.delivered, stats.dropped,
+                stats.failed, us(avgLatency), us(stats.maxLatency), us(stats.maxCallbackTime));
+    }
+}
+
+void CanBus::cmdSetQueue(int fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() != 3) {
+        dprintf(fd, "Invalid number of arguments to --queue: %zu\n", options.size() - 1);
+        return;
+    }
+
+    ListenerQueue::Config config;
+    if (!base::ParseUint(options[1].c_str(), &config.capacity) || config.capacity == 0) {
+        dprintf(fd, "Invalid queue capacity: %s\n", options[1].c_str());
+        return;
+    }
+    const auto policy = ListenerQueue::parseOverflowPolicy(options[2]);
+    if (!policy) {
+        dprintf(fd, "Invalid overflow policy: %s\n", options[2].c_str());
+        return;
+    }
+    config.overflowPolicy = *policy;
+
+    {
+        std::lock_guard<std::mutex> lck(mMsgListenersGuard);
+        mQueueConfig = config;
+        for (auto& listener : mMsgListeners) listener.queue->setConfig(config);
+    }
+    dprintf(fd, "Delivery queue capacity set to %zu, overflow policy to %s\n", config.capacity,
+            toString(config.overflowPolicy).c_str());
+}
+
+libcanhaltools::SendStatus CanBus::cmdSendBurst(int fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() != 3) {
+        dprintf(fd, "Invalid number of arguments to --send-burst: %zu\n", options.size() - 1);
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    const auto message = libcanhaltools::parseCanMessage(options[1]);
+    if (!message) {
+        dprintf(fd, "Invalid message: %s\n", options[1].c_str());
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+    size_t count;
+    if (!base::ParseUint(options[2].c_str(), &count, kMaxBurstSize) || count == 0) {
+        dprintf(fd, "Invalid message count: %s\n", options[2].c_str());
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    size_t sent;
+    const auto result = sendBurst(std::vector<CanMessage>(count, *message), &sent);
+    dprintf(fd, "Sent %zu of %zu messages: %s\n", sent, count, toString(result).c_str());
+    return {result, sent};
+}
+
+libcanhaltools::SendStatus CanBus::cmdSendCyclic(int fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() != 3) {
+        dprintf(fd, "Invalid number of arguments to --send-cyclic: %zu\n", options.size() - 1);
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    const auto message = libcanhaltools::parseCanMessage(options[1]);
+    if (!message) {
+        dprintf(fd, "Invalid message: %s\n", options[1].c_str());
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+    uint32_t periodMs;
+    if (!base::ParseUint(options[2].c_str(), &periodMs) || periodMs == 0) {
+        dprintf(fd, "Invalid period: %s\n", options[2].c_str());
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    const auto result = startCyclicSend(*message, std::chrono::milliseconds(periodMs));
+    dprintf(fd, "Start sending %s every %ums: %s\n", options[1].c_str(), periodMs,
+            toString(result).c_str());
+    return {result, 0};
+}
+
+libcanhaltools::SendStatus CanBus::cmdStopCyclic(int fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() != 2) {
+        dprintf(fd, "Invalid number of arguments to --stop-cyclic: %zu\n", options.size() - 1);
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    const auto message = libcanhaltools::parseCanMessage(options[1]);
+    if (!message) {
+        dprintf(fd, "Invalid message: %s\n", options[1].c_str());
+        return {Result::INVALID_ARGUMENTS, 0};
+    }
+
+    const auto result = stopCyclicSend(*message);
+    dprintf(fd, "Stop sending %s: %s\n", options[1].c_str(), toString(result).c_str());
+    return {result, 0};
+}
+
 bool CanBus::down() {
     std::lock_guard<std::mutex> lck(mIsUpGuard);
 
@@ -203,6 +504,7 @@ bool CanBus::down() {
 
     clearMsgListeners();
     clearErrListeners();
+    mBcmSocket.reset();  // stops all cyclic messages
     mSocket.reset();
 
     bool success = true;
@@ -218,52 +520,6 @@ bool CanBus::down() {
     return success;
 }
 
-/**
- * Helper function to determine if a flag meets the requirements of a
- * FilterFlag. See definition of FilterFlag in types.hal
- *
- * \param filterFlag FilterFlag object to match flag against
- * \param flag bool object from CanMessage object
- */
-static bool satisfiesFilterFlag(FilterFlag filterFlag, bool flag) {
-    if (filterFlag == FilterFlag::DONT_CARE) return true;
-    if (filterFlag == FilterFlag::SET) return flag;
-    if (filterFlag == FilterFlag::NOT_SET) return !flag;
-    return false;
-}
-
-/**
- * Match the filter set against message id.
- *
- * For details on the filters syntax, please see CanMessageFilter at
- * the HAL definition (types.hal).
- *
- * \param filter Filter to match against
- * \param id Message id to filter
- * \return true if the message id matches the filter, false otherwise
- */
-static bool match(const hidl_vec<CanMessageFilter>& filter, CanMessageId id, bool isRtr,
-                  bool isExtendedId) {
-    if (filter.size() == 0) return true;
-
-    bool anyNonExcludeRulePresent = false;
-    bool anyNonExcludeRuleSatisfied = false;
-    for (auto& rule : filter) {
-        const bool satisfied = ((id & rule.mask) == rule.id) &&
-                               satisfiesFilterFlag(rule.rtr, isRtr) &&
-                               satisfiesFilterFlag(rule.extendedFormat, isExtendedId);
-
-        if (rule.exclude) {
-            // Any excluded (blacklist) rule not being satisfied invalidates the whole filter set.
-            if (satisfied) return false;
-        } else {
-            anyNonExcludeRulePresent = true;
-            if (satisfied) anyNonExcludeRuleSatisfied = true;
-        }
-    }
-    return !anyNonExcludeRulePresent || anyNonExcludeRuleSatisfied;
-}
-
 void CanBus::notifyErrorListeners(ErrorEvent err, bool isFatal) {
     std::lock_guard<std::mutex> lck(mErrListenersGuard);
     for (auto& listener : mErrListeners) {
@@ -297,35 +553,56 @@ static ErrorEvent parseErrorFrame(const struct canfd_frame& frame) {
     return ErrorEvent::UNKNOWN_ERROR;
 }
 
-void CanBus::onRead(const struct canfd_frame& frame, std::chrono::nanoseconds timestamp) {
-    if ((frame.can_id & CAN_ERR_FLAG) != 0) {
-        // error bit is set
-        LOG(WARNING) << "CAN Error frame received";
-        notifyErrorListeners(parseErrorFrame(frame), false);
-        return;
-    }
-
-    CanMessage message = {};
-    message.id = frame.can_id & CAN_EFF_MASK;  // mask out eff/rtr/err flags
-    message.payload = hidl_vec<uint8_t>(frame.data, frame.data + frame.len);
-    message.timestamp = timestamp.count();
-    message.isExtendedId = (frame.can_id & CAN_EFF_FLAG) != 0;
-    message.remoteTransmissionRequest = (frame.can_id & CAN_RTR_FLAG) != 0;
+void CanBus::onRead(const std::vector<CanSocket::Frame>& frames) {
+    mReadErrors.clear();
+    mReadDeliveries.clear();
+    std::unique_lock<std::mutex> readLck(mReadQueuesGuard);
+    {
+        // Listeners are locked once for the whole burst rather than for every frame.
+        std::lock_guard<std::mutex> lck(mMsgListenersGuard);
+        for (size_t frameIdx = 0; frameIdx < frames.size(); frameIdx++) {
+            const auto& received = frames[frameIdx];
+            const auto& frame = received.frame;
+            if ((frame.can_id & CAN_ERR_FLAG) != 0) {
+                // error bit is set
+                LOG(WARNING) << "CAN Error frame received";
+                mReadErrors.push_back(parseErrorFrame(frame));
+                continue;
+            }
+
+            if (UNLIKELY(kSuperVerbose)) {
+                CanMessage message = {};
+                toCanMessage(received, &message);
+                LOG(VERBOSE) << "Got message " << toString(message);
+            }
+
+            const CanMessageId id = frame.can_id & CAN_EFF_MASK;  // mask out eff/rtr/err flags
+            const bool isExtendedId = (frame.can_id & CAN_EFF_FLAG) != 0;
+            const bool isRtr = (frame.can_id & CAN_RTR_FLAG) != 0;
+            mFilterIndex.findListeners(id, isRtr, isExtendedId, &mMatchingListeners);
+            for (const auto i : mMatchingListeners) mReadDeliveries.push_back({i, frameIdx});
+        }
 
-    if (UNLIKELY(kSuperVerbose)) {
-        LOG(VERBOSE) << "Got message " << toString(message);
+        /* Queues are referenced once per burst, so that listeners closed in the meantime can't go
+         * away while frames are pushed to them. */
+        if (!mReadDeliveries.empty()) {
+            mReadQueues.resize(mMsgListeners.size());
+            for (size_t i = 0; i < mMsgListeners.size(); i++) {
+                mReadQueues[i] = mMsgListeners[i].queue;
+            }
+        }
     }
 
-    std::lock_guard<std::mutex> lck(mMsgListenersGuard);
-    for (auto& listener : mMsgListeners) {
-        if (!match(listener.filter, message.id, message.remoteTransmissionRequest,
-                   message.isExtendedId))
-            continue;
-        if (!listener.callback->onReceive(message).isOk() && !listener.failedOnce) {
-            listener.failedOnce = true;
-            LOG(WARNING) << "Failed to notify listener about message";
-        }
+    /* Pushing may block with OverflowPolicy::BLOCK, which mustn't keep listen(), closing listeners
+     * or debug commands waiting, nor deadlock a listener calling back into the bus. */
+    for (const auto& [listenerIdx, frameIdx] : mReadDeliveries) {
+        mReadQueues[listenerIdx]->push(frames[frameIdx]);
     }
+    mReadQueues.clear();
+    readLck.unlock();
+
+    // Error listeners are called synchronously and may call back into the bus.
+    for (const auto err : mReadErrors) notifyErrorListeners(err, false);
 }
 
 void CanBus::onError(int errnoVal) {
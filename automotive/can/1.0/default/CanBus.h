@@ -16,14 +16,19 @@
 
 #pragma once
 
+#include "CanBcmSocket.h"
+#include "CanFilterIndex.h"
 #include "CanSocket.h"
+#include "ListenerQueue.h"
 
 #include <android-base/unique_fd.h>
 #include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
+#include <libcanhaltools/libcanhaltools.h>
 #include <utils/Mutex.h>
 
 #include <atomic>
+#include <chrono>
 #include <thread>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
@@ -37,6 +42,33 @@ struct CanBus : public ICanBus {
     Return<void> listen(const hidl_vec<CanMessageFilter>& filter,
                         const sp<ICanMessageListener>& listener, listen_cb _hidl_cb) override;
     Return<sp<ICloseHandle>> listenForErrors(const sp<ICanErrorListener>& listener) override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
+    /**
+     * Send several messages with as few system calls as possible.
+     *
+     * \param messages Messages to send, in order
+     * \param sent Number of messages sent, less than all of them in case of failure
+     * \return OK if all messages were sent, an error otherwise
+     */
+    Result sendBurst(const std::vector<CanMessage>& messages, size_t* sent);
+
+    /**
+     * Have the kernel send a message periodically, until stopCyclicSend() or the bus goes down.
+     *
+     * Starting a message with the same id again replaces its payload and period.
+     *
+     * \param message Message to send, with a classic CAN payload of up to 8 bytes
+     * \param period Time between two messages
+     */
+    Result startCyclicSend(const CanMessage& message, std::chrono::microseconds period);
+
+    /**
+     * Stop sending a message started with startCyclicSend().
+     *
+     * \param message Message with the same id, isExtendedId and remoteTransmissionRequest flags
+     */
+    Result stopCyclicSend(const CanMessage& message);
 
     void setErrorCallback(ErrorCallback errcb);
     ICanController::Result up();
@@ -79,19 +111,57 @@ struct CanBus : public ICanBus {
         sp<ICanMessageListener> callback;
         hidl_vec<CanMessageFilter> filter;
         wp<ICloseHandle> closeHandle;
-        bool failedOnce = false;
+        std::shared_ptr<ListenerQueue> queue;
     };
+    std::vector<hidl_vec<CanMessageFilter>> getListenerFilters() REQUIRES(mMsgListenersGuard);
     void clearMsgListeners();
     void clearErrListeners();
 
     void notifyErrorListeners(ErrorEvent err, bool isFatal);
 
-    void onRead(const struct canfd_frame& frame, std::chrono::nanoseconds timestamp);
+    void cmdHelp(int fd) const;
+    void cmdDumpListeners(int fd);
+    void cmdSetQueue(int fd, const hidl_vec<hidl_string>& options);
+    /* Commands sending messages also end their output with a status line for tools, see
+     * libcanhaltools::formatSendStatus. */
+    libcanhaltools::SendStatus cmdSendBurst(int fd, const hidl_vec<hidl_string>& options);
+    libcanhaltools::SendStatus cmdSendCyclic(int fd, const hidl_vec<hidl_string>& options);
+    libcanhaltools::SendStatus cmdStopCyclic(int fd, const hidl_vec<hidl_string>& options);
+
+    CanBcmSocket* getBcmSocket() REQUIRES(mIsUpGuard);
+
+    void onRead(const std::vector<CanSocket::Frame>& frames);
     void onError(int errnoVal);
 
     std::mutex mMsgListenersGuard;
     std::vector<CanMessageListener> mMsgListeners GUARDED_BY(mMsgListenersGuard);
 
+    /**
+     * Filters of mMsgListeners, in the same order.
+     *
+     * Kernel filters of mSocket are only updated in listen(), since they can't be accessed once
+     * the bus is down. They may let more messages through until then, which is fine.
+     */
+    CanFilterIndex mFilterIndex GUARDED_BY(mMsgListenersGuard);
+    std::vector<size_t> mMatchingListeners GUARDED_BY(mMsgListenersGuard);  // onRead scratch space
+
+    /**
+     * Scratch space of onRead, only used by the reader thread: error frames of the burst, frames
+     * to push as (listener index, frame index) and the queues of listeners at that time.
+     */
+    std::vector<ErrorEvent> mReadErrors;
+    std::vector<std::pair<size_t, size_t>> mReadDeliveries;
+
+    /**
+     * Held by the reader thread while it references queues, so closing can wait for that. Taken
+     * before mMsgListenersGuard.
+     */
+    std::mutex mReadQueuesGuard;
+    std::vector<std::shared_ptr<ListenerQueue>> mReadQueues GUARDED_BY(mReadQueuesGuard);
+
+    /** Config of delivery queues of all listeners, see cmdSetQueue. */
+    ListenerQueue::Config mQueueConfig GUARDED_BY(mMsgListenersGuard);
+
     std::mutex mErrListenersGuard;
     std::vector<sp<ICanErrorListener>> mErrListeners GUARDED_BY(mErrListenersGuard);
 
@@ -106,6 +176,9 @@ struct CanBus : public ICanBus {
     std::mutex mIsUpGuard;
     bool mIsUp GUARDED_BY(mIsUpGuard) = false;
 
+    /** Broadcast manager socket for cyclic messages, opened with the first one. */
+    std::unique_ptr<CanBcmSocket> mBcmSocket GUARDED_BY(mIsUpGuard);
+
     ErrorCallback mErrCb;
 };
 
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CanFilterIndex.h"
+
+#include <algorithm>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/** Number of (standard id, RTR flag) pairs. */
+static constexpr size_t kStandardKeys = (CAN_SFF_MASK + 1) * 2;
+
+/** Kernel limit on the number of filters per socket (CAN_RAW_FILTER_MAX). */
+static constexpr size_t kMaxKernelFilters = 512;
+
+/** Kernel filter matching every frame. */
+static constexpr struct can_filter kAcceptAll = {0, 0};
+
+/**
+ * Helper function to determine if a flag meets the requirements of a
+ * FilterFlag. See definition of FilterFlag in types.hal
+ *
+ * \param filterFlag FilterFlag object to match flag against
+ * \param flag bool object from CanMessage object
+ */
+static bool satisfiesFilterFlag(FilterFlag filterFlag, bool flag) {
+    if (filterFlag == FilterFlag::DONT_CARE) return true;
+    if (filterFlag == FilterFlag::SET) return flag;
+    if (filterFlag == FilterFlag::NOT_SET) return !flag;
+    return false;
+}
+
+bool CanFilterIndex::match(const hidl_vec<CanMessageFilter>& filter, CanMessageId id, bool isRtr,
+                           bool isExtendedId) {
+    if (filter.size() == 0) return true;
+
+    bool anyNonExcludeRulePresent = false;
+    bool anyNonExcludeRuleSatisfied = false;
+    for (auto& rule : filter) {
+        const bool satisfied = ((id & rule.mask) == rule.id) &&
+                               satisfiesFilterFlag(rule.rtr, isRtr) &&
+                               satisfiesFilterFlag(rule.extendedFormat, isExtendedId);
+
+        if (rule.exclude) {
+            // Any excluded (blacklist) rule not being satisfied invalidates the whole filter set.
+            if (satisfied) return false;
+        } else {
+            anyNonExcludeRulePresent = true;
+            if (satisfied) anyNonExcludeRuleSatisfied = true;
+        }
+    }
+    return !anyNonExcludeRulePresent || anyNonExcludeRuleSatisfied;
+}
+
+/**
+ * Set kernel filter bits for a frame flag.
+ *
+ * \param filter Kernel filter to update
+ * \param canFlag CAN_RTR_FLAG or CAN_EFF_FLAG
+ * \param filterFlag Requirement of the HAL rule on that flag
+ */
+static void setKernelFilterFlag(struct can_filter& filter, canid_t canFlag,
+                                FilterFlag filterFlag) {
+    if (filterFlag == FilterFlag::DONT_CARE) return;
+    filter.can_mask |= canFlag;
+    if (filterFlag == FilterFlag::SET) filter.can_id |= canFlag;
+}
+
+static std::vector<struct can_filter> toKernelFilters(
+        const std::vector<hidl_vec<CanMessageFilter>>& filters) {
+    std::vector<struct can_filter> kernelFilters;
+    for (const auto& filter : filters) {
+        bool anyNonExcludeRulePresent = false;
+        for (const auto& rule : filter) {
+            if (rule.exclude) continue;
+            anyNonExcludeRulePresent = true;
+
+            // Such rules can't be satisfied by any message id.
+            if ((rule.id & ~rule.mask) != 0 || (rule.id & ~CAN_EFF_MASK) != 0) continue;
+
+            struct can_filter kernelFilter = {rule.id, rule.mask & CAN_EFF_MASK};
+            setKernelFilterFlag(kernelFilter, CAN_RTR_FLAG, rule.rtr);
+            setKernelFilterFlag(kernelFilter, CAN_EFF_FLAG, rule.extendedFormat);
+            kernelFilters.push_back(kernelFilter);
+        }
+        if (!anyNonExcludeRulePresent) return {kAcceptAll};
+    }
+
+    const auto asPair = [](const struct can_filter& f) { return std::pair(f.can_id, f.can_mask); };
+    std::sort(kernelFilters.begin(), kernelFilters.end(),
+              [&](const auto& a, const auto& b) { return asPair(a) < asPair(b); });
+    kernelFilters.erase(std::unique(kernelFilters.begin(), kernelFilters.end(),
+                                    [&](const auto& a, const auto& b) {
+                                        return asPair(a) == asPair(b);
+                                    }),
+                        kernelFilters.end());
+
+    if (kernelFilters.size() > kMaxKernelFilters) return {kAcceptAll};
+    return kernelFilters;
+}
+
+CanFilterIndex::CanFilterIndex() : CanFilterIndex(std::vector<hidl_vec<CanMessageFilter>>()) {}
+
+CanFilterIndex::CanFilterIndex(const std::vector<hidl_vec<CanMessageFilter>>& filters)
+    : mKernelFilters(toKernelFilters(filters)) {
+    mStandardOffsets.reserve(kStandardKeys + 1);
+    mStandardOffsets.push_back(0);
+    for (size_t key = 0; key < kStandardKeys; key++) {
+        for (size_t listener = 0; listener < filters.size(); listener++) {
+            if (match(filters[listener], key >> 1, key & 1, false)) {
+                mStandardListeners.push_back(listener);
+            }
+        }
+        mStandardOffsets.push_back(mStandardListeners.size());
+    }
+
+    for (size_t listener = 0; listener < filters.size(); listener++) {
+        bool anyNonExcludeRulePresent = false;
+        for (const auto& rule : filters[listener]) {
+            if (!rule.exclude) anyNonExcludeRulePresent = true;
+
+            // Such rules can't be satisfied by any message id.
+            if ((rule.id & ~rule.mask) != 0) continue;
+
+            auto bucket = std::find_if(mMaskBuckets.begin(), mMaskBuckets.end(),
+                                       [&](const auto& b) { return b.mask == rule.mask; });
+            if (bucket == mMaskBuckets.end()) {
+                bucket = mMaskBuckets.insert(mMaskBuckets.end(), {rule.mask, {}});
+            }
+            bucket->rules[rule.id].push_back(
+                    {static_cast<uint32_t>(listener), rule.rtr, rule.extendedFormat, rule.exclude});
+        }
+        if (!anyNonExcludeRulePresent) mOpenListeners.push_back(listener);
+    }
+}
+
+void CanFilterIndex::findListeners(CanMessageId id, bool isRtr, bool isExtendedId,
+                                   std::vector<size_t>* listeners) const {
+    if (!isExtendedId && id <= CAN_SFF_MASK) {
+        const auto key = id << 1 | isRtr;
+        listeners->assign(mStandardListeners.begin() + mStandardOffsets[key],
+                          mStandardListeners.begin() + mStandardOffsets[key + 1]);
+        return;
+    }
+
+    /* Collect satisfied rules as (listener << 1 | exclude). Listeners without include rules are
+     * treated as if they had one satisfied. */
+    listeners->clear();
+    for (const auto listener : mOpenListeners) listeners->push_back(listener << 1);
+    for (const auto& bucket : mMaskBuckets) {
+        const auto rules = bucket.rules.find(id & bucket.mask);
+        if (rules == bucket.rules.end()) continue;
+        for (const auto& rule : rules->second) {
+            if (!satisfiesFilterFlag(rule.rtr, isRtr)) continue;
+            if (!satisfiesFilterFlag(rule.extendedFormat, isExtendedId)) continue;
+            listeners->push_back(rule.listener << 1 | rule.exclude);
+        }
+    }
+    std::sort(listeners->begin(), listeners->end());
+
+    // A listener matches if it has a satisfied include rule and no satisfied exclude rule.
+    size_t matching = 0;
+    for (size_t i = 0; i < listeners->size();) {
+        const auto listener = (*listeners)[i] >> 1;
+        bool anyIncludeRuleSatisfied = false;
+        bool anyExcludeRuleSatisfied = false;
+        for (; i < listeners->size() && (*listeners)[i] >> 1 == listener; i++) {
+            if (((*listeners)[i] & 1) != 0) {
+                anyExcludeRuleSatisfied = true;
+            } else {
+                anyIncludeRuleSatisfied = true;
+            }
+        }
+        if (anyIncludeRuleSatisfied && !anyExcludeRuleSatisfied) (*listeners)[matching++] = listener;
+    }
+    listeners->resize(matching);
+}
+
+const std::vector<struct can_filter>& CanFilterIndex::getKernelFilters() const {
+    return mKernelFilters;
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/automotive/can/1.0/types.h>
+#include <linux/can.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Filters of all message listeners of a bus, compiled for dispatching received messages.
+ *
+ * Listeners are identified by their position on the list of filters the index was built from.
+ * Matching listeners for every standard (11-bit) ID are found in advance. Extended IDs are looked
+ * up in a hash table per distinct rule mask, so it takes as many lookups as there are different
+ * masks, regardless of the number of listeners and rules.
+ */
+class CanFilterIndex {
+  public:
+    /** Index with no listeners. */
+    CanFilterIndex();
+
+    /**
+     * Build the index.
+     *
+     * \param filters Filter set of every listener
+     */
+    explicit CanFilterIndex(const std::vector<hidl_vec<CanMessageFilter>>& filters);
+
+    /**
+     * Find listeners whose filters let a message through.
+     *
+     * \param id Message id
+     * \param isRtr Whether it's a Remote Transmission Request
+     * \param isExtendedId Whether the message has a 29-bit id
+     * \param listeners Replaced with positions of matching listeners, in ascending order
+     */
+    void findListeners(CanMessageId id, bool isRtr, bool isExtendedId,
+                       std::vector<size_t>* listeners) const;
+
+    /**
+     * Kernel filters (see CAN_RAW_FILTER) letting through every message any listener may accept.
+     *
+     * Exclude rules are not taken into account, since a frame passes kernel filters if any of them
+     * matches. No filters means no listener accepts any message.
+     */
+    const std::vector<struct can_filter>& getKernelFilters() const;
+
+    /**
+     * Match the filter set against message id.
+     *
+     * For details on the filters syntax, please see CanMessageFilter at
+     * the HAL definition (types.hal).
+     *
+     * \param filter Filter to match against
+     * \param id Message id to filter
+     * \return true if the message id matches the filter, false otherwise
+     */
+    static bool match(const hidl_vec<CanMessageFilter>& filter, CanMessageId id, bool isRtr,
+                      bool isExtendedId);
+
+  private:
+    struct Rule {
+        uint32_t listener;
+        FilterFlag rtr;
+        FilterFlag extendedFormat;
+        bool exclude;
+    };
+
+    /** Rules sharing the same mask, by their id. */
+    struct MaskBucket {
+        uint32_t mask;
+        std::unordered_map<CanMessageId, std::vector<Rule>> rules;
+    };
+
+    /**
+     * Listeners matching standard id and RTR flag (id << 1 | isRtr) of k are stored in
+     * mStandardListeners, between mStandardOffsets[k] and mStandardOffsets[k + 1].
+     */
+    std::vector<uint32_t> mStandardOffsets;
+    std::vector<uint32_t> mStandardListeners;
+
+    std::vector<MaskBucket> mMaskBuckets;
+
+    /** Listeners without any include rules, accepting every message not explicitly excluded. */
+    std::vector<uint32_t> mOpenListeners;
+
+    std::vector<struct can_filter> mKernelFilters;
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -20,19 +20,96 @@
 #include <libnetdevice/can.h>
 #include <libnetdevice/libnetdevice.h>
 #include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <utils/SystemClock.h>
 
 #include <chrono>
+#include <cstring>
+#include <optional>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
 using namespace std::chrono_literals;
 
-/* How frequently the read thread checks whether the interface was asked to be down.
+/* Ask for software receive timestamps, taken when the frame reaches the network stack. They are
+ * in the CLOCK_REALTIME domain. Hardware ones are not used: they come from the clock of the
+ * controller, which can't be converted to time since boot with a CLOCK_REALTIME offset. */
+static constexpr int kTimestampingFlags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+/* How long a measured offset between the kernel timestamp clock and the time since boot is used
+ * before measuring it again. The clocks drift apart slowly, but the wall clock may also be set. */
+static constexpr auto kClockOffsetValidity = 1s;
+
+static std::chrono::nanoseconds toNanoseconds(const struct timespec& ts) {
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+static std::chrono::nanoseconds clockNow(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return toNanoseconds(ts);
+}
+
+/**
+ * Converts kernel timestamps to time since boot, as returned by elapsedRealtimeNano().
+ *
+ * There is no direct way to convert between these clocks, so the offset between them is
+ * estimated by reading the real time clock in between two reads of the boot time clock, a few
+ * times, and keeping the sample that took the least time.
+ */
+class BootClockOffset {
+  public:
+    /**
+     * \param realtime Kernel timestamp to convert
+     * \param now Current time since boot, to know when the offset has to be measured again
+     */
+    std::chrono::nanoseconds toBootTime(std::chrono::nanoseconds realtime,
+                                        std::chrono::nanoseconds now) {
+        if (!mMeasuredAt || now - *mMeasuredAt > kClockOffsetValidity) measure();
+        return realtime + mOffset;
+    }
+
+  private:
+    static constexpr int kSamples = 5;
+
+    void measure() {
+        auto shortestSample = std::chrono::nanoseconds::max();
+        for (int i = 0; i < kSamples; i++) {
+            const auto before = clockNow(CLOCK_BOOTTIME);
+            const auto realtime = clockNow(CLOCK_REALTIME);
+            const auto after = clockNow(CLOCK_BOOTTIME);
+            if (after - before < shortestSample) {
+                shortestSample = after - before;
+                mOffset = before + (after - before) / 2 - realtime;
+                mMeasuredAt = after;
+            }
+        }
+    }
+
+    std::chrono::nanoseconds mOffset = 0ns;
+    std::optional<std::chrono::nanoseconds> mMeasuredAt;
+};
+
+/**
+ * Returns the kernel software timestamp of a received message.
  *
- * Note: This does *not* affect read timing or bandwidth, just CPU load vs time to
- *       down the interface. */
-static constexpr auto kReadPooling = 100ms;
+ * \return Timestamp in the CLOCK_REALTIME domain, or 0 if there is none
+ */
+static std::chrono::nanoseconds getReceiveTimestamp(struct msghdr& msg) {
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING) continue;
+
+        struct scm_timestamping timestamps;
+        memcpy(&timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+        return toNanoseconds(timestamps.ts[0]);
+    }
+    return 0ns;
+}
 
 std::unique_ptr<CanSocket> CanSocket::open(const std::string& ifname, ReadCallback rdcb,
                                            ErrorCallback errcb) {
@@ -42,14 +119,40 @@ std::unique_ptr<CanSocket> CanSocket::open(const std::string& ifname, ReadCallba
         return nullptr;
     }
 
+    if (setsockopt(sock.get(), SOL_SOCKET, SO_TIMESTAMPING, &kTimestampingFlags,
+                   sizeof(kTimestampingFlags)) < 0) {
+        PLOG(WARNING) << "Can't enable receive timestamps on " << ifname
+                      << ", frames will be stamped when they are read";
+    }
+
+    base::unique_fd epoll(epoll_create1(EPOLL_CLOEXEC));
+    base::unique_fd stopEvent(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (!epoll.ok() || !stopEvent.ok()) {
+        PLOG(ERROR) << "Can't create reader thread events for " << ifname;
+        return nullptr;
+    }
+    for (const auto& fd : {sock.get(), stopEvent.get()}) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+            PLOG(ERROR) << "Can't watch CAN socket on " << ifname;
+            return nullptr;
+        }
+    }
+
     // Can't use std::make_unique due to private CanSocket constructor.
-    return std::unique_ptr<CanSocket>(new CanSocket(std::move(sock), rdcb, errcb));
+    return std::unique_ptr<CanSocket>(new CanSocket(std::move(sock), std::move(epoll),
+                                                    std::move(stopEvent), rdcb, errcb));
 }
 
-CanSocket::CanSocket(base::unique_fd socket, ReadCallback rdcb, ErrorCallback errcb)
+CanSocket::CanSocket(base::unique_fd socket, base::unique_fd epoll, base::unique_fd stopEvent,
+                     ReadCallback rdcb, ErrorCallback errcb)
     : mReadCallback(rdcb),
       mErrorCallback(errcb),
       mSocket(std::move(socket)),
+      mEpoll(std::move(epoll)),
+      mStopEvent(std::move(stopEvent)),
       mReaderThread(&CanSocket::readerThread, this) {}
 
 CanSocket::~CanSocket() {
@@ -60,6 +163,10 @@ CanSocket::~CanSocket() {
     if (mReaderThreadFinished) {
         mReaderThread.detach();
     } else {
+        const uint64_t wakeUp = 1;
+        if (write(mStopEvent.get(), &wakeUp, sizeof(wakeUp)) < 0) {
+            PLOG(ERROR) << "Can't wake the reader thread up";
+        }
         mReaderThread.join();
     }
 }
@@ -77,67 +184,120 @@ bool CanSocket::send(const struct canfd_frame& frame) {
     return true;
 }
 
-static struct timeval toTimeval(std::chrono::microseconds t) {
-    struct timeval tv;
-    tv.tv_sec = t / 1s;
-    tv.tv_usec = (t % 1s) / 1us;
-    return tv;
+size_t CanSocket::send(const struct canfd_frame* frames, size_t count, bool* queueFull) {
+    std::vector<struct iovec> iovs(count);
+    std::vector<struct mmsghdr> msgs(count);
+    for (size_t i = 0; i < count; i++) {
+        iovs[i] = {const_cast<struct canfd_frame*>(&frames[i]), CAN_MTU};
+        msgs[i].msg_hdr = {};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    *queueFull = false;
+    size_t sent = 0;
+    while (sent < count) {
+        const auto res = sendmmsg(mSocket.get(), msgs.data() + sent, count - sent, MSG_DONTWAIT);
+        if (res > 0) {
+            sent += res;
+            continue;
+        }
+        if (res < 0 && errno == EINTR) continue;
+
+        *queueFull = res < 0 && (errno == EAGAIN || errno == ENOBUFS);
+        if (!*queueFull) PLOG(DEBUG) << "CanSocket send failed after " << sent << " of " << count;
+        break;
+    }
+    return sent;
 }
 
-static int selectRead(const base::unique_fd& fd, std::chrono::microseconds timeout) {
-    auto timeouttv = toTimeval(timeout);
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(fd.get(), &readfds);
-    return select(fd.get() + 1, &readfds, nullptr, nullptr, &timeouttv);
+bool CanSocket::setFilters(const std::vector<struct can_filter>& filters) {
+    if (setsockopt(mSocket.get(), SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                   filters.size() * sizeof(struct can_filter)) < 0) {
+        PLOG(ERROR) << "Can't set CAN filters";
+        return false;
+    }
+    return true;
 }
 
 void CanSocket::readerThread() {
     LOG(VERBOSE) << "Reader thread started";
     int errnoCopy = 0;
+    bool failed = false;
 
-    while (!mStopReaderThread) {
-        /* The ideal would be to have a blocking read(3) call and interrupt it with shutdown(3).
-         * This is unfortunately not supported for SocketCAN, so we need to rely on select(3). */
-        const auto sel = selectRead(mSocket, kReadPooling);
-        if (sel == 0) continue;  // timeout
-        if (sel == -1) {
-            PLOG(ERROR) << "Select failed";
+    /* Frames are received straight into the batch passed to the read callback. Its capacity never
+     * changes, so the buffers set up below stay valid. */
+    std::vector<Frame> batch;
+    batch.reserve(kReadBatchSize);
+    union ControlBuffer {
+        char data[CMSG_SPACE(sizeof(struct scm_timestamping))];
+        struct cmsghdr align;
+    };
+    std::vector<ControlBuffer> controls(kReadBatchSize);
+    std::vector<struct iovec> iovs(kReadBatchSize);
+    std::vector<struct mmsghdr> msgs(kReadBatchSize);
+    BootClockOffset clockOffset;
+
+    while (!mStopReaderThread && !failed) {
+        struct epoll_event event;
+        if (epoll_wait(mEpoll.get(), &event, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            errnoCopy = errno;
+            PLOG(ERROR) << "Waiting for CAN packets failed";
             break;
         }
 
-        struct canfd_frame frame;
-        const auto nbytes = read(mSocket.get(), &frame, CAN_MTU);
-
-        /* We could use SIOCGSTAMP to get a precise UNIX timestamp for a given packet, but what
-         * we really need is a time since boot. There is no direct way to convert between these
-         * clocks. We could implement a class to calculate the difference between the clocks
-         * (querying both several times and picking the smallest difference); apply the difference
-         * to a SIOCGSTAMP returned value; re-synchronize if the elapsed time is too much in the
-         * past (indicating the UNIX timestamp might have been adjusted).
-         *
-         * Apart from the added complexity, it's possible the added calculations and system calls
-         * would add so much time to the processing pipeline so the precision of the reported time
-         * was buried under the subsystem latency. Let's just use a local time since boot here and
-         * leave precise hardware timestamps for custom proprietary implementations (if needed). */
-        const std::chrono::nanoseconds ts(elapsedRealtimeNano());
-
-        if (nbytes != CAN_MTU) {
-            if (nbytes >= 0) {
-                LOG(ERROR) << "Failed to read CAN packet, got " << nbytes << " bytes";
+        // Drain everything that's queued, up to kReadBatchSize frames per system call.
+        while (!mStopReaderThread) {
+            batch.resize(kReadBatchSize);
+            for (size_t i = 0; i < kReadBatchSize; i++) {
+                iovs[i] = {&batch[i].frame, CAN_MTU};
+                msgs[i].msg_hdr = {};
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_control = controls[i].data;
+                msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+            }
+
+            const auto nmsgs = recvmmsg(mSocket.get(), msgs.data(), kReadBatchSize, MSG_DONTWAIT,
+                                        nullptr);
+            if (nmsgs < 0) {
+                batch.clear();
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+
+                errnoCopy = errno;
+                PLOG(ERROR) << "Failed to read CAN packets";
+                failed = true;
                 break;
             }
-            if (errno == EAGAIN) continue;
 
-            errnoCopy = errno;
-            PLOG(ERROR) << "Failed to read CAN packet";
-            break;
-        }
+            const std::chrono::nanoseconds now(elapsedRealtimeNano());
+            size_t received = 0;
+            for (; received < static_cast<size_t>(nmsgs); received++) {
+                const auto nbytes = msgs[received].msg_len;
+                if (nbytes != CAN_MTU) {
+                    LOG(ERROR) << "Failed to read CAN packet, got " << nbytes << " bytes";
+                    failed = true;
+                    break;
+                }
 
-        mReadCallback(frame, ts);
+                /* Frames without a kernel timestamp (if the socket doesn't support them) are
+                 * stamped with the time they were read at. A timestamp can't be later than that,
+                 * even if the wall clock was set since the offset was measured. */
+                const auto timestamp = getReceiveTimestamp(msgs[received].msg_hdr);
+                batch[received].timestamp =
+                        timestamp != 0ns ? std::min(clockOffset.toBootTime(timestamp, now), now)
+                                         : now;
+            }
+            batch.resize(received);
+
+            if (!batch.empty()) mReadCallback(batch);
+            if (failed || received < kReadBatchSize) break;
+        }
     }
 
-    bool failed = !mStopReaderThread;
+    failed = !mStopReaderThread;
     auto errCb = mErrorCallback;
     mReaderThreadFinished = true;
 
@@ -23,14 +23,25 @@
 #include <atomic>
 #include <chrono>
 #include <thread>
+#include <vector>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
 /** Wrapper around SocketCAN socket. */
 struct CanSocket {
-    using ReadCallback = std::function<void(const struct canfd_frame&, std::chrono::nanoseconds)>;
+    /** Received frame, along with the time since boot it was received at. */
+    struct Frame {
+        struct canfd_frame frame;
+        std::chrono::nanoseconds timestamp;
+    };
+
+    /** Called with every burst of frames read from the socket, in the order they were received. */
+    using ReadCallback = std::function<void(const std::vector<Frame>& frames)>;
     using ErrorCallback = std::function<void(int errnoVal)>;
 
+    /** Maximum number of frames read with a single system call. */
+    static constexpr size_t kReadBatchSize = 64;
+
     /**
      * Open and bind SocketCAN socket.
      *
@@ -51,14 +62,40 @@ struct CanSocket {
      */
     bool send(const struct canfd_frame& frame);
 
+    /**
+     * Send several CAN frames, with as few system calls as possible.
+     *
+     * Doesn't wait for the interface transmit queue to drain when it's full, so that the caller can
+     * retry later without holding any locks in the meantime.
+     *
+     * \param frames Frames to send, in order
+     * \param count Number of frames
+     * \param queueFull Set to whether sending stopped because the transmit queue is full
+     * \return Number of frames sent, less than count in case of failure
+     */
+    size_t send(const struct canfd_frame* frames, size_t count, bool* queueFull);
+
+    /**
+     * Set kernel filters for received frames, see CAN_RAW_FILTER.
+     *
+     * Error frames are received regardless of these filters.
+     *
+     * \param filters Frames matching any of these are received, so no filters block all frames
+     * \return true in case of success, false otherwise
+     */
+    bool setFilters(const std::vector<struct can_filter>& filters);
+
   private:
-    CanSocket(base::unique_fd socket, ReadCallback rdcb, ErrorCallback errcb);
+    CanSocket(base::unique_fd socket, base::unique_fd epoll, base::unique_fd stopEvent,
+              ReadCallback rdcb, ErrorCallback errcb);
     void readerThread();
 
     ReadCallback mReadCallback;
     ErrorCallback mErrorCallback;
 
     const base::unique_fd mSocket;
+    const base::unique_fd mEpoll;
+    const base::unique_fd mStopEvent;  // eventfd that wakes the reader thread up to stop it
     std::thread mReaderThread;
     std::atomic<bool> mStopReaderThread = false;
     std::atomic<bool> mReaderThreadFinished = false;
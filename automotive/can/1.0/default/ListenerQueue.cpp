@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ListenerQueue.h"
+
+#include <android-base/logging.h>
+#include <utils/SystemClock.h>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+ListenerQueue::ListenerQueue(sp<ICanMessageListener> listener, Config config)
+    : mListener(listener), mConfig(config), mFrames(config.capacity) {
+    mDeliveryThread = std::thread(&ListenerQueue::deliveryThread, this);
+}
+
+ListenerQueue::~ListenerQueue() {
+    stop();
+    mDeliveryThread.join();
+}
+
+void ListenerQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lck(mLock);
+        mStop = true;
+    }
+    mMessageQueued.notify_all();
+    mMessageDelivered.notify_all();
+}
+
+void ListenerQueue::push(const CanSocket::Frame& frame) {
+    std::unique_lock<std::mutex> lck(mLock);
+    if (mStop) return;
+    if (mCount >= mConfig.capacity && mConfig.overflowPolicy == OverflowPolicy::BLOCK) {
+        // The config may change while waiting, to a bigger capacity or another policy.
+        mMessageDelivered.wait(lck, [this] {
+            return mStop || mCount < mConfig.capacity ||
+                   mConfig.overflowPolicy != OverflowPolicy::BLOCK;
+        });
+        if (mStop) return;
+    }
+    if (mCount >= mConfig.capacity) {
+        if (mConfig.overflowPolicy == OverflowPolicy::DROP_NEWEST) {
+            mStats.dropped++;
+            return;
+        }
+        // OverflowPolicy::DROP_OLDEST
+        mFirst = (mFirst + 1) % mFrames.size();
+        mCount--;
+        mStats.dropped++;
+    }
+
+    mFrames[(mFirst + mCount) % mFrames.size()] = frame;
+    mCount++;
+    mStats.maxDepth = std::max(mStats.maxDepth, mCount);
+    lck.unlock();
+    mMessageQueued.notify_one();
+}
+
+void ListenerQueue::setCapacity(size_t capacity) {
+    // Keep the most recent frames.
+    std::vector<CanSocket::Frame> frames(capacity);
+    const auto kept = std::min(mCount, capacity);
+    mStats.dropped += mCount - kept;
+    for (size_t i = 0; i < kept; i++) {
+        frames[i] = mFrames[(mFirst + mCount - kept + i) % mFrames.size()];
+    }
+    mFrames = std::move(frames);
+    mFirst = 0;
+    mCount = kept;
+}
+
+void ListenerQueue::setConfig(Config config) {
+    std::lock_guard<std::mutex> lck(mLock);
+    if (config.capacity != mConfig.capacity) setCapacity(config.capacity);
+    mConfig = config;
+    // Blocked push() may fit now.
+    mMessageDelivered.notify_all();
+}
+
+ListenerQueue::Stats ListenerQueue::getStats() const {
+    std::lock_guard<std::mutex> lck(mLock);
+    auto stats = mStats;
+    stats.depth = mCount;
+    return stats;
+}
+
+void ListenerQueue::deliveryThread() {
+    std::vector<CanSocket::Frame> batch;
+    batch.reserve(kDeliveryBatchSize);
+    CanMessage message = {};
+
+    std::unique_lock<std::mutex> lck(mLock);
+    while (true) {
+        mMessageQueued.wait(lck, [this] { return mStop || mCount > 0; });
+        if (mStop) break;
+
+        batch.clear();
+        for (; mCount > 0 && batch.size() < kDeliveryBatchSize; mCount--) {
+            batch.push_back(mFrames[mFirst]);
+            mFirst = (mFirst + 1) % mFrames.size();
+        }
+        lck.unlock();
+        mMessageDelivered.notify_all();
+
+        uint64_t failed = 0;
+        std::chrono::nanoseconds totalLatency = {};
+        std::chrono::nanoseconds maxLatency = {};
+        std::chrono::nanoseconds maxCallbackTime = {};
+        for (const auto& frame : batch) {
+            toCanMessage(frame, &message);
+            const std::chrono::nanoseconds deliveryStart(elapsedRealtimeNano());
+            if (!mListener->onReceive(message).isOk()) failed++;
+            const std::chrono::nanoseconds deliveryEnd(elapsedRealtimeNano());
+
+            const auto latency = deliveryStart - frame.timestamp;
+            totalLatency += latency;
+            maxLatency = std::max(maxLatency, latency);
+            maxCallbackTime = std::max(maxCallbackTime, deliveryEnd - deliveryStart);
+        }
+
+        lck.lock();
+        if (failed > 0 && mStats.failed == 0) {
+            LOG(WARNING) << "Failed to notify listener about message";
+        }
+        mStats.delivered += batch.size();
+        mStats.failed += failed;
+        mStats.totalLatency += totalLatency;
+        mStats.maxLatency = std::max(mStats.maxLatency, maxLatency);
+        mStats.maxCallbackTime = std::max(mStats.maxCallbackTime, maxCallbackTime);
+    }
+}
+
+std::optional<ListenerQueue::OverflowPolicy> ListenerQueue::parseOverflowPolicy(
+        const std::string& str) {
+    if (str == "drop-oldest") return OverflowPolicy::DROP_OLDEST;
+    if (str == "drop-newest") return OverflowPolicy::DROP_NEWEST;
+    if (str == "block") return OverflowPolicy::BLOCK;
+    return std::nullopt;
+}
+
+std::string toString(ListenerQueue::OverflowPolicy policy) {
+    switch (policy) {
+        case ListenerQueue::OverflowPolicy::DROP_OLDEST:
+            return "drop-oldest";
+        case ListenerQueue::OverflowPolicy::DROP_NEWEST:
+            return "drop-newest";
+        case ListenerQueue::OverflowPolicy::BLOCK:
+            return "block";
+    }
+    return "unknown";
+}
+
+void toCanMessage(const CanSocket::Frame& frame, CanMessage* message) {
+    message->id = frame.frame.can_id & CAN_EFF_MASK;  // mask out eff/rtr/err flags
+    message->payload.setToExternal(const_cast<uint8_t*>(frame.frame.data), frame.frame.len);
+    message->timestamp = frame.timestamp.count();
+    message->isExtendedId = (frame.frame.can_id & CAN_EFF_FLAG) != 0;
+    message->remoteTransmissionRequest = (frame.frame.can_id & CAN_RTR_FLAG) != 0;
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CanSocket.h"
+
+#include <android-base/macros.h>
+#include <android/hardware/automotive/can/1.0/ICanMessageListener.h>
+#include <utils/Mutex.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Bounded queue of messages for a single listener, delivered on its own thread.
+ *
+ * ICanMessageListener::onReceive is a synchronous call, so delivering messages straight from the
+ * socket reader thread would let one slow client hold up every other client and the socket.
+ *
+ * Received frames are kept in a ring buffer allocated up front and turned into CanMessage only
+ * when delivered, with the payload referring to the queued frame, so there are no allocations per
+ * message.
+ */
+struct ListenerQueue {
+    /** What to do with a message that doesn't fit in a full queue. */
+    enum class OverflowPolicy {
+        /** Make room by dropping the oldest message. Listeners get the most recent data. */
+        DROP_OLDEST,
+        /** Drop the new message. */
+        DROP_NEWEST,
+        /** Wait until the listener catches up, stalling reception for all listeners. */
+        BLOCK,
+    };
+
+    struct Config {
+        /** Maximum number of messages waiting for delivery, at least 1. */
+        size_t capacity = 256;
+        OverflowPolicy overflowPolicy = OverflowPolicy::DROP_OLDEST;
+    };
+
+    struct Stats {
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        /** Deliveries for which the listener call failed, e.g. because the client died. */
+        uint64_t failed = 0;
+        size_t depth = 0;
+        size_t maxDepth = 0;
+        /** Time from receiving a message to passing it to the listener. */
+        std::chrono::nanoseconds totalLatency = {};
+        std::chrono::nanoseconds maxLatency = {};
+        /** Time the listener took to handle a single message. */
+        std::chrono::nanoseconds maxCallbackTime = {};
+    };
+
+    ListenerQueue(sp<ICanMessageListener> listener, Config config);
+
+    /** Stops the delivery thread, dropping messages that weren't delivered yet. */
+    ~ListenerQueue();
+
+    /**
+     * Stop delivering messages, without waiting for the one being delivered, if any.
+     *
+     * Queued messages and messages pushed after that are dropped, and a blocked push() returns.
+     */
+    void stop();
+
+    /**
+     * Queue frame for delivery.
+     *
+     * \param frame Data frame to deliver
+     */
+    void push(const CanSocket::Frame& frame);
+
+    /** Change queue config, applied to messages pushed after that. */
+    void setConfig(Config config);
+
+    Stats getStats() const;
+
+    static std::optional<OverflowPolicy> parseOverflowPolicy(const std::string& str);
+
+  private:
+    /** Maximum number of frames taken off the queue at once by the delivery thread. */
+    static constexpr size_t kDeliveryBatchSize = 32;
+
+    void setCapacity(size_t capacity) REQUIRES(mLock);
+    void deliveryThread();
+
+    const sp<ICanMessageListener> mListener;
+
+    mutable std::mutex mLock;
+    std::condition_variable mMessageQueued;
+    std::condition_variable mMessageDelivered;
+    Config mConfig GUARDED_BY(mLock);
+
+    /** Ring buffer of mConfig.capacity frames, mCount of them queued starting at mFirst. */
+    std::vector<CanSocket::Frame> mFrames GUARDED_BY(mLock);
+    size_t mFirst GUARDED_BY(mLock) = 0;
+    size_t mCount GUARDED_BY(mLock) = 0;
+
+    Stats mStats GUARDED_BY(mLock);
+    bool mStop GUARDED_BY(mLock) = false;
+
+    std::thread mDeliveryThread;
+
+    DISALLOW_COPY_AND_ASSIGN(ListenerQueue);
+};
+
+std::string toString(ListenerQueue::OverflowPolicy policy);
+
+/**
+ * Fill message with a received data frame.
+ *
+ * The payload is not copied, so the message must not be used after the frame is gone.
+ */
+void toCanMessage(const CanSocket::Frame& frame, CanMessage* message);
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
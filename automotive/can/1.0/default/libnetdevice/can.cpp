@@ -65,6 +65,29 @@ base::unique_fd socket(const std::string& ifname) {
     return sock;
 }
 
+base::unique_fd bcmSocket(const std::string& ifname) {
+    struct sockaddr_can addr = {};
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = nametoindex(ifname);
+    if (addr.can_ifindex == 0) {
+        LOG(ERROR) << "Interface " << ifname << " doesn't exists";
+        return {};
+    }
+
+    base::unique_fd sock(::socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_BCM));
+    if (!sock.ok()) {
+        LOG(ERROR) << "Failed to create CAN broadcast manager socket";
+        return {};
+    }
+
+    if (0 != connect(sock.get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) {
+        PLOG(ERROR) << "Can't connect to CAN interface " << ifname;
+        return {};
+    }
+
+    return sock;
+}
+
 bool setBitrate(std::string ifname, uint32_t bitrate) {
     struct can_bittiming bt = {};
     bt.bitrate = bitrate;
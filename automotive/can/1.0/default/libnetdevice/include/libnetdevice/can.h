@@ -30,6 +30,14 @@ namespace android::netdevice::can {
  */
 base::unique_fd socket(const std::string& ifname);
 
+/**
+ * Opens and connects SocketCAN broadcast manager socket, for sending frames periodically.
+ *
+ * \param ifname Interface to open a socket against
+ * \return Socket's FD or -1 in case of failure
+ */
+base::unique_fd bcmSocket(const std::string& ifname);
+
 /**
  * Sets CAN interface bitrate.
  *
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CanFilterIndex.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/** Rules per listener, like a client interested in a handful of ECUs. */
+static constexpr size_t kRulesPerListener = 8;
+
+/** Messages of the bus traffic, mostly standard ids with some extended ones. */
+static constexpr size_t kMessages = 1024;
+
+struct Message {
+    CanMessageId id;
+    bool isExtendedId;
+};
+
+/** Listeners with exact id rules, some range (masked) rules and an occasional exclude rule. */
+static std::vector<hidl_vec<CanMessageFilter>> makeFilters(size_t listeners) {
+    std::mt19937 random(listeners);
+    std::vector<hidl_vec<CanMessageFilter>> filters;
+    for (size_t i = 0; i < listeners; i++) {
+        hidl_vec<CanMessageFilter> filter(kRulesPerListener);
+        for (auto& rule : filter) {
+            rule = {};
+            const bool isExtendedId = random() % 4 == 0;
+            rule.mask = random() % 4 == 0 ? 0x7F0 : (isExtendedId ? CAN_EFF_MASK : CAN_SFF_MASK);
+            rule.id = random() & (isExtendedId ? CAN_EFF_MASK : CAN_SFF_MASK) & rule.mask;
+            rule.extendedFormat = isExtendedId ? FilterFlag::SET : FilterFlag::NOT_SET;
+        }
+        if (i % 4 == 0) filter[0].exclude = true;
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+static std::vector<Message> makeTraffic() {
+    std::mt19937 random(0);
+    std::vector<Message> messages;
+    for (size_t i = 0; i < kMessages; i++) {
+        const bool isExtendedId = random() % 8 == 0;
+        const CanMessageId id = random() & (isExtendedId ? CAN_EFF_MASK : CAN_SFF_MASK);
+        messages.push_back({id, isExtendedId});
+    }
+    return messages;
+}
+
+/** Matching every listener's rules for every message, as CanBus used to. */
+static void BM_DispatchLinear(benchmark::State& state) {
+    const auto filters = makeFilters(state.range(0));
+    const auto messages = makeTraffic();
+    size_t matches = 0;
+    for (auto _ : state) {
+        for (const auto& message : messages) {
+            for (const auto& filter : filters) {
+                if (CanFilterIndex::match(filter, message.id, false, message.isExtendedId)) {
+                    matches++;
+                }
+            }
+        }
+    }
+    benchmark::DoNotOptimize(matches);
+    state.SetItemsProcessed(state.iterations() * messages.size());
+}
+BENCHMARK(BM_DispatchLinear)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_DispatchIndexed(benchmark::State& state) {
+    const CanFilterIndex index(makeFilters(state.range(0)));
+    const auto messages = makeTraffic();
+    std::vector<size_t> listeners;
+    size_t matches = 0;
+    for (auto _ : state) {
+        for (const auto& message : messages) {
+            index.findListeners(message.id, false, message.isExtendedId, &listeners);
+            matches += listeners.size();
+        }
+    }
+    benchmark::DoNotOptimize(matches);
+    state.SetItemsProcessed(state.iterations() * messages.size());
+}
+BENCHMARK(BM_DispatchIndexed)->RangeMultiplier(4)->Range(1, 256);
+
+/** Building the index, which happens on every listen() and close. */
+static void BM_BuildIndex(benchmark::State& state) {
+    const auto filters = makeFilters(state.range(0));
+    for (auto _ : state) {
+        CanFilterIndex index(filters);
+        benchmark::DoNotOptimize(index);
+    }
+}
+BENCHMARK(BM_BuildIndex)->RangeMultiplier(4)->Range(1, 256)->Unit(benchmark::kMillisecond);
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CanFilterIndex.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+namespace {
+
+struct Message {
+    CanMessageId id;
+    bool isRtr;
+    bool isExtendedId;
+};
+
+std::ostream& operator<<(std::ostream& os, const Message& msg) {
+    return os << std::hex << msg.id << std::dec << (msg.isExtendedId ? " extended" : "")
+              << (msg.isRtr ? " rtr" : "");
+}
+
+FilterFlag randomFlag(std::mt19937& random) {
+    switch (random() % 3) {
+        case 0:
+            return FilterFlag::SET;
+        case 1:
+            return FilterFlag::NOT_SET;
+        default:
+            return FilterFlag::DONT_CARE;
+    }
+}
+
+/**
+ * Listeners with up to 4 rules each, of all kinds: exact standard and extended ids, ranges,
+ * arbitrary masks, flag requirements, exclude rules and rules no id can satisfy. Some listeners
+ * have no rules at all.
+ */
+std::vector<hidl_vec<CanMessageFilter>> makeFilters(std::mt19937& random, size_t listeners) {
+    std::vector<hidl_vec<CanMessageFilter>> filters;
+    for (size_t i = 0; i < listeners; i++) {
+        hidl_vec<CanMessageFilter> filter(random() % 5);
+        for (auto& rule : filter) {
+            rule = {};
+            const bool isExtendedId = random() % 3 == 0;
+            const uint32_t idMask = isExtendedId ? CAN_EFF_MASK : CAN_SFF_MASK;
+            switch (random() % 5) {
+                case 0:
+                    rule.mask = 0x7F0;
+                    break;
+                case 1:
+                    rule.mask = random() & idMask;
+                    break;
+                default:
+                    rule.mask = idMask;
+            }
+            rule.id = random() & idMask;
+            if (random() % 8 != 0) rule.id &= rule.mask;
+            rule.rtr = randomFlag(random);
+            rule.extendedFormat = random() % 2 == 0 ? randomFlag(random)
+                                                    : (isExtendedId ? FilterFlag::SET
+                                                                    : FilterFlag::NOT_SET);
+            rule.exclude = random() % 4 == 0;
+        }
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+/** Every standard id and random extended ids, some of them picked to hit extended rules. */
+std::vector<Message> makeMessages(std::mt19937& random,
+                                  const std::vector<hidl_vec<CanMessageFilter>>& filters) {
+    std::vector<Message> messages;
+    for (CanMessageId id = 0; id <= CAN_SFF_MASK; id++) {
+        messages.push_back({id, false, false});
+        messages.push_back({id, true, false});
+    }
+    for (size_t i = 0; i < 2048; i++) {
+        const CanMessageId id = random() & CAN_EFF_MASK;
+        messages.push_back({id, random() % 2 == 0, true});
+    }
+    for (const auto& filter : filters) {
+        for (const auto& rule : filter) {
+            const CanMessageId id = (rule.id | (random() & ~rule.mask)) & CAN_EFF_MASK;
+            messages.push_back({id, false, true});
+            messages.push_back({id, true, true});
+        }
+    }
+    return messages;
+}
+
+std::vector<size_t> matchAll(const std::vector<hidl_vec<CanMessageFilter>>& filters,
+                             const Message& msg) {
+    std::vector<size_t> listeners;
+    for (size_t i = 0; i < filters.size(); i++) {
+        if (CanFilterIndex::match(filters[i], msg.id, msg.isRtr, msg.isExtendedId)) {
+            listeners.push_back(i);
+        }
+    }
+    return listeners;
+}
+
+bool passesKernelFilters(const std::vector<struct can_filter>& kernelFilters, const Message& msg) {
+    canid_t canId = msg.id;
+    if (msg.isExtendedId) canId |= CAN_EFF_FLAG;
+    if (msg.isRtr) canId |= CAN_RTR_FLAG;
+    for (const auto& filter : kernelFilters) {
+        if ((canId & filter.can_mask) == (filter.can_id & filter.can_mask)) return true;
+    }
+    return false;
+}
+
+TEST(CanFilterIndexTest, noListeners) {
+    CanFilterIndex index;
+    std::vector<size_t> listeners = {1, 2, 3};
+    index.findListeners(0x123, false, false, &listeners);
+    EXPECT_TRUE(listeners.empty());
+    index.findListeners(0x1234567, false, true, &listeners);
+    EXPECT_TRUE(listeners.empty());
+    EXPECT_TRUE(index.getKernelFilters().empty());
+}
+
+TEST(CanFilterIndexTest, listenerWithoutIncludeRulesAcceptsAll) {
+    hidl_vec<CanMessageFilter> excludeOnly(1);
+    excludeOnly[0] = {};
+    excludeOnly[0].id = 0x100;
+    excludeOnly[0].mask = CAN_SFF_MASK;
+    excludeOnly[0].extendedFormat = FilterFlag::NOT_SET;
+    excludeOnly[0].exclude = true;
+    CanFilterIndex index({excludeOnly});
+
+    std::vector<size_t> listeners;
+    index.findListeners(0x101, false, false, &listeners);
+    EXPECT_EQ(std::vector<size_t>({0}), listeners);
+    index.findListeners(0x100, false, false, &listeners);
+    EXPECT_TRUE(listeners.empty());
+    index.findListeners(0x100, false, true, &listeners);
+    EXPECT_EQ(std::vector<size_t>({0}), listeners);
+
+    ASSERT_EQ(1u, index.getKernelFilters().size());
+    EXPECT_EQ(0u, index.getKernelFilters()[0].can_mask);
+}
+
+TEST(CanFilterIndexTest, randomFiltersMatchLinearScan) {
+    std::mt19937 random(0);
+    for (size_t listenerCount : {1, 2, 5, 20, 100}) {
+        for (int round = 0; round < 5; round++) {
+            const auto filters = makeFilters(random, listenerCount);
+            const CanFilterIndex index(filters);
+            const auto& kernelFilters = index.getKernelFilters();
+
+            std::vector<size_t> listeners;
+            for (const auto& msg : makeMessages(random, filters)) {
+                const auto expected = matchAll(filters, msg);
+                index.findListeners(msg.id, msg.isRtr, msg.isExtendedId, &listeners);
+                ASSERT_EQ(expected, listeners) << "message " << msg;
+
+                // Kernel filters may let more through, but never drop a message that's listened to.
+                if (!expected.empty()) {
+                    ASSERT_TRUE(passesKernelFilters(kernelFilters, msg)) << "message " << msg;
+                }
+            }
+        }
+    }
+}
+
+TEST(CanFilterIndexTest, kernelFiltersOfExactRules) {
+    hidl_vec<CanMessageFilter> standard(1);
+    standard[0] = {};
+    standard[0].id = 0x123;
+    standard[0].mask = CAN_SFF_MASK;
+    standard[0].rtr = FilterFlag::NOT_SET;
+    standard[0].extendedFormat = FilterFlag::NOT_SET;
+    hidl_vec<CanMessageFilter> extended(1);
+    extended[0] = {};
+    extended[0].id = 0x1234567;
+    extended[0].mask = CAN_EFF_MASK;
+    extended[0].extendedFormat = FilterFlag::SET;
+    CanFilterIndex index({standard, extended});
+
+    const auto& kernelFilters = index.getKernelFilters();
+    ASSERT_EQ(2u, kernelFilters.size());
+    EXPECT_TRUE(passesKernelFilters(kernelFilters, {0x123, false, false}));
+    EXPECT_FALSE(passesKernelFilters(kernelFilters, {0x123, true, false}));
+    EXPECT_FALSE(passesKernelFilters(kernelFilters, {0x123, false, true}));
+    EXPECT_FALSE(passesKernelFilters(kernelFilters, {0x124, false, false}));
+    EXPECT_TRUE(passesKernelFilters(kernelFilters, {0x1234567, false, true}));
+    EXPECT_TRUE(passesKernelFilters(kernelFilters, {0x1234567, true, true}));
+    EXPECT_FALSE(passesKernelFilters(kernelFilters, {0x1234566, false, true}));
+}
+
+}  // namespace
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CanSocket.h"
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <libnetdevice/can.h>
+#include <libnetdevice/libnetdevice.h>
+#include <linux/can.h>
+#include <utils/SystemClock.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+using namespace std::chrono_literals;
+using namespace std::placeholders;
+
+/** Virtual interface created for the benchmark, so it has to run as root. */
+static const std::string kIfname = "vcanbench0";
+
+/** Counts frames delivered by CanSocket and how long it took since they were received. */
+class Receiver {
+  public:
+    void onRead(const std::vector<CanSocket::Frame>& frames) {
+        const std::chrono::nanoseconds now(elapsedRealtimeNano());
+        std::lock_guard<std::mutex> lck(mMutex);
+        mFrames += frames.size();
+        mReads++;
+        for (const auto& frame : frames) mLatency += now - frame.timestamp;
+        mFramesReceived.notify_one();
+    }
+
+    bool waitFor(uint64_t frames) {
+        std::unique_lock<std::mutex> lck(mMutex);
+        return mFramesReceived.wait_for(lck, 1s, [&] { return mFrames >= frames; });
+    }
+
+    double framesPerRead() const {
+        return static_cast<double>(mFrames) / std::max<uint64_t>(mReads, 1);
+    }
+
+    double latencyUs() const {
+        return std::chrono::duration<double, std::micro>(mLatency).count() /
+               std::max<uint64_t>(mFrames, 1);
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mFramesReceived;
+    uint64_t mFrames = 0;
+    uint64_t mReads = 0;
+    std::chrono::nanoseconds mLatency = 0ns;
+};
+
+/** Sends bursts of state.range(0) frames over vcan and waits for CanSocket to deliver them. */
+static void BM_ReceiveBursts(benchmark::State& state) {
+    if (!netdevice::exists(kIfname) && !netdevice::add(kIfname, "vcan")) {
+        state.SkipWithError("Can't create vcan interface, is the benchmark running as root?");
+        return;
+    }
+    netdevice::up(kIfname);
+
+    Receiver receiver;
+    auto socket = CanSocket::open(kIfname, std::bind(&Receiver::onRead, &receiver, _1),
+                                  [](int errnoVal) { LOG(ERROR) << "Read error " << errnoVal; });
+    auto writer = netdevice::can::socket(kIfname);
+    if (!socket || !writer.ok()) {
+        state.SkipWithError("Can't open CAN sockets");
+        netdevice::del(kIfname);
+        return;
+    }
+
+    struct canfd_frame frame = {};
+    frame.can_id = 0x123;
+    frame.len = 8;
+
+    const uint64_t burst = state.range(0);
+    uint64_t sent = 0;
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < burst; i++) {
+            frame.data[0] = i;
+            // The writer is non-blocking, just retry if the interface queue is full.
+            while (write(writer.get(), &frame, CAN_MTU) != CAN_MTU) {
+            }
+            sent++;
+        }
+        if (!receiver.waitFor(sent)) {
+            state.SkipWithError("Frames were dropped");
+            break;
+        }
+    }
+
+    socket.reset();
+    netdevice::del(kIfname);
+
+    state.SetItemsProcessed(sent);
+    state.counters["framesPerRead"] = receiver.framesPerRead();
+    state.counters["latencyUs"] = receiver.latencyUs();
+}
+BENCHMARK(BM_ReceiveBursts)->Arg(1)->Arg(16)->Arg(64)->Arg(128)->UseRealTime();
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
+
+BENCHMARK_MAIN();
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ListenerQueue.h"
+
+#include <gtest/gtest.h>
+#include <utils/SystemClock.h>
+
+#include <future>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+namespace {
+
+using namespace std::chrono_literals;
+using OverflowPolicy = ListenerQueue::OverflowPolicy;
+
+/** How long to wait for something that should happen, before failing. */
+constexpr auto kTimeout = 5s;
+
+/** How long to wait for something that shouldn't happen, before assuming it won't. */
+constexpr auto kSettleTime = 50ms;
+
+/**
+ * Listener holding up delivery until released, so that messages pile up in the queue.
+ *
+ * The first message can be used to tell when the delivery thread is stuck in onReceive, with the
+ * queue empty.
+ */
+struct GatedListener : public ICanMessageListener {
+    Return<void> onReceive(const CanMessage& message) override {
+        std::unique_lock<std::mutex> lck(mLock);
+        mReceived.push_back(message.id);
+        mChanged.notify_all();
+        mChanged.wait(lck, [this] { return mOpen; });
+        return {};
+    }
+
+    void open() {
+        std::lock_guard<std::mutex> lck(mLock);
+        mOpen = true;
+        mChanged.notify_all();
+    }
+
+    bool waitForReceived(size_t count) {
+        std::unique_lock<std::mutex> lck(mLock);
+        return mChanged.wait_for(lck, kTimeout, [&] { return mReceived.size() >= count; });
+    }
+
+    std::vector<CanMessageId> received() {
+        std::lock_guard<std::mutex> lck(mLock);
+        return mReceived;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mChanged;
+    bool mOpen = false;
+    std::vector<CanMessageId> mReceived;
+};
+
+CanSocket::Frame makeFrame(CanMessageId id) {
+    CanSocket::Frame frame = {};
+    frame.frame.can_id = id;
+    frame.frame.len = 1;
+    frame.timestamp = std::chrono::nanoseconds(elapsedRealtimeNano());
+    return frame;
+}
+
+/** Push ids [first, last] to the queue. */
+void pushRange(ListenerQueue& queue, CanMessageId first, CanMessageId last) {
+    for (auto id = first; id <= last; id++) queue.push(makeFrame(id));
+}
+
+class ListenerQueueTest : public ::testing::Test {
+  protected:
+    /** Create the queue and have its delivery thread stuck delivering message 0. */
+    void start(ListenerQueue::Config config) {
+        mQueue = std::make_unique<ListenerQueue>(mListener, config);
+        mQueue->push(makeFrame(0));
+        ASSERT_TRUE(mListener->waitForReceived(1));
+    }
+
+    void TearDown() override {
+        mListener->open();
+        mQueue.reset();
+    }
+
+    sp<GatedListener> mListener = new GatedListener;
+    std::unique_ptr<ListenerQueue> mQueue;
+};
+
+TEST_F(ListenerQueueTest, deliversInOrder) {
+    start({8, OverflowPolicy::DROP_OLDEST});
+    pushRange(*mQueue, 1, 8);
+    mListener->open();
+
+    ASSERT_TRUE(mListener->waitForReceived(9));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 1, 2, 3, 4, 5, 6, 7, 8}), mListener->received());
+    EXPECT_EQ(0u, mQueue->getStats().dropped);
+}
+
+TEST_F(ListenerQueueTest, dropOldest) {
+    start({4, OverflowPolicy::DROP_OLDEST});
+    pushRange(*mQueue, 1, 10);
+
+    auto stats = mQueue->getStats();
+    EXPECT_EQ(4u, stats.depth);
+    EXPECT_EQ(4u, stats.maxDepth);
+    EXPECT_EQ(6u, stats.dropped);
+
+    mListener->open();
+    ASSERT_TRUE(mListener->waitForReceived(5));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 7, 8, 9, 10}), mListener->received());
+}
+
+TEST_F(ListenerQueueTest, dropNewest) {
+    start({4, OverflowPolicy::DROP_NEWEST});
+    pushRange(*mQueue, 1, 10);
+
+    auto stats = mQueue->getStats();
+    EXPECT_EQ(4u, stats.depth);
+    EXPECT_EQ(6u, stats.dropped);
+
+    mListener->open();
+    ASSERT_TRUE(mListener->waitForReceived(5));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 1, 2, 3, 4}), mListener->received());
+}
+
+TEST_F(ListenerQueueTest, blockWaitsForDelivery) {
+    start({2, OverflowPolicy::BLOCK});
+    pushRange(*mQueue, 1, 2);
+
+    auto pushed = std::async(std::launch::async, [this] { mQueue->push(makeFrame(3)); });
+    EXPECT_EQ(std::future_status::timeout, pushed.wait_for(kSettleTime));
+
+    mListener->open();
+    EXPECT_EQ(std::future_status::ready, pushed.wait_for(kTimeout));
+    ASSERT_TRUE(mListener->waitForReceived(4));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 1, 2, 3}), mListener->received());
+    EXPECT_EQ(0u, mQueue->getStats().dropped);
+}
+
+TEST_F(ListenerQueueTest, stopReleasesBlockedPush) {
+    start({1, OverflowPolicy::BLOCK});
+    pushRange(*mQueue, 1, 1);
+
+    auto pushed = std::async(std::launch::async, [this] { mQueue->push(makeFrame(2)); });
+    EXPECT_EQ(std::future_status::timeout, pushed.wait_for(kSettleTime));
+
+    mQueue->stop();
+    EXPECT_EQ(std::future_status::ready, pushed.wait_for(kTimeout));
+
+    // Nothing is delivered after stopping.
+    pushRange(*mQueue, 3, 3);
+    mListener->open();
+    std::this_thread::sleep_for(kSettleTime);
+    EXPECT_EQ(std::vector<CanMessageId>({0}), mListener->received());
+}
+
+TEST_F(ListenerQueueTest, shrinkKeepsMostRecent) {
+    start({8, OverflowPolicy::DROP_OLDEST});
+    pushRange(*mQueue, 1, 6);
+
+    mQueue->setConfig({2, OverflowPolicy::DROP_OLDEST});
+    auto stats = mQueue->getStats();
+    EXPECT_EQ(2u, stats.depth);
+    EXPECT_EQ(4u, stats.dropped);
+
+    // The ring buffer wraps around at the new capacity.
+    pushRange(*mQueue, 7, 9);
+    stats = mQueue->getStats();
+    EXPECT_EQ(2u, stats.depth);
+    EXPECT_EQ(7u, stats.dropped);
+
+    mListener->open();
+    ASSERT_TRUE(mListener->waitForReceived(3));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 8, 9}), mListener->received());
+}
+
+TEST_F(ListenerQueueTest, growReleasesBlockedPush) {
+    start({1, OverflowPolicy::BLOCK});
+    pushRange(*mQueue, 1, 1);
+
+    auto pushed = std::async(std::launch::async, [this] { mQueue->push(makeFrame(2)); });
+    EXPECT_EQ(std::future_status::timeout, pushed.wait_for(kSettleTime));
+
+    mQueue->setConfig({2, OverflowPolicy::BLOCK});
+    EXPECT_EQ(std::future_status::ready, pushed.wait_for(kTimeout));
+    EXPECT_EQ(2u, mQueue->getStats().depth);
+
+    mListener->open();
+    ASSERT_TRUE(mListener->waitForReceived(3));
+    EXPECT_EQ(std::vector<CanMessageId>({0, 1, 2}), mListener->received());
+}
+
+TEST_F(ListenerQueueTest, switchToDropPolicyReleasesBlockedPush) {
+    start({1, OverflowPolicy::BLOCK});
+    pushRange(*mQueue, 1, 1);
+
+    auto pushed = std::async(std::launch::async, [this] { mQueue->push(makeFrame(2)); });
+    EXPECT_EQ(std::future_status::timeout, pushed.wait_for(kSettleTime));
+
+    mQueue->setConfig({1, OverflowPolicy::DROP_OLDEST});
+    EXPECT_EQ(std::future_status::ready, pushed.wait_for(kTimeout));
+}
+
+TEST(ListenerQueueParseTest, overflowPolicy) {
+    for (auto policy : {OverflowPolicy::DROP_OLDEST, OverflowPolicy::DROP_NEWEST,
+                        OverflowPolicy::BLOCK}) {
+        EXPECT_EQ(policy, ListenerQueue::parseOverflowPolicy(toString(policy)));
+    }
+    EXPECT_FALSE(ListenerQueue::parseOverflowPolicy("drop"));
+}
+
+}  // namespace
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -16,16 +16,20 @@
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
+#include <cutils/native_handle.h>
 #include <hidl-utils/hidl-utils.h>
 #include <libcanhaltools/libcanhaltools.h>
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace android::hardware::automotive::can {
 
+using ICanBus = V1_0::ICanBus;
 using ICanController = V1_0::ICanController;
 
 static void usage() {
@@ -41,6 +45,16 @@ static void usage() {
     std::cerr << "canhalctrl down <bus name>" << std::endl;
     std::cerr << "where:" << std::endl;
     std::cerr << " bus name - name under which ICanBus will be published" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "canhalctrl stats <bus name>" << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " bus name - name under which ICanBus is published" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "canhalctrl queue <bus name> <capacity> <policy>" << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " bus name - name under which ICanBus is published" << std::endl;
+    std::cerr << " capacity - number of messages each listener can fall behind by" << std::endl;
+    std::cerr << " policy - one of: drop-oldest, drop-newest, block" << std::endl;
 }
 
 static int up(const std::string& busName, ICanController::InterfaceType type,
@@ -108,6 +122,29 @@ static int down(const std::string& busName) {
     return -1;
 }
 
+/**
+ * Run a debug command of the bus, see CanBus::debug, printing its output to stdout.
+ */
+static int debugBus(const std::string& busName, const std::vector<std::string>& options) {
+    auto bus = ICanBus::getService(busName);
+    if (bus == nullptr) {
+        std::cerr << "Bus " << busName << " is not available" << std::endl;
+        return -1;
+    }
+
+    native_handle_t* handle = native_handle_create(1, 0);
+    handle->data[0] = dup(STDOUT_FILENO);
+    hidl_handle fd;
+    fd.setTo(handle, true);
+
+    const auto ret = bus->debug(fd, hidl_vec<hidl_string>(options.begin(), options.end()));
+    if (!ret.isOk()) {
+        std::cerr << "Failed to query bus " << busName << ": " << ret.description() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
 static std::optional<ICanController::InterfaceType> parseInterfaceType(const std::string& str) {
     if (str == "virtual") return ICanController::InterfaceType::VIRTUAL;
     if (str == "socketcan") return ICanController::InterfaceType::SOCKETCAN;
@@ -163,6 +200,22 @@ static int main(int argc, char* argv[]) {
         }
 
         return down(argv[0]);
+    } else if (cmd == "stats") {
+        if (argc != 1) {
+            std::cerr << "Invalid number of arguments to stats command: " << argc << std::endl;
+            usage();
+            return -1;
+        }
+
+        return debugBus(argv[0], {});
+    } else if (cmd == "queue") {
+        if (argc != 3) {
+            std::cerr << "Invalid number of arguments to queue command: " << argc << std::endl;
+            usage();
+            return -1;
+        }
+
+        return debugBus(argv[0], {"--queue", argv[1], argv[2]});
     } else {
         std::cerr << "Invalid command: " << cmd << std::endl;
         usage();
@@ -15,44 +15,95 @@
  */
 
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanMessageListener.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
 #include <hidl-utils/hidl-utils.h>
+#include <libcanhaltools/CanCapture.h>
 
 #include <linux/can.h>
-#include <chrono>
-#include <iomanip>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <string>
-#include <thread>
 
 namespace android::hardware::automotive::can {
 
-using namespace std::chrono_literals;
-
 using ICanBus = V1_0::ICanBus;
 using Result = V1_0::Result;
 
+using libcanhaltools::CanCapture;
+using libcanhaltools::CanCaptureReader;
+using libcanhaltools::CanCaptureWriter;
+
+/** Default number of messages in a capture, 80MB worth of records. */
+static constexpr uint64_t kDefaultCaptureCapacity = 1 << 20;
+
+/**
+ * Print a message in the same format as candump.
+ *
+ * Lines are formatted by hand and written with a single fwrite, since iostream formatting can't keep
+ * up with a busy bus. stdout is only flushed on every line if it's a terminal.
+ */
+static void printMessage(const std::string& busName, const V1_0::CanMessage& message) {
+    static constexpr char kHex[] = "0123456789ABCDEF";
+    char line[64 + CanCapture::kMaxPayload * 3];
+    const size_t maxPos = sizeof(line) - 1;  // leave space for the newline
+    size_t pos = 0;
+    const auto append = [&](const char* str, size_t len) {
+        len = std::min(len, maxPos - pos);
+        memcpy(line + pos, str, len);
+        pos += len;
+    };
+    const auto appendHex = [&](uint32_t value, int digits) {
+        for (int i = digits - 1; i >= 0 && pos < maxPos; i--) {
+            line[pos++] = kHex[(value >> (i * 4)) & 0xF];
+        }
+    };
+
+    append("  ", 2);
+    append(busName.c_str(), busName.size());
+    append("  ", 2);
+    appendHex(message.id, message.isExtendedId ? 8 : 3);
+    const auto length = std::to_string(message.payload.size());
+    append("   [", 4);
+    append(length.c_str(), length.size());
+    append("] ", 2);
+    if (message.remoteTransmissionRequest) {
+        append("remote request", 14);
+    } else {
+        for (const auto byte : message.payload) {
+            append(" ", 1);
+            appendHex(byte, 2);
+        }
+    }
+    line[pos++] = '\n';
+    fwrite(line, 1, pos, stdout);
+}
+
 struct CanMessageListener : public V1_0::ICanMessageListener {
     const std::string name;
+    const uint8_t busIndex;
+    CanCaptureWriter* const capture;
 
-    CanMessageListener(std::string name) : name(name) {}
+    /**
+     * \param name Bus name, to print with the messages
+     * \param busIndex Index of the bus in the capture
+     * \param capture Capture to write messages to, or nullptr to print them
+     */
+    CanMessageListener(std::string name, uint8_t busIndex, CanCaptureWriter* capture)
+        : name(name), busIndex(busIndex), capture(capture) {}
 
     virtual Return<void> onReceive(const V1_0::CanMessage& message) {
-        int msgIdWidth = 3;
-        if (message.isExtendedId) msgIdWidth = 8;
-        std::cout << "  " << name << "  " << std::hex << std::uppercase << std::setw(msgIdWidth)
-                  << std::setfill('0') << message.id << std::setw(0);
-        std::cout << "   [" << message.payload.size() << "] ";
-        if (message.remoteTransmissionRequest) {
-            std::cout << "remote request";
+        if (capture != nullptr) {
+            capture->write(busIndex, message);
         } else {
-            for (const auto byte : message.payload) {
-                std::cout << " " << std::setfill('0') << std::setw(2) << unsigned(byte);
-            }
+            printMessage(name, message);
         }
-        std::cout << std::nouppercase << std::dec << std::endl;
         return {};
     }
 
@@ -65,9 +116,13 @@ struct CanMessageListener : public V1_0::ICanMessageListener {
 static void usage() {
     std::cerr << "canhaldump - dump CAN bus traffic" << std::endl;
     std::cerr << std::endl << "usage:" << std::endl << std::endl;
-    std::cerr << "canhaldump <bus name>" << std::endl;
+    std::cerr << "canhaldump <bus name>... [-w <capture file> [-s <capacity>]]" << std::endl;
+    std::cerr << "canhaldump -r <capture file>" << std::endl;
     std::cerr << "where:" << std::endl;
     std::cerr << " bus name - name under which ICanBus is be published" << std::endl;
+    std::cerr << " capture file - binary capture to write or print, see canhalreplay" << std::endl;
+    std::cerr << " capacity - number of messages kept in the capture, after which the oldest ones"
+              << " are overwritten (default: " << kDefaultCaptureCapacity << ")" << std::endl;
 }
 
 // TODO(b/135918744): extract to a new library
@@ -87,24 +142,77 @@ static sp<ICanBus> tryOpen(const std::string& busname) {
     return ICanBus::castFrom(ret);
 }
 
-static int candump(const std::string& busname) {
-    auto bus = tryOpen(busname);
-    if (bus == nullptr) {
-        std::cerr << "Bus " << busname << " is not available" << std::endl;
-        return -1;
+static int candump(const std::vector<std::string>& busNames, const std::string& capturePath,
+                   uint64_t captureCapacity) {
+    std::unique_ptr<CanCaptureWriter> capture;
+    if (!capturePath.empty()) {
+        capture = CanCaptureWriter::create(capturePath, busNames, captureCapacity);
+        if (!capture) {
+            std::cerr << "Can't create capture file " << capturePath << std::endl;
+            return -1;
+        }
+    } else if (isatty(STDOUT_FILENO)) {
+        setlinebuf(stdout);
     }
 
-    Result result;
-    sp<V1_0::ICloseHandle> chnd;
-    // TODO(b/135918744): extract to library
-    bus->listen({}, new CanMessageListener(busname), hidl_utils::fill(&result, &chnd)).assertOk();
+    /* Block termination signals before any HIDL threads are started, so that they are only handled
+     * below and the capture can be closed properly. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<sp<V1_0::ICloseHandle>> closeHandles;
+    for (size_t i = 0; i < busNames.size(); i++) {
+        const auto& busname = busNames[i];
+        auto bus = tryOpen(busname);
+        if (bus == nullptr) {
+            std::cerr << "Bus " << busname << " is not available" << std::endl;
+            return -1;
+        }
+
+        Result result;
+        sp<V1_0::ICloseHandle> chnd;
+        // TODO(b/135918744): extract to library
+        bus->listen({}, new CanMessageListener(busname, i, capture.get()),
+                    hidl_utils::fill(&result, &chnd))
+                .assertOk();
 
-    if (result != Result::OK) {
-        std::cerr << "Listen call failed: " << toString(result) << std::endl;
+        if (result != Result::OK) {
+            std::cerr << "Listen call failed: " << toString(result) << std::endl;
+            return -1;
+        }
+        closeHandles.push_back(chnd);
+    }
+
+    int signal;
+    sigwait(&signals, &signal);
+
+    for (auto& chnd : closeHandles) chnd->close();
+    fflush(stdout);
+    if (capture) {
+        capture->close();
+        std::cerr << "Captured " << capture->getWritten() << " messages to " << capturePath
+                  << std::endl;
+    }
+    return 0;
+}
+
+static int printCapture(const std::string& path) {
+    const auto capture = CanCaptureReader::open(path);
+    if (!capture) {
+        std::cerr << "Can't read capture file " << path << std::endl;
         return -1;
     }
 
-    while (true) std::this_thread::sleep_for(1h);
+    const auto& busNames = capture->getBusNames();
+    for (uint64_t i = 0; i < capture->size(); i++) {
+        const auto& record = (*capture)[i];
+        const auto busName = record.bus < busNames.size() ? busNames[record.bus] : "?";
+        printMessage(busName, CanCapture::toCanMessage(record));
+    }
+    return 0;
 }
 
 static int main(int argc, char* argv[]) {
@@ -116,13 +224,44 @@ static int main(int argc, char* argv[]) {
         return 0;
     }
 
-    if (argc != 1) {
-        std::cerr << "Invalid number of arguments" << std::endl;
+    if (std::string(argv[0]) == "-r") {
+        if (argc != 2) {
+            std::cerr << "Invalid number of arguments" << std::endl;
+            usage();
+            return -1;
+        }
+        return printCapture(argv[1]);
+    }
+
+    std::vector<std::string> busNames;
+    std::string capturePath;
+    uint64_t captureCapacity = kDefaultCaptureCapacity;
+    for (int i = 0; i < argc; i++) {
+        const std::string arg(argv[i]);
+        if (arg == "-w" && i + 1 < argc) {
+            capturePath = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            if (!base::ParseUint(argv[++i], &captureCapacity) || captureCapacity == 0) {
+                std::cerr << "Invalid capture capacity: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (!arg.empty() && arg[0] != '-') {
+            busNames.push_back(arg);
+        } else {
+            std::cerr << "Invalid argument: " << arg << std::endl;
+            usage();
+            return -1;
+        }
+    }
+
+    if (busNames.empty() || busNames.size() > CanCapture::kMaxBuses) {
+        std::cerr << "Invalid number of buses, must be between 1 and " << CanCapture::kMaxBuses
+                  << std::endl;
         usage();
         return -1;
     }
 
-    return candump(argv[0]);
+    return candump(busNames, capturePath, captureCapacity);
 }
 
 }  // namespace android::hardware::automotive::can
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+#include <libcanhaltools/CanCapture.h>
+#include <libnetdevice/can.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace android::hardware::automotive::can {
+
+using namespace std::chrono_literals;
+using libcanhaltools::CanCapture;
+using libcanhaltools::CanCaptureReader;
+
+/** Maximum number of frames that are due at once sent with a single system call. */
+static constexpr size_t kMaxBurst = 64;
+
+/** How long to wait for the interface transmit queue to drain before retrying. */
+static constexpr auto kSendRetryDelay = 100us;
+
+static void usage() {
+    std::cerr << "canhalreplay - replay CAN bus traffic captured with canhaldump" << std::endl;
+    std::cerr << std::endl << "usage:" << std::endl << std::endl;
+    std::cerr << "canhalreplay <capture file> <interface> [-b <bus name>] [-x <speed>]"
+              << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " capture file - written with canhaldump -w" << std::endl;
+    std::cerr << " interface - SocketCAN interface of the bus to replay onto, such as the vcan"
+              << " interface of a virtual bus brought up with canhalctrl. CAN FD frames are only"
+              << " replayed if it supports them" << std::endl;
+    std::cerr << " bus name - only replay messages captured on this bus" << std::endl;
+    std::cerr << " speed - playback speed multiplier, 0 to send as fast as possible (default: 1)"
+              << std::endl;
+}
+
+static struct canfd_frame toFrame(const CanCapture::Record& record) {
+    struct canfd_frame frame = {};
+    frame.can_id = record.id;
+    if ((record.flags & CanCapture::kFlagExtendedId) != 0) frame.can_id |= CAN_EFF_FLAG;
+    if ((record.flags & CanCapture::kFlagRemoteTransmissionRequest) != 0) {
+        frame.can_id |= CAN_RTR_FLAG;
+    }
+    frame.len = std::min<uint8_t>(record.length, CanCapture::kMaxPayload);
+    memcpy(frame.data, record.payload, frame.len);
+    return frame;
+}
+
+/**
+ * Enable sending CAN FD frames on the socket, if the interface supports them.
+ *
+ * \return Whether frames with payloads over 8 bytes can be sent
+ */
+static bool enableFdFrames(int sock, const std::string& ifname) {
+    struct ifreq ifr = {};
+    strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFMTU, &ifr) != 0 || ifr.ifr_mtu != CANFD_MTU) return false;
+
+    const int enable = 1;
+    return setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) == 0;
+}
+
+/** Send all frames, waiting for the transmit queue to drain if it's full. */
+static bool sendAll(int sock, struct mmsghdr* msgs, size_t count) {
+    size_t sent = 0;
+    while (sent < count) {
+        const auto res = sendmmsg(sock, msgs + sent, count - sent, 0);
+        if (res > 0) {
+            sent += res;
+        } else if (res < 0 && (errno == EAGAIN || errno == ENOBUFS || errno == EINTR)) {
+            std::this_thread::sleep_for(kSendRetryDelay);
+        } else {
+            PLOG(ERROR) << "Failed to send frames";
+            return false;
+        }
+    }
+    return true;
+}
+
+static int canreplay(const std::string& path, const std::string& ifname,
+                     const std::optional<std::string>& busName, double speed) {
+    const auto capture = CanCaptureReader::open(path);
+    if (!capture) {
+        std::cerr << "Can't read capture file " << path << std::endl;
+        return -1;
+    }
+
+    std::optional<uint8_t> busIndex;
+    if (busName) {
+        const auto& names = capture->getBusNames();
+        const auto it = std::find(names.begin(), names.end(), *busName);
+        if (it == names.end()) {
+            std::cerr << "Bus " << *busName << " is not in the capture" << std::endl;
+            return -1;
+        }
+        busIndex = it - names.begin();
+    }
+
+    auto sock = netdevice::can::socket(ifname);
+    if (!sock.ok()) {
+        std::cerr << "Can't open interface " << ifname << std::endl;
+        return -1;
+    }
+
+    const bool fdEnabled = enableFdFrames(sock.get(), ifname);
+
+    struct canfd_frame frames[kMaxBurst];
+    struct iovec iovs[kMaxBurst];
+    struct mmsghdr msgs[kMaxBurst] = {};
+    for (size_t i = 0; i < kMaxBurst; i++) {
+        iovs[i] = {&frames[i], CAN_MTU};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Each frame is sent when as much time has passed since the start of the replay as between
+     * the first captured frame and its own, so that delays don't accumulate. */
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<uint64_t> firstTimestamp;
+    const auto getDueTime = [&](const CanCapture::Record& record) {
+        if (speed == 0) return std::chrono::nanoseconds(0);
+        // Timestamps of different buses may be slightly out of order, hence the signed difference.
+        const auto offset = static_cast<int64_t>(record.timestamp - *firstTimestamp);
+        return std::chrono::nanoseconds(static_cast<int64_t>(offset / speed));
+    };
+
+    uint64_t sent = 0;
+    uint64_t skipped = 0;
+    std::chrono::nanoseconds totalLateness = {};
+    std::chrono::nanoseconds maxLateness = {};
+    uint64_t i = 0;
+    while (i < capture->size()) {
+        const auto& record = (*capture)[i];
+        if (busIndex && record.bus != *busIndex) {
+            i++;
+            continue;
+        }
+        if (!firstTimestamp) firstTimestamp = record.timestamp;
+        std::this_thread::sleep_until(start + getDueTime(record));
+
+        // Send every frame that's due by now with a single system call.
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        size_t count = 0;
+        for (; i < capture->size() && count < kMaxBurst; i++) {
+            const auto& next = (*capture)[i];
+            if (busIndex && next.bus != *busIndex) continue;
+            const auto nextDue = getDueTime(next);
+            if (nextDue > elapsed) break;
+
+            // CAN FD frames don't fit in a classic frame, so they're only sent if the bus has FD.
+            const bool isFd = next.length > CAN_MAX_DLEN;
+            if (isFd && !fdEnabled) {
+                skipped++;
+                continue;
+            }
+            iovs[count].iov_len = isFd ? CANFD_MTU : CAN_MTU;
+            frames[count++] = toFrame(next);
+            const auto lateness = elapsed - nextDue;
+            totalLateness += lateness;
+            maxLateness = std::max(maxLateness, lateness);
+        }
+
+        if (!sendAll(sock.get(), msgs, count)) break;
+        sent += count;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const auto us = [](std::chrono::nanoseconds time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+    };
+    std::cout << "Replayed " << sent << " frames in " << elapsed.count() << "s ("
+              << static_cast<uint64_t>(sent / elapsed.count()) << " frames/s), lateness avg/max: "
+              << us(sent > 0 ? totalLateness / static_cast<int64_t>(sent) : totalLateness) << "/"
+              << us(maxLateness) << "us" << std::endl;
+    if (skipped > 0) {
+        std::cerr << "Skipped " << skipped << " frames with payloads over " << CAN_MAX_DLEN
+                  << " bytes, since " << ifname << " doesn't support CAN FD" << std::endl;
+    }
+    return sent > 0 ? 0 : -1;
+}
+
+static int main(int argc, char* argv[]) {
+    base::SetDefaultTag("CanHalReplay");
+    base::SetMinimumLogSeverity(android::base::VERBOSE);
+
+    if (argc == 0) {
+        usage();
+        return 0;
+    }
+
+    if (argc < 2 || argc % 2 != 0) {
+        std::cerr << "Invalid number of arguments" << std::endl;
+        usage();
+        return -1;
+    }
+
+    std::optional<std::string> busName;
+    double speed = 1;
+    for (int i = 2; i < argc; i += 2) {
+        const std::string arg(argv[i]);
+        if (arg == "-b") {
+            busName = argv[i + 1];
+        } else if (arg == "-x") {
+            char* end;
+            speed = strtod(argv[i + 1], &end);
+            if (*end != '\0' || speed < 0) {
+                std::cerr << "Invalid speed: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else {
+            std::cerr << "Invalid argument: " << arg << std::endl;
+            usage();
+            return -1;
+        }
+    }
+
+    return canreplay(argv[0], argv[1], busName, speed);
+}
+
+}  // namespace android::hardware::automotive::can
+
+int main(int argc, char* argv[]) {
+    if (argc < 1) return -1;
+    return ::android::hardware::automotive::can::main(--argc, ++argv);
+}
@@ -14,12 +14,17 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
-#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
+#include <cutils/native_handle.h>
+#include <libcanhaltools/libcanhaltools.h>
+#include <fcntl.h>
 
+#include <chrono>
 #include <iostream>
 #include <string>
 
@@ -31,11 +36,17 @@ using Result = V1_0::Result;
 static void usage() {
     std::cerr << "canhalsend - simple command line tool to send raw CAN frames" << std::endl;
     std::cerr << std::endl << "usage:" << std::endl << std::endl;
-    std::cerr << "canhalsend <bus name> <can id>#<data>" << std::endl;
+    std::cerr << "canhalsend <bus name> <can id>#<data> [-n <count> [-b <burst size>]]" << std::endl;
+    std::cerr << "canhalsend <bus name> <can id>#<data> -p <period ms>" << std::endl;
     std::cerr << "where:" << std::endl;
     std::cerr << " bus name - name under which ICanBus is published" << std::endl;
     std::cerr << " can id - such as 1a5 or 1fab5982" << std::endl;
     std::cerr << " data - such as deadbeef, 010203, or R for a remote frame" << std::endl;
+    std::cerr << " count - send the frame this many times and report the send rate" << std::endl;
+    std::cerr << " burst size - send up to this many frames per call, with a single system call"
+              << std::endl;
+    std::cerr << " period ms - have the HAL send the frame periodically, or stop it if 0"
+              << std::endl;
 }
 
 // TODO(b/135918744): extract to a new library
@@ -70,54 +81,100 @@ static int cansend(const std::string& busname, const V1_0::CanMessage& msg) {
     return 0;
 }
 
-static std::optional<V1_0::CanMessage> parseCanMessage(const std::string& msg) {
-    const auto hashpos = msg.find("#");
-    if (hashpos == std::string::npos) return std::nullopt;
-
-    const std::string msgidStr = msg.substr(0, hashpos);
-    const std::string payloadStr = msg.substr(hashpos + 1);
+/**
+ * Run a debug command of the bus, see CanBus::debug.
+ *
+ * \return Output of the command, or nullopt in case of failure
+ */
+static std::optional<std::string> debugBus(const sp<ICanBus>& bus,
+                                           const std::vector<std::string>& options) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        std::cerr << "Failed to create a pipe" << std::endl;
+        return std::nullopt;
+    }
+    base::unique_fd readFd(fds[0]);
+    {
+        native_handle_t* handle = native_handle_create(1, 0);
+        handle->data[0] = fds[1];
+        hidl_handle fd;
+        fd.setTo(handle, true);  // closes the write end once the command is done
+
+        const auto ret = bus->debug(fd, hidl_vec<hidl_string>(options.begin(), options.end()));
+        if (!ret.isOk()) {
+            std::cerr << "Debug call failed: " << ret.description() << std::endl;
+            return std::nullopt;
+        }
+    }
 
-    V1_0::CanMessageId msgid;
-    // "0x" must be prepended to msgidStr, since ParseUint doesn't accept a base argument.
-    if (!android::base::ParseUint("0x" + msgidStr, &msgid)) return std::nullopt;
+    std::string output;
+    if (!base::ReadFdToString(readFd, &output)) return std::nullopt;
+    return output;
+}
 
-    V1_0::CanMessage canmsg = {};
-    canmsg.id = msgid;
-    if (msgid > 0x7FF) {
-        canmsg.isExtendedId = true;
+static int cansendCyclic(const std::string& busname, const std::string& msg, uint32_t periodMs) {
+    auto bus = tryOpen(busname);
+    if (bus == nullptr) {
+        std::cerr << "Bus " << busname << " is not available" << std::endl;
+        return -1;
     }
 
-    if (android::base::StartsWith(payloadStr, "R")) {
-        canmsg.remoteTransmissionRequest = true;
-
-        /* The CAN bus HAL doesn't define a data length code (DLC) field, since it is inferrred
-         * from the payload size. RTR messages indicate to the receiver how many bytes they are
-         * expecting to receive back via the DLC sent with the RTR frame. */
-        if (payloadStr.size() <= 1) return canmsg;
+    auto output = periodMs > 0 ? debugBus(bus, {"--send-cyclic", msg, std::to_string(periodMs)})
+                               : debugBus(bus, {"--stop-cyclic", msg});
+    if (!output) return -1;
+    const auto status = libcanhaltools::parseSendStatus(&*output);
+    std::cout << *output;
+    if (!status) {
+        std::cerr << "Bus " << busname << " doesn't support cyclic messages" << std::endl;
+        return -1;
+    }
+    return status->result == Result::OK ? 0 : -1;
+}
 
-        unsigned int dlc = 0;
+/**
+ * Send a frame count times, either one by one with ICanBus::send, or in bursts of burstSize frames
+ * with a single system call each. The latter isn't part of ICanBus, so it's run as a debug command.
+ */
+static int cansendLoad(const std::string& busname, const std::string& msgStr,
+                       const V1_0::CanMessage& msg, size_t count, size_t burstSize) {
+    auto bus = tryOpen(busname);
+    if (bus == nullptr) {
+        std::cerr << "Bus " << busname << " is not available" << std::endl;
+        return -1;
+    }
 
-        /* The maximum DLC for CAN-FD is 64 bytes and CAN 2.0 is 8 bytes. Limit the size of the DLC
-         * to something memory safe and let the HAL determine if the DLC is valid. */
-        if (!android::base::ParseUint(payloadStr.substr(1), &dlc, 10000u)) {
-            std::cerr << "Invalid DLC for RTR frame!" << std::endl;
-            return std::nullopt;
+    size_t sent = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (sent < count) {
+        if (burstSize <= 1) {
+            const auto result = bus->send(msg);
+            if (result != Result::OK) {
+                std::cerr << "Send call failed: " << toString(result) << std::endl;
+                break;
+            }
+            sent++;
+            continue;
         }
-        canmsg.payload.resize(dlc);
-        return canmsg;
-    }
 
-    std::vector<uint8_t> payload;
-    if (payloadStr.size() % 2 != 0) return std::nullopt;
-    for (size_t i = 0; i < payloadStr.size(); i += 2) {
-        std::string byteStr(payloadStr, i, 2);
-        uint8_t byteBuf;
-        if (!android::base::ParseUint("0x" + byteStr, &byteBuf)) return std::nullopt;
-        payload.emplace_back(byteBuf);
+        const auto burst = std::min(burstSize, count - sent);
+        auto output = debugBus(bus, {"--send-burst", msgStr, std::to_string(burst)});
+        if (!output) break;
+        const auto status = libcanhaltools::parseSendStatus(&*output);
+        if (!status) {
+            std::cerr << "Bus " << busname << " doesn't support sending bursts" << std::endl;
+            break;
+        }
+        sent += status->sent;
+        if (status->result != Result::OK) {
+            std::cerr << "Burst send failed: " << *output;
+            break;
+        }
     }
-    canmsg.payload = payload;
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-    return canmsg;
+    std::cout << "Sent " << sent << " of " << count << " frames in " << elapsed.count() << "s ("
+              << static_cast<uint64_t>(sent / elapsed.count()) << " frames/s)" << std::endl;
+    return sent == count ? 0 : -1;
 }
 
 static int main(int argc, char* argv[]) {
@@ -129,20 +186,49 @@ static int main(int argc, char* argv[]) {
         return 0;
     }
 
-    if (argc != 2) {
+    if (argc != 2 && argc != 4 && argc != 6) {
         std::cerr << "Invalid number of arguments" << std::endl;
         usage();
         return -1;
     }
 
     std::string busname(argv[0]);
-    const auto canmsg = parseCanMessage(argv[1]);
+    const std::string msgStr(argv[1]);
+    const auto canmsg = libcanhaltools::parseCanMessage(msgStr);
     if (!canmsg) {
         std::cerr << "Failed to parse CAN message argument" << std::endl;
         return -1;
     }
 
-    return cansend(busname, *canmsg);
+    if (argc == 2) return cansend(busname, *canmsg);
+
+    const std::string mode(argv[2]);
+    if (mode == "-p" && argc == 4) {
+        uint32_t periodMs;
+        if (!android::base::ParseUint(argv[3], &periodMs)) {
+            std::cerr << "Invalid period: " << argv[3] << std::endl;
+            return -1;
+        }
+        return cansendCyclic(busname, msgStr, periodMs);
+    }
+    if (mode != "-n" || (argc == 6 && std::string(argv[4]) != "-b")) {
+        std::cerr << "Invalid arguments" << std::endl;
+        usage();
+        return -1;
+    }
+
+    size_t count;
+    if (!android::base::ParseUint(argv[3], &count) || count == 0) {
+        std::cerr << "Invalid count: " << argv[3] << std::endl;
+        return -1;
+    }
+    size_t burstSize = 1;
+    if (argc == 6 && (!android::base::ParseUint(argv[5], &burstSize) || burstSize == 0)) {
+        std::cerr << "Invalid burst size: " << argv[5] << std::endl;
+        return -1;
+    }
+
+    return cansendLoad(busname, msgStr, *canmsg, count, burstSize);
 }
 
 }  // namespace android::hardware::automotive::can
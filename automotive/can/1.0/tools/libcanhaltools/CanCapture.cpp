@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libcanhaltools/CanCapture.h"
+
+#include <android-base/logging.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace android::hardware::automotive::can::libcanhaltools {
+
+static_assert(sizeof(CanCapture::Header) % alignof(CanCapture::Record) == 0,
+              "Records must be aligned after the header");
+
+static size_t fileSize(uint64_t capacity) {
+    return sizeof(CanCapture::Header) + capacity * sizeof(CanCapture::Record);
+}
+
+static CanCapture::Record* getRecords(CanCapture::Header* header) {
+    return reinterpret_cast<CanCapture::Record*>(header + 1);
+}
+
+void CanCapture::toRecord(const V1_0::CanMessage& message, uint8_t bus, Record* record) {
+    record->timestamp = message.timestamp;
+    record->id = message.id;
+    record->bus = bus;
+    record->flags = (message.isExtendedId ? kFlagExtendedId : 0) |
+                    (message.remoteTransmissionRequest ? kFlagRemoteTransmissionRequest : 0);
+    record->length = std::min(message.payload.size(), kMaxPayload);
+    record->reserved = 0;
+    if (record->length > 0) memcpy(record->payload, message.payload.data(), record->length);
+}
+
+V1_0::CanMessage CanCapture::toCanMessage(const Record& record) {
+    V1_0::CanMessage message = {};
+    message.id = record.id;
+    message.timestamp = record.timestamp;
+    message.isExtendedId = (record.flags & kFlagExtendedId) != 0;
+    message.remoteTransmissionRequest = (record.flags & kFlagRemoteTransmissionRequest) != 0;
+    // The length comes from the file, which may be corrupt or still being written.
+    const auto length = std::min(size_t{record.length}, kMaxPayload);
+    message.payload = std::vector<uint8_t>(record.payload, record.payload + length);
+    return message;
+}
+
+std::unique_ptr<CanCaptureWriter> CanCaptureWriter::create(const std::string& path,
+                                                           const std::vector<std::string>& busNames,
+                                                           uint64_t capacity) {
+    if (busNames.size() > CanCapture::kMaxBuses) {
+        LOG(ERROR) << "Can't capture more than " << CanCapture::kMaxBuses << " buses";
+        return nullptr;
+    }
+    if (capacity == 0) {
+        LOG(ERROR) << "Capture capacity must not be zero";
+        return nullptr;
+    }
+
+    base::unique_fd fd(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Can't create capture file " << path;
+        return nullptr;
+    }
+
+    // The file is sparse, so a large capacity doesn't take any space until it's used.
+    const auto size = fileSize(capacity);
+    if (ftruncate(fd.get(), size) != 0) {
+        PLOG(ERROR) << "Can't resize capture file " << path;
+        return nullptr;
+    }
+    auto map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "Can't map capture file " << path;
+        return nullptr;
+    }
+
+    auto header = static_cast<CanCapture::Header*>(map);
+    memcpy(header->magic, CanCapture::kMagic, sizeof(CanCapture::kMagic));
+    header->version = CanCapture::kVersion;
+    header->recordSize = sizeof(CanCapture::Record);
+    header->capacity = capacity;
+    header->written = 0;
+    for (size_t i = 0; i < busNames.size(); i++) {
+        strncpy(header->busNames[i], busNames[i].c_str(), CanCapture::kMaxBusNameLength);
+    }
+
+    // Can't use std::make_unique due to private CanCaptureWriter constructor.
+    return std::unique_ptr<CanCaptureWriter>(new CanCaptureWriter(std::move(fd), header, size));
+}
+
+CanCaptureWriter::CanCaptureWriter(base::unique_fd fd, CanCapture::Header* header,
+                                   size_t mappedSize)
+    : mFd(std::move(fd)), mHeader(header), mMappedSize(mappedSize) {}
+
+CanCaptureWriter::~CanCaptureWriter() {
+    close();
+}
+
+void CanCaptureWriter::write(uint8_t bus, const V1_0::CanMessage& message) {
+    std::lock_guard<std::mutex> lck(mLock);
+    if (mHeader == nullptr) return;
+
+    auto& record = getRecords(mHeader)[mHeader->written % mHeader->capacity];
+    CanCapture::toRecord(message, bus, &record);
+    mHeader->written++;
+}
+
+void CanCaptureWriter::close() {
+    std::lock_guard<std::mutex> lck(mLock);
+    if (mHeader == nullptr) return;
+
+    const auto written = mHeader->written;
+    const bool trim = written < mHeader->capacity;
+    if (trim) mHeader->capacity = written;
+
+    if (msync(mHeader, mMappedSize, MS_SYNC) != 0) PLOG(ERROR) << "Can't flush capture file";
+    munmap(mHeader, mMappedSize);
+    mHeader = nullptr;
+
+    if (trim && ftruncate(mFd.get(), fileSize(written)) != 0) {
+        PLOG(ERROR) << "Can't trim capture file";
+    }
+}
+
+uint64_t CanCaptureWriter::getWritten() const {
+    std::lock_guard<std::mutex> lck(mLock);
+    return mHeader == nullptr ? 0 : mHeader->written;
+}
+
+std::unique_ptr<CanCaptureReader> CanCaptureReader::open(const std::string& path) {
+    base::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Can't open capture file " << path;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0) {
+        PLOG(ERROR) << "Can't stat capture file " << path;
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    if (size < sizeof(CanCapture::Header)) {
+        LOG(ERROR) << path << " is too short to be a capture file";
+        return nullptr;
+    }
+
+    auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "Can't map capture file " << path;
+        return nullptr;
+    }
+    // Can't use std::make_unique due to private CanCaptureReader constructor.
+    std::unique_ptr<CanCaptureReader> reader(new CanCaptureReader(map, size));
+
+    const auto& header = *static_cast<const CanCapture::Header*>(map);
+    if (memcmp(header.magic, CanCapture::kMagic, sizeof(CanCapture::kMagic)) != 0 ||
+        header.version != CanCapture::kVersion ||
+        header.recordSize != sizeof(CanCapture::Record)) {
+        LOG(ERROR) << path << " is not a supported capture file";
+        return nullptr;
+    }
+    if (header.capacity > (size - sizeof(CanCapture::Header)) / sizeof(CanCapture::Record)) {
+        LOG(ERROR) << "Capture file " << path << " is truncated";
+        return nullptr;
+    }
+    // Empty captures are trimmed to no records at all when closed.
+    if (header.capacity == 0 && header.written != 0) {
+        LOG(ERROR) << "Capture file " << path << " has no room for its records";
+        return nullptr;
+    }
+
+    reader->mCapacity = header.capacity;
+    reader->mSize = std::min(header.written, header.capacity);
+    reader->mFirst = header.written > header.capacity ? header.written % header.capacity : 0;
+    for (const auto& name : header.busNames) {
+        if (name[0] == '\0') break;
+        reader->mBusNames.emplace_back(name, strnlen(name, sizeof(name)));
+    }
+    return reader;
+}
+
+CanCaptureReader::CanCaptureReader(const void* map, size_t mappedSize)
+    : mMap(map),
+      mMappedSize(mappedSize),
+      mRecords(reinterpret_cast<const CanCapture::Record*>(
+              static_cast<const CanCapture::Header*>(map) + 1)),
+      mCapacity(0),
+      mFirst(0),
+      mSize(0) {}
+
+CanCaptureReader::~CanCaptureReader() {
+    munmap(const_cast<void*>(mMap), mMappedSize);
+}
+
+const std::vector<std::string>& CanCaptureReader::getBusNames() const {
+    return mBusNames;
+}
+
+uint64_t CanCaptureReader::size() const {
+    return mSize;
+}
+
+const CanCapture::Record& CanCaptureReader::operator[](uint64_t i) const {
+    return mRecords[(mFirst + i) % mCapacity];
+}
+
+}  // namespace android::hardware::automotive::can::libcanhaltools
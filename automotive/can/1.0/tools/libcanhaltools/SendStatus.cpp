@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libcanhaltools/libcanhaltools.h"
+
+#include <android-base/parseint.h>
+
+namespace android::hardware::automotive::can::libcanhaltools {
+
+/* The status line is "status <result> <sent>", with the numeric value of the result, so that it
+ * doesn't depend on the names of the values. */
+static constexpr char kStatusPrefix[] = "status ";
+
+std::string formatSendStatus(const SendStatus& status) {
+    return kStatusPrefix + std::to_string(static_cast<uint32_t>(status.result)) + " " +
+           std::to_string(status.sent) + "\n";
+}
+
+std::optional<SendStatus> parseSendStatus(std::string* output) {
+    if (output->empty() || output->back() != '\n') return std::nullopt;
+    const auto lineStart = output->rfind('\n', output->size() - 2);
+    const auto statusStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+    const auto line = output->substr(statusStart, output->size() - 1 - statusStart);
+
+    if (line.compare(0, sizeof(kStatusPrefix) - 1, kStatusPrefix) != 0) return std::nullopt;
+    const auto fields = line.substr(sizeof(kStatusPrefix) - 1);
+    const auto space = fields.find(' ');
+    if (space == std::string::npos) return std::nullopt;
+
+    uint32_t result;
+    SendStatus status;
+    if (!base::ParseUint(fields.substr(0, space), &result) ||
+        !base::ParseUint(fields.substr(space + 1), &status.sent)) {
+        return std::nullopt;
+    }
+    status.result = static_cast<V1_0::Result>(result);
+
+    output->resize(statusStart);
+    return status;
+}
+
+}  // namespace android::hardware::automotive::can::libcanhaltools
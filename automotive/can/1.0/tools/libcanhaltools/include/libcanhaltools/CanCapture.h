@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <android/hardware/automotive/can/1.0/types.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android::hardware::automotive::can::libcanhaltools {
+
+/**
+ * Binary capture of CAN traffic of one or more buses.
+ *
+ * The file is a header followed by a ring of fixed-size records, so that the writer can map it
+ * once and never has to make a system call per message. Once the ring is full, the oldest records
+ * are overwritten. Since the file is mapped shared, a capture survives its writer crashing.
+ */
+struct CanCapture {
+    static constexpr char kMagic[8] = {'C', 'A', 'N', 'H', 'A', 'L', 'C', 'P'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kMaxBuses = 8;
+    static constexpr size_t kMaxBusNameLength = 31;
+    static constexpr size_t kMaxPayload = 64;
+
+    struct Header {
+        char magic[sizeof(kMagic)];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t capacity;  // number of records in the ring
+        uint64_t written;   // number of records written so far, possibly more than capacity
+        char busNames[kMaxBuses][kMaxBusNameLength + 1];
+    };
+
+    struct Record {
+        uint64_t timestamp;  // CanMessage::timestamp, as set by the HAL of the given bus
+        V1_0::CanMessageId id;
+        uint8_t bus;  // index into Header::busNames
+        uint8_t flags;
+        uint8_t length;
+        uint8_t reserved;
+        uint8_t payload[kMaxPayload];
+    };
+    static constexpr uint8_t kFlagExtendedId = 1 << 0;
+    static constexpr uint8_t kFlagRemoteTransmissionRequest = 1 << 1;
+
+    static void toRecord(const V1_0::CanMessage& message, uint8_t bus, Record* record);
+    static V1_0::CanMessage toCanMessage(const Record& record);
+};
+
+/** Writes a capture, see CanCapture. Can be called from multiple threads. */
+struct CanCaptureWriter {
+    /**
+     * Create a capture file.
+     *
+     * \param path File to write, overwritten if it exists
+     * \param busNames Names of the captured buses, up to CanCapture::kMaxBuses
+     * \param capacity Number of records the file holds before the oldest ones get overwritten
+     * \return Writer instance, or nullptr in case of failure
+     */
+    static std::unique_ptr<CanCaptureWriter> create(const std::string& path,
+                                                    const std::vector<std::string>& busNames,
+                                                    uint64_t capacity);
+    ~CanCaptureWriter();
+
+    /**
+     * Append a message to the capture.
+     *
+     * \param bus Index of the bus in the busNames passed to create()
+     * \param message Received message
+     */
+    void write(uint8_t bus, const V1_0::CanMessage& message);
+
+    /**
+     * Flush the capture to the file and trim it to the records written, if the ring isn't full.
+     *
+     * Nothing can be written after the capture is closed.
+     */
+    void close();
+
+    /** Number of records written so far, including those overwritten since. */
+    uint64_t getWritten() const;
+
+  private:
+    CanCaptureWriter(base::unique_fd fd, CanCapture::Header* header, size_t mappedSize);
+
+    const base::unique_fd mFd;
+    mutable std::mutex mLock;
+    CanCapture::Header* mHeader;  // followed by the records, unmapped by close()
+    const size_t mMappedSize;
+
+    DISALLOW_COPY_AND_ASSIGN(CanCaptureWriter);
+};
+
+/** Reads a capture written with CanCaptureWriter. */
+struct CanCaptureReader {
+    /**
+     * Open and validate a capture file.
+     *
+     * \param path File to read
+     * \return Reader instance, or nullptr in case of failure
+     */
+    static std::unique_ptr<CanCaptureReader> open(const std::string& path);
+    ~CanCaptureReader();
+
+    const std::vector<std::string>& getBusNames() const;
+
+    /** Number of records available. */
+    uint64_t size() const;
+
+    /**
+     * Get a record, in the order they were written.
+     *
+     * \param i Index of the record, less than size()
+     */
+    const CanCapture::Record& operator[](uint64_t i) const;
+
+  private:
+    CanCaptureReader(const void* map, size_t mappedSize);
+
+    const void* mMap;
+    const size_t mMappedSize;
+    const CanCapture::Record* mRecords;
+    uint64_t mCapacity;
+    uint64_t mFirst;
+    uint64_t mSize;
+    std::vector<std::string> mBusNames;
+
+    DISALLOW_COPY_AND_ASSIGN(CanCaptureReader);
+};
+
+}  // namespace android::hardware::automotive::can::libcanhaltools
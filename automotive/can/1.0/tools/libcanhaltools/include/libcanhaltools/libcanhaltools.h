@@ -19,6 +19,9 @@
 #include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
 
+#include <optional>
+#include <string>
+
 namespace android::hardware::automotive::can::libcanhaltools {
 
 /**
@@ -45,4 +48,42 @@ bool isSupported(sp<V1_0::ICanController> ctrl, V1_0::ICanController::InterfaceT
  */
 V1_0::ICanController::Result configureIface(V1_0::ICanController::BusConfig can_config);
 
+/**
+ * Parse a message in the notation of canhalsend, such as 1a5#deadbeef.
+ *
+ * The payload is a sequence of hex bytes, or R for a remote frame, optionally followed by the
+ * decimal number of bytes requested, such as 1a5#R4. With no # at all, the message has no payload.
+ * Ids above 0x7FF are extended.
+ *
+ * \param str message to parse.
+ * \return the message, or nullopt if str isn't a valid one.
+ */
+std::optional<V1_0::CanMessage> parseCanMessage(const std::string& str);
+
+/** Outcome of a debug command of a CAN bus that sends messages, such as --send-burst. */
+struct SendStatus {
+    V1_0::Result result;
+    /** Number of messages sent. */
+    size_t sent;
+};
+
+/**
+ * Format the status line ending the output of a debug command that sends messages.
+ *
+ * Tools read it with parseSendStatus, rather than the human readable output before it.
+ *
+ * \param status outcome of the command.
+ * \return the line, including the line break.
+ */
+std::string formatSendStatus(const SendStatus& status);
+
+/**
+ * Take the status line off the end of the output of a debug command that sends messages.
+ *
+ * \param output output of the command, left with the human readable part only.
+ * \return the status, or nullopt if the output doesn't end with one, e.g. because the HAL doesn't
+ *         support the command.
+ */
+std::optional<SendStatus> parseSendStatus(std::string* output);
+
 }  // namespace android::hardware::automotive::can::libcanhaltools
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libcanhaltools/libcanhaltools.h"
+
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <linux/can.h>
+
+namespace android::hardware::automotive::can::libcanhaltools {
+
+std::optional<V1_0::CanMessage> parseCanMessage(const std::string& str) {
+    const auto hashpos = str.find('#');
+    const auto idStr = str.substr(0, hashpos);
+    const auto payloadStr = hashpos == std::string::npos ? "" : str.substr(hashpos + 1);
+
+    V1_0::CanMessage message = {};
+    // "0x" must be prepended, since ParseUint doesn't accept a base argument.
+    if (idStr.empty() || !base::ParseUint("0x" + idStr, &message.id, CAN_EFF_MASK)) {
+        return std::nullopt;
+    }
+    message.isExtendedId = message.id > CAN_SFF_MASK;
+
+    if (base::StartsWith(payloadStr, "R")) {
+        message.remoteTransmissionRequest = true;
+
+        /* The CAN bus HAL doesn't define a data length code (DLC) field, since it is inferred from
+         * the payload size. RTR messages indicate to the receiver how many bytes they are
+         * expecting to receive back via the DLC sent with the RTR frame. */
+        if (payloadStr.size() == 1) return message;
+
+        /* Limit the DLC to the CAN FD maximum and let the HAL determine if it's valid for the
+         * bus. */
+        size_t dlc;
+        if (!base::ParseUint(payloadStr.substr(1), &dlc, size_t{CANFD_MAX_DLEN})) {
+            return std::nullopt;
+        }
+        message.payload.resize(dlc);
+        return message;
+    }
+
+    if (payloadStr.size() % 2 != 0) return std::nullopt;
+    std::vector<uint8_t> payload;
+    for (size_t i = 0; i < payloadStr.size(); i += 2) {
+        uint8_t byte;
+        if (!base::ParseUint("0x" + payloadStr.substr(i, 2), &byte)) return std::nullopt;
+        payload.push_back(byte);
+    }
+    message.payload = payload;
+    return message;
+}
+
+}  // namespace android::hardware::automotive::can::libcanhaltools
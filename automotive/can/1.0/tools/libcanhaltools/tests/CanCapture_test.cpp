@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <libcanhaltools/CanCapture.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+namespace android::hardware::automotive::can::libcanhaltools {
+
+namespace {
+
+/** Message n, with ids, flags and payload lengths varying with n. */
+V1_0::CanMessage makeMessage(uint32_t n) {
+    V1_0::CanMessage message = {};
+    message.isExtendedId = n % 3 == 0;
+    message.id = message.isExtendedId ? 0x1000000 + n : n % 0x800;
+    message.remoteTransmissionRequest = n % 5 == 0;
+    message.timestamp = 1000000000ull + n * 1000ull;
+    std::vector<uint8_t> payload(n % (CanCapture::kMaxPayload + 1));
+    for (size_t i = 0; i < payload.size(); i++) payload[i] = n + i;
+    message.payload = payload;
+    return message;
+}
+
+void expectRecord(const CanCapture::Record& record, uint8_t bus, uint32_t n) {
+    const auto expected = makeMessage(n);
+    const auto message = CanCapture::toCanMessage(record);
+    EXPECT_EQ(bus, record.bus) << "message " << n;
+    EXPECT_EQ(expected.id, message.id) << "message " << n;
+    EXPECT_EQ(expected.timestamp, message.timestamp) << "message " << n;
+    EXPECT_EQ(expected.isExtendedId, message.isExtendedId) << "message " << n;
+    EXPECT_EQ(expected.remoteTransmissionRequest, message.remoteTransmissionRequest)
+            << "message " << n;
+    EXPECT_EQ(expected.payload, message.payload) << "message " << n;
+}
+
+TEST(CanCaptureTest, roundTrip) {
+    TemporaryFile file;
+    auto writer = CanCaptureWriter::create(file.path, {"can0", "can1"}, 1000);
+    ASSERT_NE(nullptr, writer);
+    for (uint32_t n = 0; n < 100; n++) writer->write(n % 2, makeMessage(n));
+    EXPECT_EQ(100u, writer->getWritten());
+    writer->close();
+
+    const auto reader = CanCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    EXPECT_EQ(std::vector<std::string>({"can0", "can1"}), reader->getBusNames());
+    ASSERT_EQ(100u, reader->size());
+    for (uint32_t n = 0; n < 100; n++) expectRecord((*reader)[n], n % 2, n);
+}
+
+TEST(CanCaptureTest, wrapsAroundKeepingMostRecent) {
+    TemporaryFile file;
+    auto writer = CanCaptureWriter::create(file.path, {"can0"}, 16);
+    ASSERT_NE(nullptr, writer);
+    for (uint32_t n = 0; n < 40; n++) writer->write(0, makeMessage(n));
+    writer->close();
+
+    const auto reader = CanCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    ASSERT_EQ(16u, reader->size());
+    for (uint32_t i = 0; i < 16; i++) expectRecord((*reader)[i], 0, 24 + i);
+}
+
+TEST(CanCaptureTest, readableWhileWriting) {
+    TemporaryFile file;
+    auto writer = CanCaptureWriter::create(file.path, {"can0"}, 16);
+    ASSERT_NE(nullptr, writer);
+    for (uint32_t n = 0; n < 20; n++) writer->write(0, makeMessage(n));
+
+    // Like after the writer crashed, without trimming the file.
+    const auto reader = CanCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    ASSERT_EQ(16u, reader->size());
+    for (uint32_t i = 0; i < 16; i++) expectRecord((*reader)[i], 0, 4 + i);
+}
+
+TEST(CanCaptureTest, empty) {
+    TemporaryFile file;
+    auto writer = CanCaptureWriter::create(file.path, {"can0"}, 16);
+    ASSERT_NE(nullptr, writer);
+    writer->close();
+
+    const auto reader = CanCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    EXPECT_EQ(0u, reader->size());
+}
+
+TEST(CanCaptureTest, longPayloadIsTruncated) {
+    auto message = makeMessage(1);
+    message.payload = std::vector<uint8_t>(CanCapture::kMaxPayload + 8, 0xAA);
+    CanCapture::Record record;
+    CanCapture::toRecord(message, 0, &record);
+    EXPECT_EQ(CanCapture::kMaxPayload, CanCapture::toCanMessage(record).payload.size());
+}
+
+TEST(CanCaptureTest, corruptLengthIsClamped) {
+    CanCapture::Record record = {};
+    memset(record.payload, 0xAA, sizeof(record.payload));
+    record.length = 0xFF;
+    EXPECT_EQ(std::vector<uint8_t>(CanCapture::kMaxPayload, 0xAA),
+              CanCapture::toCanMessage(record).payload);
+}
+
+TEST(CanCaptureTest, rejectsInvalidFiles) {
+    EXPECT_EQ(nullptr, CanCaptureWriter::create("/nonexistent/capture", {"can0"}, 16));
+    EXPECT_EQ(nullptr, CanCaptureWriter::create(TemporaryFile().path, {"can0"}, 0));
+    EXPECT_EQ(nullptr, CanCaptureReader::open("/nonexistent/capture"));
+
+    TemporaryFile garbage;
+    ASSERT_TRUE(base::WriteStringToFile(std::string(sizeof(CanCapture::Header), 'x'),
+                                        garbage.path));
+    EXPECT_EQ(nullptr, CanCaptureReader::open(garbage.path));
+
+    // Records written, but no room for them.
+    TemporaryFile noCapacity;
+    CanCapture::Header header = {};
+    memcpy(header.magic, CanCapture::kMagic, sizeof(CanCapture::kMagic));
+    header.version = CanCapture::kVersion;
+    header.recordSize = sizeof(CanCapture::Record);
+    header.capacity = 0;
+    header.written = 3;
+    ASSERT_TRUE(base::WriteStringToFile(
+            std::string(reinterpret_cast<const char*>(&header), sizeof(header)), noCapacity.path));
+    EXPECT_EQ(nullptr, CanCaptureReader::open(noCapacity.path));
+
+    // Capacity bigger than the file.
+    TemporaryFile truncated;
+    header.capacity = 16;
+    ASSERT_TRUE(base::WriteStringToFile(
+            std::string(reinterpret_cast<const char*>(&header), sizeof(header)), truncated.path));
+    EXPECT_EQ(nullptr, CanCaptureReader::open(truncated.path));
+}
+
+}  // namespace
+
+}  // namespace android::hardware::automotive::can::libcanhaltools
@@ -17,10 +17,12 @@
 #define LOG_TAG "VtsHalEvsTest"
 
 #include "FrameHandler.h"
+#include "ConversionPool.h"
 #include "FormatConvert.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <chrono>
 
 #include <android/log.h>
 #include <cutils/native_handle.h>
@@ -43,6 +45,19 @@ void FrameHandler::shutdown()
     // Make sure we're not still streaming
     blockingStopStream();
 
+    // Report how long it took to convert the frames of this camera for the display
+    using ::android::hardware::automotive::evs::common::ConversionPool;
+    const auto stats = ConversionPool::getInstance().getStats(mCameraInfo.cameraId);
+    if (stats.frames > 0) {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        ALOGI("Converted %llu frames of %s at %.1f fps, latency avg %lld us, max %lld us",
+              static_cast<unsigned long long>(stats.frames), mCameraInfo.cameraId.c_str(),
+              stats.framesPerSecond(),
+              static_cast<long long>(duration_cast<microseconds>(stats.averageLatency()).count()),
+              static_cast<long long>(duration_cast<microseconds>(stats.maxLatency).count()));
+    }
+
     // At this point, the receiver thread is no longer running, so we can safely drop
     // our remote object references so they can be freed
     mCamera = nullptr;
@@ -241,19 +256,21 @@ bool FrameHandler::copyBufferContents(const BufferDesc& tgtBuffer,
 
     if (srcPixels && tgtPixels) {
         using namespace ::android::hardware::automotive::evs::common;
+        auto& pool = ConversionPool::getInstance();
+        const std::string streamId = mCameraInfo.cameraId;
         if (tgtBuffer.format == HAL_PIXEL_FORMAT_RGBA_8888) {
             if (srcBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
-                Utils::copyNV21toRGB32(width, height,
-                                       srcPixels,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::NV21, width, height,
+                             srcPixels, 0,
+                             tgtPixels, tgtBuffer.stride);
             } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
-                Utils::copyYV12toRGB32(width, height,
-                                       srcPixels,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::YV12, width, height,
+                             srcPixels, 0,
+                             tgtPixels, tgtBuffer.stride);
             } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
-                Utils::copyYUYVtoRGB32(width, height,
-                                       srcPixels, srcBuffer.stride,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::YUYV, width, height,
+                             srcPixels, srcBuffer.stride,
+                             tgtPixels, tgtBuffer.stride);
             } else if (srcBuffer.format == tgtBuffer.format) {  // 32bit RGBA
                 Utils::copyMatchedInterleavedFormats(width, height,
                                                      srcPixels, srcBuffer.stride,
@@ -265,17 +282,17 @@ bool FrameHandler::copyBufferContents(const BufferDesc& tgtBuffer,
             }
         } else if (tgtBuffer.format == HAL_PIXEL_FORMAT_BGRA_8888) {
             if (srcBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
-                Utils::copyNV21toBGR32(width, height,
-                                       srcPixels,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::NV21, width, height,
+                             srcPixels, 0,
+                             tgtPixels, tgtBuffer.stride, true);
             } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
-                Utils::copyYV12toBGR32(width, height,
-                                       srcPixels,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::YV12, width, height,
+                             srcPixels, 0,
+                             tgtPixels, tgtBuffer.stride, true);
             } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
-                Utils::copyYUYVtoBGR32(width, height,
-                                       srcPixels, srcBuffer.stride,
-                                       tgtPixels, tgtBuffer.stride);
+                pool.convert(streamId, Utils::SourceFormat::YUYV, width, height,
+                             srcPixels, srcBuffer.stride,
+                             tgtPixels, tgtBuffer.stride, true);
             } else if (srcBuffer.format == tgtBuffer.format) {  // 32bit RGBA
                 Utils::copyMatchedInterleavedFormats(width, height,
                                                      srcPixels, srcBuffer.stride,
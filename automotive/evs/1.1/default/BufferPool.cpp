@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.1-service"
+
+#include "BufferPool.h"
+
+#include <log/log.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+static uint64_t makeHead(uint32_t id, uint64_t head) {
+    return (((head >> 32) + 1) << 32) | id;
+}
+
+
+BufferPool::BufferPool(uint32_t width, uint32_t height, uint32_t format, uint64_t usage) :
+        mWidth(width),
+        mHeight(height),
+        mFormat(format),
+        mUsage(usage),
+        mFreeHead(kNone) {
+    for (unsigned i = 0; i < kMaxBuffers; i++) {
+        mStates[i] = EMPTY;
+        mNext[i] = kNone;
+    }
+}
+
+
+BufferPool::~BufferPool() {
+    // Nobody can return buffers anymore, so release the ones that are still out
+    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+    for (uint32_t id = 0; id < kMaxBuffers; id++) {
+        if (mStates[id] == EMPTY) {
+            continue;
+        }
+        if (mStates[id] != FREE) {
+            ALOGE("Error - releasing buffer despite remote ownership");
+        }
+        alloc.free(mHandles[id]);
+    }
+}
+
+
+bool BufferPool::resize(unsigned count) {
+    if (count > kMaxBuffers) {
+        ALOGE("Rejecting buffer request in excess of internal limit");
+        return false;
+    }
+
+    // Cancel releases still pending before allocating anything new
+    while (mCount < count && takePendingRelease()) {
+        mCount++;
+    }
+
+    if (mCount < count) {
+        unsigned needed = count - mCount;
+        ALOGI("Allocating %u buffers for camera frames", needed);
+
+        // Allocate all buffers before making any of them available, so a failure can be rolled
+        // back without the frame generation thread having picked one of them up
+        GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+        std::vector<uint32_t> added;
+        for (uint32_t id = 0; id < kMaxBuffers && added.size() < needed; id++) {
+            if (mStates[id] != EMPTY) {
+                continue;
+            }
+
+            buffer_handle_t memHandle = nullptr;
+            uint32_t stride = 0;
+            status_t result = alloc.allocate(mWidth, mHeight, mFormat, 1, mUsage,
+                                             &memHandle, &stride, 0, "EvsCamera");
+            if (result != NO_ERROR) {
+                ALOGE("Error %d allocating %d x %d graphics buffer", result, mWidth, mHeight);
+                break;
+            }
+            if (!memHandle) {
+                ALOGE("We didn't get a buffer handle back from the allocator");
+                break;
+            }
+            mHandles[id] = memHandle;
+            mStride = stride;
+            added.push_back(id);
+        }
+
+        if (added.size() != needed) {
+            ALOGE("Rolling back to previous frame queue size");
+            for (auto id : added) {
+                alloc.free(mHandles[id]);
+                mHandles[id] = nullptr;
+            }
+            return false;
+        }
+
+        for (auto id : added) {
+            mStates[id] = FREE;
+            mCount++;
+            push(id);
+        }
+    } else if (mCount > count) {
+        unsigned toRelease = mCount - count;
+        ALOGI("Returning %u camera frame buffers", toRelease);
+
+        // Free what isn't in use now, and the rest as soon as it's returned
+        for (; toRelease > 0; toRelease--) {
+            const uint32_t id = pop();
+            if (id == kNone) {
+                break;
+            }
+            freeBuffer(id);
+            mCount--;
+        }
+        if (toRelease > 0) {
+            ALOGW("%u buffers are still in use, releasing them once they are returned",
+                  toRelease);
+            mPendingRelease += toRelease;
+            mCount -= toRelease;
+        }
+    }
+
+    return true;
+}
+
+
+int BufferPool::acquire() {
+    const uint32_t id = pop();
+    if (id == kNone) {
+        return -1;
+    }
+
+    mStates[id] = IN_USE;
+    mInUse++;
+    return id;
+}
+
+
+bool BufferPool::release(uint32_t id) {
+    if (id >= kMaxBuffers) {
+        return false;
+    }
+
+    // Only one caller can return a buffer, even if a client returns it twice concurrently
+    State expected = IN_USE;
+    if (!mStates[id].compare_exchange_strong(expected, RETURNING)) {
+        return false;
+    }
+    mInUse--;
+
+    if (takePendingRelease()) {
+        freeBuffer(id);
+    } else {
+        mStates[id] = FREE;
+        push(id);
+    }
+    return true;
+}
+
+
+void BufferPool::push(uint32_t id) {
+    uint64_t head = mFreeHead.load();
+    do {
+        mNext[id].store(static_cast<uint32_t>(head));
+    } while (!mFreeHead.compare_exchange_weak(head, makeHead(id, head)));
+}
+
+
+uint32_t BufferPool::pop() {
+    uint64_t head = mFreeHead.load();
+    uint32_t id;
+    do {
+        id = static_cast<uint32_t>(head);
+        if (id == kNone) {
+            return kNone;
+        }
+    } while (!mFreeHead.compare_exchange_weak(head, makeHead(mNext[id].load(), head)));
+
+    return id;
+}
+
+
+bool BufferPool::takePendingRelease() {
+    unsigned pending = mPendingRelease.load();
+    while (pending > 0) {
+        if (mPendingRelease.compare_exchange_weak(pending, pending - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void BufferPool::freeBuffer(uint32_t id) {
+    GraphicBufferAllocator::get().free(mHandles[id]);
+    mHandles[id] = nullptr;
+    mStates[id] = EMPTY;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BUFFERPOOL_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BUFFERPOOL_H
+
+#include <cutils/native_handle.h>
+
+#include <atomic>
+#include <stdint.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// The graphics buffers of a camera stream.
+//
+// Buffers are allocated whenever the number of frames in flight is set, never while streaming.
+// Free buffers are kept on a lock-free list, so the frame generation thread and the clients
+// returning frames hand buffers to each other without taking a lock.  A buffer's id is its index
+// in the pool and doesn't change as long as the buffer is allocated.
+class BufferPool {
+public:
+    // Arbitrary limit on the number of graphics buffers allowed to be allocated.  Safeguards
+    // against unreasonable resource consumption and provides a testable limit.
+    static constexpr unsigned kMaxBuffers = 100;
+
+    BufferPool(uint32_t width, uint32_t height, uint32_t format, uint64_t usage);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Allocate or release buffers so that there are `count` of them.  Buffers that are in use are
+    // released once they are returned, and any left are released when the pool is destroyed.
+    // If not all buffers can be allocated, the ones allocated by this call are released again
+    // and false is returned.  Must not be called concurrently with itself.
+    bool resize(unsigned count);
+
+    // Take a free buffer, returning its id, or -1 if all of them are in use.
+    int acquire();
+
+    // Return a buffer taken with acquire().  Returns false if the id doesn't refer to a buffer in
+    // use.
+    bool release(uint32_t id);
+
+    // Handle of a buffer taken with acquire().
+    buffer_handle_t getHandle(uint32_t id) const { return mHandles[id]; }
+
+    // Row stride of the buffers, in pixels.
+    uint32_t getStride() const { return mStride; }
+
+    unsigned getCount() const { return mCount; }
+    unsigned getInUse() const { return mInUse; }
+
+private:
+    enum State : uint8_t {
+        EMPTY,          // No buffer allocated
+        FREE,           // On the free list
+        IN_USE,         // Taken with acquire()
+        RETURNING,      // Being returned by release()
+    };
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    void push(uint32_t id);
+    uint32_t pop();
+    bool takePendingRelease();
+    void freeBuffer(uint32_t id);
+
+    const uint32_t mWidth;
+    const uint32_t mHeight;
+    const uint32_t mFormat;
+    const uint64_t mUsage;
+    std::atomic<uint32_t> mStride{0};
+
+    buffer_handle_t mHandles[kMaxBuffers] = {};
+    std::atomic<State> mStates[kMaxBuffers];
+
+    // Free list head, with the id of the first free buffer in the lower 32 bits and a counter
+    // in the upper ones that is incremented on every change, so that a pop() racing with other
+    // pop()s and push()es can't succeed based on a stale next id.
+    std::atomic<uint64_t> mFreeHead;
+    std::atomic<uint32_t> mNext[kMaxBuffers];
+
+    std::atomic<unsigned> mCount{0};            // Buffers allocated, minus pending releases
+    std::atomic<unsigned> mInUse{0};
+    std::atomic<unsigned> mPendingRelease{0};   // Buffers to release when they are returned
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BUFFERPOOL_H
@@ -19,10 +19,11 @@
 #include "EvsCamera.h"
 #include "EvsEnumerator.h"
 
-#include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 #include <utils/SystemClock.h>
 
+#include <stdio.h>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -35,15 +36,13 @@ namespace implementation {
 const char EvsCamera::kCameraName_Backup[] = "backup";
 
 
-// Arbitrary limit on number of graphics buffers allowed to be allocated
-// Safeguards against unreasonable resource consumption and provides a testable limit
-const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
+// We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
+static const int kTargetFrameRate = 12;
+static const nsecs_t kTargetFramePeriod = s2ns(1) / kTargetFrameRate;
 
 
 EvsCamera::EvsCamera(const char *id,
                      unique_ptr<ConfigManager::CameraInfo> &camInfo) :
-        mFramesAllowed(0),
-        mFramesInUse(0),
         mStreamState(STOPPED),
         mCameraInfo(camInfo) {
 
@@ -78,18 +77,9 @@ void EvsCamera::forceShutdown()
     // Claim the lock while we work on internal state
     std::lock_guard <std::mutex> lock(mAccessLock);
 
-    // Drop all the graphics buffers we've been using
-    if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
-                ALOGE("Error - releasing buffer despite remote ownership");
-            }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
-        }
-        mBuffers.clear();
-    }
+    // Drop all the graphics buffers we've been using.  The ones still held by the client are
+    // released when it returns them, or when we're destroyed.
+    mBufferPool->resize(0);
 
     // Put this object into an unrecoverable error state since somebody else
     // is going to own the underlying camera now
@@ -147,7 +137,7 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
     }
 
     // If the client never indicated otherwise, configure ourselves for a single streaming buffer
-    if (mFramesAllowed < 1) {
+    if (mBufferPool->getCount() < 1) {
         if (!setAvailableFrames_Locked(1)) {
             ALOGE("Failed to start stream because we couldn't get a graphics buffer");
             return EvsResult::BUFFER_NOT_AVAILABLE;
@@ -170,7 +160,6 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
 
 
 Return<void> EvsCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
-    std::lock_guard <std::mutex> lock(mAccessLock);
     returnBuffer(buffer.bufferId, buffer.memHandle);
 
     return Void();
@@ -252,8 +241,6 @@ Return<void> EvsCamera::getPhysicalCameraInfo(const hidl_string& id,
 
 
 Return<EvsResult> EvsCamera::doneWithFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers)  {
-    std::lock_guard <std::mutex> lock(mAccessLock);
-
     for (auto&& buffer : buffers) {
         returnBuffer(buffer.bufferId, buffer.buffer.nativeHandle);
     }
@@ -363,113 +350,58 @@ EvsCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& /* buffers */,
 }
 
 
-bool EvsCamera::setAvailableFrames_Locked(unsigned bufferCount) {
-    if (bufferCount < 1) {
-        ALOGE("Ignoring request to set buffer count to zero");
-        return false;
+Return<void> EvsCamera::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        ALOGE("Invalid parameters passed to debug()");
+        return {};
     }
-    if (bufferCount > MAX_BUFFERS_IN_FLIGHT) {
-        ALOGE("Rejecting buffer request in excess of internal limit");
-        return false;
+    const int out = fd->data[0];
+
+    if (options.size() > 0 && options[0] == "--reset") {
+        mFramesDelivered = 0;
+        mFramesSkipped = 0;
+        mTicksMissed = 0;
+        mPacingLateness.reset();
+        mGenerationTime.reset();
+        mClientHoldTime.reset();
+        dprintf(out, "Camera %s: statistics reset\n", mDescription.v1.cameraId.c_str());
+        return {};
     }
 
-    // Is an increase required?
-    if (mFramesAllowed < bufferCount) {
-        // An increase is required
-        unsigned needed = bufferCount - mFramesAllowed;
-        ALOGI("Allocating %d buffers for camera frames", needed);
-
-        unsigned added = increaseAvailableFrames_Locked(needed);
-        if (added != needed) {
-            // If we didn't add all the frames we needed, then roll back to the previous state
-            ALOGE("Rolling back to previous frame queue size");
-            decreaseAvailableFrames_Locked(added);
-            return false;
-        }
-    } else if (mFramesAllowed > bufferCount) {
-        // A decrease is required
-        unsigned framesToRelease = mFramesAllowed - bufferCount;
-        ALOGI("Returning %d camera frame buffers", framesToRelease);
-
-        unsigned released = decreaseAvailableFrames_Locked(framesToRelease);
-        if (released != framesToRelease) {
-            // This shouldn't happen with a properly behaving client because the client
-            // should only make this call after returning sufficient outstanding buffers
-            // to allow a clean resize.
-            ALOGE("Buffer queue shrink failed -- too many buffers currently in use?");
-        }
+    StreamStateValues state;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        state = mStreamState;
     }
-
-    return true;
+    static const char* const kStateNames[] = {"STOPPED", "RUNNING", "STOPPING", "DEAD"};
+    dprintf(out, "Camera %s: %s, %u buffers with %u in use, %d fps target\n",
+            mDescription.v1.cameraId.c_str(), kStateNames[state],
+            mBufferPool->getCount(), mBufferPool->getInUse(), kTargetFrameRate);
+    dprintf(out, "  frames delivered: %llu, skipped without a free buffer: %llu, "
+            "ticks missed: %llu\n",
+            static_cast<unsigned long long>(mFramesDelivered.load()),
+            static_cast<unsigned long long>(mFramesSkipped.load()),
+            static_cast<unsigned long long>(mTicksMissed.load()));
+    mPacingLateness.dump(out, "pacing lateness");
+    mGenerationTime.dump(out, "frame generation");
+    mClientHoldTime.dump(out, "client hold time");
+    return {};
 }
 
 
-unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
-    unsigned added = 0;
-
-    while (added < numToAdd) {
-        buffer_handle_t memHandle = nullptr;
-        status_t result = alloc.allocate(mWidth, mHeight, mFormat, 1, mUsage,
-                                         &memHandle, &mStride, 0, "EvsCamera");
-        if (result != NO_ERROR) {
-            ALOGE("Error %d allocating %d x %d graphics buffer", result, mWidth, mHeight);
-            break;
-        }
-        if (!memHandle) {
-            ALOGE("We didn't get a buffer handle back from the allocator");
-            break;
-        }
-
-        // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
-        }
-
-        mFramesAllowed++;
-        added++;
+bool EvsCamera::setAvailableFrames_Locked(unsigned bufferCount) {
+    if (bufferCount < 1) {
+        ALOGE("Ignoring request to set buffer count to zero");
+        return false;
     }
-
-    return added;
-}
-
-
-unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
-    unsigned removed = 0;
-
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
-
-            mFramesAllowed--;
-            removed++;
-
-            if (removed == numToRemove) {
-                break;
-            }
-        }
+    if (bufferCount > BufferPool::kMaxBuffers) {
+        ALOGE("Rejecting buffer request in excess of internal limit");
+        return false;
     }
 
-    return removed;
+    // The pool rolls back to the previous state if it can't allocate all buffers, and releases
+    // buffers still in use once the client returns them
+    return mBufferPool->resize(bufferCount);
 }
 
 
@@ -478,13 +410,16 @@ unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 void EvsCamera::generateFrames() {
     ALOGD("Frame generation loop started");
 
-    unsigned idx;
+    FramePacer pacer(kTargetFramePeriod);
+    pacer.start(systemTime(SYSTEM_TIME_MONOTONIC));
 
     while (true) {
-        bool timeForFrame = false;
-        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        unsigned missed = 0;
+        const nsecs_t frameTime = pacer.waitForNextFrame(&missed);
+        mPacingLateness.record(systemTime(SYSTEM_TIME_MONOTONIC) - frameTime);
+        mTicksMissed += missed;
 
-        // Lock scope for updating shared state
+        // Lock scope for checking shared state
         {
             std::lock_guard<std::mutex> lock(mAccessLock);
 
@@ -492,85 +427,59 @@ void EvsCamera::generateFrames() {
                 // Break out of our main thread loop
                 break;
             }
-
-            // Are we allowed to issue another buffer?
-            if (mFramesInUse >= mFramesAllowed) {
-                // Can't do anything right now -- skip this frame
-                ALOGW("Skipped a frame because too many are in flight\n");
-            } else {
-                // Identify an available buffer to fill
-                for (idx = 0; idx < mBuffers.size(); idx++) {
-                    if (!mBuffers[idx].inUse) {
-                        if (mBuffers[idx].handle != nullptr) {
-                            // Found an available record, so stop looking
-                            break;
-                        }
-                    }
-                }
-                if (idx >= mBuffers.size()) {
-                    // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                    ALOGE("Failed to find an available buffer slot\n");
-                } else {
-                    // We're going to make the frame busy
-                    mBuffers[idx].inUse = true;
-                    mFramesInUse++;
-                    timeForFrame = true;
-                }
-            }
         }
 
-        if (timeForFrame) {
-            // Assemble the buffer description we'll transmit below
-            BufferDesc_1_1 newBuffer = {};
-            AHardwareBuffer_Desc* pDesc =
-                reinterpret_cast<AHardwareBuffer_Desc *>(&newBuffer.buffer.description);
-            pDesc->width = mWidth;
-            pDesc->height = mHeight;
-            pDesc->layers = 1;
-            pDesc->format = mFormat;
-            pDesc->usage = mUsage;
-            pDesc->stride = mStride;
-            newBuffer.buffer.nativeHandle = mBuffers[idx].handle;
-            newBuffer.pixelSize = sizeof(uint32_t);
-            newBuffer.bufferId = idx;
-            newBuffer.deviceId = mDescription.v1.cameraId;
-            newBuffer.timestamp = elapsedRealtimeNano();
-
-            // Write test data into the image buffer
-            fillTestFrame(newBuffer);
-
-            // Issue the (asynchronous) callback to the client -- can't be holding the lock
-            hidl_vec<BufferDesc_1_1> frames;
-            frames.resize(1);
-            frames[0] = newBuffer;
-            auto result = mStream->deliverFrame_1_1(frames);
-            if (result.isOk()) {
-                ALOGD("Delivered %p as id %d",
-                      newBuffer.buffer.nativeHandle.getNativeHandle(), newBuffer.bufferId);
-            } else {
-                // This can happen if the client dies and is likely unrecoverable.
-                // To avoid consuming resources generating failing calls, we stop sending
-                // frames.  Note, however, that the stream remains in the "STREAMING" state
-                // until cleaned up on the main thread.
-                ALOGE("Frame delivery call failed in the transport layer.");
-
-                // Since we didn't actually deliver it, mark the frame as available
-                std::lock_guard<std::mutex> lock(mAccessLock);
-                mBuffers[idx].inUse = false;
-                mFramesInUse--;
-
-                break;
-            }
+        // Are we allowed to issue another buffer?
+        const int idx = mBufferPool->acquire();
+        if (idx < 0) {
+            // Can't do anything right now -- skip this frame
+            ALOGW("Skipped a frame because too many are in flight\n");
+            mFramesSkipped++;
+            continue;
         }
 
-        // We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
-        static const int kTargetFrameRate = 12;
-        static const nsecs_t kTargetFrameTimeUs = 1000*1000 / kTargetFrameRate;
-        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const nsecs_t workTimeUs = (now - startTime) / 1000;
-        const nsecs_t sleepDurationUs = kTargetFrameTimeUs - workTimeUs;
-        if (sleepDurationUs > 0) {
-            usleep(sleepDurationUs);
+        // Assemble the buffer description we'll transmit below
+        BufferDesc_1_1 newBuffer = {};
+        AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<AHardwareBuffer_Desc *>(&newBuffer.buffer.description);
+        pDesc->width = mWidth;
+        pDesc->height = mHeight;
+        pDesc->layers = 1;
+        pDesc->format = mFormat;
+        pDesc->usage = mUsage;
+        pDesc->stride = mBufferPool->getStride();
+        newBuffer.buffer.nativeHandle = mBufferPool->getHandle(idx);
+        newBuffer.pixelSize = sizeof(uint32_t);
+        newBuffer.bufferId = idx;
+        newBuffer.deviceId = mDescription.v1.cameraId;
+        newBuffer.timestamp = elapsedRealtimeNano();
+
+        // Write test data into the image buffer
+        fillTestFrame(newBuffer);
+
+        // Issue the (asynchronous) callback to the client -- can't be holding the lock.
+        // The client may return the frame before the call returns.
+        hidl_vec<BufferDesc_1_1> frames;
+        frames.resize(1);
+        frames[0] = newBuffer;
+        mDeliveryTimes[idx] = systemTime(SYSTEM_TIME_MONOTONIC);
+        auto result = mStream->deliverFrame_1_1(frames);
+        if (result.isOk()) {
+            ALOGD("Delivered %p as id %d",
+                  newBuffer.buffer.nativeHandle.getNativeHandle(), newBuffer.bufferId);
+            mFramesDelivered++;
+            mGenerationTime.record(systemTime(SYSTEM_TIME_MONOTONIC) - frameTime);
+        } else {
+            // This can happen if the client dies and is likely unrecoverable.
+            // To avoid consuming resources generating failing calls, we stop sending
+            // frames.  Note, however, that the stream remains in the "STREAMING" state
+            // until cleaned up on the main thread.
+            ALOGE("Frame delivery call failed in the transport layer.");
+
+            // Since we didn't actually deliver it, mark the frame as available
+            mBufferPool->release(idx);
+
+            break;
         }
     }
 
@@ -653,32 +562,21 @@ void EvsCamera::fillTestFrame(const BufferDesc_1_0& buff) {
 
 
 void EvsCamera::returnBuffer(const uint32_t bufferId, const buffer_handle_t memHandle) {
-    std::lock_guard <std::mutex> lock(mAccessLock);
-
+    // Clients return frames without taking mAccessLock, so they never wait for the frame
+    // generation thread or for each other
     if (memHandle == nullptr) {
         ALOGE("ignoring doneWithFrame called with null handle");
-    } else if (bufferId >= mBuffers.size()) {
-        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
-              bufferId, mBuffers.size()-1);
-    } else if (!mBuffers[bufferId].inUse) {
-        ALOGE("ignoring doneWithFrame called on frame %d which is already free",
-              bufferId);
+    } else if (bufferId >= BufferPool::kMaxBuffers) {
+        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %u)",
+              bufferId, BufferPool::kMaxBuffers - 1);
     } else {
-        // Mark the frame as available
-        mBuffers[bufferId].inUse = false;
-        mFramesInUse--;
-
-        // If this frame's index is high in the array, try to move it down
-        // to improve locality after mFramesAllowed has been reduced.
-        if (bufferId >= mFramesAllowed) {
-            // Find an empty slot lower in the array (which should always exist in this case)
-            for (auto&& rec : mBuffers) {
-                if (rec.handle == nullptr) {
-                    rec.handle = mBuffers[bufferId].handle;
-                    mBuffers[bufferId].handle = nullptr;
-                    break;
-                }
-            }
+        // Read the delivery time first, the buffer can be delivered again once it's released
+        const nsecs_t deliveryTime = mDeliveryTimes[bufferId];
+        if (mBufferPool->release(bufferId)) {
+            mClientHoldTime.record(systemTime(SYSTEM_TIME_MONOTONIC) - deliveryTime);
+        } else {
+            ALOGE("ignoring doneWithFrame called on frame %d which is already free",
+                  bufferId);
         }
     }
 }
@@ -711,6 +609,8 @@ sp<EvsCamera> EvsCamera::Create(const char *deviceName,
     evsCamera->mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
     evsCamera->mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
                          GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY;
+    evsCamera->mBufferPool = std::make_unique<BufferPool>(evsCamera->mWidth, evsCamera->mHeight,
+                                                          evsCamera->mFormat, evsCamera->mUsage);
 
     return evsCamera;
 }
@@ -23,9 +23,13 @@
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
+#include <memory>
 #include <thread>
 
+#include "BufferPool.h"
 #include "ConfigManager.h"
+#include "FrameTiming.h"
 
 using BufferDesc_1_0 = ::android::hardware::automotive::evs::V1_0::BufferDesc;
 using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
@@ -85,6 +89,9 @@ public:
     Return<void>      importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
                                             importExternalBuffers_cb _hidl_cb) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void>      debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     static sp<EvsCamera> Create(const char *deviceName);
     static sp<EvsCamera> Create(const char *deviceName,
                                 unique_ptr<ConfigManager::CameraInfo> &camInfo,
@@ -102,11 +109,8 @@ public:
 private:
     EvsCamera(const char *id,
               unique_ptr<ConfigManager::CameraInfo> &camInfo);
-    // These three functions are expected to be called while mAccessLock is held
-    //
+    // This function is expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
-    unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
-    unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
 
     void generateFrames();
     void fillTestFrame(const BufferDesc_1_0& buff);
@@ -123,20 +127,20 @@ private:
     uint32_t mHeight = 0;           // Vertical pixel count in the buffers
     uint32_t mFormat = 0;           // Values from android_pixel_format_t
     uint64_t mUsage  = 0;           // Values from from Gralloc.h
-    uint32_t mStride = 0;           // Bytes per line in the buffers
 
     sp<IEvsCameraStream_1_1> mStream = nullptr;  // The callback used to deliver each frame
 
-    struct BufferRecord {
-        buffer_handle_t handle;
-        bool inUse;
-
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
-    };
-
-    std::vector <BufferRecord> mBuffers;  // Graphics buffers to transfer images
-    unsigned mFramesAllowed;              // How many buffers are we currently using
-    unsigned mFramesInUse;                // How many buffers are currently outstanding
+    std::unique_ptr<BufferPool> mBufferPool;     // Graphics buffers to transfer images
+
+    // Frame timing, for debug().  Frames are returned by clients without taking mAccessLock,
+    // so all of these are updated without it too.
+    std::atomic<nsecs_t> mDeliveryTimes[BufferPool::kMaxBuffers] = {};  // Indexed by buffer id
+    std::atomic<uint64_t> mFramesDelivered{0};
+    std::atomic<uint64_t> mFramesSkipped{0};    // No buffer was free when a frame was due
+    std::atomic<uint64_t> mTicksMissed{0};      // Frame generation took longer than a period
+    LatencyHistogram mPacingLateness;           // Wakeup time after a frame was due
+    LatencyHistogram mGenerationTime;           // Frame due until it was delivered
+    LatencyHistogram mClientHoldTime;           // Frame delivered until it was returned
 
     enum StreamStateValues {
         STOPPED,
@@ -21,6 +21,8 @@
 #include "EvsDisplay.h"
 #include "EvsUltrasonicsArray.h"
 
+#include <stdio.h>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -456,6 +458,36 @@ Return<void> EvsEnumerator::closeUltrasonicsArray(
     return Void();
 }
 
+
+Return<void> EvsEnumerator::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        ALOGE("Invalid parameters passed to debug()");
+        return Void();
+    }
+    const int out = fd->data[0];
+
+    if (options.size() > 0 && options[0] == "--help") {
+        dprintf(out, "Dumps the buffers and frame timing of the open cameras.\n"
+                     "Options:\n"
+                     "  --reset: Resets the frame timing statistics.\n");
+        return Void();
+    }
+
+    bool anyOpen = false;
+    for (auto &&cam : sCameraList) {
+        sp<EvsCamera> pActiveCamera = cam.activeInstance.promote();
+        if (pActiveCamera != nullptr) {
+            pActiveCamera->debug(fd, options);
+            anyOpen = true;
+        }
+    }
+    if (!anyOpen) {
+        dprintf(out, "No cameras are open\n");
+    }
+
+    return Void();
+}
+
 } // namespace implementation
 } // namespace V1_1
 } // namespace evs
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameTiming.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+nsecs_t FramePacer::waitForNextFrame(unsigned* missed) {
+    *missed = 0;
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now >= mNextFrame + mPeriod) {
+        // We're late by at least a whole period, so move on to the last tick that has passed
+        *missed = (now - mNextFrame) / mPeriod;
+        mNextFrame += *missed * mPeriod;
+    }
+
+    const nsecs_t frameTime = mNextFrame;
+    mNextFrame += mPeriod;
+
+    // Sleep until an absolute time, so that the time spent getting here doesn't add up
+    struct timespec wakeup = {
+        static_cast<time_t>(frameTime / 1000000000),
+        static_cast<long>(frameTime % 1000000000),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr) == EINTR) {
+        // Interrupted by a signal, keep sleeping
+    }
+
+    return frameTime;
+}
+
+
+void LatencyHistogram::record(nsecs_t duration) {
+    const uint64_t us = duration > 0 ? duration / 1000 : 0;
+
+    // Bucket 0 holds durations below 1us, bucket i those in [2^(i-1), 2^i) us
+    unsigned bucket = us > 0 ? 64 - __builtin_clzll(us) : 0;
+    if (bucket >= kNumBuckets) {
+        bucket = kNumBuckets - 1;
+    }
+    mBuckets[bucket]++;
+    mCount++;
+    mTotalUs += us;
+
+    uint64_t max = mMaxUs.load();
+    while (us > max && !mMaxUs.compare_exchange_weak(max, us)) {
+        // Somebody else updated the maximum, try again
+    }
+}
+
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : mBuckets) {
+        bucket = 0;
+    }
+    mCount = 0;
+    mTotalUs = 0;
+    mMaxUs = 0;
+}
+
+
+void LatencyHistogram::dump(int fd, const char* name) const {
+    const uint64_t count = mCount;
+    dprintf(fd, "  %s: %llu samples, avg %llu us, max %llu us\n", name,
+            static_cast<unsigned long long>(count),
+            static_cast<unsigned long long>(count > 0 ? mTotalUs / count : 0),
+            static_cast<unsigned long long>(mMaxUs.load()));
+
+    for (unsigned i = 0; i < kNumBuckets; i++) {
+        const uint64_t samples = mBuckets[i];
+        if (samples == 0) {
+            continue;
+        }
+        if (i + 1 < kNumBuckets) {
+            dprintf(fd, "    < %8llu us: %llu\n", 1ull << i,
+                    static_cast<unsigned long long>(samples));
+        } else {
+            dprintf(fd, "    >=%8llu us: %llu\n", 1ull << (i - 1),
+                    static_cast<unsigned long long>(samples));
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMETIMING_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMETIMING_H
+
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <stdint.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Paces frame generation like a display vsync.  Frame times are on a fixed grid starting at
+// start(), so neither the time spent on a frame nor oversleeping shifts the following ones.
+// Ticks that are missed entirely are skipped rather than made up for with a burst of frames.
+class FramePacer {
+public:
+    explicit FramePacer(nsecs_t period) : mPeriod(period) {}
+
+    void start(nsecs_t now) { mNextFrame = now; }
+
+    // Sleep until the next frame is due, and return the time it was due at.  missed is set to
+    // the number of ticks skipped because the caller was too late for them.
+    nsecs_t waitForNextFrame(unsigned* missed);
+
+private:
+    const nsecs_t mPeriod;
+    nsecs_t mNextFrame = 0;
+};
+
+
+// Histogram of durations, with buckets of powers of two microseconds.  Can be recorded to from
+// any thread without locking.
+class LatencyHistogram {
+public:
+    void record(nsecs_t duration);
+    void reset();
+    void dump(int fd, const char* name) const;
+
+private:
+    static constexpr unsigned kNumBuckets = 24;     // The last one holds everything >= 4s
+
+    std::atomic<uint64_t> mBuckets[kNumBuckets] = {};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<uint64_t> mTotalUs{0};
+    std::atomic<uint64_t> mMaxUs{0};
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMETIMING_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionPool.h"
+
+#include <algorithm>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+
+// Bands smaller than this aren't worth handing to another thread.
+static constexpr unsigned kMinRowsPerBand = 16;
+
+// Frames are split into a few more bands than there are threads, so that threads finishing early
+// can help with the rest.
+static constexpr unsigned kBandsPerThread = 2;
+
+
+ConversionPool::Clock::duration ConversionPool::StreamStats::averageLatency() const {
+    return frames > 0 ? totalLatency / static_cast<int64_t>(frames) : Clock::duration(0);
+}
+
+
+double ConversionPool::StreamStats::framesPerSecond() const {
+    if (frames < 2 || lastFrame <= firstFrame) {
+        return 0;
+    }
+
+    const std::chrono::duration<double> elapsed = lastFrame - firstFrame;
+    return (frames - 1) / elapsed.count();
+}
+
+
+ConversionPool& ConversionPool::getInstance() {
+    static ConversionPool sInstance(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return sInstance;
+}
+
+
+ConversionPool::ConversionPool(unsigned numWorkers) {
+    for (unsigned i = 0; i < numWorkers; i++) {
+        mWorkers.emplace_back(&ConversionPool::workerLoop, this);
+    }
+}
+
+
+ConversionPool::~ConversionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mShutdown = true;
+    }
+    mWorkSignal.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+
+void ConversionPool::convert(const std::string& streamId, Utils::SourceFormat format,
+                             unsigned width, unsigned height,
+                             uint8_t* src, unsigned srcStridePixels,
+                             uint32_t* dst, unsigned dstStridePixels,
+                             bool bgrxFormat) {
+    const auto start = Clock::now();
+
+    Job job;
+    job.format = format;
+    job.width = width;
+    job.height = height;
+    job.src = src;
+    job.srcStridePixels = srcStridePixels;
+    job.dst = dst;
+    job.dstStridePixels = dstStridePixels;
+    job.bgrxFormat = bgrxFormat;
+
+    // Keep bands an even number of rows, so each of them starts on a new chroma row
+    const unsigned numThreads = mWorkers.size() + 1;
+    job.rowsPerBand = std::max(kMinRowsPerBand,
+                               (height + numThreads * kBandsPerThread - 1) /
+                               (numThreads * kBandsPerThread));
+    job.rowsPerBand = (job.rowsPerBand + 1) & ~1u;
+    job.numBands = (height + job.rowsPerBand - 1) / job.rowsPerBand;
+
+    if (mWorkers.empty() || job.numBands <= 1) {
+        Utils::convertRows(format, width, height, src, srcStridePixels, dst, dstStridePixels,
+                           bgrxFormat, 0, height);
+    } else {
+        std::unique_lock<std::mutex> lock(mLock);
+        mJobs.push_back(&job);
+        mWorkSignal.notify_all();
+
+        // Work on our own frame rather than just waiting for the workers
+        unsigned band;
+        while (takeBand(&job, &band) != nullptr) {
+            lock.unlock();
+            convertBand(job, band);
+            lock.lock();
+            finishBand(&job);
+        }
+        mDoneSignal.wait(lock, [&job] { return job.bandsDone == job.numBands; });
+    }
+
+    const auto end = Clock::now();
+    const auto latency = end - start;
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    auto& stats = mStats[streamId];
+    if (stats.frames == 0) {
+        stats.firstFrame = end;
+    }
+    stats.frames++;
+    stats.pixels += static_cast<uint64_t>(width) * height;
+    stats.totalLatency += latency;
+    stats.maxLatency = std::max(stats.maxLatency, latency);
+    stats.lastFrame = end;
+}
+
+
+ConversionPool::StreamStats ConversionPool::getStats(const std::string& streamId) {
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    const auto it = mStats.find(streamId);
+    return it != mStats.end() ? it->second : StreamStats();
+}
+
+
+void ConversionPool::resetStats(const std::string& streamId) {
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    mStats.erase(streamId);
+}
+
+
+ConversionPool::Job* ConversionPool::takeBand(Job* job, unsigned* band) {
+    if (job == nullptr) {
+        if (mJobs.empty()) {
+            return nullptr;
+        }
+        job = mJobs.front();
+    } else if (job->nextBand == job->numBands) {
+        return nullptr;
+    }
+
+    *band = job->nextBand++;
+    if (job->nextBand == job->numBands) {
+        mJobs.erase(std::find(mJobs.begin(), mJobs.end(), job));
+    }
+    return job;
+}
+
+
+void ConversionPool::convertBand(const Job& job, unsigned band) {
+    Utils::convertRows(job.format, job.width, job.height,
+                       job.src, job.srcStridePixels,
+                       job.dst, job.dstStridePixels,
+                       job.bgrxFormat, band * job.rowsPerBand, job.rowsPerBand);
+}
+
+
+void ConversionPool::finishBand(Job* job) {
+    // The job must not be touched after its last band is done, since convert() returns then
+    if (++job->bandsDone == job->numBands) {
+        mDoneSignal.notify_all();
+    }
+}
+
+
+void ConversionPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mWorkSignal.wait(lock, [this] { return mShutdown || !mJobs.empty(); });
+        if (mShutdown) {
+            return;
+        }
+
+        unsigned band;
+        Job* job = takeBand(nullptr, &band);
+        lock.unlock();
+        convertBand(*job, band);
+        lock.lock();
+        finishBand(job);
+    }
+}
+
+} // namespace common
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -17,6 +17,11 @@
 #define LOG_TAG "VtsHalEvsTest"
 
 #include "FormatConvert.h"
+#include "FormatConvertKernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
 namespace android {
 namespace hardware {
@@ -35,41 +40,164 @@ int Utils::align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-inline float Utils::clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
-}
-
-
-uint32_t Utils::yuvToRgbx(const unsigned char Y,
-                          const unsigned char Uin,
-                          const unsigned char Vin,
-                          bool bgrxFormat) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
-
-    if (!bgrxFormat) {
-        return (R      ) |
-               (G <<  8) |
-               (B << 16) |
-               0xFF000000;  // Fill the alpha channel with ones
-    } else {
-        return (R << 16) |
-               (G <<  8) |
-               (B      ) |
-               0xFF000000;  // Fill the alpha channel with ones
+namespace kernels {
+
+void nv21RowScalar(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                   bool bgrxFormat) {
+    for (unsigned c = 0; c < width; c += 2) {
+        const Chroma chroma(uv[c], uv[c + 1]);
+        dst[c] = toRgbx(y[c], chroma, bgrxFormat);
+        if (c + 1 < width) dst[c + 1] = toRgbx(y[c + 1], chroma, bgrxFormat);
+    }
+}
+
+void yv12RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                   unsigned width, bool bgrxFormat) {
+    for (unsigned c = 0; c < width; c += 2) {
+        const Chroma chroma(u[c / 2], v[c / 2]);
+        dst[c] = toRgbx(y[c], chroma, bgrxFormat);
+        if (c + 1 < width) dst[c + 1] = toRgbx(y[c + 1], chroma, bgrxFormat);
+    }
+}
+
+void yuyvRowScalar(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat) {
+    for (unsigned c = 0; c + 1 < width; c += 2) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        const uint8_t* pair = yuyv + c * 2;
+        const Chroma chroma(pair[1], pair[3]);
+        dst[c] = toRgbx(pair[0], chroma, bgrxFormat);
+        dst[c + 1] = toRgbx(pair[2], chroma, bgrxFormat);
+    }
+}
+
+static const RowKernels kScalarKernels = {
+    nv21RowScalar,
+    yv12RowScalar,
+    yuyvRowScalar,
+};
+
+} // namespace kernels
+
+
+std::vector<Utils::SimdLevel> Utils::getSupportedSimdLevels() {
+    std::vector<SimdLevel> levels = {SimdLevel::NONE};
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) levels.push_back(SimdLevel::SSE2);
+    if (__builtin_cpu_supports("avx2")) levels.push_back(SimdLevel::AVX2);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    levels.push_back(SimdLevel::NEON);
+#endif
+    return levels;
+}
+
+static const kernels::RowKernels* getKernels(Utils::SimdLevel level) {
+    switch (level) {
+#if defined(__i386__) || defined(__x86_64__)
+        case Utils::SimdLevel::SSE2:
+            return &kernels::kSse2Kernels;
+        case Utils::SimdLevel::AVX2:
+            return &kernels::kAvx2Kernels;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        case Utils::SimdLevel::NEON:
+            return &kernels::kNeonKernels;
+#endif
+        default:
+            return &kernels::kScalarKernels;
+    }
+}
+
+// The best supported level is used unless another one is selected.
+static std::atomic<Utils::SimdLevel> sSimdLevel{Utils::getSupportedSimdLevels().back()};
+
+Utils::SimdLevel Utils::getSimdLevel() {
+    return sSimdLevel;
+}
+
+bool Utils::setSimdLevel(SimdLevel level) {
+    const auto supported = getSupportedSimdLevels();
+    if (std::find(supported.begin(), supported.end(), level) == supported.end()) {
+        return false;
+    }
+
+    sSimdLevel = level;
+    return true;
+}
+
+
+void Utils::convertRows(SourceFormat format, unsigned width, unsigned height,
+                        uint8_t* src, unsigned srcStridePixels,
+                        uint32_t* dst, unsigned dstStridePixels,
+                        bool bgrxFormat, unsigned firstRow, unsigned numRows)
+{
+    const auto kernels = getKernels(sSimdLevel);
+    const unsigned endRow = std::min(firstRow + numRows, height);
+    switch (format) {
+        case SourceFormat::NV21: {
+            // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2
+            // interleaved U/V array.  It assumes an even width and height for the overall image,
+            // and a horizontal stride that is an even multiple of 16 bytes for both the Y and UV
+            // arrays.
+            unsigned strideLum = align<16>(width);
+            unsigned sizeY = strideLum * height;
+            unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
+            unsigned offsetUV = sizeY;
+
+            uint8_t* srcY = src;
+            uint8_t* srcUV = src+offsetUV;
+
+            for (unsigned r = firstRow; r < endRow; r++) {
+                // Note that we're walking the same UV row twice for even/odd luminance rows
+                uint8_t* rowY  = srcY  + r*strideLum;
+                uint8_t* rowUV = srcUV + (r/2 * strideColor);
+
+                uint32_t* rowDest = dst + r*dstStridePixels;
+
+                kernels->nv21(rowY, rowUV, rowDest, width, bgrxFormat);
+            }
+            break;
+        }
+
+        case SourceFormat::YV12: {
+            // The YV12 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 U array,
+            // followed by another 1/2 x 1/2 V array.  It assumes an even width and height for the
+            // overall image, and a horizontal stride that is an even multiple of 16 bytes for each
+            // of the Y, U, and V arrays.
+            unsigned strideLum = align<16>(width);
+            unsigned sizeY = strideLum * height;
+            unsigned strideColor = align<16>(strideLum/2);
+            unsigned sizeColor = strideColor * height/2;
+            unsigned offsetU = sizeY;
+            unsigned offsetV = sizeY + sizeColor;
+
+            uint8_t* srcY = src;
+            uint8_t* srcU = src+offsetU;
+            uint8_t* srcV = src+offsetV;
+
+            for (unsigned r = firstRow; r < endRow; r++) {
+                // Note that we're walking the same U and V rows twice for even/odd luminance rows
+                uint8_t* rowY = srcY + r*strideLum;
+                uint8_t* rowU = srcU + (r/2 * strideColor);
+                uint8_t* rowV = srcV + (r/2 * strideColor);
+
+                uint32_t* rowDest = dst + r*dstStridePixels;
+
+                kernels->yv12(rowY, rowU, rowV, rowDest, width, bgrxFormat);
+            }
+            break;
+        }
+
+        case SourceFormat::YUYV:
+            for (unsigned r = firstRow; r < endRow; r++) {
+                // 2 bytes per source pixel, 4 bytes per destination pixel
+                uint8_t* rowSrc = src + r*srcStridePixels*2;
+                uint32_t* rowDest = dst + r*dstStridePixels;
+
+                kernels->yuyv(rowSrc, rowDest, width & ~1, bgrxFormat);
+            }
+            break;
     }
 }
 
@@ -79,30 +207,8 @@ void Utils::copyNV21toRGB32(unsigned width, unsigned height,
                             uint32_t* dst, unsigned dstStridePixels,
                             bool bgrxFormat)
 {
-    // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
-    // U/V array.  It assumes an even width and height for the overall image, and a horizontal
-    // stride that is an even multiple of 16 bytes for both the Y and UV arrays.
-    unsigned strideLum = align<16>(width);
-    unsigned sizeY = strideLum * height;
-    unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
-    unsigned offsetUV = sizeY;
-
-    uint8_t* srcY = src;
-    uint8_t* srcUV = src+offsetUV;
-
-    for (unsigned r = 0; r < height; r++) {
-        // Note that we're walking the same UV row twice for even/odd luminance rows
-        uint8_t* rowY  = srcY  + r*strideLum;
-        uint8_t* rowUV = srcUV + (r/2 * strideColor);
-
-        uint32_t* rowDest = dst + r*dstStridePixels;
-
-        for (unsigned c = 0; c < width; c++) {
-            unsigned uCol = (c & ~1);   // uCol is always even and repeats 1:2 with Y values
-            unsigned vCol = uCol | 1;   // vCol is always odd
-            rowDest[c] = yuvToRgbx(rowY[c], rowUV[uCol], rowUV[vCol], bgrxFormat);
-        }
-    }
+    convertRows(SourceFormat::NV21, width, height, src, 0, dst, dstStridePixels, bgrxFormat,
+                0, height);
 }
 
 
@@ -111,33 +217,8 @@ void Utils::copyYV12toRGB32(unsigned width, unsigned height,
                             uint32_t* dst, unsigned dstStridePixels,
                             bool bgrxFormat)
 {
-    // The YV12 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 U array, followed
-    // by another 1/2 x 1/2 V array.  It assumes an even width and height for the overall image,
-    // and a horizontal stride that is an even multiple of 16 bytes for each of the Y, U,
-    // and V arrays.
-    unsigned strideLum = align<16>(width);
-    unsigned sizeY = strideLum * height;
-    unsigned strideColor = align<16>(strideLum/2);
-    unsigned sizeColor = strideColor * height/2;
-    unsigned offsetU = sizeY;
-    unsigned offsetV = sizeY + sizeColor;
-
-    uint8_t* srcY = src;
-    uint8_t* srcU = src+offsetU;
-    uint8_t* srcV = src+offsetV;
-
-    for (unsigned r = 0; r < height; r++) {
-        // Note that we're walking the same U and V rows twice for even/odd luminance rows
-        uint8_t* rowY = srcY + r*strideLum;
-        uint8_t* rowU = srcU + (r/2 * strideColor);
-        uint8_t* rowV = srcV + (r/2 * strideColor);
-
-        uint32_t* rowDest = dst + r*dstStridePixels;
-
-        for (unsigned c = 0; c < width; c++) {
-            rowDest[c] = yuvToRgbx(rowY[c], rowU[c], rowV[c], bgrxFormat);
-        }
-    }
+    convertRows(SourceFormat::YV12, width, height, src, 0, dst, dstStridePixels, bgrxFormat,
+                0, height);
 }
 
 
@@ -146,31 +227,8 @@ void Utils::copyYUYVtoRGB32(unsigned width, unsigned height,
                             uint32_t* dst, unsigned dstStridePixels,
                             bool bgrxFormat)
 {
-    uint32_t* srcWords = (uint32_t*)src;
-
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
-
-    for (unsigned r = 0; r < height; r++) {
-        for (unsigned c = 0; c < width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *srcWords++;
-
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
-
-            // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V, bgrxFormat);
-            *(dst+1) = yuvToRgbx(Y2, U, V, bgrxFormat);
-            dst += 2;
-        }
-
-        // Skip over any extra data or end of row alignment padding
-        srcWords += srcRowPadding32;
-        dst += dstRowPadding32;
-    }
+    convertRows(SourceFormat::YUYV, width, height, src, srcStridePixels, dst, dstStridePixels,
+                bgrxFormat, 0, height);
 }
 
 
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVS_FORMATCONVERTKERNELS_H
+#define EVS_FORMATCONVERTKERNELS_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+namespace kernels {
+
+// Fixed point YUV to RGB conversion shared by all row kernels, so that they produce exactly the
+// same output.  It is laid out for 16bit SIMD lanes:
+//
+//   R = (Y*128 + V*128 + mulhi(V*256, kRV))            >> 7
+//   G = (Y*128 - (mulhi(U*256, kGU) + mulhi(V*256, kGV))) >> 7
+//   B = (Y*128 + sat(U*256 + mulhi(U*256, kBU)))       >> 7
+//
+// where U and V are centered around zero, mulhi(a, b) = (a*b) >> 16, sums saturate to int16 and
+// the result saturates to [0, 255].  The kXX constants are the fractional parts of the 1.140,
+// 0.395, 0.581 and 2.032 factors of the original float conversion in Q15, which they match within
+// one unit for every input.
+constexpr int16_t kRV = 4588;   // 1.140 = 1 + 0.140
+constexpr int16_t kGU = 12943;  // 0.395
+constexpr int16_t kGV = 19038;  // 0.581
+constexpr int16_t kBU = 1049;   // 2.032 = 2 + 0.032
+constexpr int kFractionBits = 7;
+
+inline int mulhi(int a, int b) {
+    return (a * b) >> 16;
+}
+
+inline int saturate16(int value) {
+    return value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value);
+}
+
+inline uint32_t saturate8(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Chroma contributions of a pair of pixels sharing U and V.
+struct Chroma {
+    int r, g, b;
+
+    Chroma(uint8_t Uin, uint8_t Vin) {
+        const int U = Uin - 128;
+        const int V = Vin - 128;
+        r = V * 128 + mulhi(V * 256, kRV);
+        g = mulhi(U * 256, kGU) + mulhi(V * 256, kGV);
+        b = saturate16(U * 256 + mulhi(U * 256, kBU));
+    }
+};
+
+inline uint32_t toRgbx(uint8_t Y, const Chroma& chroma, bool bgrxFormat) {
+    const int Y7 = Y << kFractionBits;
+    const uint32_t R = saturate8(saturate16(Y7 + chroma.r) >> kFractionBits);
+    const uint32_t G = saturate8(saturate16(Y7 - chroma.g) >> kFractionBits);
+    const uint32_t B = saturate8(saturate16(Y7 + chroma.b) >> kFractionBits);
+    return bgrxFormat ? ((R << 16) | (G << 8) | B | 0xFF000000)
+                      : (R | (G << 8) | (B << 16) | 0xFF000000);
+}
+
+// Row kernels convert `width` pixels of a single row.  Each pair of pixels shares the chroma
+// samples at index c/2 of their row.
+struct RowKernels {
+    // Y row and interleaved U/V row, U first.
+    void (*nv21)(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                 bool bgrxFormat);
+    // Y, U and V rows.
+    void (*yv12)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                 unsigned width, bool bgrxFormat);
+    // Y0 U Y1 V interleaved row.
+    void (*yuyv)(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat);
+};
+
+// Scalar kernels, also used for the last pixels of a row by the SIMD kernels.
+void nv21RowScalar(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                   bool bgrxFormat);
+void yv12RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                   unsigned width, bool bgrxFormat);
+void yuyvRowScalar(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat);
+
+#if defined(__i386__) || defined(__x86_64__)
+extern const RowKernels kSse2Kernels;
+extern const RowKernels kAvx2Kernels;
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+extern const RowKernels kNeonKernels;
+#endif
+
+} // namespace kernels
+} // namespace common
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif // EVS_FORMATCONVERTKERNELS_H
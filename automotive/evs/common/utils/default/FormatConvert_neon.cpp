@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FormatConvertKernels.h"
+
+#include <arm_neon.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+namespace kernels {
+
+// The kernels convert 16 pixels at a time.  Y values are loaded de-interleaved into even and odd
+// pixels, so each chroma lane lines up with both pixels that share it.  vqdmulh(a, b) computes
+// (2 * a * b) >> 16, so it is applied to U*128 and V*128 to get mulhi(U*256, b) and
+// mulhi(V*256, b).
+static inline uint8x16_t channel(int16x8_t even, int16x8_t odd) {
+    const uint8x8x2_t pixels = vzip_u8(vqshrun_n_s16(even, kFractionBits),
+                                       vqshrun_n_s16(odd, kFractionBits));
+    return vcombine_u8(pixels.val[0], pixels.val[1]);
+}
+
+static inline void convert16(uint8x8_t yEven, uint8x8_t yOdd, uint8x8_t u8, uint8x8_t v8,
+                             uint32_t* dst, bool bgrxFormat) {
+    const uint8x8_t bias = vdup_n_u8(128);
+    const int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, bias));
+    const int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, bias));
+    const int16x8_t u7 = vshlq_n_s16(u, 7);
+    const int16x8_t v7 = vshlq_n_s16(v, 7);
+    const int16x8_t rC = vaddq_s16(v7, vqdmulhq_n_s16(v7, kRV));
+    const int16x8_t gC = vaddq_s16(vqdmulhq_n_s16(u7, kGU), vqdmulhq_n_s16(v7, kGV));
+    const int16x8_t bC = vqaddq_s16(vshlq_n_s16(u, 8), vqdmulhq_n_s16(u7, kBU));
+
+    const int16x8_t even = vreinterpretq_s16_u16(vshll_n_u8(yEven, kFractionBits));
+    const int16x8_t odd = vreinterpretq_s16_u16(vshll_n_u8(yOdd, kFractionBits));
+    const uint8x16_t R = channel(vqaddq_s16(even, rC), vqaddq_s16(odd, rC));
+    const uint8x16_t G = channel(vqsubq_s16(even, gC), vqsubq_s16(odd, gC));
+    const uint8x16_t B = channel(vqaddq_s16(even, bC), vqaddq_s16(odd, bC));
+
+    uint8x16x4_t pixels;
+    pixels.val[0] = bgrxFormat ? B : R;
+    pixels.val[1] = G;
+    pixels.val[2] = bgrxFormat ? R : B;
+    pixels.val[3] = vdupq_n_u8(0xFF);
+    vst4q_u8(reinterpret_cast<uint8_t*>(dst), pixels);
+}
+
+static void nv21RowNeon(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                        bool bgrxFormat) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const uint8x8x2_t ys = vld2_u8(y + c);
+        const uint8x8x2_t uvs = vld2_u8(uv + c);
+        convert16(ys.val[0], ys.val[1], uvs.val[0], uvs.val[1], dst + c, bgrxFormat);
+    }
+    nv21RowScalar(y + c, uv + c, dst + c, width - c, bgrxFormat);
+}
+
+static void yv12RowNeon(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                        unsigned width, bool bgrxFormat) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const uint8x8x2_t ys = vld2_u8(y + c);
+        convert16(ys.val[0], ys.val[1], vld1_u8(u + c / 2), vld1_u8(v + c / 2), dst + c,
+                  bgrxFormat);
+    }
+    yv12RowScalar(y + c, u + c / 2, v + c / 2, dst + c, width - c, bgrxFormat);
+}
+
+static void yuyvRowNeon(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const uint8x8x4_t pairs = vld4_u8(yuyv + c * 2);  // Y0, U, Y1, V
+        convert16(pairs.val[0], pairs.val[2], pairs.val[1], pairs.val[3], dst + c, bgrxFormat);
+    }
+    yuyvRowScalar(yuyv + c * 2, dst + c, width - c, bgrxFormat);
+}
+
+const RowKernels kNeonKernels = {
+    nv21RowNeon,
+    yv12RowNeon,
+    yuyvRowNeon,
+};
+
+} // namespace kernels
+} // namespace common
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FormatConvertKernels.h"
+
+#include <immintrin.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+namespace kernels {
+
+// SSE2 kernels convert 16 pixels at a time.  AVX2 is only required by the functions that are
+// explicitly compiled for it, and those are only used if the CPU supports it.
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+
+// Convert 16 pixels, given their Y values and the 8 U and V values they share, as 16bit lanes.
+static inline void convert16(__m128i y, __m128i u, __m128i v, uint32_t* dst, bool bgrxFormat) {
+    const __m128i zero = _mm_setzero_si128();
+    u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+    const __m128i u8 = _mm_slli_epi16(u, 8);
+    const __m128i v8 = _mm_slli_epi16(v, 8);
+    const __m128i rC = _mm_add_epi16(_mm_slli_epi16(v, 7),
+                                     _mm_mulhi_epi16(v8, _mm_set1_epi16(kRV)));
+    const __m128i gC = _mm_add_epi16(_mm_mulhi_epi16(u8, _mm_set1_epi16(kGU)),
+                                     _mm_mulhi_epi16(v8, _mm_set1_epi16(kGV)));
+    const __m128i bC = _mm_adds_epi16(u8, _mm_mulhi_epi16(u8, _mm_set1_epi16(kBU)));
+
+    // Each chroma value applies to two pixels
+    const __m128i yLo = _mm_slli_epi16(_mm_unpacklo_epi8(y, zero), kFractionBits);
+    const __m128i yHi = _mm_slli_epi16(_mm_unpackhi_epi8(y, zero), kFractionBits);
+    const auto channel = [&](__m128i lo, __m128i hi) {
+        return _mm_packus_epi16(_mm_srai_epi16(lo, kFractionBits),
+                                _mm_srai_epi16(hi, kFractionBits));
+    };
+    const __m128i R = channel(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(rC, rC)),
+                              _mm_adds_epi16(yHi, _mm_unpackhi_epi16(rC, rC)));
+    const __m128i G = channel(_mm_subs_epi16(yLo, _mm_unpacklo_epi16(gC, gC)),
+                              _mm_subs_epi16(yHi, _mm_unpackhi_epi16(gC, gC)));
+    const __m128i B = channel(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(bC, bC)),
+                              _mm_adds_epi16(yHi, _mm_unpackhi_epi16(bC, bC)));
+
+    // Interleave into RGBx (or BGRx) pixels
+    const __m128i first = bgrxFormat ? B : R;
+    const __m128i third = bgrxFormat ? R : B;
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i xgLo = _mm_unpacklo_epi8(first, G);
+    const __m128i xgHi = _mm_unpackhi_epi8(first, G);
+    const __m128i xaLo = _mm_unpacklo_epi8(third, alpha);
+    const __m128i xaHi = _mm_unpackhi_epi8(third, alpha);
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(xgLo, xaLo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(xgLo, xaLo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(xgHi, xaHi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(xgHi, xaHi));
+}
+
+static void nv21RowSse2(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                        bool bgrxFormat) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const __m128i uvs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + c));
+        convert16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + c)),
+                  _mm_and_si128(uvs, lowBytes), _mm_srli_epi16(uvs, 8), dst + c, bgrxFormat);
+    }
+    nv21RowScalar(y + c, uv + c, dst + c, width - c, bgrxFormat);
+}
+
+static void yv12RowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                        unsigned width, bool bgrxFormat) {
+    const __m128i zero = _mm_setzero_si128();
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const __m128i us = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + c / 2));
+        const __m128i vs = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + c / 2));
+        convert16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + c)),
+                  _mm_unpacklo_epi8(us, zero), _mm_unpacklo_epi8(vs, zero), dst + c, bgrxFormat);
+    }
+    yv12RowScalar(y + c, u + c / 2, v + c / 2, dst + c, width - c, bgrxFormat);
+}
+
+static void yuyvRowSse2(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i lowWords = _mm_set1_epi32(0x0000FFFF);
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(yuyv + c * 2);
+        const __m128i x0 = _mm_loadu_si128(src);
+        const __m128i x1 = _mm_loadu_si128(src + 1);
+        const __m128i y = _mm_packus_epi16(_mm_and_si128(x0, lowBytes),
+                                           _mm_and_si128(x1, lowBytes));
+        const __m128i uv0 = _mm_srli_epi16(x0, 8);  // U0 V0 U1 V1 ...
+        const __m128i uv1 = _mm_srli_epi16(x1, 8);
+        const __m128i u = _mm_packs_epi32(_mm_and_si128(uv0, lowWords),
+                                          _mm_and_si128(uv1, lowWords));
+        const __m128i v = _mm_packs_epi32(_mm_srli_epi32(uv0, 16), _mm_srli_epi32(uv1, 16));
+        convert16(y, u, v, dst + c, bgrxFormat);
+    }
+    yuyvRowScalar(yuyv + c * 2, dst + c, width - c, bgrxFormat);
+}
+
+const RowKernels kSse2Kernels = {
+    nv21RowSse2,
+    yv12RowSse2,
+    yuyvRowSse2,
+};
+
+
+// Convert 32 pixels, given their Y values and the 16 U and V values they share, as 16bit lanes.
+AVX2_TARGET
+static inline void convert32(__m256i y, __m256i u, __m256i v, uint32_t* dst, bool bgrxFormat) {
+    const __m256i zero = _mm256_setzero_si256();
+    u = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+    v = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+    const __m256i u8 = _mm256_slli_epi16(u, 8);
+    const __m256i v8 = _mm256_slli_epi16(v, 8);
+    const __m256i rC = _mm256_add_epi16(_mm256_slli_epi16(v, 7),
+                                        _mm256_mulhi_epi16(v8, _mm256_set1_epi16(kRV)));
+    const __m256i gC = _mm256_add_epi16(_mm256_mulhi_epi16(u8, _mm256_set1_epi16(kGU)),
+                                        _mm256_mulhi_epi16(v8, _mm256_set1_epi16(kGV)));
+    const __m256i bC = _mm256_adds_epi16(u8, _mm256_mulhi_epi16(u8, _mm256_set1_epi16(kBU)));
+
+    // Unpacking works within 128bit lanes, so the low halves hold pixels 0-7 and 16-23, and the
+    // high halves pixels 8-15 and 24-31, both for Y and for the duplicated chroma values.  Packing
+    // the channels back to bytes restores the original order.
+    const __m256i yLo = _mm256_slli_epi16(_mm256_unpacklo_epi8(y, zero), kFractionBits);
+    const __m256i yHi = _mm256_slli_epi16(_mm256_unpackhi_epi8(y, zero), kFractionBits);
+    const auto channel = [&](__m256i lo, __m256i hi) AVX2_TARGET {
+        return _mm256_packus_epi16(_mm256_srai_epi16(lo, kFractionBits),
+                                   _mm256_srai_epi16(hi, kFractionBits));
+    };
+    const __m256i R = channel(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(rC, rC)),
+                              _mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(rC, rC)));
+    const __m256i G = channel(_mm256_subs_epi16(yLo, _mm256_unpacklo_epi16(gC, gC)),
+                              _mm256_subs_epi16(yHi, _mm256_unpackhi_epi16(gC, gC)));
+    const __m256i B = channel(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(bC, bC)),
+                              _mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(bC, bC)));
+
+    // Interleave into RGBx (or BGRx) pixels, then put the 128bit lanes back in order
+    const __m256i first = bgrxFormat ? B : R;
+    const __m256i third = bgrxFormat ? R : B;
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+    const __m256i xgLo = _mm256_unpacklo_epi8(first, G);   // pixels 0-7, 16-23
+    const __m256i xgHi = _mm256_unpackhi_epi8(first, G);   // pixels 8-15, 24-31
+    const __m256i xaLo = _mm256_unpacklo_epi8(third, alpha);
+    const __m256i xaHi = _mm256_unpackhi_epi8(third, alpha);
+    const __m256i p0 = _mm256_unpacklo_epi16(xgLo, xaLo);  // pixels 0-3, 16-19
+    const __m256i p1 = _mm256_unpackhi_epi16(xgLo, xaLo);  // pixels 4-7, 20-23
+    const __m256i p2 = _mm256_unpacklo_epi16(xgHi, xaHi);  // pixels 8-11, 24-27
+    const __m256i p3 = _mm256_unpackhi_epi16(xgHi, xaHi);  // pixels 12-15, 28-31
+    __m256i* out = reinterpret_cast<__m256i*>(dst);
+    _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+AVX2_TARGET
+static void nv21RowAvx2(const uint8_t* y, const uint8_t* uv, uint32_t* dst, unsigned width,
+                        bool bgrxFormat) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    unsigned c = 0;
+    for (; c + 32 <= width; c += 32) {
+        const __m256i uvs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + c));
+        convert32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + c)),
+                  _mm256_and_si256(uvs, lowBytes), _mm256_srli_epi16(uvs, 8), dst + c,
+                  bgrxFormat);
+    }
+    nv21RowSse2(y + c, uv + c, dst + c, width - c, bgrxFormat);
+}
+
+AVX2_TARGET
+static void yv12RowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst,
+                        unsigned width, bool bgrxFormat) {
+    unsigned c = 0;
+    for (; c + 32 <= width; c += 32) {
+        const __m128i us = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + c / 2));
+        const __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + c / 2));
+        convert32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + c)),
+                  _mm256_cvtepu8_epi16(us), _mm256_cvtepu8_epi16(vs), dst + c, bgrxFormat);
+    }
+    yv12RowSse2(y + c, u + c / 2, v + c / 2, dst + c, width - c, bgrxFormat);
+}
+
+AVX2_TARGET
+static void yuyvRowAvx2(const uint8_t* yuyv, uint32_t* dst, unsigned width, bool bgrxFormat) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    const __m256i lowWords = _mm256_set1_epi32(0x0000FFFF);
+    unsigned c = 0;
+    for (; c + 32 <= width; c += 32) {
+        const __m256i* src = reinterpret_cast<const __m256i*>(yuyv + c * 2);
+        const __m256i x0 = _mm256_loadu_si256(src);
+        const __m256i x1 = _mm256_loadu_si256(src + 1);
+        // Packing interleaves the 128bit lanes of both sources, 0xD8 puts them back in order
+        const __m256i y = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(_mm256_and_si256(x0, lowBytes), _mm256_and_si256(x1, lowBytes)),
+                0xD8);
+        const __m256i uv0 = _mm256_srli_epi16(x0, 8);  // U0 V0 U1 V1 ...
+        const __m256i uv1 = _mm256_srli_epi16(x1, 8);
+        const __m256i u = _mm256_permute4x64_epi64(
+                _mm256_packs_epi32(_mm256_and_si256(uv0, lowWords),
+                                   _mm256_and_si256(uv1, lowWords)),
+                0xD8);
+        const __m256i v = _mm256_permute4x64_epi64(
+                _mm256_packs_epi32(_mm256_srli_epi32(uv0, 16), _mm256_srli_epi32(uv1, 16)), 0xD8);
+        convert32(y, u, v, dst + c, bgrxFormat);
+    }
+    yuyvRowSse2(yuyv + c * 2, dst + c, width - c, bgrxFormat);
+}
+
+const RowKernels kAvx2Kernels = {
+    nv21RowAvx2,
+    yv12RowAvx2,
+    yuyvRowAvx2,
+};
+
+} // namespace kernels
+} // namespace common
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVS_VTS_CONVERSIONPOOL_H
+#define EVS_VTS_CONVERSIONPOOL_H
+
+#include "FormatConvert.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+
+// Runs the Utils format conversions on a set of worker threads shared by all camera streams.
+// Each frame is split into bands of rows, so a single frame is converted in parallel, and frames
+// of several streams delivered at the same time are converted concurrently instead of one after
+// the other.  Latency and throughput are tracked per stream.
+//
+// Its users are the EVS VTS frame handlers, which convert every received frame for display.  The
+// default EVS cameras fill RGBA test frames in place, so they have no conversion to run on it.
+class ConversionPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct StreamStats {
+        uint64_t frames = 0;
+        uint64_t pixels = 0;
+        Clock::duration totalLatency{0};    // From the convert() call until the frame is done
+        Clock::duration maxLatency{0};
+        Clock::time_point firstFrame;       // When the first and the last frame were done
+        Clock::time_point lastFrame;
+
+        Clock::duration averageLatency() const;
+        double framesPerSecond() const;
+    };
+
+    // The pool shared by the whole process, with as many threads as there are CPU cores,
+    // including the threads calling convert().
+    static ConversionPool& getInstance();
+
+    // Create a pool with the given number of worker threads.  Threads calling convert() work on
+    // their own frames too, so a pool without workers converts every frame on its caller.
+    explicit ConversionPool(unsigned numWorkers);
+    ~ConversionPool();
+
+    // Convert a frame like Utils::convertRows() does for all rows, and return once it's done.
+    // streamId identifies the stream the frame belongs to in the stats, like a camera id.
+    // Can be called from any number of threads at the same time.
+    void convert(const std::string& streamId, Utils::SourceFormat format,
+                 unsigned width, unsigned height,
+                 uint8_t* src, unsigned srcStridePixels,
+                 uint32_t* dst, unsigned dstStridePixels,
+                 bool bgrxFormat = false);
+
+    StreamStats getStats(const std::string& streamId);
+    void resetStats(const std::string& streamId);
+
+private:
+    // A frame being converted.  It lives on the stack of the thread that called convert(), which
+    // waits until all bands are done.
+    struct Job {
+        Utils::SourceFormat format;
+        unsigned width;
+        unsigned height;
+        uint8_t* src;
+        unsigned srcStridePixels;
+        uint32_t* dst;
+        unsigned dstStridePixels;
+        bool bgrxFormat;
+
+        unsigned rowsPerBand;
+        unsigned numBands;
+        unsigned nextBand = 0;      // Protected by mLock, as are the members below
+        unsigned bandsDone = 0;
+    };
+
+    // Take the next band of the given job, or of the oldest queued one if job is nullptr.
+    // Returns nullptr if there is none.  Must be called with mLock held.
+    Job* takeBand(Job* job, unsigned* band);
+    void convertBand(const Job& job, unsigned band);
+    void finishBand(Job* job);
+    void workerLoop();
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mLock;
+    std::condition_variable mWorkSignal;    // Signaled when a job is queued or on shutdown
+    std::condition_variable mDoneSignal;    // Signaled when the last band of a job is done
+    std::deque<Job*> mJobs;                 // Jobs with bands not taken yet
+    bool mShutdown = false;
+
+    std::mutex mStatsLock;
+    std::unordered_map<std::string, StreamStats> mStats;
+};
+
+} // namespace common
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif // EVS_VTS_CONVERSIONPOOL_H
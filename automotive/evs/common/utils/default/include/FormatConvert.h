@@ -19,6 +19,7 @@
 
 #include <queue>
 #include <stdint.h>
+#include <vector>
 
 
 namespace android {
@@ -29,6 +30,23 @@ namespace common {
 
 class Utils {
 public:
+    // Instruction set extensions the YUV conversions below can use.  All of them produce exactly
+    // the same output, using fixed point arithmetic.
+    enum class SimdLevel {
+        NONE,
+        SSE2,
+        AVX2,
+        NEON,
+    };
+
+    // Levels supported by the CPU, the best one last.  It is used unless setSimdLevel() is called.
+    static std::vector<SimdLevel> getSupportedSimdLevels();
+    static SimdLevel getSimdLevel();
+
+    // Select the instruction set to use for all following conversions, mainly for testing and
+    // benchmarking.  Returns false if it is not supported by the CPU.
+    static bool setSimdLevel(SimdLevel level);
+
     // Given an image buffer in NV21 format (HAL_PIXEL_FORMAT_YCRCB_420_SP), output 32bit RGBx/BGRx
     // values.  The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
     // U/V array.  It assumes an even width and height for the overall image, and a horizontal
@@ -71,6 +89,23 @@ public:
                                 uint32_t* dst, unsigned dstStrideBytes);
 
 
+    // Source formats of convertRows(), see the copy*toRGB32() functions above.
+    enum class SourceFormat {
+        NV21,
+        YV12,
+        YUYV,
+    };
+
+    // Convert only the rows [firstRow, firstRow + numRows) of a width x height image, exactly like
+    // the corresponding copy*toRGB32() function does for the whole image.  Separate row ranges can
+    // be converted concurrently; this is how ConversionPool splits frames into bands.
+    // srcStridePixels is only used for YUYV.
+    static void convertRows(SourceFormat format, unsigned width, unsigned height,
+                            uint8_t* src, unsigned srcStridePixels,
+                            uint32_t* dst, unsigned dstStridePixels,
+                            bool bgrxFormat, unsigned firstRow, unsigned numRows);
+
+
     // Given an simple rectangular image buffer with an integer number of bytes per pixel,
     // copy the pixel values into a new rectangular buffer (potentially with a different stride).
     // This is typically used to copy RGBx data into an RGBx output buffer.
@@ -82,12 +117,6 @@ public:
 private:
     template<unsigned alignment>
     static int align(int value);
-
-    static inline float clamp(float v, float min, float max);
-    static uint32_t yuvToRgbx(const unsigned char Y,
-                              const unsigned char Uin,
-                              const unsigned char Vin,
-                              bool bgrxFormat = false);
 };
 
 } // namespace common
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "ConversionPool.h"
+#include "FormatConvert.h"
+
+using android::hardware::automotive::evs::common::ConversionPool;
+using android::hardware::automotive::evs::common::Utils;
+
+namespace {
+
+// Camera frame sizes, the arguments are SimdLevel, width and height.
+void frameSizes(benchmark::internal::Benchmark* b) {
+    for (auto level : Utils::getSupportedSimdLevels()) {
+        b->Args({static_cast<int>(level), 640, 480});
+        b->Args({static_cast<int>(level), 1280, 720});
+        b->Args({static_cast<int>(level), 1920, 1080});
+    }
+}
+
+// Arbitrary input bytes like the fuzzer gets, large enough for any of the formats.
+std::vector<uint8_t> makeInput(unsigned width, unsigned height) {
+    std::vector<uint8_t> src(width * height * 2);
+    std::srand(0);
+    for (auto& value : src) {
+        value = std::rand();
+    }
+    return src;
+}
+
+template <typename Convert>
+void runConversion(benchmark::State& state, Convert convert) {
+    const auto level = static_cast<Utils::SimdLevel>(state.range(0));
+    const unsigned width = state.range(1);
+    const unsigned height = state.range(2);
+    Utils::setSimdLevel(level);
+
+    auto src = makeInput(width, height);
+    std::vector<uint32_t> dst(width * height);
+    for (auto _ : state) {
+        convert(width, height, src.data(), dst.data());
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+    Utils::setSimdLevel(Utils::getSupportedSimdLevels().back());
+}
+
+void BM_NV21toRGB32(benchmark::State& state) {
+    runConversion(state, [](unsigned width, unsigned height, uint8_t* src, uint32_t* dst) {
+        Utils::copyNV21toRGB32(width, height, src, dst, width);
+    });
+}
+BENCHMARK(BM_NV21toRGB32)->Apply(frameSizes);
+
+void BM_YV12toRGB32(benchmark::State& state) {
+    runConversion(state, [](unsigned width, unsigned height, uint8_t* src, uint32_t* dst) {
+        Utils::copyYV12toRGB32(width, height, src, dst, width);
+    });
+}
+BENCHMARK(BM_YV12toRGB32)->Apply(frameSizes);
+
+void BM_YUYVtoRGB32(benchmark::State& state) {
+    runConversion(state, [](unsigned width, unsigned height, uint8_t* src, uint32_t* dst) {
+        Utils::copyYUYVtoRGB32(width, height, src, width, dst, width);
+    });
+}
+BENCHMARK(BM_YUYVtoRGB32)->Apply(frameSizes);
+
+void BM_YUYVtoBGR32(benchmark::State& state) {
+    runConversion(state, [](unsigned width, unsigned height, uint8_t* src, uint32_t* dst) {
+        Utils::copyYUYVtoBGR32(width, height, src, width, dst, width);
+    });
+}
+BENCHMARK(BM_YUYVtoBGR32)->Apply(frameSizes);
+
+// Several cameras streaming at once, each benchmark thread being one of them.  Compares
+// converting each frame on the thread that delivers it with handing it to the shared pool.
+void BM_MultiStream_Direct(benchmark::State& state) {
+    const unsigned width = 1280, height = 720;
+    auto src = makeInput(width, height);
+    std::vector<uint32_t> dst(width * height);
+    for (auto _ : state) {
+        Utils::copyYUYVtoRGB32(width, height, src.data(), width, dst.data(), width);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MultiStream_Direct)->ThreadRange(1, 4)->UseRealTime();
+
+void BM_MultiStream_Pool(benchmark::State& state) {
+    const unsigned width = 1280, height = 720;
+    static std::atomic<int> sNextStream{0};
+    const std::string streamId = "camera" + std::to_string(sNextStream++);
+    auto src = makeInput(width, height);
+    std::vector<uint32_t> dst(width * height);
+    auto& pool = ConversionPool::getInstance();
+    pool.resetStats(streamId);
+    for (auto _ : state) {
+        pool.convert(streamId, Utils::SourceFormat::YUYV, width, height, src.data(), width,
+                     dst.data(), width);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    const auto stats = pool.getStats(streamId);
+    state.counters["avg_latency_us"] =
+            std::chrono::duration<double, std::micro>(stats.averageLatency()).count();
+    state.counters["max_latency_us"] =
+            std::chrono::duration<double, std::micro>(stats.maxLatency).count();
+}
+BENCHMARK(BM_MultiStream_Pool)->ThreadRange(1, 4)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -18,8 +18,43 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <vector>
+#include "ConversionPool.h"
 #include "FormatConvert.h"
 
+using android::hardware::automotive::evs::common::ConversionPool;
+using android::hardware::automotive::evs::common::Utils;
+
+#if defined(COPY_NV21_TO_RGB32) || defined(COPY_NV21_TO_BGR32)
+static constexpr Utils::SourceFormat kSourceFormat = Utils::SourceFormat::NV21;
+#elif defined(COPY_YV12_TO_RGB32) || defined(COPY_YV12_TO_BGR32)
+static constexpr Utils::SourceFormat kSourceFormat = Utils::SourceFormat::YV12;
+#else
+static constexpr Utils::SourceFormat kSourceFormat = Utils::SourceFormat::YUYV;
+#endif
+
+#if defined(COPY_NV21_TO_BGR32) || defined(COPY_YV12_TO_BGR32) || defined(COPY_YUYV_TO_BGR32)
+static constexpr bool kBgrxFormat = true;
+#else
+static constexpr bool kBgrxFormat = false;
+#endif
+
+static void convert(int width, int height, uint8_t* src, uint32_t* tgt) {
+#ifdef COPY_NV21_TO_RGB32
+    Utils::copyNV21toRGB32(width, height, src, tgt, 0);
+#elif COPY_NV21_TO_BGR32
+    Utils::copyNV21toBGR32(width, height, src, tgt, 0);
+#elif COPY_YV12_TO_RGB32
+    Utils::copyYV12toRGB32(width, height, src, tgt, 0);
+#elif COPY_YV12_TO_BGR32
+    Utils::copyYV12toBGR32(width, height, src, tgt, 0);
+#elif COPY_YUYV_TO_RGB32
+    Utils::copyYUYVtoRGB32(width, height, src, 0, tgt, 0);
+#elif COPY_YUYV_TO_BGR32
+    Utils::copyYUYVtoBGR32(width, height, src, 0, tgt, 0);
+#endif
+}
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) {
     if (size < 256) {
         return 0;
@@ -30,27 +65,41 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) {
     int width = (int)sqrt(size);
     int height = width * ((float)random_variable / 10.0);
 
-    uint8_t* src = (uint8_t*)malloc(sizeof(uint8_t) * size);
+    // With the row strides padded to 16 bytes, an image of this size may need up to three times
+    // as many bytes as the input has.  The rest of the buffer is left zero.
+    uint8_t* src = (uint8_t*)calloc(3 * size, sizeof(uint8_t));
     memcpy(src, data, sizeof(uint8_t) * (size));
-    uint32_t* tgt = (uint32_t*)malloc(sizeof(uint32_t) * size);
+    uint32_t* tgt = (uint32_t*)calloc(size, sizeof(uint32_t));
 
-#ifdef COPY_NV21_TO_RGB32
-    android::hardware::automotive::evs::common::Utils::copyNV21toRGB32(width, height, src, tgt, 0);
-#elif COPY_NV21_TO_BGR32
-    android::hardware::automotive::evs::common::Utils::copyNV21toBGR32(width, height, src, tgt, 0);
-#elif COPY_YV12_TO_RGB32
-    android::hardware::automotive::evs::common::Utils::copyYV12toRGB32(width, height, src, tgt, 0);
-#elif COPY_YV12_TO_BGR32
-    android::hardware::automotive::evs::common::Utils::copyYV12toBGR32(width, height, src, tgt, 0);
-#elif COPY_YUYV_TO_RGB32
-    android::hardware::automotive::evs::common::Utils::copyYUYVtoRGB32(width, height, src, 0, tgt,
-                                                                       0);
-#elif COPY_YUYV_TO_BGR32
-    android::hardware::automotive::evs::common::Utils::copyYUYVtoBGR32(width, height, src, 0, tgt,
-                                                                       0);
-#endif
+    // Every SIMD level has to produce exactly the same output as the scalar conversion.
+    const std::vector<Utils::SimdLevel> levels = Utils::getSupportedSimdLevels();
+    Utils::setSimdLevel(Utils::SimdLevel::NONE);
+    convert(width, height, src, tgt);
+    uint32_t* simdTgt = (uint32_t*)malloc(sizeof(uint32_t) * size);
+    for (size_t i = 1; i < levels.size(); i++) {
+        memcpy(simdTgt, tgt, sizeof(uint32_t) * size);
+        Utils::setSimdLevel(levels[i]);
+        convert(width, height, src, simdTgt);
+        if (memcmp(simdTgt, tgt, sizeof(uint32_t) * size) != 0) {
+            abort();
+        }
+    }
+    Utils::setSimdLevel(levels.back());
+
+    // Converting in bands on several threads has to produce the same image as converting it at
+    // once.  Unlike above, every row goes to its own place in the target.
+    static ConversionPool sPool(3);
+    Utils::convertRows(kSourceFormat, width, height, src, width, tgt, width, kBgrxFormat,
+                       0, height);
+    memset(simdTgt, 0, sizeof(uint32_t) * size);
+    sPool.convert("fuzzer", kSourceFormat, width, height, src, width, simdTgt, width,
+                  kBgrxFormat);
+    if (memcmp(simdTgt, tgt, sizeof(uint32_t) * size) != 0) {
+        abort();
+    }
 
     free(src);
+    free(simdTgt);
     free(tgt);
 
     return 0;
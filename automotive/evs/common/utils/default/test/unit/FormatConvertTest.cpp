@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "FormatConvert.h"
+
+using android::hardware::automotive::evs::common::Utils;
+
+namespace {
+
+struct Size {
+    unsigned width;
+    unsigned height;
+};
+
+// Odd widths leave a tail for the scalar code after every SIMD block size, odd heights a last
+// luminance row with a chroma row of its own.
+const Size kSizes[] = {{1, 1},  {2, 2},  {7, 3},   {15, 5},  {16, 16},  {17, 4},
+                       {31, 2}, {33, 7}, {64, 8},  {65, 9},  {127, 3},  {641, 6}};
+
+// Bytes a source of the given format and size takes, see Utils::convertRows, plus a row of room
+// for the extra chroma row of odd heights.  YUYV rows are srcStridePixels long.
+size_t sourceBytes(Utils::SourceFormat format, const Size& size, unsigned srcStridePixels) {
+    const size_t strideLum = (size.width + 15) & ~15u;
+    switch (format) {
+        case Utils::SourceFormat::NV21:
+            return strideLum * size.height + strideLum * (size.height / 2 + 1);
+        case Utils::SourceFormat::YV12: {
+            const size_t strideColor = (strideLum / 2 + 15) & ~15u;
+            return strideLum * size.height + 2 * strideColor * (size.height / 2 + 1);
+        }
+        case Utils::SourceFormat::YUYV:
+        default:
+            return srcStridePixels * 2 * size.height;
+    }
+}
+
+std::vector<uint8_t> makeSource(size_t bytes, unsigned seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> src(bytes);
+    for (auto& value : src) value = random();
+    return src;
+}
+
+// Converts a zeroed destination with rows dstStridePixels apart.
+std::vector<uint32_t> convert(Utils::SimdLevel level, Utils::SourceFormat format, const Size& size,
+                              std::vector<uint8_t>& src, unsigned srcStridePixels,
+                              unsigned dstStridePixels, bool bgrxFormat) {
+    EXPECT_TRUE(Utils::setSimdLevel(level));
+    std::vector<uint32_t> dst(dstStridePixels * size.height);
+    Utils::convertRows(format, size.width, size.height, src.data(), srcStridePixels, dst.data(),
+                       dstStridePixels, bgrxFormat, 0, size.height);
+    return dst;
+}
+
+class FormatConvertTest : public ::testing::TestWithParam<Utils::SourceFormat> {
+  protected:
+    void TearDown() override { Utils::setSimdLevel(Utils::getSupportedSimdLevels().back()); }
+};
+
+// Every supported level writes exactly what the scalar conversion writes, and nothing between
+// the rows.
+TEST_P(FormatConvertTest, simdLevelsMatchScalar) {
+    const auto format = GetParam();
+    unsigned seed = 0;
+    for (const auto& size : kSizes) {
+        const unsigned srcStridePixels = size.width + 5;
+        const unsigned dstStridePixels = size.width + 3;
+        auto src = makeSource(sourceBytes(format, size, srcStridePixels), seed++);
+        for (bool bgrxFormat : {false, true}) {
+            const auto expected = convert(Utils::SimdLevel::NONE, format, size, src,
+                                          srcStridePixels, dstStridePixels, bgrxFormat);
+            for (unsigned r = 0; r < size.height; r++) {
+                for (unsigned c = size.width; c < dstStridePixels; c++) {
+                    ASSERT_EQ(0u, expected[r * dstStridePixels + c]);
+                }
+            }
+            for (auto level : Utils::getSupportedSimdLevels()) {
+                EXPECT_EQ(expected, convert(level, format, size, src, srcStridePixels,
+                                            dstStridePixels, bgrxFormat))
+                        << "level " << static_cast<int>(level) << ", " << size.width << "x"
+                        << size.height << (bgrxFormat ? " BGRx" : " RGBx");
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, FormatConvertTest,
+                         ::testing::Values(Utils::SourceFormat::NV21, Utils::SourceFormat::YV12,
+                                           Utils::SourceFormat::YUYV));
+
+float clampChannel(float value) {
+    return value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+}
+
+// The fixed point conversion is within one of the float conversion it replaced, for every
+// (Y, U, V).  0.48% of the channel values differ.
+TEST(FormatConvertFloatTest, withinOneOfFloatConversion) {
+    // One YUYV image per U, with V by row and Y by column.
+    const Size size = {256, 256};
+    std::vector<uint8_t> src(size.width * size.height * 2);
+    std::vector<uint32_t> dst(size.width * size.height);
+    size_t differing = 0;
+    for (unsigned U = 0; U < 256; U++) {
+        for (unsigned V = 0; V < size.height; V++) {
+            for (unsigned Y = 0; Y < size.width; Y++) {
+                uint8_t* pixel = &src[(V * size.width + Y) * 2];
+                pixel[0] = Y;
+                pixel[1] = (Y % 2 == 0) ? U : V;
+            }
+        }
+        Utils::copyYUYVtoRGB32(size.width, size.height, src.data(), size.width, dst.data(),
+                               size.width);
+
+        for (unsigned V = 0; V < size.height; V++) {
+            for (unsigned Y = 0; Y < size.width; Y++) {
+                const float u = U - 128.0f;
+                const float v = V - 128.0f;
+                const int expected[] = {
+                        static_cast<uint8_t>(clampChannel(Y + 1.140f * v)),
+                        static_cast<uint8_t>(clampChannel(Y - 0.395f * u - 0.581f * v)),
+                        static_cast<uint8_t>(clampChannel(Y + 2.032f * u)),
+                };
+                const uint32_t pixel = dst[V * size.width + Y];
+                for (int channel = 0; channel < 3; channel++) {
+                    const int actual = (pixel >> (8 * channel)) & 0xFF;
+                    ASSERT_LE(std::abs(actual - expected[channel]), 1)
+                            << "Y " << Y << ", U " << U << ", V " << V;
+                    if (actual != expected[channel]) differing++;
+                }
+            }
+        }
+    }
+    EXPECT_LT(differing, 256u * 256 * 256 * 3 / 200);
+}
+
+}  // namespace
@@ -16,9 +16,12 @@
 
 #include "SurroundView2dSession.h"
 
+#include <android-base/properties.h>
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -26,13 +29,49 @@ namespace sv {
 namespace V1_0 {
 namespace implementation {
 
+// Size of the synthesized camera images
+static const unsigned kCameraWidth = 1280;
+static const unsigned kCameraHeight = 720;
+
+// Footprint of the car in the middle of the 2d view, in milli-meters
+static const float kCarWidth = 1900;
+static const float kCarLength = 4600;
+
+// How often to log the time spent stitching, in frames
+static const int kStitchStatsInterval = 100;
+
+// Set to true to stitch every frame and log the time it takes
+static const char kStitchProperty[] = "persist.vendor.automotive.sv.stitch";
+
 SurroundView2dSession::SurroundView2dSession() :
-    mStreamState(STOPPED) {
+    mStreamState(STOPPED),
+    mStitchEnabled(android::base::GetBoolProperty(kStitchProperty, false)),
+    mStitcher(mStitchEnabled ? std::max(std::thread::hardware_concurrency(), 1u) : 1) {
     mEvsCameraIds = {"0" , "1", "2", "3"};
 
     mConfig.width = 640;
     mConfig.blending = SvQuality::HIGH;
 
+    mMappingInfo.width = 8000; // keeps ratio to 4:3
+    mMappingInfo.height = 6000;
+    mMappingInfo.center.isValid = true;
+    mMappingInfo.center.x = 0;
+    mMappingInfo.center.y = 0;
+
+    // A grid in a different color for each camera, so the seams between them are visible
+    const uint32_t colors[] = {0xFF0000FF, 0xFF00FF00, 0xFFFF0000, 0xFF00FFFF};
+    for (unsigned i = 0; mStitchEnabled && i < mEvsCameraIds.size(); i++) {
+        std::vector<uint32_t> image(kCameraWidth * kCameraHeight);
+        for (unsigned y = 0; y < kCameraHeight; y++) {
+            for (unsigned x = 0; x < kCameraWidth; x++) {
+                const bool line = x % 64 < 2 || y % 64 < 2;
+                image[y * kCameraWidth + x] = line ? 0xFFFFFFFF : colors[i % 4];
+            }
+        }
+        mCameraImages.push_back(std::move(image));
+        mStitcherInputs.push_back({mCameraImages.back().data(), kCameraWidth});
+    }
+
     framesRecord.frames.svBuffers.resize(1);
     framesRecord.frames.svBuffers[0].viewId = 0;
     framesRecord.frames.svBuffers[0].hardwareBuffer.nativeHandle =
@@ -108,13 +147,7 @@ Return<void> SurroundView2dSession::get2dMappingInfo(
     ALOGD("SurroundView2dSession::get2dMappingInfo");
     std::unique_lock <std::mutex> lock(mAccessLock);
 
-    Sv2dMappingInfo info;
-    info.width = 8; // keeps ratio to 4:3
-    info.height = 6;
-    info.center.isValid = true;
-    info.center.x = 0;
-    info.center.y = 0;
-    _hidl_cb(info);
+    _hidl_cb(mMappingInfo);
     return android::hardware::Void();
 }
 
@@ -207,6 +240,7 @@ void SurroundView2dSession::generateFrames() {
                 mConfig.width * 3 / 4;
         }
 
+        stitchFrame();
         usleep(100 * 1000);
 
         framesRecord.frames.timestampNs = elapsedRealtimeNano();
@@ -231,6 +265,55 @@ void SurroundView2dSession::generateFrames() {
     mStream->notify(SvEvent::STREAM_STOPPED);
 }
 
+void SurroundView2dSession::stitchFrame() {
+    if (!mStitchEnabled) {
+        return;
+    }
+
+    Sv2dConfig config;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        config = mConfig;
+    }
+
+    // Rebuild the lookup tables when the output size or blending changes
+    if (config.width != mStitcherConfig.width || config.blending != mStitcherConfig.blending) {
+        SurroundView2dStitcher::GroundArea area;
+        area.width = mMappingInfo.width;
+        area.height = mMappingInfo.height;
+        area.centerX = mMappingInfo.center.x;
+        area.centerY = mMappingInfo.center.y;
+        area.carWidth = kCarWidth;
+        area.carLength = kCarLength;
+
+        const unsigned width = config.width;
+        const unsigned height = config.width * 3 / 4;
+        mStitcherReady = mStitcher.setup(
+            area, SurroundView2dStitcher::defaultCameras(kCameraWidth, kCameraHeight),
+            width, height, config.blending == SvQuality::HIGH);
+        mStitcherConfig = config;
+        if (!mStitcherReady) {
+            ALOGE("Failed to set up stitching for a %u x %u frame", width, height);
+        }
+        mOutputImage.resize(width * height);
+    }
+    if (!mStitcherReady) {
+        return;
+    }
+
+    const int64_t start = elapsedRealtimeNano();
+    mStitcher.stitch(mStitcherInputs, mOutputImage.data(), mStitcher.getOutputWidth());
+    mStitchTimeNs += elapsedRealtimeNano() - start;
+
+    if (++mStitchedFrames == kStitchStatsInterval) {
+        ALOGD("Stitched %d frames of %u x %u in %.2f ms on average", mStitchedFrames,
+              mStitcher.getOutputWidth(), mStitcher.getOutputHeight(),
+              mStitchTimeNs / 1e6 / mStitchedFrames);
+        mStitchedFrames = 0;
+        mStitchTimeNs = 0;
+    }
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
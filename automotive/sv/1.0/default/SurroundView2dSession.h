@@ -23,6 +23,9 @@
 #include <hidl/Status.h>
 
 #include <thread>
+#include <vector>
+
+#include "SurroundView2dStitcher.h"
 
 using namespace ::android::hardware::automotive::sv::V1_0;
 using ::android::hardware::Return;
@@ -63,6 +66,7 @@ public:
 
 private:
     void generateFrames();
+    void stitchFrame();
 
     enum StreamStateValues {
         STOPPED,
@@ -73,6 +77,7 @@ private:
     StreamStateValues mStreamState;
 
     Sv2dConfig mConfig;
+    Sv2dMappingInfo mMappingInfo;
 
     std::thread mCaptureThread; // The thread we'll use to synthesize frames
 
@@ -87,6 +92,20 @@ private:
     std::mutex mAccessLock;
 
     std::vector<std::string> mEvsCameraIds;
+
+    // Stitches test images of the cameras into each frame, so the default implementation does
+    // the work of a real one.  The frames sent to the stream don't carry the stitched image, so
+    // this only runs when enabled with a system property, to measure it.  Only used by
+    // mCaptureThread.
+    const bool mStitchEnabled;
+    SurroundView2dStitcher mStitcher;
+    std::vector<std::vector<uint32_t>> mCameraImages;
+    std::vector<SurroundView2dStitcher::Image> mStitcherInputs;
+    std::vector<uint32_t> mOutputImage;
+    Sv2dConfig mStitcherConfig = {};        // The config the stitcher was last set up for
+    bool mStitcherReady = false;
+    int mStitchedFrames = 0;
+    int64_t mStitchTimeNs = 0;              // Since the stitching stats were last logged
 };
 
 }  // namespace implementation
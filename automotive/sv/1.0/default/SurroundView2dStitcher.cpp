@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SurroundView2dStitcher"
+
+#include "SurroundView2dStitcher.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// 32 RGBA pixels are two cache lines of an output row
+static constexpr unsigned kTileWidth = 32;
+static constexpr unsigned kTileHeight = 16;
+
+// The lookup table can't address more cameras, or larger images
+static constexpr unsigned kMaxCameras = 256;
+static constexpr unsigned kMaxImageSize = 65535;
+
+// Width of the band along the image edges where a camera's weight falls off to zero when
+// blending, as a fraction of the image size
+static constexpr float kEdgeFeather = 0.05f;
+
+
+// Where a camera sees a point on the ground, and how well.
+struct Projection {
+    float u;
+    float v;
+    float weight;
+};
+
+
+// A camera's axes in car coordinates: x and y along the image rows and columns, z along the
+// optical axis.
+struct CameraAxes {
+    float x[3];
+    float y[3];
+    float z[3];
+};
+
+
+static CameraAxes getAxes(const SurroundView2dStitcher::CameraParams& camera) {
+    const float heading[3] = {std::sin(camera.yaw), std::cos(camera.yaw), 0};
+    const float cosPitch = std::cos(camera.pitch);
+    const float sinPitch = std::sin(camera.pitch);
+
+    CameraAxes axes;
+    axes.x[0] = heading[1];
+    axes.x[1] = -heading[0];
+    axes.x[2] = 0;
+    for (int i = 0; i < 3; i++) {
+        axes.y[i] = -sinPitch * heading[i];
+        axes.z[i] = cosPitch * heading[i];
+    }
+    axes.y[2] = -cosPitch;
+    axes.z[2] = -sinPitch;
+    return axes;
+}
+
+
+// Project a point on the ground into a camera image.  Returns false if the camera doesn't see
+// it, or too close to the image edges to be sampled.
+static bool project(const SurroundView2dStitcher::CameraParams& camera, const CameraAxes& axes,
+                    float groundX, float groundY, Projection* projection) {
+    const float d[3] = {
+        groundX - camera.position[0],
+        groundY - camera.position[1],
+        -camera.position[2],
+    };
+    const float x = d[0] * axes.x[0] + d[1] * axes.x[1] + d[2] * axes.x[2];
+    const float y = d[0] * axes.y[0] + d[1] * axes.y[1] + d[2] * axes.y[2];
+    const float z = d[0] * axes.z[0] + d[1] * axes.z[1] + d[2] * axes.z[2];
+
+    const float radius = std::sqrt(x * x + y * y);
+    const float theta = std::atan2(radius, z);
+    const float maxTheta = camera.fieldOfView / 2;
+    if (theta >= maxTheta || radius == 0) {
+        // Points right on the optical axis are never on the ground for a camera looking down
+        // at an angle
+        return false;
+    }
+
+    // Equidistant fisheye: the distance from the principal point grows with the angle
+    const float r = camera.focalLength * theta;
+    const float u = camera.principalX + r * x / radius;
+    const float v = camera.principalY + r * y / radius;
+
+    // Keep the 2x2 neighbourhood used for bilinear sampling inside the image
+    const float maxU = camera.width - 1;
+    const float maxV = camera.height - 1;
+    if (u < 0 || v < 0 || u >= maxU || v >= maxV) {
+        return false;
+    }
+
+    const float feather = kEdgeFeather * std::min(camera.width, camera.height);
+    const float edge = std::min({u, v, maxU - u, maxV - v});
+    projection->u = u;
+    projection->v = v;
+    projection->weight = (1 - theta / maxTheta) * std::min(1.0f, edge / feather);
+    return true;
+}
+
+
+static uint32_t lerp(uint32_t a, uint32_t b, uint32_t f) {
+    // Two channels at a time, each in the lower byte of a 16 bit half.  With f below 256, the
+    // sums of the products fit the halves.
+    const uint32_t rb = ((a & 0x00FF00FF) * (256 - f) + (b & 0x00FF00FF) * f) >> 8;
+    const uint32_t ga = ((a >> 8) & 0x00FF00FF) * (256 - f) + ((b >> 8) & 0x00FF00FF) * f;
+    return (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+}
+
+
+static uint32_t sample(const SurroundView2dStitcher::Image& image,
+                       unsigned x, unsigned y, unsigned fx, unsigned fy) {
+    const uint32_t* p = image.pixels + y * image.stride + x;
+    const uint32_t top = lerp(p[0], p[1], fx);
+    const uint32_t bottom = lerp(p[image.stride], p[image.stride + 1], fx);
+    return lerp(top, bottom, fy);
+}
+
+
+std::vector<SurroundView2dStitcher::CameraParams>
+SurroundView2dStitcher::defaultCameras(unsigned width, unsigned height) {
+    const float kPi = 3.14159265f;
+    const float fieldOfView = 190 * kPi / 180;
+
+    CameraParams camera = {};
+    camera.width = width;
+    camera.height = height;
+    camera.principalX = width / 2.0f;
+    camera.principalY = height / 2.0f;
+    camera.fieldOfView = fieldOfView;
+
+    // The image circle covers the image diagonal
+    camera.focalLength = std::sqrt(static_cast<float>(width * width + height * height)) /
+                         fieldOfView;
+
+    // Front and rear cameras in the bumpers, side cameras under the mirrors
+    std::vector<CameraParams> cameras(4, camera);
+    const float positions[4][3] = {
+        {0, 2300, 600},
+        {1000, 900, 1000},
+        {0, -2300, 800},
+        {-1000, 900, 1000},
+    };
+    for (unsigned i = 0; i < 4; i++) {
+        std::copy(positions[i], positions[i] + 3, cameras[i].position);
+        cameras[i].yaw = i * kPi / 2;
+        cameras[i].pitch = (i % 2 == 0 ? 30 : 45) * kPi / 180;
+    }
+    return cameras;
+}
+
+
+SurroundView2dStitcher::SurroundView2dStitcher(unsigned numThreads) {
+    for (unsigned i = 1; i < numThreads; i++) {
+        mWorkers.emplace_back(&SurroundView2dStitcher::workerLoop, this);
+    }
+}
+
+
+SurroundView2dStitcher::~SurroundView2dStitcher() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mShutdown = true;
+    }
+    mWorkSignal.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+
+bool SurroundView2dStitcher::setup(const GroundArea& area,
+                                   const std::vector<CameraParams>& cameras,
+                                   unsigned outputWidth, unsigned outputHeight, bool blend) {
+    if (outputWidth == 0 || outputHeight == 0 || area.width <= 0 || area.height <= 0) {
+        ALOGE("Invalid output of %u x %u pixels covering %f x %f mm",
+              outputWidth, outputHeight, area.width, area.height);
+        return false;
+    }
+    if (cameras.empty() || cameras.size() > kMaxCameras) {
+        ALOGE("Invalid number of cameras: %zu", cameras.size());
+        return false;
+    }
+    for (auto&& camera : cameras) {
+        if (camera.width < 2 || camera.height < 2 ||
+            camera.width > kMaxImageSize || camera.height > kMaxImageSize) {
+            ALOGE("Invalid camera image size of %u x %u", camera.width, camera.height);
+            return false;
+        }
+    }
+
+    std::vector<CameraAxes> axes;
+    for (auto&& camera : cameras) {
+        axes.push_back(getAxes(camera));
+    }
+
+    mOutputWidth = outputWidth;
+    mOutputHeight = outputHeight;
+    mTilesPerRow = (outputWidth + kTileWidth - 1) / kTileWidth;
+    mNumTiles = mTilesPerRow * ((outputHeight + kTileHeight - 1) / kTileHeight);
+    mLut.clear();
+    mLut.reserve(static_cast<size_t>(outputWidth) * outputHeight);
+    mTileStart.clear();
+
+    const float pixelWidth = area.width / outputWidth;
+    const float pixelHeight = area.height / outputHeight;
+    const float left = area.centerX - area.width / 2;
+    const float top = area.centerY + area.height / 2;
+
+    for (unsigned tile = 0; tile < mNumTiles; tile++) {
+        mTileStart.push_back(mLut.size());
+        const unsigned x0 = (tile % mTilesPerRow) * kTileWidth;
+        const unsigned y0 = (tile / mTilesPerRow) * kTileHeight;
+        const unsigned x1 = std::min(x0 + kTileWidth, outputWidth);
+        const unsigned y1 = std::min(y0 + kTileHeight, outputHeight);
+
+        for (unsigned y = y0; y < y1; y++) {
+            const float groundY = top - (y + 0.5f) * pixelHeight;
+            for (unsigned x = x0; x < x1; x++) {
+                const float groundX = left + (x + 0.5f) * pixelWidth;
+                LutEntry entry = {};
+                mLut.push_back(entry);
+
+                if (std::abs(groundX - area.centerX) < area.carWidth / 2 &&
+                    std::abs(groundY - area.centerY) < area.carLength / 2) {
+                    continue;
+                }
+
+                // Find the two cameras seeing this point best
+                Projection best[2] = {};
+                unsigned bestCamera[2] = {};
+                unsigned found = 0;
+                for (unsigned i = 0; i < cameras.size(); i++) {
+                    Projection p;
+                    if (!project(cameras[i], axes[i], groundX, groundY, &p) || p.weight <= 0) {
+                        continue;
+                    }
+                    if (found == 0 || p.weight > best[0].weight) {
+                        best[1] = best[0];
+                        bestCamera[1] = bestCamera[0];
+                        best[0] = p;
+                        bestCamera[0] = i;
+                    } else if (found == 1 || p.weight > best[1].weight) {
+                        best[1] = p;
+                        bestCamera[1] = i;
+                    }
+                    found++;
+                }
+
+                LutEntry& e = mLut.back();
+                e.numSamples = std::min(found, blend ? 2u : 1u);
+                for (unsigned i = 0; i < e.numSamples; i++) {
+                    const float u = std::floor(best[i].u);
+                    const float v = std::floor(best[i].v);
+                    e.x[i] = static_cast<uint16_t>(u);
+                    e.y[i] = static_cast<uint16_t>(v);
+                    e.camera[i] = static_cast<uint8_t>(bestCamera[i]);
+                    e.fx[i] = static_cast<uint8_t>((best[i].u - u) * 256);
+                    e.fy[i] = static_cast<uint8_t>((best[i].v - v) * 256);
+                }
+                if (e.numSamples == 2) {
+                    const float share = best[1].weight / (best[0].weight + best[1].weight);
+                    e.alpha = static_cast<uint8_t>(share * 256);
+                }
+            }
+        }
+    }
+
+    ALOGI("Built %u x %u lookup table for %zu cameras, %s blending",
+          outputWidth, outputHeight, cameras.size(), blend ? "with" : "without");
+    return true;
+}
+
+
+void SurroundView2dStitcher::stitch(const std::vector<Image>& cameras,
+                                    uint32_t* output, unsigned outputStride) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mInputs = cameras.data();
+    mOutput = output;
+    mOutputStride = outputStride;
+    mNextTile = 0;
+    mFrame++;
+    mActive = true;
+    mWorkSignal.notify_all();
+    lock.unlock();
+
+    // Work on the frame too rather than just waiting for the workers
+    stitchTiles();
+
+    // All tiles are taken once we're done, so wait for the workers still stitching theirs.
+    // Workers that didn't get to the frame yet must not start on it after we return.
+    lock.lock();
+    mDoneSignal.wait(lock, [this] { return mBusy == 0; });
+    mActive = false;
+}
+
+
+void SurroundView2dStitcher::stitchTiles() {
+    unsigned tile;
+    while ((tile = mNextTile++) < mNumTiles) {
+        stitchTile(tile);
+    }
+}
+
+
+void SurroundView2dStitcher::stitchTile(unsigned tile) {
+    const unsigned x0 = (tile % mTilesPerRow) * kTileWidth;
+    const unsigned y0 = (tile / mTilesPerRow) * kTileHeight;
+    const unsigned width = std::min(kTileWidth, mOutputWidth - x0);
+    const unsigned height = std::min(kTileHeight, mOutputHeight - y0);
+
+    const LutEntry* entry = &mLut[mTileStart[tile]];
+    for (unsigned y = 0; y < height; y++) {
+        uint32_t* out = mOutput + (y0 + y) * mOutputStride + x0;
+        for (unsigned x = 0; x < width; x++, entry++) {
+            switch (entry->numSamples) {
+                case 0:
+                    out[x] = 0;
+                    break;
+                case 1:
+                    out[x] = sample(mInputs[entry->camera[0]], entry->x[0], entry->y[0],
+                                    entry->fx[0], entry->fy[0]);
+                    break;
+                default:
+                    out[x] = lerp(sample(mInputs[entry->camera[0]], entry->x[0], entry->y[0],
+                                         entry->fx[0], entry->fy[0]),
+                                  sample(mInputs[entry->camera[1]], entry->x[1], entry->y[1],
+                                         entry->fx[1], entry->fy[1]),
+                                  entry->alpha);
+                    break;
+            }
+        }
+    }
+}
+
+
+void SurroundView2dStitcher::workerLoop() {
+    uint64_t frame = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mWorkSignal.wait(lock, [this, &frame] {
+            return mShutdown || (mActive && mFrame != frame);
+        });
+        if (mShutdown) {
+            return;
+        }
+
+        frame = mFrame;
+        mBusy++;
+        lock.unlock();
+        stitchTiles();
+        lock.lock();
+        if (--mBusy == 0) {
+            mDoneSignal.notify_all();
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
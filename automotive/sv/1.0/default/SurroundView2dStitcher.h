@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// CPU reference implementation of the 2d surround view: a top-down view of the ground around the
+// car, stitched from the images of fisheye cameras looking out of it.
+//
+// For every output pixel, setup() finds the cameras that see the matching point on the ground
+// and stores where to sample them in a lookup table, so stitch() only has to follow the table.
+// The table is laid out tile by tile, so the output pixels and the table entries a thread works
+// on are next to each other in memory, and tiles are spread over a set of worker threads.
+//
+// Positions are in milli-meters in the android automotive coordinate system: x points to the
+// right of the car, y to its front and z up, with the ground at z = 0.  Images are RGBA 8888.
+class SurroundView2dStitcher {
+public:
+    // The area of the ground shown, and the car in its middle, which no camera sees.
+    struct GroundArea {
+        float width;
+        float height;
+        float centerX;
+        float centerY;
+        float carWidth;
+        float carLength;
+    };
+
+    // Calibration of a camera with an equidistant fisheye lens.
+    struct CameraParams {
+        unsigned width;         // Image size in pixels
+        unsigned height;
+        float focalLength;      // In pixels per radian from the optical axis
+        float principalX;       // Where the optical axis hits the image, in pixels
+        float principalY;
+        float position[3];
+        float yaw;              // Direction the camera faces, clockwise from the front, in radians
+        float pitch;            // Downward tilt, in radians
+        float fieldOfView;      // Diagonal field of view, in radians
+    };
+
+    struct Image {
+        const uint32_t* pixels;
+        unsigned stride;        // In pixels
+    };
+
+    // A front, right, rear and left camera on a typical car, with images of the given size.
+    static std::vector<CameraParams> defaultCameras(unsigned width, unsigned height);
+
+    // Create a stitcher running on the given number of threads, including the one calling
+    // stitch().
+    explicit SurroundView2dStitcher(unsigned numThreads);
+    ~SurroundView2dStitcher();
+
+    SurroundView2dStitcher(const SurroundView2dStitcher&) = delete;
+    SurroundView2dStitcher& operator=(const SurroundView2dStitcher&) = delete;
+
+    // Build the lookup tables for an output of the given size.  If blend is true, pixels seen by
+    // two cameras mix both of them, with the weight of each one falling off towards the edges of
+    // its image.  Otherwise they show the camera seeing them best.  Returns false if the
+    // parameters are invalid.
+    bool setup(const GroundArea& area, const std::vector<CameraParams>& cameras,
+               unsigned outputWidth, unsigned outputHeight, bool blend);
+
+    // Stitch one image per camera, in the order passed to setup(), into the output image.
+    // Pixels no camera sees are set to transparent black.  Must not be called concurrently with
+    // itself or setup().
+    void stitch(const std::vector<Image>& cameras, uint32_t* output, unsigned outputStride);
+
+    unsigned getOutputWidth() const { return mOutputWidth; }
+    unsigned getOutputHeight() const { return mOutputHeight; }
+
+private:
+    // Where to sample the cameras for an output pixel: in the first numSamples cameras listed,
+    // at (x + fx / 256, y + fy / 256) pixels, and with a share of alpha / 256 for the second one.
+    struct LutEntry {
+        uint16_t x[2];
+        uint16_t y[2];
+        uint8_t camera[2];
+        uint8_t fx[2];
+        uint8_t fy[2];
+        uint8_t alpha;
+        uint8_t numSamples;
+    };
+
+    void stitchTiles();
+    void stitchTile(unsigned tile);
+    void workerLoop();
+
+    unsigned mOutputWidth = 0;
+    unsigned mOutputHeight = 0;
+    unsigned mTilesPerRow = 0;
+    unsigned mNumTiles = 0;
+    std::vector<LutEntry> mLut;             // Tile by tile, row by row within each tile
+    std::vector<size_t> mTileStart;         // Index of the first entry of each tile
+
+    // The frame being stitched
+    const Image* mInputs = nullptr;
+    uint32_t* mOutput = nullptr;
+    unsigned mOutputStride = 0;
+    std::atomic<unsigned> mNextTile{0};
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mLock;
+    std::condition_variable mWorkSignal;    // Signaled when a frame is started or on shutdown
+    std::condition_variable mDoneSignal;    // Signaled when the last worker is done with a frame
+    uint64_t mFrame = 0;                    // Protected by mLock, as are the members below
+    bool mActive = false;                   // Workers may still join the frame
+    unsigned mBusy = 0;                     // Workers stitching tiles of the frame
+    bool mShutdown = false;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
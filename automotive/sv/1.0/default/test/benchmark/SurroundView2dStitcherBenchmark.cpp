@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "SurroundView2dStitcher.h"
+
+using android::hardware::automotive::sv::V1_0::implementation::SurroundView2dStitcher;
+
+namespace {
+
+// Four 1280 x 720 cameras around a car, covering 8 x 6 meters.
+const unsigned kCameraWidth = 1280;
+const unsigned kCameraHeight = 720;
+const SurroundView2dStitcher::GroundArea kArea = {8000, 6000, 0, 0, 1900, 4600};
+
+// Output widths, with the height keeping the 4:3 ratio of the area, with and without blending,
+// on one thread and on all CPU cores.
+void outputSizes(benchmark::internal::Benchmark* b) {
+    const int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (int width : {640, 1280, 1920}) {
+        for (int blend : {0, 1}) {
+            b->Args({width, blend, 1});
+            if (cores > 1) {
+                b->Args({width, blend, cores});
+            }
+        }
+    }
+}
+
+std::vector<std::vector<uint32_t>> makeCameraImages() {
+    std::vector<std::vector<uint32_t>> images(4);
+    std::srand(0);
+    for (auto& image : images) {
+        image.resize(kCameraWidth * kCameraHeight);
+        for (auto& pixel : image) {
+            pixel = std::rand();
+        }
+    }
+    return images;
+}
+
+void BM_Stitch2d(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const unsigned height = width * 3 / 4;
+    SurroundView2dStitcher stitcher(state.range(2));
+    if (!stitcher.setup(kArea, SurroundView2dStitcher::defaultCameras(kCameraWidth, kCameraHeight),
+                        width, height, state.range(1) != 0)) {
+        state.SkipWithError("Failed to set up the stitcher");
+        return;
+    }
+
+    auto images = makeCameraImages();
+    std::vector<SurroundView2dStitcher::Image> inputs;
+    for (auto& image : images) {
+        inputs.push_back({image.data(), kCameraWidth});
+    }
+    std::vector<uint32_t> output(width * height);
+    for (auto _ : state) {
+        stitcher.stitch(inputs, output.data(), width);
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_Stitch2d)->Apply(outputSizes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_Setup2d(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const auto cameras = SurroundView2dStitcher::defaultCameras(kCameraWidth, kCameraHeight);
+    SurroundView2dStitcher stitcher(1);
+    for (auto _ : state) {
+        stitcher.setup(kArea, cameras, width, width * 3 / 4, state.range(1) != 0);
+    }
+}
+BENCHMARK(BM_Setup2d)->Args({1280, 1})->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -32,7 +32,9 @@ using namespace android::hardware;
 using namespace android::hardware::automotive::vehicle::V2_0;
 
 int main(int /* argc */, char* /* argv */ []) {
-    auto store = std::make_unique<VehiclePropertyStore>();
+    // The fake value generators write values while clients read them.
+    auto store =
+            std::make_unique<VehiclePropertyStore>(VehiclePropertyStore::StorageMode::INDEXED);
     auto connector = std::make_unique<impl::EmulatedVehicleConnector>();
     auto hal = std::make_unique<impl::EmulatedVehicleHal>(store.get(), connector.get());
     auto emulator = std::make_unique<impl::VehicleEmulator>(hal.get());
@@ -17,17 +17,30 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 #define android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 
+#include <algorithm>
 #include <queue>
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <thread>
 #include <condition_variable>
 #include <iostream>
+#include <vector>
 
 namespace android {
 
 template<typename T>
 class ConcurrentQueue {
 public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    /* Time spent in the queue by the items returned from a single flush. */
+    struct QueueingDelay {
+        std::chrono::nanoseconds total {0};
+        std::chrono::nanoseconds max {0};
+    };
+
     void waitForItems() {
         std::unique_lock<std::mutex> g(mLock);
         while (mQueue.empty() && mIsActive) {
@@ -35,29 +48,75 @@ public:
         }
     }
 
-    std::vector<T> flush() {
+    /* Waits until the queue has at least batchSize items or the flush deadline of any queued item
+     * has passed, see push(T&&, TimePoint). Returns immediately once the queue is deactivated.
+     */
+    void waitForBatch(size_t batchSize) {
+        std::unique_lock<std::mutex> g(mLock);
+        mWakeUpSize = std::max<size_t>(batchSize, 1);
+        while (mIsActive) {
+            if (mQueue.empty()) {
+                mCond.wait(g);
+            } else if (mQueue.size() >= mWakeUpSize || Clock::now() >= mFlushDeadline) {
+                break;
+            } else {
+                mCond.wait_until(g, mFlushDeadline);
+            }
+        }
+        mWakeUpSize = 1;
+    }
+
+    std::vector<T> flush(QueueingDelay* outDelay = nullptr) {
         std::vector<T> items;
+        flushTo(&items, outDelay);
+        return items;
+    }
 
+    /* Appends all queued items to *out, so callers can reuse the same vector between flushes. */
+    void flushTo(std::vector<T>* out, QueueingDelay* outDelay = nullptr) {
         MuxGuard g(mLock);
         if (mQueue.empty() || !mIsActive) {
-            return items;
+            return;
         }
+        TimePoint now = outDelay != nullptr ? Clock::now() : TimePoint();
+        out->reserve(out->size() + mQueue.size());
         while (!mQueue.empty()) {
-            items.push_back(std::move(mQueue.front()));
+            Entry& entry = mQueue.front();
+            if (outDelay != nullptr) {
+                auto delay = now - entry.enqueueTime;
+                outDelay->total += delay;
+                outDelay->max = std::max<std::chrono::nanoseconds>(outDelay->max, delay);
+            }
+            out->push_back(std::move(entry.item));
             mQueue.pop();
         }
-        return items;
+        mFlushDeadline = TimePoint::max();
     }
 
+    /* Pushes an item that consumers waiting with waitForBatch() will receive without delay. */
     void push(T&& item) {
+        push(std::move(item), TimePoint::min());
+    }
+
+    /* Pushes an item that must be flushed no later than flushDeadline. The deadline is only
+     * honored by consumers waiting with waitForBatch().
+     */
+    void push(T&& item, TimePoint flushDeadline) {
+        bool shouldNotify;
         {
             MuxGuard g(mLock);
             if (!mIsActive) {
                 return;
             }
-            mQueue.push(std::move(item));
+            mQueue.push(Entry { std::move(item), Clock::now() });
+            // Only wake up the consumer if this item changes what it is waiting for.
+            shouldNotify = mQueue.size() == 1 || mQueue.size() >= mWakeUpSize
+                           || flushDeadline < mFlushDeadline;
+            mFlushDeadline = std::min(mFlushDeadline, flushDeadline);
+        }
+        if (shouldNotify) {
+            mCond.notify_one();
         }
-        mCond.notify_one();
     }
 
     /* Deactivates the queue, thus no one can push items to it, also
@@ -78,13 +137,25 @@ public:
 private:
     using MuxGuard = std::lock_guard<std::mutex>;
 
+    struct Entry {
+        T item;
+        TimePoint enqueueTime;
+    };
+
     bool mIsActive = true;
     mutable std::mutex mLock;
     std::condition_variable mCond;
-    std::queue<T> mQueue;
+    std::queue<Entry> mQueue;
+    TimePoint mFlushDeadline = TimePoint::max();  // Earliest flush deadline of queued items.
+    size_t mWakeUpSize = 1;  // Queue size the waiting consumer wants to be notified at.
 };
 
-template<typename T>
+/**
+ * Delivers items from a queue to a callback in batches on a dedicated thread. Queue can be
+ * ConcurrentQueue or any class with the same waiting, pushing and flushing methods, e.g.
+ * RingBufferQueue.
+ */
+template<typename T, typename Queue = ConcurrentQueue<T>>
 class BatchingConsumer {
 private:
     enum class State {
@@ -102,14 +173,50 @@ public:
 
     using OnBatchReceivedFunc = std::function<void(const std::vector<T>& vec)>;
 
-    void run(ConcurrentQueue<T>* queue,
+    /* Counters describing batches delivered so far. */
+    struct Stats {
+        uint64_t batches;
+        uint64_t items;
+        uint64_t maxBatchSize;
+        std::chrono::nanoseconds totalQueueingDelay;
+        std::chrono::nanoseconds maxQueueingDelay;
+    };
+
+    /* Delivers everything that was queued during batchInterval after the first item arrives. */
+    void run(Queue* queue,
              std::chrono::nanoseconds batchInterval,
              const OnBatchReceivedFunc& func) {
         mQueue = queue;
         mBatchInterval = batchInterval;
+        mMaxBatchSize = 0;
+
+        mWorkerThread = std::thread(
+            &BatchingConsumer::runInternal, this, func);
+    }
+
+    /* Delivers queued items as soon as there are maxBatchSize of them or the flush deadline of
+     * any of them passes, whichever comes first. Items pushed without a deadline are delivered
+     * right away.
+     */
+    void runWithDeadlines(Queue* queue,
+                          size_t maxBatchSize,
+                          const OnBatchReceivedFunc& func) {
+        mQueue = queue;
+        mBatchInterval = std::chrono::nanoseconds::zero();
+        mMaxBatchSize = std::max<size_t>(maxBatchSize, 1);
 
         mWorkerThread = std::thread(
-            &BatchingConsumer<T>::runInternal, this, func);
+            &BatchingConsumer::runInternal, this, func);
+    }
+
+    Stats getStats() const {
+        return Stats {
+            .batches = mBatches,
+            .items = mItems,
+            .maxBatchSize = mMaxDeliveredBatchSize,
+            .totalQueueingDelay = std::chrono::nanoseconds(mTotalQueueingDelayNs),
+            .maxQueueingDelay = std::chrono::nanoseconds(mMaxQueueingDelayNs),
+        };
     }
 
     void requestStop() {
@@ -125,16 +232,26 @@ public:
 private:
     void runInternal(const OnBatchReceivedFunc& onBatchReceived) {
         if (mState.exchange(State::RUNNING) == State::INIT) {
+            // Reused between batches to avoid allocating a new vector for each of them.
+            std::vector<T> items;
             while (State::RUNNING == mState) {
-                mQueue->waitForItems();
-                if (State::STOP_REQUESTED == mState) break;
+                if (mMaxBatchSize > 0) {
+                    mQueue->waitForBatch(mMaxBatchSize);
+                    if (State::STOP_REQUESTED == mState) break;
+                } else {
+                    mQueue->waitForItems();
+                    if (State::STOP_REQUESTED == mState) break;
 
-                std::this_thread::sleep_for(mBatchInterval);
-                if (State::STOP_REQUESTED == mState) break;
+                    std::this_thread::sleep_for(mBatchInterval);
+                    if (State::STOP_REQUESTED == mState) break;
+                }
 
-                std::vector<T> items = mQueue->flush();
+                typename ConcurrentQueue<T>::QueueingDelay delay;
+                items.clear();
+                mQueue->flushTo(&items, &delay);
 
                 if (items.size() > 0) {
+                    updateStats(items.size(), delay);
                     onBatchReceived(items);
                 }
             }
@@ -143,12 +260,32 @@ private:
         mState = State::STOPPED;
     }
 
+    // Only called from the worker thread, readers may call getStats() from any thread.
+    void updateStats(size_t batchSize, const typename ConcurrentQueue<T>::QueueingDelay& delay) {
+        mBatches++;
+        mItems += batchSize;
+        if (batchSize > mMaxDeliveredBatchSize) {
+            mMaxDeliveredBatchSize = batchSize;
+        }
+        mTotalQueueingDelayNs += delay.total.count();
+        if (delay.max.count() > mMaxQueueingDelayNs) {
+            mMaxQueueingDelayNs = delay.max.count();
+        }
+    }
+
 private:
     std::thread mWorkerThread;
 
     std::atomic<State> mState;
     std::chrono::nanoseconds mBatchInterval;
-    ConcurrentQueue<T>* mQueue;
+    size_t mMaxBatchSize = 0;  // Zero when batching by mBatchInterval.
+    Queue* mQueue;
+
+    std::atomic<uint64_t> mBatches {0};
+    std::atomic<uint64_t> mItems {0};
+    std::atomic<uint64_t> mMaxDeliveredBatchSize {0};
+    std::atomic<int64_t> mTotalQueueingDelayNs {0};
+    std::atomic<int64_t> mMaxQueueingDelayNs {0};
 };
 
 }  // namespace android
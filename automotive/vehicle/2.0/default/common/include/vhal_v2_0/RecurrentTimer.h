@@ -17,20 +17,31 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 #define android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <functional>
-#include <list>
 #include <mutex>
-#include <set>
+#include <queue>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include <log/log.h>
+
 /**
  * This class allows to specify multiple time intervals to receive
  * notifications. A single thread is used internally.
+ *
+ * Events are aligned to multiples of their interval, so all cookies registered with the same
+ * interval fire together. They are kept in one group per interval and a min-heap orders the groups
+ * by their next event time, thus a wake-up only touches groups that are due, no matter how many
+ * cookies are registered. Groups due within kCoalescingWindow of each other are delivered in the
+ * same wake-up. The thread sleeps on a timerfd armed for the earliest group.
  */
 class RecurrentTimer {
 private:
@@ -40,12 +51,28 @@ private:
 public:
     using Action = std::function<void(const std::vector<int32_t>& cookies)>;
 
+    /* Delivery statistics, drift is how late events were delivered compared to their schedule. */
+    struct Stats {
+        uint64_t wakeUps;
+        uint64_t events;
+        uint64_t missedEvents;  // Events skipped because the timer fell behind by an interval.
+        Nanos totalDrift;
+        Nanos maxDrift;
+    };
+
+    /* Events that are due this close to each other are delivered in one wake-up. */
+    static constexpr Nanos kCoalescingWindow = std::chrono::microseconds(100);
+
     RecurrentTimer(const Action& action) : mAction(action) {
+        // CLOCK_MONOTONIC is the clock behind std::chrono::steady_clock.
+        mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        LOG_ALWAYS_FATAL_IF(mTimerFd < 0, "Failed to create timerfd, errno: %d", errno);
         mTimerThread = std::thread(&RecurrentTimer::loop, this, action);
     }
 
     virtual ~RecurrentTimer() {
         stop();
+        close(mTimerFd);
     }
 
     /**
@@ -54,75 +81,187 @@ public:
      * interval provided before.
      */
     void registerRecurrentEvent(std::chrono::nanoseconds interval, int32_t cookie) {
-        TimePoint now = Clock::now();
-        // Align event time point among all intervals. Thus if we have two intervals 1ms and 2ms,
-        // during every second wake-up both intervals will be triggered.
-        TimePoint absoluteTime = now - Nanos(now.time_since_epoch().count() % interval.count());
+        std::lock_guard<std::mutex> g(mLock);
+        auto it = mCookieToLocation.find(cookie);
+        if (it != mCookieToLocation.end()) {
+            if (it->second.interval == interval) return;
+            removeCookieLocked(it);
+        }
 
-        {
-            std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime };
+        auto groupIt = mGroups.find(interval.count());
+        if (groupIt == mGroups.end()) {
+            TimePoint now = Clock::now();
+            // Align event time point among all intervals. Thus if we have two intervals 1ms and
+            // 2ms, during every second wake-up both intervals will be triggered.
+            TimePoint absoluteTime =
+                    now - Nanos(now.time_since_epoch().count() % interval.count());
+            groupIt = mGroups.emplace(interval.count(),
+                                      IntervalGroup { interval, absoluteTime, {},
+                                                      ++mLastGeneration, true }).first;
+            pushLocked(groupIt->second);
+            compactLocked();
+            if (absoluteTime < mArmedTime) {
+                armLocked(absoluteTime);
+            }
         }
-        mCond.notify_one();
+        IntervalGroup& group = groupIt->second;
+        mCookieToLocation[cookie] = { interval, group.cookies.size() };
+        group.cookies.push_back(cookie);
     }
 
     void unregisterRecurrentEvent(int32_t cookie) {
-        {
-            std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap.erase(cookie);
+        std::lock_guard<std::mutex> g(mLock);
+        auto it = mCookieToLocation.find(cookie);
+        if (it != mCookieToLocation.end()) {
+            removeCookieLocked(it);
         }
-        mCond.notify_one();
     }
 
+    Stats getStats() const {
+        std::lock_guard<std::mutex> g(mLock);
+        return mStats;
+    }
 
 private:
+    static constexpr auto kInvalidTime = TimePoint(Nanos::max());
 
-    struct RecurrentEvent {
+    /* All cookies registered with the same interval. */
+    struct IntervalGroup {
         Nanos interval;
-        int32_t cookie;
         TimePoint absoluteTime;  // Absolute time of the next event.
+        std::vector<int32_t> cookies;
+        uint64_t generation;  // Tells heap entries of a removed group from its re-created one.
+        bool firstEvent;  // The first event is aligned to the past, it doesn't count as drift.
 
-        void updateNextEventTime(TimePoint now) {
+        // Returns the number of events that were skipped.
+        int64_t updateNextEventTime(TimePoint deliveryTime) {
             // We want to move time to next event by adding some number of intervals (usually 1)
-            // to previous absoluteTime.
-            int intervalMultiplier = (now - absoluteTime) / interval;
+            // to previous absoluteTime, so it is past everything delivered in this wake-up.
+            int64_t intervalMultiplier = (deliveryTime - absoluteTime) / interval + 1;
             if (intervalMultiplier <= 0) intervalMultiplier = 1;
             absoluteTime += intervalMultiplier * interval;
+            return intervalMultiplier - 1;
         }
     };
 
-    void loop(const Action& action) {
-        static constexpr auto kInvalidTime = TimePoint(Nanos::max());
+    struct CookieLocation {
+        Nanos interval;
+        size_t index;  // Index in IntervalGroup::cookies.
+    };
+
+    struct HeapEntry {
+        TimePoint absoluteTime;
+        int64_t intervalNs;
+        uint64_t generation;
+
+        bool operator>(const HeapEntry& other) const {
+            return absoluteTime > other.absoluteTime;
+        }
+    };
+
+    using CookieMap = std::unordered_map<int32_t, CookieLocation>;
 
+    void removeCookieLocked(CookieMap::iterator it) {
+        auto groupIt = mGroups.find(it->second.interval.count());
+        std::vector<int32_t>& cookies = groupIt->second.cookies;
+        size_t index = it->second.index;
+        cookies[index] = cookies.back();
+        mCookieToLocation[cookies[index]].index = index;
+        cookies.pop_back();
+        mCookieToLocation.erase(it);
+        // Its heap entry becomes stale and is dropped once it reaches the top.
+        if (cookies.empty()) {
+            mGroups.erase(groupIt);
+        }
+    }
+
+    void pushLocked(const IntervalGroup& group) {
+        mHeap.push({ group.absoluteTime, group.interval.count(), group.generation });
+    }
+
+    // Re-creating a group leaves a stale entry behind, rebuild the heap before they pile up.
+    void compactLocked() {
+        if (mHeap.size() <= 2 * mGroups.size() + 64) return;
+        mHeap = EventHeap();
+        for (const auto& it : mGroups) {
+            pushLocked(it.second);
+        }
+    }
+
+    // Returns the group an entry refers to, or nullptr if the entry is stale.
+    IntervalGroup* findGroupLocked(const HeapEntry& entry) {
+        auto it = mGroups.find(entry.intervalNs);
+        if (it == mGroups.end() || it->second.generation != entry.generation) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    // Wakes the timer thread at the given time, kInvalidTime disarms the timer.
+    void armLocked(TimePoint time) {
+        struct itimerspec spec {};
+        if (time != kInvalidTime) {
+            int64_t ns = std::max<int64_t>(time.time_since_epoch().count(), 1);
+            spec.it_value.tv_sec = ns / 1000000000;
+            spec.it_value.tv_nsec = ns % 1000000000;
+        }
+        timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        mArmedTime = time;
+    }
+
+    void loop(const Action& action) {
         std::vector<int32_t> cookies;
 
         while (!mStopRequested) {
-            auto now = Clock::now();
-            auto nextEventTime = kInvalidTime;
             cookies.clear();
 
             {
-                std::unique_lock<std::mutex> g(mLock);
+                std::lock_guard<std::mutex> g(mLock);
+                auto now = Clock::now();
+                auto deliveryTime = now + kCoalescingWindow;
 
-                for (auto&& it : mCookieToEventsMap) {
-                    RecurrentEvent& event = it.second;
-                    if (event.absoluteTime <= now) {
-                        event.updateNextEventTime(now);
-                        cookies.push_back(event.cookie);
-                    }
+                while (!mHeap.empty() && mHeap.top().absoluteTime <= deliveryTime) {
+                    HeapEntry entry = mHeap.top();
+                    mHeap.pop();
+                    IntervalGroup* group = findGroupLocked(entry);
+                    if (group == nullptr) continue;
 
-                    if (nextEventTime > event.absoluteTime) {
-                        nextEventTime = event.absoluteTime;
+                    if (!group->firstEvent) {
+                        Nanos drift = std::max(now - group->absoluteTime, Nanos::zero());
+                        mStats.totalDrift += drift * group->cookies.size();
+                        mStats.maxDrift = std::max(mStats.maxDrift, drift);
                     }
+                    group->firstEvent = false;
+                    mStats.missedEvents +=
+                            group->updateNextEventTime(deliveryTime) * group->cookies.size();
+                    cookies.insert(cookies.end(), group->cookies.begin(), group->cookies.end());
+                    pushLocked(*group);
                 }
+
+                // Drop stale entries so they don't cause spurious wake-ups.
+                while (!mHeap.empty() && findGroupLocked(mHeap.top()) == nullptr) {
+                    mHeap.pop();
+                }
+
+                if (cookies.size() != 0) {
+                    mStats.wakeUps++;
+                    mStats.events += cookies.size();
+                }
+                // Re-arming would cancel the wake-up stop() has armed.
+                if (mStopRequested) break;
+                armLocked(mHeap.empty() ? kInvalidTime : mHeap.top().absoluteTime);
             }
 
             if (cookies.size() != 0) {
                 action(cookies);
             }
 
-            std::unique_lock<std::mutex> g(mLock);
-            mCond.wait_until(g, nextEventTime);  // nextEventTime can be nanoseconds::max()
+            // Blocks until the armed time, registerRecurrentEvent() and stop() re-arm the timer.
+            uint64_t expirations;
+            if (read(mTimerFd, &expirations, sizeof(expirations)) < 0 && errno != EINTR) {
+                ALOGE("Failed to read timerfd, errno: %d", errno);
+                break;
+            }
         }
     }
 
@@ -130,20 +269,30 @@ private:
         mStopRequested = true;
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap.clear();
+            mCookieToLocation.clear();
+            mGroups.clear();
+            mHeap = EventHeap();
+            armLocked(TimePoint(Nanos(1)));  // In the past, wakes the thread up right away.
         }
-        mCond.notify_one();
         if (mTimerThread.joinable()) {
             mTimerThread.join();
         }
     }
 private:
+    using EventHeap =
+            std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>>;
+
     mutable std::mutex mLock;
     std::thread mTimerThread;
-    std::condition_variable mCond;
+    int mTimerFd;
     std::atomic_bool mStopRequested { false };
     Action mAction;
-    std::unordered_map<int32_t, RecurrentEvent> mCookieToEventsMap;
+    CookieMap mCookieToLocation;
+    std::unordered_map<int64_t, IntervalGroup> mGroups;  // Keyed by interval in nanoseconds.
+    EventHeap mHeap;
+    uint64_t mLastGeneration = 0;
+    TimePoint mArmedTime = kInvalidTime;
+    Stats mStats {};
 };
 
 
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_RingBufferQueue_H_
+#define android_hardware_automotive_vehicle_V2_0_RingBufferQueue_H_
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ConcurrentQueue.h"
+
+namespace android {
+
+/**
+ * Bounded multi-producer / single-consumer queue that can be used in place of ConcurrentQueue,
+ * e.g. with BatchingConsumer.
+ *
+ * Items are stored in a preallocated ring of cells with per-cell sequence numbers, so push() and
+ * flush() never take a lock or allocate memory as long as the ring doesn't overflow. A consumer
+ * waiting for items sleeps on a futex that producers only wake when the pushed item changes what
+ * the consumer is waiting for.
+ *
+ * When the ring is full the overflow policy decides what happens:
+ *  - DROP_OLDEST discards the oldest queued item to make room for the new one.
+ *  - COALESCE_BY_KEY moves new items to an overflow table (guarded by a lock) where an item
+ *    replaces a queued item with the same key, e.g. a newer value of the same property. Until the
+ *    consumer drains the table all new items go there, so items with the same key are delivered
+ *    in the order they were pushed.
+ */
+template<typename T>
+class RingBufferQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    using QueueingDelay = typename ConcurrentQueue<T>::QueueingDelay;
+    using KeyFunction = std::function<int64_t(const T& item)>;
+
+    enum class OverflowPolicy {
+        DROP_OLDEST,
+        COALESCE_BY_KEY,
+    };
+
+    /**
+     * Creates a queue holding at least capacity items (rounded up to a power of two). keyFunction
+     * is only used with OverflowPolicy::COALESCE_BY_KEY.
+     */
+    explicit RingBufferQueue(size_t capacity,
+                             OverflowPolicy policy = OverflowPolicy::DROP_OLDEST,
+                             const KeyFunction& keyFunction = nullptr)
+        : mMask(roundUpToPowerOfTwo(std::max<size_t>(capacity, 2)) - 1),
+          mCells(new Cell[mMask + 1]),
+          mPolicy(policy),
+          mKeyFunction(keyFunction) {
+        for (size_t i = 0; i <= mMask; i++) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RingBufferQueue(const RingBufferQueue&) = delete;
+    RingBufferQueue& operator=(const RingBufferQueue&) = delete;
+
+    void waitForItems() {
+        waitUntilReady(1);
+    }
+
+    /* Same as ConcurrentQueue::waitForBatch(). */
+    void waitForBatch(size_t batchSize) {
+        waitUntilReady(std::max<size_t>(batchSize, 1));
+    }
+
+    std::vector<T> flush(QueueingDelay* outDelay = nullptr) {
+        std::vector<T> items;
+        flushTo(&items, outDelay);
+        return items;
+    }
+
+    /* Appends all queued items to *out, so callers can reuse the same vector between flushes. */
+    void flushTo(std::vector<T>* out, QueueingDelay* outDelay = nullptr) {
+        if (!mIsActive.load()) return;
+
+        // Reset the deadline before draining: a deadline published by a producer after this
+        // point belongs to an item that is either drained below or stays queued.
+        mFlushDeadlineNs.store(kNoDeadline);
+
+        TimePoint now = outDelay != nullptr ? Clock::now() : TimePoint();
+        T item;
+        TimePoint enqueueTime;
+        while (tryDequeue(&item, &enqueueTime)) {
+            addDelay(outDelay, now - enqueueTime);
+            out->push_back(std::move(item));
+        }
+
+        if (mOverflowSize.load() > 0) {
+            std::lock_guard<std::mutex> g(mOverflowLock);
+            for (OverflowEntry& entry : mOverflowItems) {
+                addDelay(outDelay, now - entry.enqueueTime);
+                out->push_back(std::move(entry.item));
+            }
+            mOverflowItems.clear();
+            mOverflowIndex.clear();
+            mOverflowSize.store(0);
+        }
+    }
+
+    /* Pushes an item that a consumer waiting with waitForBatch() receives without delay. */
+    void push(T&& item) {
+        push(std::move(item), TimePoint::min());
+    }
+
+    /* Same as ConcurrentQueue::push(T&&, TimePoint). */
+    void push(T&& item, TimePoint flushDeadline) {
+        if (!mIsActive.load()) return;
+
+        TimePoint now = Clock::now();
+        if (mPolicy == OverflowPolicy::COALESCE_BY_KEY) {
+            if (mOverflowSize.load() > 0 || !tryEnqueue(&item, now)) {
+                pushToOverflow(std::move(item), now);
+            }
+        } else {
+            while (!tryEnqueue(&item, now)) {
+                T oldest;
+                TimePoint oldestEnqueueTime;
+                if (tryDequeue(&oldest, &oldestEnqueueTime)) {
+                    mDroppedCount++;
+                }
+            }
+        }
+
+        int64_t deadlineNs = toNanos(flushDeadline);
+        int64_t currentDeadlineNs = mFlushDeadlineNs.load();
+        while (deadlineNs < currentDeadlineNs
+               && !mFlushDeadlineNs.compare_exchange_weak(currentDeadlineNs, deadlineNs)) {
+        }
+
+        // The item was claimed with a sequentially consistent CAS on the enqueue position, so
+        // either the consumer's size() sees it or we see that the consumer is waiting. Only the
+        // producer that clears the flag issues the wake-up syscall.
+        if (mConsumerWaiting.load()
+            && (size() >= mWakeUpSize.load() || deadlineNs < mConsumerWakeUpNs.load())
+            && mConsumerWaiting.exchange(false)) {
+            mWakeSequence.fetch_add(1);
+            futexWake();
+        }
+    }
+
+    /* Deactivates the queue, thus no one can push items to it, also notifies waiting consumer. */
+    void deactivate() {
+        mIsActive.store(false);
+        mWakeSequence.fetch_add(1);
+        futexWake();
+    }
+
+    /* Approximate number of queued items, including ones still being written by producers. */
+    size_t size() const {
+        size_t enqueued = mEnqueuePos.load();
+        size_t dequeued = mDequeuePos.load();
+        return (enqueued > dequeued ? enqueued - dequeued : 0) + mOverflowSize.load();
+    }
+
+    size_t capacity() const { return mMask + 1; }
+
+    /* Number of items discarded because of OverflowPolicy::DROP_OLDEST. */
+    uint64_t getDroppedCount() const { return mDroppedCount.load(); }
+
+    /* Number of items replaced by newer ones because of OverflowPolicy::COALESCE_BY_KEY. */
+    uint64_t getCoalescedCount() const { return mCoalescedCount.load(); }
+
+private:
+    static constexpr int64_t kNoDeadline = INT64_MAX;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+        TimePoint enqueueTime;
+    };
+
+    struct OverflowEntry {
+        T item;
+        TimePoint enqueueTime;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    static int64_t toNanos(TimePoint t) {
+        if (t == TimePoint::min()) return INT64_MIN;
+        if (t == TimePoint::max()) return kNoDeadline;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    static void addDelay(QueueingDelay* delay, std::chrono::nanoseconds value) {
+        if (delay == nullptr) return;
+        delay->total += value;
+        delay->max = std::max(delay->max, value);
+    }
+
+    bool tryEnqueue(T* item, TimePoint now) {
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst,
+                                                      std::memory_order_relaxed)) {
+                    cell.item = std::move(*item);
+                    cell.enqueueTime = now;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full.
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Also used by producers to drop the oldest item, so dequeue position is claimed with a CAS.
+    bool tryDequeue(T* item, TimePoint* enqueueTime) {
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *item = std::move(cell.item);
+                    *enqueueTime = cell.enqueueTime;
+                    cell.sequence.store(pos + mMask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty.
+            } else {
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void pushToOverflow(T&& item, TimePoint now) {
+        int64_t key = mKeyFunction ? mKeyFunction(item) : 0;
+        std::lock_guard<std::mutex> g(mOverflowLock);
+        auto it = mOverflowIndex.find(key);
+        if (mKeyFunction && it != mOverflowIndex.end()) {
+            mOverflowItems[it->second] = OverflowEntry { std::move(item), now };
+            mCoalescedCount++;
+            return;
+        }
+        mOverflowIndex[key] = mOverflowItems.size();
+        mOverflowItems.push_back(OverflowEntry { std::move(item), now });
+        mOverflowSize.store(mOverflowItems.size());
+    }
+
+    bool isReady(size_t batchSize) const {
+        if (!mIsActive.load()) return true;
+        size_t queued = size();
+        return queued >= batchSize
+               || (queued > 0 && toNanos(Clock::now()) >= mFlushDeadlineNs.load());
+    }
+
+    void waitUntilReady(size_t batchSize) {
+        mWakeUpSize.store(batchSize);
+        for (;;) {
+            uint32_t sequence = mWakeSequence.load();
+            if (isReady(batchSize)) break;
+
+            int64_t deadlineNs = size() > 0 ? mFlushDeadlineNs.load() : kNoDeadline;
+            mConsumerWakeUpNs.store(deadlineNs);
+            mConsumerWaiting.store(true);
+            // Producers check mConsumerWaiting after publishing their item, so re-checking here
+            // guarantees that either they see the flag or we see their item.
+            if (!isReady(batchSize)) {
+                futexWait(sequence, deadlineNs);
+            }
+            mConsumerWaiting.store(false);
+        }
+        mWakeUpSize.store(1);
+    }
+
+    void futexWait(uint32_t expected, int64_t deadlineNs) {
+        struct timespec timeout;
+        struct timespec* timeoutPtr = nullptr;
+        if (deadlineNs != kNoDeadline) {
+            int64_t remainingNs = std::max<int64_t>(deadlineNs - toNanos(Clock::now()), 0);
+            timeout.tv_sec = remainingNs / 1000000000;
+            timeout.tv_nsec = remainingNs % 1000000000;
+            timeoutPtr = &timeout;
+        }
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mWakeSequence), FUTEX_WAIT_PRIVATE,
+                expected, timeoutPtr, nullptr, 0);
+    }
+
+    void futexWake() {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mWakeSequence), FUTEX_WAKE_PRIVATE, 1,
+                nullptr, nullptr, 0);
+    }
+
+private:
+    const size_t mMask;
+    const std::unique_ptr<Cell[]> mCells;
+    const OverflowPolicy mPolicy;
+    const KeyFunction mKeyFunction;
+
+    // Producer and consumer positions live on separate cache lines.
+    alignas(64) std::atomic<size_t> mEnqueuePos {0};
+    alignas(64) std::atomic<size_t> mDequeuePos {0};
+
+    alignas(64) std::atomic<uint32_t> mWakeSequence {0};  // Futex word.
+    std::atomic<bool> mConsumerWaiting {false};
+    std::atomic<size_t> mWakeUpSize {1};
+    std::atomic<int64_t> mConsumerWakeUpNs {kNoDeadline};
+    std::atomic<int64_t> mFlushDeadlineNs {kNoDeadline};
+    std::atomic<bool> mIsActive {true};
+
+    std::mutex mOverflowLock;
+    std::vector<OverflowEntry> mOverflowItems;  // Guarded by mOverflowLock.
+    std::unordered_map<int64_t, size_t> mOverflowIndex;  // Guarded by mOverflowLock.
+    std::atomic<size_t> mOverflowSize {0};
+
+    std::atomic<uint64_t> mDroppedCount {0};
+    std::atomic<uint64_t> mCoalescedCount {0};
+};
+
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_RingBufferQueue_H_
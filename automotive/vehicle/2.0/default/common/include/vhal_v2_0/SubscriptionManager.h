@@ -21,6 +21,8 @@
 #include <map>
 #include <set>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 #include <android/log.h>
 #include <hidl/HidlSupport.h>
@@ -48,8 +50,11 @@ public:
         return mCallback;
     }
 
-    void addOrUpdateSubscription(const SubscribeOptions &opts);
+    /* Returns the subscription options for opts.propId after merging opts into them. */
+    SubscribeOptions addOrUpdateSubscription(const SubscribeOptions &opts);
+    void removeSubscription(int32_t propId);
     bool isSubscribed(int32_t propId, SubscribeFlags flags);
+    bool hasSubscriptions() const { return !mSubscriptions.empty(); }
     std::vector<int32_t> getSubscribedProperties() const;
 
 private:
@@ -75,7 +80,7 @@ public:
 
 struct HalClientValues {
     sp<HalClient> client;
-    std::list<VehiclePropValue *> values;
+    std::vector<VehiclePropValue *> values;
 };
 
 using ClientId = uint64_t;
@@ -107,12 +112,17 @@ public:
                                        std::list<SubscribeOptions>* outUpdatedOptions);
 
     /**
-     * Returns a list of IVehicleCallback -> list of VehiclePropValue ready for
-     * dispatching to its clients.
+     * Distributes values among subscribed clients. outClientValues gets an entry per client,
+     * entries of clients that didn't receive any values have empty values. Callers should pass the
+     * same vector to each call, so its buffers are reused between batches.
+     *
+     * Clients subscribed to a continuous property get at most as many events per second and area
+     * as their own sample rate, even if the property is updated faster for other clients.
      */
-    std::list<HalClientValues> distributeValuesToClients(
+    void distributeValuesToClients(
             const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-            SubscribeFlags flags) const;
+            SubscribeFlags flags,
+            std::vector<HalClientValues>* outClientValues);
 
     std::list<sp<HalClient>> getSubscribedClients(int32_t propId, SubscribeFlags flags) const;
     /**
@@ -126,13 +136,15 @@ private:
 
     bool updateHalEventSubscriptionLocked(const SubscribeOptions& opts, SubscribeOptions* out);
 
-    void addClientToPropMapLocked(int32_t propId, const sp<HalClient>& client);
+    void addOrUpdateSubscriberLocked(const sp<HalClient>& client, const SubscribeOptions& opts);
 
-    sp<HalClientVector> getClientsForPropertyLocked(int32_t propId) const;
+    void removeSubscriberLocked(int32_t propId, const sp<HalClient>& client);
 
     sp<HalClient> getOrCreateHalClientLocked(ClientId callingPid,
                                              const sp<IVehicleCallback>& callback);
 
+    void removeHalClientLocked(ClientId clientId);
+
     void onCallbackDead(uint64_t cookie);
 
 private:
@@ -155,13 +167,34 @@ private:
         OnClientDead mOnClientDead;
     };
 
+    /* Time when the next event of an area may be delivered to a decimated subscriber. */
+    struct NextEventTime {
+        int32_t areaId;
+        int64_t timestamp;
+    };
+
+    /**
+     * Entry of the per-property subscriber index. It holds everything needed to deliver a value to
+     * the client, so distributing values doesn't need to look up each client's subscriptions.
+     */
+    struct PropertySubscriber {
+        sp<HalClient> client;
+        size_t clientSlot;  // Index of the client in mClientSlots.
+        SubscribeFlags flags;
+        int64_t minEventIntervalNs;  // Zero if all events are delivered.
+        std::vector<NextEventTime> nextEventTimes;
+
+        bool shouldDeliver(const VehiclePropValue& value);
+    };
+
 private:
     using MuxGuard = std::lock_guard<std::mutex>;
 
     mutable std::mutex mLock;
 
     std::map<ClientId, sp<HalClient>> mClients;
-    std::map<int32_t, sp<HalClientVector>> mPropToClients;
+    std::vector<sp<HalClient>> mClientSlots;  // Dense client indices, free slots are null.
+    std::unordered_map<int32_t, std::vector<PropertySubscriber>> mPropToSubscribers;
     std::map<int32_t, SubscribeOptions> mHalEventSubscribeOptions;
 
     OnPropertyUnsubscribed mOnPropertyUnsubscribed;
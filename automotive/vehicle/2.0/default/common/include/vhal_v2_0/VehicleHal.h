@@ -46,6 +46,33 @@ public:
 
     virtual StatusCode set(const VehiclePropValue& propValue) = 0;
 
+    /**
+     * Gets values for several requests at once. outValues and outStatuses are resized to the
+     * number of requests and filled in request order; a value may be null if its get failed.
+     *
+     * The default implementation calls get() for each request. Override it to serve values that
+     * are kept in a VehiclePropertyStore with a single VehiclePropertyStore::readValuesOrNull().
+     */
+    virtual void getBatch(const std::vector<const VehiclePropValue*>& requests,
+                          std::vector<VehiclePropValuePtr>* outValues,
+                          std::vector<StatusCode>* outStatuses) {
+        outValues->resize(requests.size());
+        outStatuses->resize(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            (*outValues)[i] = get(*requests[i], &(*outStatuses)[i]);
+        }
+    }
+
+    /**
+     * Maximum number of threads a batch of gets may be split across, see getBatch(). Override it
+     * if get() waits for the vehicle, e.g. for a round trip to an MCU, so that a batch takes about
+     * as long as its slowest requests rather than all of them. get() already has to be
+     * thread-safe since HIDL calls arrive on several binder threads.
+     */
+    virtual size_t getMaxConcurrentGets() const {
+        return 1;
+    }
+
     /**
      * Subscribe to HAL property events. This method might be called multiple
      * times for the same vehicle property to update sample rate.
@@ -21,18 +21,23 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
-#include "ConcurrentQueue.h"
+#include "RingBufferQueue.h"
 #include "SubscriptionManager.h"
 #include "VehicleHal.h"
 #include "VehicleObjectPool.h"
 #include "VehiclePropConfigIndex.h"
+#include "VehiclePropValueRecorder.h"
 
 namespace android {
 namespace hardware {
@@ -48,10 +53,21 @@ namespace V2_0 {
  */
 class VehicleHalManager : public IVehicle {
 public:
-    VehicleHalManager(VehicleHal* vehicleHal)
+    using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
+
+    /**
+     * @param poolMode - mode of the pool of values handed to the HAL. Mode::SLAB avoids
+     * allocations for large payloads, but the HAL must then never move out of a value or its
+     * vectors, see VehiclePropValuePool.
+     */
+    VehicleHalManager(VehicleHal* vehicleHal,
+                      VehiclePropValuePool::Mode poolMode = VehiclePropValuePool::Mode::PER_TYPE)
         : mHal(vehicleHal),
           mSubscriptionManager(std::bind(&VehicleHalManager::onAllClientsUnsubscribed,
-                                         this, std::placeholders::_1)) {
+                                         this, std::placeholders::_1)),
+          mEventQueue(kEventQueueCapacity, EventQueue::OverflowPolicy::COALESCE_BY_KEY,
+                      &VehicleHalManager::getEventKey),
+          mValueObjectPool(4 /* maxRecyclableVectorSize */, poolMode) {
         init();
     }
 
@@ -59,6 +75,15 @@ public:
 
     void init();
 
+    /**
+     * Sets how long events of properties with given change mode may wait in the event queue so
+     * they can be delivered to clients together with other events. Batches are delivered once
+     * the budget of any queued event runs out or enough events accumulate. By default ON_CHANGE
+     * events are delivered immediately and CONTINUOUS events wait up to 10ms.
+     */
+    void setEventLatencyBudget(VehiclePropertyChangeMode changeMode,
+                               std::chrono::nanoseconds budget);
+
     // ---------------------------------------------------------------------------------------------
     // Methods derived from IVehicle
     Return<void> getAllPropConfigs(getAllPropConfigs_cb _hidl_cb)  override;
@@ -75,8 +100,25 @@ public:
 
     Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
+    // ---------------------------------------------------------------------------------------------
+    // Batched get() and set() for in-process clients and debug commands
+
+    /**
+     * Gets values for all requests with VehicleHal::getBatch(). Large enough batches are split
+     * across up to VehicleHal::getMaxConcurrentGets() threads, one getBatch() call per part. The
+     * threads are started and joined on every call, there is no pool. Configs and permissions
+     * are checked the same way get() does, but only once for consecutive requests of the same
+     * property.
+     * outValues and outStatuses get one entry per request; a value is null if its get failed.
+     */
+    void getBatch(const std::vector<VehiclePropValue>& requests,
+                  std::vector<VehiclePropValuePtr>* outValues,
+                  std::vector<StatusCode>* outStatuses);
+
+    /** Sets all values in order, like set() would. Returns one status per value. */
+    std::vector<StatusCode> setBatch(const std::vector<VehiclePropValue>& values);
+
   private:
-    using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
     // Returns true if needs to call again shortly.
     using RetriableAction = std::function<bool()>;
 
@@ -93,6 +135,7 @@ public:
     void handlePropertySetEvent(const VehiclePropValue& value);
 
     const VehiclePropConfig* getPropConfigOrNull(int32_t prop) const;
+    std::chrono::nanoseconds getEventLatencyBudget(int32_t prop) const;
 
     bool checkWritePermission(const VehiclePropConfig &config) const;
     bool checkReadPermission(const VehiclePropConfig &config) const;
@@ -102,8 +145,11 @@ public:
     // TODO: most functions below (exception dump() and cmdSetOne()) should be const, but they rely
     // on IVehicle.get(), which isn't...
     void cmdDump(int fd, const hidl_vec<hidl_string>& options);
-    void cmdDumpOneProperty(int fd, int32_t prop, int32_t areaId);
-    void cmdDumpOneProperty(int fd, int rowNumber, const VehiclePropConfig& config);
+    void cmdDumpProperties(int fd, const std::vector<VehiclePropValue>& requests,
+                           const std::vector<std::string>& rowPrefixes);
+    static void addDumpRequests(int rowNumber, const VehiclePropConfig& config,
+                                std::vector<VehiclePropValue>* requests,
+                                std::vector<std::string>* rowPrefixes);
 
     static bool checkArgumentsSize(int fd, const hidl_vec<hidl_string>& options, size_t minSize);
     static bool checkCallerHasWritePermissions(int fd);
@@ -113,6 +159,9 @@ public:
     void cmdDumpAllProperties(int fd);
     void cmdDumpSpecificProperties(int fd, const hidl_vec<hidl_string>& options);
     void cmdSetOneProperty(int fd, const hidl_vec<hidl_string>& options);
+    void cmdDumpStats(int fd) const;
+    void cmdStartRecording(int fd, const hidl_vec<hidl_string>& options);
+    void cmdStopRecording(int fd);
 
     static bool isSubscribable(const VehiclePropConfig& config,
                                SubscribeFlags flags);
@@ -120,16 +169,31 @@ public:
     static float checkSampleRate(const VehiclePropConfig& config,
                                  float sampleRate);
     static ClientId getClientId(const sp<IVehicleCallback>& callback);
+    static int64_t getEventKey(const VehiclePropValuePtr& value);
 private:
+    using EventQueue = RingBufferQueue<VehiclePropValuePtr>;
+
+    /**
+     * Number of events that can be queued before events of the same property and area start to
+     * be coalesced, i.e. clients only receive the latest of them.
+     */
+    static constexpr size_t kEventQueueCapacity = 4096;
+
     VehicleHal* mHal;
     std::unique_ptr<VehiclePropConfigIndex> mConfigIndex;
+    std::atomic<bool> mConfigIndexReady { false };  // Set once mConfigIndex is initialized.
     SubscriptionManager mSubscriptionManager;
 
     hidl_vec<VehiclePropValue> mHidlVecOfVehiclePropValuePool;
+    std::vector<HalClientValues> mClientValues;  // Only used by the BatchingConsumer thread.
 
-    ConcurrentQueue<VehiclePropValuePtr> mEventQueue;
-    BatchingConsumer<VehiclePropValuePtr> mBatchingConsumer;
+    EventQueue mEventQueue;
+    BatchingConsumer<VehiclePropValuePtr, EventQueue> mBatchingConsumer;
     VehiclePropValuePool mValueObjectPool;
+    VehiclePropValueRecorder mRecorder;  // Records batches delivered to clients, if started.
+
+    std::atomic<int64_t> mOnChangeLatencyBudgetNs;
+    std::atomic<int64_t> mContinuousLatencyBudgetNs;
 };
 
 }  // namespace V2_0
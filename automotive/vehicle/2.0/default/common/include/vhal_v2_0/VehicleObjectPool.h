@@ -37,6 +37,10 @@ struct PoolStats {
     std::atomic<uint32_t> Obtained {0};
     std::atomic<uint32_t> Created {0};
     std::atomic<uint32_t> Recycled {0};
+    // Only updated by VehiclePropValuePool in slab mode.
+    std::atomic<uint32_t> CacheHits {0};    // Served from the thread-local cache.
+    std::atomic<uint32_t> CacheMisses {0};  // Taken from the shared depot or created.
+    std::atomic<uint64_t> BytesResident {0};  // Held by slab values, in use or cached.
 
     static PoolStats* instance() {
         static PoolStats inst;
@@ -145,6 +149,20 @@ private:
  * synchornization penalty for these objects since we do not store them in the
  * pool.
  *
+ * In slab mode, values are recycled by the size of their vector payload instead
+ * of their exact type and vector size. Every value is allocated together with
+ * its payload storage, rounded up to a power of two, and its vector points to
+ * that storage, so neither obtaining nor recycling it allocates. Payloads up to
+ * kMaxSlabPayloadBytes are recycled. Free values are process-wide: each thread
+ * keeps a small cache per size class that is used without locking and only
+ * goes to a shared depot when it runs empty or full.
+ *
+ * The vectors of a slab value don't own their storage, they are views into the
+ * slab. Never move out of a slab value or its vectors (e.g.
+ * "VehiclePropValue x = std::move(*v)") or swap them with vectors of another
+ * value: the result keeps pointing into the slab, which is reused as soon as
+ * the value is recycled. Copy the value instead.
+ *
  * This class is thread-safe. Users can obtain an object in one thread and pass
  * it to another.
  *
@@ -163,6 +181,13 @@ class VehiclePropValuePool {
 public:
     using RecyclableType = recyclable_ptr<VehiclePropValue>;
 
+    enum class Mode {
+        PER_TYPE,  // One pool of values per type and vector size.
+        SLAB,      // Values are shared by payload size class, must not be moved from, see above.
+    };
+
+    static constexpr size_t kMaxSlabPayloadBytes = 1024;
+
     /**
      * Creates VehiclePropValuePool
      *
@@ -173,9 +198,12 @@ public:
      * object, but once it goes out of scope it will be deleted immediately, not
      * returning back to the object pool.
      *
+     * @param mode - in Mode::SLAB, values with a vector payload up to
+     * kMaxSlabPayloadBytes are recycled regardless of maxRecyclableVectorSize.
+     *
      */
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4) :
-        mMaxRecyclableVectorSize(maxRecyclableVectorSize) {};
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4, Mode mode = Mode::PER_TYPE) :
+        mMaxRecyclableVectorSize(maxRecyclableVectorSize), mMode(mode) {};
 
     RecyclableType obtain(VehiclePropertyType type);
 
@@ -200,6 +228,10 @@ private:
                                     size_t vectorSize) const;
     RecyclableType obtainRecylable(VehiclePropertyType type,
                                    size_t vecSize);
+    RecyclableType obtainFromSlab(VehiclePropertyType type, size_t vecSize,
+                                  size_t payloadBytes) const;
+
+    static void recycleSlabValue(VehiclePropValue* v);
 
     class InternalPool: public ObjectPool<VehiclePropValue> {
     public:
@@ -230,10 +262,12 @@ private:
             delete v;
         }
     };
+    const Deleter<VehiclePropValue> mSlabDeleter { &VehiclePropValuePool::recycleSlabValue };
 
 private:
     mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
+    const Mode mMode;
     std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools;
 };
 
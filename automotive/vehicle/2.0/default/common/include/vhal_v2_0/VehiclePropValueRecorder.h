@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VehiclePropValueRecorder_H_
+#define android_hardware_automotive_vehicle_V2_0_VehiclePropValueRecorder_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+#include "VehicleObjectPool.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Appends batches of property values to a compact binary log that VehiclePropValueLogReader can
+ * read back, e.g. to replay a drive offline.
+ *
+ * Log layout: the "VHALREC" magic including its terminating zero, followed by one frame per
+ * recorded batch:
+ *
+ *     varint         frame size in bytes, not counting this field
+ *     varint         number of values in the batch
+ *     for each value:
+ *         varint     timestamp delta to the previous value in the log, zigzag-encoded
+ *         varint     prop, areaId and status
+ *         uint8      value layout, see kScalarValue and the k*Present bits
+ *         the value: a single scalar of the property's type, or each non-empty vector as a
+ *                    varint count followed by zigzag varints (int32, int64), raw floats, raw
+ *                    bytes or the raw characters of stringValue
+ *
+ * record() only encodes into a memory buffer; a background thread writes the buffer out. If the
+ * disk can't keep up, batches are dropped once kMaxPendingBytes are buffered.
+ */
+class VehiclePropValueRecorder {
+public:
+    using VehiclePropValuePtr = recyclable_ptr<VehiclePropValue>;
+
+    struct Stats {
+        uint64_t batches;
+        uint64_t values;
+        uint64_t bytesWritten;
+        uint64_t droppedBatches;
+    };
+
+    VehiclePropValueRecorder() = default;
+    ~VehiclePropValueRecorder();
+
+    /** Starts recording to |path|, replacing its contents. A recording in progress is stopped. */
+    bool start(const std::string& path);
+
+    /** Writes out everything recorded so far and closes the log. */
+    void stop();
+
+    bool isRecording() const { return mRecording.load(std::memory_order_relaxed); }
+
+    /** Appends a batch to the log. Does nothing if the recorder is not started. */
+    void record(const std::vector<VehiclePropValuePtr>& values);
+
+    Stats getStats() const;
+
+    /** Frames are handed to the writer thread once this many bytes are buffered. */
+    static constexpr size_t kFlushThresholdBytes = 64 * 1024;
+    static constexpr size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+private:
+    void stopLocked();
+    void writerThread();
+
+    std::atomic<bool> mRecording { false };
+    std::mutex mControlLock;  // Serializes start() and stop().
+
+    mutable std::mutex mLock;
+    std::condition_variable mCond;
+    int mFd = -1;
+    bool mStopping = false;
+    int64_t mLastTimestamp = 0;
+    std::vector<uint8_t> mFrame;    // Scratch buffer for the frame being encoded.
+    std::vector<uint8_t> mPending;  // Encoded frames waiting for the writer thread.
+    Stats mStats {};
+    std::thread mWriterThread;
+};
+
+/** Reads a log written by VehiclePropValueRecorder, one value at a time. */
+class VehiclePropValueLogReader {
+public:
+    VehiclePropValueLogReader() = default;
+    ~VehiclePropValueLogReader();
+
+    VehiclePropValueLogReader(const VehiclePropValueLogReader&) = delete;
+    VehiclePropValueLogReader& operator=(const VehiclePropValueLogReader&) = delete;
+
+    /** Returns false if |path| can't be read or isn't a recorder log. */
+    bool open(const std::string& path);
+
+    /**
+     * Reads the next value. Returns false at the end of the log or at the first truncated or
+     * corrupted frame, which is what a log looks like when the recorder was killed.
+     */
+    bool next(VehiclePropValue* value);
+
+    /** Goes back to the first value in the log. */
+    bool rewind();
+
+private:
+    bool readFrame();
+    bool fill(size_t numBytes);
+
+    int mFd = -1;
+    std::vector<uint8_t> mBuffer;  // Bytes read from the file, [mBegin, mEnd) not consumed yet.
+    size_t mBegin = 0;
+    size_t mEnd = 0;
+    size_t mFramePos = 0;  // Values of the current frame are decoded from mBuffer in place.
+    size_t mFrameEnd = 0;
+    uint64_t mValuesLeftInFrame = 0;
+    int64_t mLastTimestamp = 0;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VehiclePropValueRecorder_H_
@@ -18,12 +18,17 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_PropertyDb_H_
 
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "VehicleObjectPool.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -34,16 +39,33 @@ namespace V2_0 {
  * Encapsulates work related to storing and accessing configuration, storing and modifying
  * vehicle property values.
  *
- * VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
- * to get value for all areas for particular property.
+ * By default VehiclePropertyValues stored in a sorted map thus it makes easier to get range of
+ * values, e.g. to get value for all areas for particular property. In this mode the class is
+ * thread-safe, however it uses blocking synchronization across all methods.
  *
- * This class is thread-safe, however it uses blocking synchronization across all methods.
+ * StorageMode::INDEXED keeps a small per-property vector of values sorted by area and token
+ * instead. Readers work on immutable snapshots of that vector and don't wait for writers to copy
+ * it, writers only serialize with other writers of the same property. Taking or replacing a
+ * snapshot still goes through std::atomic_load / std::atomic_store on a shared_ptr, which libc++
+ * implements with a small global pool of mutexes, so this mode shortens the critical sections
+ * rather than removing them.
  */
 class VehiclePropertyStore {
 public:
     /* Function that used to calculate unique token for given VehiclePropValue */
     using TokenFunction = std::function<int64_t(const VehiclePropValue& value)>;
 
+    enum class StorageMode {
+        SORTED_MAP,
+        INDEXED,
+    };
+
+    explicit VehiclePropertyStore(StorageMode mode = StorageMode::SORTED_MAP);
+    ~VehiclePropertyStore();
+
+    VehiclePropertyStore(const VehiclePropertyStore&) = delete;
+    VehiclePropertyStore& operator=(const VehiclePropertyStore&) = delete;
+
 private:
     struct RecordConfig {
         VehiclePropConfig propConfig;
@@ -62,6 +84,9 @@ private:
     using PropertyMap = std::map<RecordId, VehiclePropValue>;
     using PropertyMapRange = std::pair<PropertyMap::const_iterator, PropertyMap::const_iterator>;
 
+    // Backend used for StorageMode::INDEXED, defined in VehiclePropertyStore.cpp.
+    class PropertyIndex;
+
 public:
     void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr);
 
@@ -77,6 +102,14 @@ public:
     std::unique_ptr<VehiclePropValue> readValueOrNull(const VehiclePropValue& request) const;
     std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
                                                       int64_t token = 0) const;
+    /* Reads the values for all requests and copies them straight into values obtained from
+     * |pool|. Values that aren't found are returned as nullptr, in request order.
+     * With StorageMode::SORTED_MAP the store lock is taken once for the whole batch. With
+     * StorageMode::INDEXED no store lock is taken; each request is a separate lookup in the
+     * snapshot of its property. */
+    std::vector<recyclable_ptr<VehiclePropValue>> readValuesOrNull(
+            const std::vector<const VehiclePropValue*>& requests,
+            VehiclePropValuePool* pool) const;
 
     std::vector<VehiclePropConfig> getAllConfigs() const;
     const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
@@ -93,6 +126,8 @@ private:
     std::unordered_map<int32_t /* VehicleProperty */, RecordConfig> mConfigs;
 
     PropertyMap mPropertyValues;  // Sorted map of RecordId : VehiclePropValue.
+
+    std::unique_ptr<PropertyIndex> mIndex;  // Only set in StorageMode::INDEXED.
 };
 
 }  // namespace V2_0
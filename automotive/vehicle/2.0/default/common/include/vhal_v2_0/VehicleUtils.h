@@ -68,6 +68,8 @@ std::unique_ptr<VehiclePropValue> createVehiclePropValue(
 size_t getVehicleRawValueVectorSize(
     const VehiclePropValue::RawValue& value, VehiclePropertyType type);
 
+// Vectors of dest that already have the size of src are copied into in place, even if they
+// point to external storage.
 void copyVehicleRawValue(VehiclePropValue::RawValue* dest,
                                 const VehiclePropValue::RawValue& src);
 
@@ -18,6 +18,7 @@
 
 #include "SubscriptionManager.h"
 
+#include <algorithm>
 #include <cmath>
 #include <inttypes.h>
 
@@ -47,22 +48,27 @@ bool mergeSubscribeOptions(const SubscribeOptions &oldOpts,
     return updated;
 }
 
-void HalClient::addOrUpdateSubscription(const SubscribeOptions &opts)  {
+SubscribeOptions HalClient::addOrUpdateSubscription(const SubscribeOptions &opts)  {
     ALOGI("%s opts.propId: 0x%x", __func__, opts.propId);
 
     auto it = mSubscriptions.find(opts.propId);
     if (it == mSubscriptions.end()) {
         mSubscriptions.emplace(opts.propId, opts);
+        return opts;
     } else {
         const SubscribeOptions& oldOpts = it->second;
         SubscribeOptions updatedOptions;
         if (mergeSubscribeOptions(oldOpts, opts, &updatedOptions)) {
-            mSubscriptions.erase(it);
-            mSubscriptions.emplace(opts.propId, updatedOptions);
+            it->second = updatedOptions;
         }
+        return it->second;
     }
 }
 
+void HalClient::removeSubscription(int32_t propId) {
+    mSubscriptions.erase(propId);
+}
+
 bool HalClient::isSubscribed(int32_t propId,
                              SubscribeFlags flags) {
     auto it = mSubscriptions.find(propId);
@@ -102,9 +108,7 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
     for (size_t i = 0; i < optionList.size(); i++) {
         const SubscribeOptions& opts = optionList[i];
         ALOGI("SubscriptionManager::addOrUpdateSubscription, prop: 0x%x", opts.propId);
-        client->addOrUpdateSubscription(opts);
-
-        addClientToPropMapLocked(opts.propId, client);
+        addOrUpdateSubscriberLocked(client, client->addOrUpdateSubscription(opts));
 
         if (SubscribeFlags::EVENTS_FROM_CAR & opts.flags) {
             SubscribeOptions updated;
@@ -117,31 +121,33 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
     return StatusCode::OK;
 }
 
-std::list<HalClientValues> SubscriptionManager::distributeValuesToClients(
+void SubscriptionManager::distributeValuesToClients(
         const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-        SubscribeFlags flags) const {
-    std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
+        SubscribeFlags flags,
+        std::vector<HalClientValues>* outClientValues) {
+    MuxGuard g(mLock);
 
-    {
-        MuxGuard g(mLock);
-        for (const auto& propValue: propValues) {
-            VehiclePropValue* v = propValue.get();
-            auto clients = getSubscribedClientsLocked(v->prop, flags);
-            for (const auto& client : clients) {
-                clientValuesMap[client].push_back(v);
-            }
-        }
+    if (outClientValues->size() < mClientSlots.size()) {
+        outClientValues->resize(mClientSlots.size());
     }
-
-    std::list<HalClientValues> clientValues;
-    for (const auto& entry : clientValuesMap) {
-        clientValues.push_back(HalClientValues {
-            .client = entry.first,
-            .values = entry.second
-        });
+    for (size_t i = 0; i < outClientValues->size(); i++) {
+        HalClientValues& clientValues = (*outClientValues)[i];
+        clientValues.client = i < mClientSlots.size() ? mClientSlots[i] : nullptr;
+        clientValues.values.clear();  // Keeps the capacity for the next batch.
     }
 
-    return clientValues;
+    for (const auto& propValue : propValues) {
+        VehiclePropValue* v = propValue.get();
+        auto it = mPropToSubscribers.find(v->prop);
+        if (it == mPropToSubscribers.end()) {
+            continue;
+        }
+        for (PropertySubscriber& subscriber : it->second) {
+            if ((subscriber.flags & flags) && subscriber.shouldDeliver(*v)) {
+                (*outClientValues)[subscriber.clientSlot].values.push_back(v);
+            }
+        }
+    }
 }
 
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(int32_t propId,
@@ -154,12 +160,11 @@ std::list<sp<HalClient>> SubscriptionManager::getSubscribedClientsLocked(
     int32_t propId, SubscribeFlags flags) const {
     std::list<sp<HalClient>> subscribedClients;
 
-    sp<HalClientVector> propClients = getClientsForPropertyLocked(propId);
-    if (propClients.get() != nullptr) {
-        for (size_t i = 0; i < propClients->size(); i++) {
-            const auto& client = propClients->itemAt(i);
-            if (client->isSubscribed(propId, flags)) {
-                subscribedClients.push_back(client);
+    auto it = mPropToSubscribers.find(propId);
+    if (it != mPropToSubscribers.end()) {
+        for (const PropertySubscriber& subscriber : it->second) {
+            if (subscriber.flags & flags) {
+                subscribedClients.push_back(subscriber.client);
             }
         }
     }
@@ -167,6 +172,30 @@ std::list<sp<HalClient>> SubscriptionManager::getSubscribedClientsLocked(
     return subscribedClients;
 }
 
+bool SubscriptionManager::PropertySubscriber::shouldDeliver(const VehiclePropValue& value) {
+    if (minEventIntervalNs == 0 || value.timestamp <= 0) {
+        return true;
+    }
+
+    auto it = std::find_if(nextEventTimes.begin(), nextEventTimes.end(),
+                           [&value](const NextEventTime& t) { return t.areaId == value.areaId; });
+    if (it == nextEventTimes.end()) {
+        nextEventTimes.push_back({value.areaId, value.timestamp + minEventIntervalNs});
+        return true;
+    }
+
+    // Events are generated at the highest sample rate any client asked for. Allow them to arrive
+    // a bit early, so a client subscribed at that same rate doesn't lose events to jitter.
+    if (value.timestamp < it->timestamp - minEventIntervalNs / 20) {
+        return false;
+    }
+    // Stay on the same schedule unless events stopped for longer than an interval.
+    it->timestamp = value.timestamp >= it->timestamp + minEventIntervalNs
+            ? value.timestamp + minEventIntervalNs
+            : it->timestamp + minEventIntervalNs;
+    return true;
+}
+
 bool SubscriptionManager::updateHalEventSubscriptionLocked(
         const SubscribeOptions &opts, SubscribeOptions *outUpdated) {
     bool updated = false;
@@ -188,23 +217,44 @@ bool SubscriptionManager::updateHalEventSubscriptionLocked(
     return updated;
 }
 
-void SubscriptionManager::addClientToPropMapLocked(
-        int32_t propId, const sp<HalClient> &client) {
-    auto it = mPropToClients.find(propId);
-    sp<HalClientVector> propClients;
-    if (it == mPropToClients.end()) {
-        propClients = new HalClientVector();
-        mPropToClients.insert(std::make_pair(propId, propClients));
-    } else {
-        propClients = it->second;
+void SubscriptionManager::addOrUpdateSubscriberLocked(
+        const sp<HalClient>& client, const SubscribeOptions& opts) {
+    int64_t minEventIntervalNs = opts.sampleRate > 0
+            ? static_cast<int64_t>(std::llround(1e9 / opts.sampleRate)) : 0;
+
+    auto& subscribers = mPropToSubscribers[opts.propId];
+    for (PropertySubscriber& subscriber : subscribers) {
+        if (subscriber.client == client) {
+            subscriber.flags = opts.flags;
+            subscriber.minEventIntervalNs = minEventIntervalNs;
+            return;
+        }
     }
-    propClients->addOrUpdate(client);
+
+    size_t slot = std::find(mClientSlots.begin(), mClientSlots.end(), client)
+            - mClientSlots.begin();
+    subscribers.push_back(PropertySubscriber {
+        .client = client,
+        .clientSlot = slot,
+        .flags = opts.flags,
+        .minEventIntervalNs = minEventIntervalNs,
+    });
 }
 
-sp<HalClientVector> SubscriptionManager::getClientsForPropertyLocked(
-        int32_t propId) const {
-    auto it = mPropToClients.find(propId);
-    return it == mPropToClients.end() ? nullptr : it->second;
+void SubscriptionManager::removeSubscriberLocked(int32_t propId, const sp<HalClient>& client) {
+    auto it = mPropToSubscribers.find(propId);
+    if (it == mPropToSubscribers.end()) {
+        return;
+    }
+    auto& subscribers = it->second;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                     [&client](const PropertySubscriber& subscriber) {
+                                         return subscriber.client == client;
+                                     }),
+                      subscribers.end());
+    if (subscribers.empty()) {
+        mPropToSubscribers.erase(it);
+    }
 }
 
 sp<HalClient> SubscriptionManager::getOrCreateHalClientLocked(
@@ -223,49 +273,54 @@ sp<HalClient> SubscriptionManager::getOrCreateHalClientLocked(
 
         sp<HalClient> client = new HalClient(callback);
         mClients.insert({clientId, client});
+
+        auto freeSlot = std::find(mClientSlots.begin(), mClientSlots.end(), nullptr);
+        if (freeSlot == mClientSlots.end()) {
+            mClientSlots.push_back(client);
+        } else {
+            *freeSlot = client;
+        }
         return client;
     } else {
         return it->second;
     }
 }
 
+void SubscriptionManager::removeHalClientLocked(ClientId clientId) {
+    auto it = mClients.find(clientId);
+    if (it == mClients.end()) {
+        return;
+    }
+    const sp<HalClient>& client = it->second;
+    auto res = client->getCallback()->unlinkToDeath(mCallbackDeathRecipient);
+    if (!res.isOk()) {
+        ALOGW("%s failed to unlink to death, client: %p, err: %s",
+              __func__, client->getCallback().get(), res.description().c_str());
+    }
+    auto slot = std::find(mClientSlots.begin(), mClientSlots.end(), client);
+    if (slot != mClientSlots.end()) {
+        *slot = nullptr;
+    }
+    mClients.erase(it);
+}
+
 void SubscriptionManager::unsubscribe(ClientId clientId,
                                       int32_t propId) {
     MuxGuard g(mLock);
-    auto propertyClients = getClientsForPropertyLocked(propId);
     auto clientIter = mClients.find(clientId);
     if (clientIter == mClients.end()) {
         ALOGW("Unable to unsubscribe: no callback found, propId: 0x%x", propId);
     } else {
-        auto client = clientIter->second;
+        sp<HalClient> client = clientIter->second;
+        removeSubscriberLocked(propId, client);
+        client->removeSubscription(propId);
 
-        if (propertyClients != nullptr) {
-            propertyClients->remove(client);
-
-            if (propertyClients->isEmpty()) {
-                mPropToClients.erase(propId);
-            }
-        }
-
-        bool isClientSubscribedToOtherProps = false;
-        for (const auto& propClient : mPropToClients) {
-            if (propClient.second->indexOf(client) >= 0) {
-                isClientSubscribedToOtherProps = true;
-                break;
-            }
-        }
-
-        if (!isClientSubscribedToOtherProps) {
-            auto res = client->getCallback()->unlinkToDeath(mCallbackDeathRecipient);
-            if (!res.isOk()) {
-                ALOGW("%s failed to unlink to death, client: %p, err: %s",
-                      __func__, client->getCallback().get(), res.description().c_str());
-            }
-            mClients.erase(clientIter);
+        if (!client->hasSubscriptions()) {
+            removeHalClientLocked(clientId);
         }
     }
 
-    if (propertyClients == nullptr || propertyClients->isEmpty()) {
+    if (mPropToSubscribers.find(propId) == mPropToSubscribers.end()) {
         mHalEventSubscribeOptions.erase(propId);
         mOnPropertyUnsubscribed(propId);
     }
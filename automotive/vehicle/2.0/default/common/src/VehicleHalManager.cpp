@@ -18,8 +18,10 @@
 
 #include "VehicleHalManager.h"
 
+#include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <thread>
 
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
@@ -46,6 +48,18 @@ using ::android::hardware::hidl_string;
 
 constexpr std::chrono::milliseconds kHalEventBatchingTimeWindow(10);
 
+/**
+ * Events are delivered to clients as soon as this many of them are queued, even if none of their
+ * latency budgets has run out yet.
+ */
+constexpr size_t kHalEventMaxBatchSize = 100;
+
+/**
+ * getBatch() only gives a thread of its own to at least this many requests, so that it isn't
+ * dominated by starting and joining the thread. Smaller batches are served on the calling thread.
+ */
+constexpr size_t kMinGetsPerThread = 8;
+
 const VehiclePropValue kEmptyValue{};
 
 /**
@@ -128,6 +142,101 @@ Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
     return Return<StatusCode>(status);
 }
 
+void VehicleHalManager::getBatch(const std::vector<VehiclePropValue>& requests,
+                                 std::vector<VehiclePropValuePtr>* outValues,
+                                 std::vector<StatusCode>* outStatuses) {
+    outValues->clear();
+    outValues->resize(requests.size());
+    outStatuses->assign(requests.size(), StatusCode::OK);
+
+    std::vector<const VehiclePropValue*> halRequests;
+    std::vector<size_t> halIndices;  // Index in requests of each of halRequests.
+    halRequests.reserve(requests.size());
+    halIndices.reserve(requests.size());
+    const VehiclePropConfig* config = nullptr;
+    for (size_t i = 0; i < requests.size(); i++) {
+        int32_t prop = requests[i].prop;
+        // Areas of a property are usually requested together.
+        if (i == 0 || prop != requests[i - 1].prop) {
+            config = getPropConfigOrNull(prop);
+            if (config == nullptr) {
+                ALOGE("Failed to get value: config not found, property: 0x%x", prop);
+            }
+        }
+        if (config == nullptr) {
+            (*outStatuses)[i] = StatusCode::INVALID_ARG;
+        } else if (!checkReadPermission(*config)) {
+            (*outStatuses)[i] = StatusCode::ACCESS_DENIED;
+        } else {
+            halRequests.push_back(&requests[i]);
+            halIndices.push_back(i);
+        }
+    }
+    if (halRequests.empty()) return;
+
+    // Consecutive requests stay together so that the HAL can still serve each part in one go.
+    // Small batches aren't split, a part must be worth starting and joining a thread for.
+    size_t numParts = std::max<size_t>(
+            1, std::min(mHal->getMaxConcurrentGets(), halRequests.size() / kMinGetsPerThread));
+    size_t partSize = (halRequests.size() + numParts - 1) / numParts;
+    struct Part {
+        std::vector<const VehiclePropValue*> requests;
+        std::vector<VehiclePropValuePtr> values;
+        std::vector<StatusCode> statuses;
+    };
+    std::vector<Part> parts(numParts);
+    for (size_t i = 0; i < numParts; i++) {
+        auto begin = halRequests.begin() + std::min(i * partSize, halRequests.size());
+        auto end = halRequests.begin() + std::min((i + 1) * partSize, halRequests.size());
+        parts[i].requests.assign(begin, end);
+    }
+
+    auto getPart = [this](Part* part) {
+        mHal->getBatch(part->requests, &part->values, &part->statuses);
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(numParts - 1);
+    for (size_t i = 1; i < numParts; i++) {
+        workers.emplace_back(getPart, &parts[i]);
+    }
+    getPart(&parts[0]);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    size_t next = 0;
+    for (auto& part : parts) {
+        for (size_t i = 0; i < part.requests.size(); i++, next++) {
+            (*outValues)[halIndices[next]] = std::move(part.values[i]);
+            (*outStatuses)[halIndices[next]] = part.statuses[i];
+        }
+    }
+}
+
+std::vector<StatusCode> VehicleHalManager::setBatch(const std::vector<VehiclePropValue>& values) {
+    std::vector<StatusCode> statuses;
+    statuses.reserve(values.size());
+    const VehiclePropConfig* config = nullptr;
+    for (size_t i = 0; i < values.size(); i++) {
+        const auto& value = values[i];
+        if (i == 0 || value.prop != values[i - 1].prop) {
+            config = getPropConfigOrNull(value.prop);
+            if (config == nullptr) {
+                ALOGE("Failed to set value: config not found, property: 0x%x", value.prop);
+            }
+        }
+        if (config == nullptr) {
+            statuses.push_back(StatusCode::INVALID_ARG);
+        } else if (!checkWritePermission(*config)) {
+            statuses.push_back(StatusCode::ACCESS_DENIED);
+        } else {
+            handlePropertySetEvent(value);
+            statuses.push_back(mHal->set(value));
+        }
+    }
+    return statuses;
+}
+
 Return<StatusCode> VehicleHalManager::subscribe(const sp<IVehicleCallback> &callback,
                                                 const hidl_vec<SubscribeOptions> &options) {
     hidl_vec<SubscribeOptions> verifiedOptions(options);
@@ -214,6 +323,12 @@ void VehicleHalManager::cmdDump(int fd, const hidl_vec<hidl_string>& options) {
         cmdDumpSpecificProperties(fd, options);
     } else if (EqualsIgnoreCase(option, "--set")) {
         cmdSetOneProperty(fd, options);
+    } else if (EqualsIgnoreCase(option, "--stats")) {
+        cmdDumpStats(fd);
+    } else if (EqualsIgnoreCase(option, "--start-recording")) {
+        cmdStartRecording(fd, options);
+    } else if (EqualsIgnoreCase(option, "--stop-recording")) {
+        cmdStopRecording(fd);
     } else {
         dprintf(fd, "Invalid option: %s\n", option.c_str());
     }
@@ -260,6 +375,11 @@ void VehicleHalManager::cmdHelp(int fd) const {
             "s for string) and an optional area.\n"
             "Notice that the string value can be set just once, while the other can have multiple "
             "values (so they're used in the respective array)\n");
+    dprintf(fd, "--stats: dumps event batching, value pool and recorder counters\n");
+    dprintf(fd,
+            "--start-recording <FILE>: records all property events delivered to clients to FILE, "
+            "which can be replayed with FakeDataCommand::StartReplay\n");
+    dprintf(fd, "--stop-recording: stops the recording and flushes it to disk\n");
 }
 
 void VehicleHalManager::cmdListAllProperties(int fd) const {
@@ -285,29 +405,36 @@ void VehicleHalManager::cmdDumpAllProperties(int fd) {
     }
     int rowNumber = 0;
     dprintf(fd, "dumping %zu properties\n", size);
+    std::vector<VehiclePropValue> requests;
+    std::vector<std::string> rowPrefixes;
     for (auto& config : halConfig) {
-        cmdDumpOneProperty(fd, ++rowNumber, config);
+        addDumpRequests(++rowNumber, config, &requests, &rowPrefixes);
     }
+    cmdDumpProperties(fd, requests, rowPrefixes);
 }
 
-void VehicleHalManager::cmdDumpOneProperty(int fd, int rowNumber, const VehiclePropConfig& config) {
+void VehicleHalManager::addDumpRequests(int rowNumber, const VehiclePropConfig& config,
+                                        std::vector<VehiclePropValue>* requests,
+                                        std::vector<std::string>* rowPrefixes) {
+    VehiclePropValue request {};
+    request.prop = config.prop;
     size_t numberAreas = config.areaConfigs.size();
     if (numberAreas == 0) {
-        if (rowNumber > 0) {
-            dprintf(fd, "%d: ", rowNumber);
-        }
-        cmdDumpOneProperty(fd, config.prop, /* areaId= */ 0);
+        request.areaId = 0;
+        requests->push_back(request);
+        rowPrefixes->push_back(rowNumber > 0 ? std::to_string(rowNumber) + ": " : "");
         return;
     }
     for (size_t j = 0; j < numberAreas; ++j) {
-        if (rowNumber > 0) {
-            if (numberAreas > 1) {
-                dprintf(fd, "%d/%zu: ", rowNumber, j);
-            } else {
-                dprintf(fd, "%d: ", rowNumber);
-            }
+        request.areaId = config.areaConfigs[j].areaId;
+        requests->push_back(request);
+        if (rowNumber <= 0) {
+            rowPrefixes->push_back("");
+        } else if (numberAreas > 1) {
+            rowPrefixes->push_back(std::to_string(rowNumber) + "/" + std::to_string(j) + ": ");
+        } else {
+            rowPrefixes->push_back(std::to_string(rowNumber) + ": ");
         }
-        cmdDumpOneProperty(fd, config.prop, config.areaConfigs[j].areaId);
     }
 }
 
@@ -315,11 +442,16 @@ void VehicleHalManager::cmdDumpSpecificProperties(int fd, const hidl_vec<hidl_st
     if (!checkArgumentsSize(fd, options, 2)) return;
 
     // options[0] is the command itself...
-    int rowNumber = 0;
     size_t size = options.size();
+    std::vector<int> props(size - 1);
     for (size_t i = 1; i < size; ++i) {
-        int prop;
-        if (!safelyParseInt(fd, i, options[i], &prop)) return;
+        if (!safelyParseInt(fd, i, options[i], &props[i - 1])) return;
+    }
+
+    int rowNumber = 0;
+    std::vector<VehiclePropValue> requests;
+    std::vector<std::string> rowPrefixes;
+    for (int prop : props) {
         const auto* config = getPropConfigOrNull(prop);
         if (config == nullptr) {
             dprintf(fd, "No property %d\n", prop);
@@ -329,22 +461,25 @@ void VehicleHalManager::cmdDumpSpecificProperties(int fd, const hidl_vec<hidl_st
             // Only show row number if there's more than 1
             rowNumber++;
         }
-        cmdDumpOneProperty(fd, rowNumber, *config);
+        addDumpRequests(rowNumber, *config, &requests, &rowPrefixes);
     }
+    cmdDumpProperties(fd, requests, rowPrefixes);
 }
 
-void VehicleHalManager::cmdDumpOneProperty(int fd, int32_t prop, int32_t areaId) {
-    VehiclePropValue input;
-    input.prop = prop;
-    input.areaId = areaId;
-    auto callback = [&](StatusCode status, const VehiclePropValue& output) {
-        if (status == StatusCode::OK) {
-            dprintf(fd, "%s\n", toString(output).c_str());
+void VehicleHalManager::cmdDumpProperties(int fd, const std::vector<VehiclePropValue>& requests,
+                                          const std::vector<std::string>& rowPrefixes) {
+    std::vector<VehiclePropValuePtr> values;
+    std::vector<StatusCode> statuses;
+    getBatch(requests, &values, &statuses);
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (statuses[i] == StatusCode::OK) {
+            dprintf(fd, "%s%s\n", rowPrefixes[i].c_str(),
+                    toString(values[i] != nullptr ? *values[i] : kEmptyValue).c_str());
         } else {
-            dprintf(fd, "Could not get property %d. Error: %s\n", prop, toString(status).c_str());
+            dprintf(fd, "%sCould not get property %d. Error: %s\n", rowPrefixes[i].c_str(),
+                    requests[i].prop, toString(statuses[i]).c_str());
         }
-    };
-    get(input, callback);
+    }
 }
 
 void VehicleHalManager::cmdSetOneProperty(int fd, const hidl_vec<hidl_string>& options) {
@@ -428,16 +563,66 @@ void VehicleHalManager::cmdSetOneProperty(int fd, const hidl_vec<hidl_string>& o
     }
 }
 
+void VehicleHalManager::cmdDumpStats(int fd) const {
+    auto stats = mBatchingConsumer.getStats();
+    dprintf(fd, "Event batches: %" PRIu64 ", events: %" PRIu64 ", max batch size: %" PRIu64 "\n",
+            stats.batches, stats.items, stats.maxBatchSize);
+    int64_t avgDelayUs = stats.items > 0
+            ? std::chrono::duration_cast<std::chrono::microseconds>(
+                      stats.totalQueueingDelay).count() / static_cast<int64_t>(stats.items)
+            : 0;
+    dprintf(fd, "Event queueing delay: avg %" PRId64 "us, max %" PRId64 "us\n", avgDelayUs,
+            std::chrono::duration_cast<std::chrono::microseconds>(stats.maxQueueingDelay).count());
+    dprintf(fd, "Events coalesced: %" PRIu64 ", queue capacity: %zu\n",
+            mEventQueue.getCoalescedCount(), mEventQueue.capacity());
+    dprintf(fd, "Latency budget: ON_CHANGE %" PRId64 "ns, CONTINUOUS %" PRId64 "ns\n",
+            mOnChangeLatencyBudgetNs.load(), mContinuousLatencyBudgetNs.load());
+    PoolStats* poolStats = PoolStats::instance();
+    dprintf(fd, "Value pool: obtained %" PRIu32 ", created %" PRIu32 ", recycled %" PRIu32
+            ", cache hits %" PRIu32 ", cache misses %" PRIu32 ", bytes resident %" PRIu64 "\n",
+            poolStats->Obtained.load(), poolStats->Created.load(), poolStats->Recycled.load(),
+            poolStats->CacheHits.load(), poolStats->CacheMisses.load(),
+            poolStats->BytesResident.load());
+    auto recorderStats = mRecorder.getStats();
+    dprintf(fd, "Recorder: %s, batches %" PRIu64 ", values %" PRIu64 ", bytes written %" PRIu64
+            ", dropped batches %" PRIu64 "\n",
+            mRecorder.isRecording() ? "recording" : "stopped", recorderStats.batches,
+            recorderStats.values, recorderStats.bytesWritten, recorderStats.droppedBatches);
+}
+
+void VehicleHalManager::cmdStartRecording(int fd, const hidl_vec<hidl_string>& options) {
+    if (!checkCallerHasWritePermissions(fd) || !checkArgumentsSize(fd, options, 2)) return;
+
+    std::string path = options[1];
+    if (mRecorder.start(path)) {
+        dprintf(fd, "Recording property events to %s\n", path.c_str());
+    } else {
+        dprintf(fd, "Failed to start recording to %s\n", path.c_str());
+    }
+}
+
+void VehicleHalManager::cmdStopRecording(int fd) {
+    if (!checkCallerHasWritePermissions(fd)) return;
+
+    mRecorder.stop();
+    auto stats = mRecorder.getStats();
+    dprintf(fd, "Recorded %" PRIu64 " values in %" PRIu64 " bytes\n", stats.values,
+            stats.bytesWritten);
+}
+
 void VehicleHalManager::init() {
     ALOGI("VehicleHalManager::init");
 
     mHidlVecOfVehiclePropValuePool.resize(kMaxHidlVecOfVehiclPropValuePoolSize);
 
+    mOnChangeLatencyBudgetNs = 0;
+    mContinuousLatencyBudgetNs =
+            std::chrono::nanoseconds(kHalEventBatchingTimeWindow).count();
 
-    mBatchingConsumer.run(&mEventQueue,
-                          kHalEventBatchingTimeWindow,
-                          std::bind(&VehicleHalManager::onBatchHalEvent,
-                                    this, _1));
+    mBatchingConsumer.runWithDeadlines(&mEventQueue,
+                                       kHalEventMaxBatchSize,
+                                       std::bind(&VehicleHalManager::onBatchHalEvent,
+                                                 this, _1));
 
     mHal->init(&mValueObjectPool,
                std::bind(&VehicleHalManager::onHalEvent, this, _1),
@@ -447,6 +632,7 @@ void VehicleHalManager::init() {
     // Initialize index with vehicle configurations received from VehicleHal.
     auto supportedPropConfigs = mHal->listProperties();
     mConfigIndex.reset(new VehiclePropConfigIndex(supportedPropConfigs));
+    mConfigIndexReady.store(true, std::memory_order_release);
 
     std::vector<int32_t> supportedProperties(
         supportedPropConfigs.size());
@@ -464,8 +650,34 @@ VehicleHalManager::~VehicleHalManager() {
     ALOGI("VehicleHalManager::dtor");
 }
 
+void VehicleHalManager::setEventLatencyBudget(VehiclePropertyChangeMode changeMode,
+                                              std::chrono::nanoseconds budget) {
+    switch (changeMode) {
+        case VehiclePropertyChangeMode::ON_CHANGE:
+            mOnChangeLatencyBudgetNs = budget.count();
+            break;
+        case VehiclePropertyChangeMode::CONTINUOUS:
+            mContinuousLatencyBudgetNs = budget.count();
+            break;
+        default:
+            ALOGW("%s: no latency budget for change mode %d", __func__, toInt(changeMode));
+    }
+}
+
+std::chrono::nanoseconds VehicleHalManager::getEventLatencyBudget(int32_t prop) const {
+    // Events may arrive while init() is still building the config index.
+    const auto* config = mConfigIndexReady.load(std::memory_order_acquire)
+            ? getPropConfigOrNull(prop) : nullptr;
+    if (config != nullptr && config->changeMode == VehiclePropertyChangeMode::CONTINUOUS) {
+        return std::chrono::nanoseconds(mContinuousLatencyBudgetNs.load());
+    }
+    return std::chrono::nanoseconds(mOnChangeLatencyBudgetNs.load());
+}
+
 void VehicleHalManager::onHalEvent(VehiclePropValuePtr v) {
-    mEventQueue.push(std::move(v));
+    auto deadline = EventQueue::Clock::now()
+                    + getEventLatencyBudget(v->prop);
+    mEventQueue.push(std::move(v), deadline);
 }
 
 void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
@@ -480,10 +692,16 @@ void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
 }
 
 void VehicleHalManager::onBatchHalEvent(const std::vector<VehiclePropValuePtr>& values) {
-    const auto& clientValues =
-        mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR);
+    if (mRecorder.isRecording()) {
+        mRecorder.record(values);
+    }
+    mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR,
+                                                   &mClientValues);
 
-    for (const HalClientValues& cv : clientValues) {
+    for (const HalClientValues& cv : mClientValues) {
+        if (cv.values.empty()) {
+            continue;
+        }
         auto vecSize = cv.values.size();
         hidl_vec<VehiclePropValue> vec;
         if (vecSize < kMaxHidlVecOfVehiclPropValuePoolSize) {
@@ -595,6 +813,14 @@ ClientId VehicleHalManager::getClientId(const sp<IVehicleCallback>& callback) {
     }
 }
 
+int64_t VehicleHalManager::getEventKey(const VehiclePropValuePtr& value) {
+    // Only the latest queued event of a property and area is kept when the event queue overflows.
+    // Composed unsigned, as shifting a negative property id left is undefined.
+    return static_cast<int64_t>(
+            (static_cast<uint64_t>(static_cast<uint32_t>(value->prop)) << 32) |
+            static_cast<uint32_t>(value->areaId));
+}
+
 }  // namespace V2_0
 }  // namespace vehicle
 }  // namespace automotive
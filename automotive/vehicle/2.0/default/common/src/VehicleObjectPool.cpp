@@ -18,6 +18,8 @@
 
 #include "VehicleObjectPool.h"
 
+#include <string.h>
+
 #include <log/log.h>
 
 #include "VehicleUtils.h"
@@ -28,8 +30,213 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+// A slab value is a single allocation: the header, the VehiclePropValue and its payload.
+struct SlabHeader {
+    size_t sizeClass;
+};
+
+constexpr size_t kMinSlabPayloadBytes = 16;
+constexpr size_t kNumSizeClasses = 7;  // 16, 32, ..., 1024 bytes.
+constexpr size_t kThreadCacheSize = 32;  // Values per size class.
+constexpr size_t kDepotSize = 1024;  // Values per size class.
+
+static_assert(kMinSlabPayloadBytes << (kNumSizeClasses - 1)
+              == VehiclePropValuePool::kMaxSlabPayloadBytes, "Size classes don't match");
+
+constexpr size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+constexpr size_t kValueOffset = alignUp(sizeof(SlabHeader), alignof(VehiclePropValue));
+constexpr size_t kPayloadOffset =
+        alignUp(kValueOffset + sizeof(VehiclePropValue), alignof(int64_t));
+
+// Returns the size of a vector element of the given type, 0 if it has no vector payload.
+size_t getPayloadElementSize(VehiclePropertyType type) {
+    switch (type) {
+        case VehiclePropertyType::INT32:      // fall through
+        case VehiclePropertyType::INT32_VEC:  // fall through
+        case VehiclePropertyType::BOOLEAN:
+            return sizeof(int32_t);
+        case VehiclePropertyType::FLOAT:      // fall through
+        case VehiclePropertyType::FLOAT_VEC:
+            return sizeof(float);
+        case VehiclePropertyType::INT64:      // fall through
+        case VehiclePropertyType::INT64_VEC:
+            return sizeof(int64_t);
+        case VehiclePropertyType::BYTES:
+            return sizeof(uint8_t);
+        default:
+            return 0;
+    }
+}
+
+size_t getSizeClass(size_t payloadBytes) {
+    size_t sizeClass = 0;
+    while ((kMinSlabPayloadBytes << sizeClass) < payloadBytes) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+size_t getAllocationSize(size_t sizeClass) {
+    return kPayloadOffset + (kMinSlabPayloadBytes << sizeClass);
+}
+
+uint8_t* getBase(VehiclePropValue* v) {
+    return reinterpret_cast<uint8_t*>(v) - kValueOffset;
+}
+
+size_t getSizeClass(VehiclePropValue* v) {
+    return reinterpret_cast<SlabHeader*>(getBase(v))->sizeClass;
+}
+
+VehiclePropValue* createSlabValue(size_t sizeClass) {
+    size_t size = getAllocationSize(sizeClass);
+    uint8_t* base = static_cast<uint8_t*>(::operator new(size));
+    new (base) SlabHeader { sizeClass };
+    PoolStats::instance()->BytesResident += size;
+    return new (base + kValueOffset) VehiclePropValue();
+}
+
+void destroySlabValue(VehiclePropValue* v) {
+    size_t size = getAllocationSize(getSizeClass(v));
+    uint8_t* base = getBase(v);
+    v->~VehiclePropValue();
+    ::operator delete(base);
+    PoolStats::instance()->BytesResident -= size;
+}
+
+// Points the vector of the given type to the payload storage of v.
+void attachPayload(VehiclePropValue* v, VehiclePropertyType type, size_t vecSize,
+                   size_t payloadBytes) {
+    uint8_t* payload = getBase(v) + kPayloadOffset;
+    memset(payload, 0, payloadBytes);
+    switch (type) {
+        case VehiclePropertyType::INT32:      // fall through
+        case VehiclePropertyType::INT32_VEC:  // fall through
+        case VehiclePropertyType::BOOLEAN:
+            v->value.int32Values.setToExternal(reinterpret_cast<int32_t*>(payload), vecSize);
+            break;
+        case VehiclePropertyType::FLOAT:      // fall through
+        case VehiclePropertyType::FLOAT_VEC:
+            v->value.floatValues.setToExternal(reinterpret_cast<float*>(payload), vecSize);
+            break;
+        case VehiclePropertyType::INT64:      // fall through
+        case VehiclePropertyType::INT64_VEC:
+            v->value.int64Values.setToExternal(reinterpret_cast<int64_t*>(payload), vecSize);
+            break;
+        case VehiclePropertyType::BYTES:
+            v->value.bytes.setToExternal(payload, vecSize);
+            break;
+        default:
+            break;
+    }
+}
+
+void detachPayload(VehiclePropValue* v) {
+    // A vector that was resized by its user owns its buffer, setToExternal() releases it.
+    v->value.int32Values.setToExternal(nullptr, 0);
+    v->value.floatValues.setToExternal(nullptr, 0);
+    v->value.int64Values.setToExternal(nullptr, 0);
+    v->value.bytes.setToExternal(nullptr, 0);
+    v->value.stringValue.clear();
+}
+
+// Free slab values that don't fit in thread caches, shared by all threads.
+class SlabDepot {
+public:
+    static SlabDepot* instance() {
+        // Never deleted, threads may flush their caches after static destructors have run.
+        static SlabDepot* depot = new SlabDepot();
+        return depot;
+    }
+
+    // Moves up to count values to out, returns the number of values moved.
+    size_t take(size_t sizeClass, VehiclePropValue** out, size_t count) {
+        std::lock_guard<std::mutex> g(mLock);
+        std::vector<VehiclePropValue*>& values = mValues[sizeClass];
+        count = std::min(count, values.size());
+        std::copy(values.end() - count, values.end(), out);
+        values.resize(values.size() - count);
+        return count;
+    }
+
+    // Takes ownership of the values, those that don't fit are destroyed.
+    void give(size_t sizeClass, VehiclePropValue* const* values, size_t count) {
+        size_t kept;
+        {
+            std::lock_guard<std::mutex> g(mLock);
+            std::vector<VehiclePropValue*>& depot = mValues[sizeClass];
+            kept = std::min(count, kDepotSize - depot.size());
+            depot.insert(depot.end(), values, values + kept);
+        }
+        for (size_t i = kept; i < count; i++) {
+            destroySlabValue(values[i]);
+        }
+    }
+
+private:
+    std::mutex mLock;
+    std::vector<VehiclePropValue*> mValues[kNumSizeClasses];
+};
+
+// Free slab values of one thread, obtain() and recycle() only lock when it is empty or full.
+class SlabThreadCache {
+public:
+    ~SlabThreadCache() {
+        for (size_t sizeClass = 0; sizeClass < kNumSizeClasses; sizeClass++) {
+            SlabDepot::instance()->give(sizeClass, mValues[sizeClass], mCount[sizeClass]);
+        }
+    }
+
+    VehiclePropValue* obtain(size_t sizeClass) {
+        size_t& count = mCount[sizeClass];
+        if (count > 0) {
+            INC_METRIC_IF_DEBUG(CacheHits)
+            return mValues[sizeClass][--count];
+        }
+        INC_METRIC_IF_DEBUG(CacheMisses)
+        count = SlabDepot::instance()->take(sizeClass, mValues[sizeClass], kThreadCacheSize / 2);
+        if (count > 0) {
+            return mValues[sizeClass][--count];
+        }
+        INC_METRIC_IF_DEBUG(Created)
+        return createSlabValue(sizeClass);
+    }
+
+    void recycle(size_t sizeClass, VehiclePropValue* v) {
+        size_t& count = mCount[sizeClass];
+        VehiclePropValue** values = mValues[sizeClass];
+        if (count == kThreadCacheSize) {
+            // Hand the least recently used half over, so other threads can use them.
+            constexpr size_t half = kThreadCacheSize / 2;
+            SlabDepot::instance()->give(sizeClass, values, half);
+            std::copy(values + half, values + count, values);
+            count -= half;
+        }
+        values[count++] = v;
+    }
+
+private:
+    VehiclePropValue* mValues[kNumSizeClasses][kThreadCacheSize];
+    size_t mCount[kNumSizeClasses] = {};
+};
+
+thread_local SlabThreadCache tSlabCache;
+
+}  // namespace
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
         VehiclePropertyType type, size_t vecSize) {
+    if (mMode == Mode::SLAB) {
+        size_t elementSize = getPayloadElementSize(type);
+        if (elementSize > 0 && vecSize <= kMaxSlabPayloadBytes / elementSize) {
+            return obtainFromSlab(type, vecSize, vecSize * elementSize);
+        }
+    }
     return isDisposable(type, vecSize)
            ? obtainDisposable(type, vecSize)
            : obtainRecylable(type, vecSize);
@@ -120,6 +327,20 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
     return obtain(type, 1);
 }
 
+VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainFromSlab(
+        VehiclePropertyType type, size_t vecSize, size_t payloadBytes) const {
+    INC_METRIC_IF_DEBUG(Obtained)
+    VehiclePropValue* v = tSlabCache.obtain(getSizeClass(payloadBytes));
+    attachPayload(v, type, vecSize, payloadBytes);
+    return RecyclableType { v, mSlabDeleter };
+}
+
+void VehiclePropValuePool::recycleSlabValue(VehiclePropValue* v) {
+    INC_METRIC_IF_DEBUG(Recycled)
+    detachPayload(v);
+    tSlabCache.recycle(getSizeClass(v), v);
+}
+
 
 void VehiclePropValuePool::InternalPool::recycle(VehiclePropValue* o) {
     if (o == nullptr) {
@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VehiclePropValueRecorder"
+
+#include "VehiclePropValueRecorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <log/log.h>
+
+#include "VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr char kLogMagic[8] = {'V', 'H', 'A', 'L', 'R', 'E', 'C', '\0'};
+constexpr size_t kMaxVarintBytes = 10;
+// Frames larger than this are treated as corruption rather than allocated.
+constexpr uint64_t kMaxFrameBytes = 64 * 1024 * 1024;
+constexpr size_t kReadBufferBytes = 64 * 1024;
+// The writer thread writes out whatever is pending at least this often.
+constexpr std::chrono::seconds kFlushInterval(1);
+
+// Layout byte of an encoded value.
+constexpr uint8_t kInt32Present = 1 << 0;
+constexpr uint8_t kInt64Present = 1 << 1;
+constexpr uint8_t kFloatPresent = 1 << 2;
+constexpr uint8_t kBytesPresent = 1 << 3;
+constexpr uint8_t kStringPresent = 1 << 4;
+// The value is exactly one element of the type of the property, stored without a count.
+constexpr uint8_t kScalarValue = 1 << 7;
+
+void writeVarint(std::vector<uint8_t>* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+void writeSignedVarint(std::vector<uint8_t>* out, int64_t value) {
+    writeVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void writeRaw(std::vector<uint8_t>* out, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + size);
+}
+
+bool readVarint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readSignedVarint(const uint8_t** p, const uint8_t* end, int64_t* value) {
+    uint64_t raw;
+    if (!readVarint(p, end, &raw)) {
+        return false;
+    }
+    *value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+    return true;
+}
+
+bool readRaw(const uint8_t** p, const uint8_t* end, void* data, size_t size) {
+    if (static_cast<size_t>(end - *p) < size) {
+        return false;
+    }
+    if (size > 0) {
+        memcpy(data, *p, size);
+    }
+    *p += size;
+    return true;
+}
+
+bool isScalar(const VehiclePropValue& value) {
+    const auto& v = value.value;
+    if (v.bytes.size() != 0 || v.stringValue.size() != 0) {
+        return false;
+    }
+    size_t int32Count = v.int32Values.size();
+    size_t int64Count = v.int64Values.size();
+    size_t floatCount = v.floatValues.size();
+    switch (getPropType(value.prop)) {
+        case VehiclePropertyType::BOOLEAN:
+        case VehiclePropertyType::INT32:
+            return int32Count == 1 && int64Count == 0 && floatCount == 0;
+        case VehiclePropertyType::INT64:
+            return int32Count == 0 && int64Count == 1 && floatCount == 0;
+        case VehiclePropertyType::FLOAT:
+            return int32Count == 0 && int64Count == 0 && floatCount == 1;
+        default:
+            return false;
+    }
+}
+
+template <typename T>
+void writeIntVector(std::vector<uint8_t>* out, const hidl_vec<T>& values) {
+    writeVarint(out, values.size());
+    for (T value : values) {
+        writeSignedVarint(out, value);
+    }
+}
+
+template <typename T>
+bool readIntVector(const uint8_t** p, const uint8_t* end, hidl_vec<T>* values) {
+    uint64_t count;
+    // Every element takes at least one byte.
+    if (!readVarint(p, end, &count) || count > static_cast<uint64_t>(end - *p)) {
+        return false;
+    }
+    values->resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t value;
+        if (!readSignedVarint(p, end, &value)) {
+            return false;
+        }
+        (*values)[i] = static_cast<T>(value);
+    }
+    return true;
+}
+
+template <typename T>
+bool readRawVector(const uint8_t** p, const uint8_t* end, hidl_vec<T>* values) {
+    uint64_t count;
+    if (!readVarint(p, end, &count) || count > static_cast<uint64_t>(end - *p) / sizeof(T)) {
+        return false;
+    }
+    values->resize(count);
+    return readRaw(p, end, values->data(), count * sizeof(T));
+}
+
+void encodeValue(const VehiclePropValue& value, int64_t* lastTimestamp,
+                 std::vector<uint8_t>* out) {
+    writeSignedVarint(out, value.timestamp - *lastTimestamp);
+    *lastTimestamp = value.timestamp;
+    writeVarint(out, static_cast<uint32_t>(value.prop));
+    writeVarint(out, static_cast<uint32_t>(value.areaId));
+    writeVarint(out, static_cast<uint32_t>(value.status));
+
+    const auto& v = value.value;
+    if (isScalar(value)) {
+        out->push_back(kScalarValue);
+        if (v.int32Values.size() == 1) {
+            writeSignedVarint(out, v.int32Values[0]);
+        } else if (v.int64Values.size() == 1) {
+            writeSignedVarint(out, v.int64Values[0]);
+        } else {
+            writeRaw(out, &v.floatValues[0], sizeof(float));
+        }
+        return;
+    }
+
+    uint8_t layout = (v.int32Values.size() ? kInt32Present : 0) |
+                     (v.int64Values.size() ? kInt64Present : 0) |
+                     (v.floatValues.size() ? kFloatPresent : 0) |
+                     (v.bytes.size() ? kBytesPresent : 0) |
+                     (v.stringValue.size() ? kStringPresent : 0);
+    out->push_back(layout);
+    if (layout & kInt32Present) {
+        writeIntVector(out, v.int32Values);
+    }
+    if (layout & kInt64Present) {
+        writeIntVector(out, v.int64Values);
+    }
+    if (layout & kFloatPresent) {
+        writeVarint(out, v.floatValues.size());
+        writeRaw(out, v.floatValues.data(), v.floatValues.size() * sizeof(float));
+    }
+    if (layout & kBytesPresent) {
+        writeVarint(out, v.bytes.size());
+        writeRaw(out, v.bytes.data(), v.bytes.size());
+    }
+    if (layout & kStringPresent) {
+        writeVarint(out, v.stringValue.size());
+        writeRaw(out, v.stringValue.c_str(), v.stringValue.size());
+    }
+}
+
+bool decodeValue(const uint8_t** p, const uint8_t* end, int64_t* lastTimestamp,
+                 VehiclePropValue* value) {
+    int64_t delta;
+    uint64_t prop, areaId, status;
+    if (!readSignedVarint(p, end, &delta) || !readVarint(p, end, &prop) ||
+        !readVarint(p, end, &areaId) || !readVarint(p, end, &status) || *p == end) {
+        return false;
+    }
+    *lastTimestamp += delta;
+    *value = {};
+    value->timestamp = *lastTimestamp;
+    value->prop = static_cast<int32_t>(prop);
+    value->areaId = static_cast<int32_t>(areaId);
+    value->status = static_cast<VehiclePropertyStatus>(status);
+
+    auto& v = value->value;
+    uint8_t layout = *(*p)++;
+    if (layout == kScalarValue) {
+        int64_t scalar;
+        switch (getPropType(value->prop)) {
+            case VehiclePropertyType::BOOLEAN:
+            case VehiclePropertyType::INT32:
+                if (!readSignedVarint(p, end, &scalar)) {
+                    return false;
+                }
+                v.int32Values.resize(1);
+                v.int32Values[0] = static_cast<int32_t>(scalar);
+                return true;
+            case VehiclePropertyType::INT64:
+                v.int64Values.resize(1);
+                return readSignedVarint(p, end, &v.int64Values[0]);
+            case VehiclePropertyType::FLOAT:
+                v.floatValues.resize(1);
+                return readRaw(p, end, &v.floatValues[0], sizeof(float));
+            default:
+                return false;
+        }
+    }
+    if ((layout & kInt32Present) && !readIntVector(p, end, &v.int32Values)) {
+        return false;
+    }
+    if ((layout & kInt64Present) && !readIntVector(p, end, &v.int64Values)) {
+        return false;
+    }
+    if ((layout & kFloatPresent) && !readRawVector(p, end, &v.floatValues)) {
+        return false;
+    }
+    if ((layout & kBytesPresent) && !readRawVector(p, end, &v.bytes)) {
+        return false;
+    }
+    if (layout & kStringPresent) {
+        uint64_t length;
+        if (!readVarint(p, end, &length) || length > static_cast<uint64_t>(end - *p)) {
+            return false;
+        }
+        v.stringValue = std::string(reinterpret_cast<const char*>(*p), length);
+        *p += length;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, data, size));
+        if (written < 0) {
+            ALOGE("%s: write failed, errno: %d", __func__, errno);
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+}  // namespace
+
+VehiclePropValueRecorder::~VehiclePropValueRecorder() {
+    stop();
+}
+
+bool VehiclePropValueRecorder::start(const std::string& path) {
+    std::lock_guard<std::mutex> c(mControlLock);
+    stopLocked();
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd < 0) {
+        ALOGE("%s: couldn't open %s, errno: %d", __func__, path.c_str(), errno);
+        return false;
+    }
+    if (!writeFully(fd, reinterpret_cast<const uint8_t*>(kLogMagic), sizeof(kLogMagic))) {
+        close(fd);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> g(mLock);
+        mFd = fd;
+        mStopping = false;
+        mLastTimestamp = 0;
+        mPending.clear();
+        mStats = {};
+        mStats.bytesWritten = sizeof(kLogMagic);
+    }
+    mWriterThread = std::thread(&VehiclePropValueRecorder::writerThread, this);
+    mRecording = true;
+    ALOGI("%s: recording property values to %s", __func__, path.c_str());
+    return true;
+}
+
+void VehiclePropValueRecorder::stop() {
+    std::lock_guard<std::mutex> c(mControlLock);
+    stopLocked();
+}
+
+void VehiclePropValueRecorder::stopLocked() {
+    if (!mWriterThread.joinable()) {
+        return;
+    }
+    mRecording = false;
+    {
+        std::lock_guard<std::mutex> g(mLock);
+        mStopping = true;
+    }
+    mCond.notify_one();
+    mWriterThread.join();
+
+    std::lock_guard<std::mutex> g(mLock);
+    close(mFd);
+    mFd = -1;
+    ALOGI("Stopped recording: %" PRIu64 " values in %" PRIu64 " bytes, dropped %" PRIu64
+          " batches", mStats.values, mStats.bytesWritten, mStats.droppedBatches);
+}
+
+void VehiclePropValueRecorder::record(const std::vector<VehiclePropValuePtr>& values) {
+    if (!isRecording() || values.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> g(mLock);
+    if (mFd < 0 || mStopping) {
+        return;
+    }
+    int64_t lastTimestamp = mLastTimestamp;
+    mFrame.clear();
+    writeVarint(&mFrame, values.size());
+    for (const auto& value : values) {
+        encodeValue(*value, &lastTimestamp, &mFrame);
+    }
+    if (mPending.size() + mFrame.size() + kMaxVarintBytes > kMaxPendingBytes) {
+        // Timestamps stay relative to the last value that made it into the log.
+        mStats.droppedBatches++;
+        return;
+    }
+    mLastTimestamp = lastTimestamp;
+    writeVarint(&mPending, mFrame.size());
+    mPending.insert(mPending.end(), mFrame.begin(), mFrame.end());
+    mStats.batches++;
+    mStats.values += values.size();
+    if (mPending.size() >= kFlushThresholdBytes) {
+        mCond.notify_one();
+    }
+}
+
+VehiclePropValueRecorder::Stats VehiclePropValueRecorder::getStats() const {
+    std::lock_guard<std::mutex> g(mLock);
+    return mStats;
+}
+
+void VehiclePropValueRecorder::writerThread() {
+    std::vector<uint8_t> buffer;
+    std::unique_lock<std::mutex> g(mLock);
+    while (true) {
+        mCond.wait_for(g, kFlushInterval,
+                       [this] { return mStopping || mPending.size() >= kFlushThresholdBytes; });
+        bool stopping = mStopping;
+        // Hand the filled buffer over and give record() the one written out last time.
+        buffer.swap(mPending);
+        int fd = mFd;
+        g.unlock();
+        bool written = buffer.empty() || writeFully(fd, buffer.data(), buffer.size());
+        g.lock();
+        if (written) {
+            mStats.bytesWritten += buffer.size();
+        }
+        buffer.clear();
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+VehiclePropValueLogReader::~VehiclePropValueLogReader() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool VehiclePropValueLogReader::open(const std::string& path) {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+    mFd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (mFd < 0) {
+        ALOGE("%s: couldn't open %s, errno: %d", __func__, path.c_str(), errno);
+        return false;
+    }
+    if (!rewind()) {
+        ALOGE("%s: %s is not a property value log", __func__, path.c_str());
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool VehiclePropValueLogReader::rewind() {
+    if (mFd < 0 || lseek(mFd, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    mBegin = mEnd = 0;
+    mFramePos = mFrameEnd = 0;
+    mValuesLeftInFrame = 0;
+    mLastTimestamp = 0;
+    if (!fill(sizeof(kLogMagic)) || memcmp(&mBuffer[mBegin], kLogMagic, sizeof(kLogMagic)) != 0) {
+        return false;
+    }
+    mBegin += sizeof(kLogMagic);
+    return true;
+}
+
+bool VehiclePropValueLogReader::next(VehiclePropValue* value) {
+    while (mValuesLeftInFrame == 0) {
+        if (!readFrame()) {
+            return false;
+        }
+    }
+    const uint8_t* p = mBuffer.data() + mFramePos;
+    const uint8_t* end = mBuffer.data() + mFrameEnd;
+    if (!decodeValue(&p, end, &mLastTimestamp, value)) {
+        ALOGE("%s: corrupted value, stopping", __func__);
+        mValuesLeftInFrame = 0;
+        mBegin = mEnd;
+        return false;
+    }
+    mFramePos = p - mBuffer.data();
+    mValuesLeftInFrame--;
+    return true;
+}
+
+bool VehiclePropValueLogReader::readFrame() {
+    // The varint may be shorter than kMaxVarintBytes at the end of the log.
+    fill(kMaxVarintBytes);
+    const uint8_t* p = mBuffer.data() + mBegin;
+    const uint8_t* end = mBuffer.data() + mEnd;
+    uint64_t frameSize;
+    if (!readVarint(&p, end, &frameSize) || frameSize > kMaxFrameBytes) {
+        return false;
+    }
+    mBegin = p - mBuffer.data();
+    if (!fill(frameSize)) {
+        return false;
+    }
+    // Values are decoded in place, the next fill() only happens once the frame is consumed.
+    mFramePos = mBegin;
+    mFrameEnd = mBegin + frameSize;
+    mBegin = mFrameEnd;
+
+    p = mBuffer.data() + mFramePos;
+    if (!readVarint(&p, mBuffer.data() + mFrameEnd, &mValuesLeftInFrame)) {
+        return false;
+    }
+    mFramePos = p - mBuffer.data();
+    return true;
+}
+
+bool VehiclePropValueLogReader::fill(size_t numBytes) {
+    if (mEnd - mBegin >= numBytes) {
+        return true;
+    }
+    if (mBegin > 0) {
+        memmove(mBuffer.data(), mBuffer.data() + mBegin, mEnd - mBegin);
+        mEnd -= mBegin;
+        mBegin = 0;
+    }
+    if (mBuffer.size() < std::max(numBytes, kReadBufferBytes)) {
+        mBuffer.resize(std::max(numBytes, kReadBufferBytes));
+    }
+    while (mEnd < numBytes) {
+        ssize_t numRead = TEMP_FAILURE_RETRY(read(mFd, mBuffer.data() + mEnd,
+                                                  mBuffer.size() - mEnd));
+        if (numRead <= 0) {
+            return false;
+        }
+        mEnd += numRead;
+    }
+    return true;
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -16,6 +16,9 @@
 #define LOG_TAG "VehiclePropertyStore"
 #include <log/log.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include <common/include/vhal_v2_0/VehicleUtils.h>
 #include "VehiclePropertyStore.h"
 
@@ -35,14 +38,322 @@ bool VehiclePropertyStore::RecordId::operator<(const VehiclePropertyStore::Recor
            || (prop == other.prop && area == other.area && token < other.token);
 }
 
+/**
+ * Storage for StorageMode::INDEXED.
+ *
+ * Every registered property owns a Record with its config and a snapshot of its values sorted by
+ * (area, token). Snapshots are immutable: readers take a reference to the current one and writers
+ * copy it and publish a new one under a per-record lock. Taking and publishing a reference are
+ * short critical sections of the shared_ptr atomic functions, in libc++ a mutex picked from a
+ * global pool by address, so readers never wait for a copy but aren't lock-free either. Values
+ * themselves are shared between consecutive snapshots, so a write only copies the value that
+ * changes.
+ *
+ * Records are found through an open-addressing hash table of atomic Record pointers. Records are
+ * only ever added, so lookups need no lock. When the table grows a new one is published and the
+ * old one is kept alive for readers that may still be probing it; capacities double, so retired
+ * tables never take more memory than the current one.
+ */
+class VehiclePropertyStore::PropertyIndex {
+public:
+    PropertyIndex();
+
+    void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc);
+    bool writeValue(const VehiclePropValue& propValue, bool updateStatus);
+    void removeValue(const VehiclePropValue& propValue);
+    void removeValuesForProperty(int32_t propId);
+
+    std::vector<VehiclePropValue> readAllValues() const;
+    std::vector<VehiclePropValue> readValuesForProperty(int32_t propId) const;
+    std::unique_ptr<VehiclePropValue> readValueOrNull(const VehiclePropValue& request) const;
+    std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area,
+                                                      int64_t token) const;
+    // Returns the stored value itself, which is immutable once published.
+    std::shared_ptr<const VehiclePropValue> getValueOrNull(const VehiclePropValue& request) const;
+
+    std::vector<VehiclePropConfig> getAllConfigs() const;
+    const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
+
+private:
+    struct Entry {
+        int32_t area;
+        int64_t token;
+        std::shared_ptr<const VehiclePropValue> value;
+    };
+    using Entries = std::vector<Entry>;
+
+    struct Record {
+        RecordConfig config;
+        std::mutex writeLock;
+        // Only accessed through std::atomic_load / std::atomic_store, which lock internally.
+        std::shared_ptr<const Entries> entries;
+    };
+
+    struct Table {
+        explicit Table(size_t capacity)
+            : mask(capacity - 1), slots(new std::atomic<Record*>[capacity]()) {}
+
+        size_t capacity() const { return mask + 1; }
+
+        const size_t mask;
+        std::unique_ptr<std::atomic<Record*>[]> slots;
+    };
+
+    static constexpr size_t kInitialTableCapacity = 64;  // Must be a power of two.
+
+    Record* findRecord(int32_t propId) const;
+    void insertLocked(Table* table, Record* record);
+    static size_t hashOf(int32_t propId);
+    static Entries::const_iterator findEntry(const Entries& entries, int32_t area, int64_t token);
+    static void appendValues(const Record& record, std::vector<VehiclePropValue>* out);
+    static void publish(Record* record, Entries&& entries);
+
+    mutable std::mutex mRegistrationLock;
+    // All records sorted by property id, owned by the index. Guarded by mRegistrationLock.
+    std::vector<std::unique_ptr<Record>> mRecords;
+    // The last element is the table in use. Guarded by mRegistrationLock.
+    std::vector<std::unique_ptr<Table>> mTables;
+    std::atomic<Table*> mTable;
+};
+
+VehiclePropertyStore::PropertyIndex::PropertyIndex() {
+    mTables.push_back(std::make_unique<Table>(kInitialTableCapacity));
+    mTable.store(mTables.back().get(), std::memory_order_release);
+}
+
+void VehiclePropertyStore::PropertyIndex::registerProperty(const VehiclePropConfig& config,
+                                                           TokenFunction tokenFunc) {
+    std::lock_guard<std::mutex> g(mRegistrationLock);
+    if (findRecord(config.prop) != nullptr) return;
+
+    auto record = std::make_unique<Record>();
+    record->config = RecordConfig { config, tokenFunc };
+    record->entries = std::make_shared<const Entries>();
+    Record* newRecord = record.get();
+
+    auto pos = std::lower_bound(mRecords.begin(), mRecords.end(), config.prop,
+                                [](const std::unique_ptr<Record>& r, int32_t prop) {
+                                    return r->config.propConfig.prop < prop;
+                                });
+    mRecords.insert(pos, std::move(record));
+
+    Table* table = mTables.back().get();
+    // Keep load factor at or below 1/2 so probe sequences stay short and always hit an empty slot.
+    if (mRecords.size() * 2 > table->capacity()) {
+        mTables.push_back(std::make_unique<Table>(table->capacity() * 2));
+        table = mTables.back().get();
+        for (const auto& r : mRecords) {
+            insertLocked(table, r.get());
+        }
+        mTable.store(table, std::memory_order_release);
+    } else {
+        insertLocked(table, newRecord);
+    }
+}
+
+bool VehiclePropertyStore::PropertyIndex::writeValue(const VehiclePropValue& propValue,
+                                                     bool updateStatus) {
+    Record* record = findRecord(propValue.prop);
+    if (record == nullptr) return false;
+
+    int32_t area = isGlobalProp(propValue.prop) ? 0 : propValue.areaId;
+    int64_t token = record->config.tokenFunction != nullptr
+            ? record->config.tokenFunction(propValue) : 0;
+
+    std::lock_guard<std::mutex> g(record->writeLock);
+    std::shared_ptr<const Entries> current = std::atomic_load(&record->entries);
+    auto it = findEntry(*current, area, token);
+    bool found = it != current->end() && it->area == area && it->token == token;
+
+    // propValue is outdated and drops it.
+    if (found && it->value->timestamp > propValue.timestamp) {
+        return false;
+    }
+
+    Entries next(*current);
+    auto nextIt = next.begin() + (it - current->begin());
+    if (!found) {
+        next.insert(nextIt, Entry { area, token, std::make_shared<VehiclePropValue>(propValue) });
+    } else {
+        // Same rules as the map-backed store: only timestamp, value and optionally status change.
+        auto updated = std::make_shared<VehiclePropValue>(*it->value);
+        updated->timestamp = propValue.timestamp;
+        updated->value = propValue.value;
+        if (updateStatus) {
+            updated->status = propValue.status;
+        }
+        nextIt->value = std::move(updated);
+    }
+    publish(record, std::move(next));
+    return true;
+}
+
+void VehiclePropertyStore::PropertyIndex::removeValue(const VehiclePropValue& propValue) {
+    Record* record = findRecord(propValue.prop);
+    if (record == nullptr) return;
+
+    int32_t area = isGlobalProp(propValue.prop) ? 0 : propValue.areaId;
+    int64_t token = record->config.tokenFunction != nullptr
+            ? record->config.tokenFunction(propValue) : 0;
+
+    std::lock_guard<std::mutex> g(record->writeLock);
+    std::shared_ptr<const Entries> current = std::atomic_load(&record->entries);
+    auto it = findEntry(*current, area, token);
+    if (it == current->end() || it->area != area || it->token != token) return;
+
+    Entries next(*current);
+    next.erase(next.begin() + (it - current->begin()));
+    publish(record, std::move(next));
+}
+
+void VehiclePropertyStore::PropertyIndex::removeValuesForProperty(int32_t propId) {
+    Record* record = findRecord(propId);
+    if (record == nullptr) return;
+
+    std::lock_guard<std::mutex> g(record->writeLock);
+    publish(record, Entries());
+}
+
+std::vector<VehiclePropValue> VehiclePropertyStore::PropertyIndex::readAllValues() const {
+    std::vector<VehiclePropValue> allValues;
+    std::lock_guard<std::mutex> g(mRegistrationLock);
+    allValues.reserve(mRecords.size());
+    for (const auto& record : mRecords) {
+        appendValues(*record, &allValues);
+    }
+    return allValues;
+}
+
+std::vector<VehiclePropValue> VehiclePropertyStore::PropertyIndex::readValuesForProperty(
+        int32_t propId) const {
+    std::vector<VehiclePropValue> values;
+    const Record* record = findRecord(propId);
+    if (record != nullptr) {
+        appendValues(*record, &values);
+    }
+    return values;
+}
+
+std::unique_ptr<VehiclePropValue> VehiclePropertyStore::PropertyIndex::readValueOrNull(
+        const VehiclePropValue& request) const {
+    auto value = getValueOrNull(request);
+    return value != nullptr ? std::make_unique<VehiclePropValue>(*value) : nullptr;
+}
+
+std::shared_ptr<const VehiclePropValue> VehiclePropertyStore::PropertyIndex::getValueOrNull(
+        const VehiclePropValue& request) const {
+    const Record* record = findRecord(request.prop);
+    if (record == nullptr) return nullptr;
+
+    int64_t token = record->config.tokenFunction != nullptr
+            ? record->config.tokenFunction(request) : 0;
+    int32_t area = isGlobalProp(request.prop) ? 0 : request.areaId;
+    std::shared_ptr<const Entries> entries = std::atomic_load(&record->entries);
+    auto it = findEntry(*entries, area, token);
+    if (it == entries->end() || it->area != area || it->token != token) return nullptr;
+    return it->value;
+}
+
+std::unique_ptr<VehiclePropValue> VehiclePropertyStore::PropertyIndex::readValueOrNull(
+        int32_t prop, int32_t area, int64_t token) const {
+    const Record* record = findRecord(prop);
+    if (record == nullptr) return nullptr;
+
+    if (isGlobalProp(prop)) area = 0;
+    std::shared_ptr<const Entries> entries = std::atomic_load(&record->entries);
+    auto it = findEntry(*entries, area, token);
+    if (it == entries->end() || it->area != area || it->token != token) return nullptr;
+    return std::make_unique<VehiclePropValue>(*it->value);
+}
+
+std::vector<VehiclePropConfig> VehiclePropertyStore::PropertyIndex::getAllConfigs() const {
+    std::vector<VehiclePropConfig> configs;
+    std::lock_guard<std::mutex> g(mRegistrationLock);
+    configs.reserve(mRecords.size());
+    for (const auto& record : mRecords) {
+        configs.push_back(record->config.propConfig);
+    }
+    return configs;
+}
+
+const VehiclePropConfig* VehiclePropertyStore::PropertyIndex::getConfigOrNull(
+        int32_t propId) const {
+    const Record* record = findRecord(propId);
+    return record != nullptr ? &record->config.propConfig : nullptr;
+}
+
+VehiclePropertyStore::PropertyIndex::Record* VehiclePropertyStore::PropertyIndex::findRecord(
+        int32_t propId) const {
+    const Table* table = mTable.load(std::memory_order_acquire);
+    for (size_t i = hashOf(propId) & table->mask;; i = (i + 1) & table->mask) {
+        Record* record = table->slots[i].load(std::memory_order_acquire);
+        if (record == nullptr || record->config.propConfig.prop == propId) {
+            return record;
+        }
+    }
+}
+
+void VehiclePropertyStore::PropertyIndex::insertLocked(Table* table, Record* record) {
+    size_t i = hashOf(record->config.propConfig.prop) & table->mask;
+    while (table->slots[i].load(std::memory_order_relaxed) != nullptr) {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].store(record, std::memory_order_release);
+}
+
+size_t VehiclePropertyStore::PropertyIndex::hashOf(int32_t propId) {
+    // Property ids differ mostly in their low bits, spread them with a multiplicative hash.
+    uint32_t h = static_cast<uint32_t>(propId) * 0x9e3779b1u;
+    return h ^ (h >> 16);
+}
+
+VehiclePropertyStore::PropertyIndex::Entries::const_iterator
+VehiclePropertyStore::PropertyIndex::findEntry(const Entries& entries, int32_t area,
+                                               int64_t token) {
+    return std::lower_bound(entries.begin(), entries.end(), std::make_pair(area, token),
+                            [](const Entry& e, const std::pair<int32_t, int64_t>& key) {
+                                return e.area < key.first
+                                       || (e.area == key.first && e.token < key.second);
+                            });
+}
+
+void VehiclePropertyStore::PropertyIndex::appendValues(const Record& record,
+                                                       std::vector<VehiclePropValue>* out) {
+    std::shared_ptr<const Entries> entries = std::atomic_load(&record.entries);
+    for (const Entry& entry : *entries) {
+        out->push_back(*entry.value);
+    }
+}
+
+void VehiclePropertyStore::PropertyIndex::publish(Record* record, Entries&& entries) {
+    std::atomic_store(&record->entries,
+                      std::shared_ptr<const Entries>(
+                              std::make_shared<const Entries>(std::move(entries))));
+}
+
+VehiclePropertyStore::VehiclePropertyStore(StorageMode mode) {
+    if (mode == StorageMode::INDEXED) {
+        mIndex = std::make_unique<PropertyIndex>();
+    }
+}
+
+VehiclePropertyStore::~VehiclePropertyStore() = default;
+
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
+    if (mIndex) {
+        mIndex->registerProperty(config, tokenFunc);
+        return;
+    }
+
     MuxGuard g(mLock);
     mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc } });
 }
 
 bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
                                         bool updateStatus) {
+    if (mIndex) return mIndex->writeValue(propValue, updateStatus);
+
     MuxGuard g(mLock);
     if (!mConfigs.count(propValue.prop)) return false;
 
@@ -69,6 +380,11 @@ bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
+    if (mIndex) {
+        mIndex->removeValue(propValue);
+        return;
+    }
+
     MuxGuard g(mLock);
     RecordId recId = getRecordIdLocked(propValue);
     auto it = mPropertyValues.find(recId);
@@ -78,12 +394,19 @@ void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
+    if (mIndex) {
+        mIndex->removeValuesForProperty(propId);
+        return;
+    }
+
     MuxGuard g(mLock);
     auto range = findRangeLocked(propId);
     mPropertyValues.erase(range.first, range.second);
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
+    if (mIndex) return mIndex->readAllValues();
+
     MuxGuard g(mLock);
     std::vector<VehiclePropValue> allValues;
     allValues.reserve(mPropertyValues.size());
@@ -94,6 +417,8 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_t propId) const {
+    if (mIndex) return mIndex->readValuesForProperty(propId);
+
     std::vector<VehiclePropValue> values;
     MuxGuard g(mLock);
     auto range = findRangeLocked(propId);
@@ -106,6 +431,8 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         const VehiclePropValue& request) const {
+    if (mIndex) return mIndex->readValueOrNull(request);
+
     MuxGuard g(mLock);
     RecordId recId = getRecordIdLocked(request);
     const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
@@ -114,14 +441,38 @@ std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         int32_t prop, int32_t area, int64_t token) const {
+    if (mIndex) return mIndex->readValueOrNull(prop, area, token);
+
     RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
     MuxGuard g(mLock);
     const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
     return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
 }
 
+std::vector<recyclable_ptr<VehiclePropValue>> VehiclePropertyStore::readValuesOrNull(
+        const std::vector<const VehiclePropValue*>& requests, VehiclePropValuePool* pool) const {
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    values.reserve(requests.size());
+    if (mIndex) {
+        for (const auto* request : requests) {
+            auto value = mIndex->getValueOrNull(*request);
+            values.push_back(value != nullptr ? pool->obtain(*value) : nullptr);
+        }
+        return values;
+    }
+
+    MuxGuard g(mLock);
+    for (const auto* request : requests) {
+        const VehiclePropValue* internalValue = getValueOrNullLocked(getRecordIdLocked(*request));
+        values.push_back(internalValue ? pool->obtain(*internalValue) : nullptr);
+    }
+    return values;
+}
+
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
+    if (mIndex) return mIndex->getAllConfigs();
+
     MuxGuard g(mLock);
     std::vector<VehiclePropConfig> configs;
     configs.reserve(mConfigs.size());
@@ -132,6 +483,8 @@ std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrNull(int32_t propId) const {
+    if (mIndex) return mIndex->getConfigOrNull(propId);
+
     MuxGuard g(mLock);
     auto recordConfigIt = mConfigs.find(propId);
     return recordConfigIt != mConfigs.end() ? &recordConfigIt->second.propConfig : nullptr;
@@ -78,12 +78,23 @@ size_t getVehicleRawValueVectorSize(
     }
 }
 
+// Unlike assignment, reuses the buffer of dest if it has the right size already, so pooled
+// values don't allocate.
+template<typename T>
+inline void copyHidlVecInPlace(hidl_vec<T>* dest, const hidl_vec<T>& src) {
+    if (dest->size() == src.size()) {
+        std::copy(src.begin(), src.end(), dest->begin());
+    } else {
+        *dest = src;
+    }
+}
+
 void copyVehicleRawValue(VehiclePropValue::RawValue* dest,
                          const VehiclePropValue::RawValue& src) {
-    dest->int32Values = src.int32Values;
-    dest->floatValues = src.floatValues;
-    dest->int64Values = src.int64Values;
-    dest->bytes = src.bytes;
+    copyHidlVecInPlace(&dest->int32Values, src.int32Values);
+    copyHidlVecInPlace(&dest->floatValues, src.floatValues);
+    copyHidlVecInPlace(&dest->int64Values, src.int64Values);
+    copyHidlVecInPlace(&dest->bytes, src.bytes);
     dest->stringValue = src.stringValue;
 }
 
@@ -19,6 +19,7 @@
 #include <thread>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <google/protobuf/arena.h>
 #include <log/log.h>
 
 #include "CommConn.h"
@@ -36,38 +37,52 @@ void CommConn::start() {
 }
 
 void CommConn::stop() {
-    if (mReadThread->joinable()) {
+    if (mReadThread && mReadThread->joinable()) {
         mReadThread->join();
     }
 }
 
 void CommConn::sendMessage(vhal_proto::EmulatorMessage const& msg) {
+    // Responses are sent from the read thread and property updates from HAL threads, the lock
+    // keeps their frames from interleaving.
+    std::lock_guard<std::mutex> g(mTxLock);
     int numBytes = msg.ByteSize();
-    std::vector<uint8_t> buffer(static_cast<size_t>(numBytes));
-    if (!msg.SerializeToArray(buffer.data(), numBytes)) {
+    mTxBuffer.resize(static_cast<size_t>(numBytes));
+    if (!msg.SerializeToArray(mTxBuffer.data(), numBytes)) {
         ALOGE("%s: SerializeToString failed!", __func__);
         return;
     }
 
-    write(buffer);
+    write(mTxBuffer);
 }
 
 void CommConn::readThread() {
-    std::vector<uint8_t> buffer;
+    // Messages are parsed into an arena that is reset after each of them, so parsing doesn't
+    // allocate as long as a message and its response fit into the initial block.
+    static constexpr size_t kArenaBlockSize = 64 * 1024;
+    std::vector<char> arenaBlock(kArenaBlockSize);
+    google::protobuf::ArenaOptions arenaOptions;
+    arenaOptions.initial_block = arenaBlock.data();
+    arenaOptions.initial_block_size = arenaBlock.size();
+    google::protobuf::Arena arena(arenaOptions);
+
+    const uint8_t* data;
+    size_t size;
     while (isOpen()) {
-        buffer = read();
-        if (buffer.size() == 0) {
+        if (!read(&data, &size)) {
             ALOGI("%s: Read returned empty message, exiting read loop.", __func__);
             break;
         }
 
-        vhal_proto::EmulatorMessage rxMsg;
-        if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
-            vhal_proto::EmulatorMessage respMsg;
-            mMessageProcessor->processMessage(rxMsg, respMsg);
+        auto rxMsg = google::protobuf::Arena::CreateMessage<vhal_proto::EmulatorMessage>(&arena);
+        if (rxMsg->ParseFromArray(data, static_cast<int32_t>(size))) {
+            auto respMsg =
+                    google::protobuf::Arena::CreateMessage<vhal_proto::EmulatorMessage>(&arena);
+            mMessageProcessor->processMessage(*rxMsg, *respMsg);
 
-            sendMessage(respMsg);
+            sendMessage(*respMsg);
         }
+        arena.Reset();
     }
 }
 
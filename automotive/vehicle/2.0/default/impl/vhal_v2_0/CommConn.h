@@ -18,6 +18,7 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_CommBase_H_
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -74,12 +75,15 @@ class CommConn {
     virtual bool isOpen() = 0;
 
     /**
-     * Blocking call to read data from the connection.
+     * Blocking call to read the next message from the connection.
      *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * @param data Set to the serialized protobuf data received from emulator. It points into a
+     *              receive buffer owned by the connection and stays valid until the next read().
+     * @param size Set to the size of the data.
+     *
+     * @return bool False if the connection was closed or some other error occurred.
      */
-    virtual std::vector<uint8_t> read() = 0;
+    virtual bool read(const uint8_t** data, size_t* size) = 0;
 
     /**
      * Transmits a string of data to the emulator.
@@ -91,7 +95,7 @@ class CommConn {
     virtual int write(const std::vector<uint8_t>& data) = 0;
 
     /**
-     * Serialized and send the given message to the other side.
+     * Serialized and send the given message to the other side. Safe to call from any thread.
      */
     void sendMessage(vhal_proto::EmulatorMessage const& msg);
 
@@ -99,6 +103,9 @@ class CommConn {
     std::unique_ptr<std::thread> mReadThread;
     MessageProcessor* mMessageProcessor;
 
+    std::mutex mTxLock;
+    std::vector<uint8_t> mTxBuffer;  // Reused by sendMessage(), guarded by mTxLock.
+
     /**
      * A thread that reads messages in a loop, and responds. You can stop this thread by calling
      * stop().
@@ -153,7 +153,11 @@ enum class FakeDataCommand : int32_t {
      * Caller must provide additional data:
      *     int32Values[1] - number of iterations. If it is not provided or -1. The iteration will be
      *                      repeated infinite times.
-     *     stringValue    - path to the fake values JSON file
+     *     int64Values[0] - optional, timestamp in the file to start from. Earlier events are
+     *                      skipped in every iteration.
+     *     floatValues[0] - optional, playback speed multiplier, defaults to 1.0.
+     *     stringValue    - path to the fake values JSON file, or to a binary trace converted from
+     *                      one by JsonFakeValueGenerator::convertToBinaryTrace()
      */
     StartJson = 2,
 
@@ -165,6 +169,22 @@ enum class FakeDataCommand : int32_t {
      */
     StopJson = 3,
 
+    /**
+     * Starts replaying a property value log recorded with the --start-recording debug command.
+     * Values are injected with the same relative timing they were recorded with. Caller must
+     * provide additional data:
+     *     int32Values[1] - number of iterations. If it is not provided or -1. The iteration will be
+     *                      repeated infinite times.
+     *     stringValue    - path to the recorded log
+     */
+    StartReplay = 4,
+
+    /**
+     * Stops replaying a recorded log. Caller must provide the path of the log:
+     *     stringValue    - path to the recorded log
+     */
+    StopReplay = 5,
+
     /**
      * Injects key press event (HAL incorporates UP/DOWN acction and triggers 2 HAL events for every
      * key-press). We set the enum with high number to leave space for future start/stop commands.
@@ -17,6 +17,7 @@
 
 #include <android/log.h>
 #include <android-base/macros.h>
+#include <inttypes.h>
 
 #include "EmulatedVehicleHal.h"
 #include "JsonFakeValueGenerator.h"
@@ -156,7 +157,52 @@ VehicleHal::VehiclePropValuePtr EmulatedVehicleHal::get(
     return v;
 }
 
+void EmulatedVehicleHal::getBatch(const std::vector<const VehiclePropValue*>& requests,
+                                  std::vector<VehiclePropValuePtr>* outValues,
+                                  std::vector<StatusCode>* outStatuses) {
+    outValues->resize(requests.size());
+    outStatuses->resize(requests.size());
+
+    // Everything get() would read from the store is read with a single lookup, the rest is
+    // served one request at a time.
+    std::vector<const VehiclePropValue*> storeRequests;
+    std::vector<size_t> storeIndices;
+    storeRequests.reserve(requests.size());
+    storeIndices.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (isReadFromStore(requests[i]->prop)) {
+            storeRequests.push_back(requests[i]);
+            storeIndices.push_back(i);
+        } else {
+            (*outValues)[i] = get(*requests[i], &(*outStatuses)[i]);
+        }
+    }
+
+    auto storeValues = mPropStore->readValuesOrNull(storeRequests, getValuePool());
+    int64_t timestamp = elapsedRealtimeNano();
+    for (size_t i = 0; i < storeValues.size(); i++) {
+        auto& v = storeValues[i];
+        if (v != nullptr) {
+            v->timestamp = timestamp;
+        }
+        (*outStatuses)[storeIndices[i]] = v != nullptr ? StatusCode::OK : StatusCode::INVALID_ARG;
+        (*outValues)[storeIndices[i]] = std::move(v);
+    }
+}
+
 bool EmulatedVehicleHal::dump(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() == 0) {
+        auto stats = mRecurrentTimer.getStats();
+        int64_t avgDriftUs = stats.events > 0
+                ? std::chrono::duration_cast<std::chrono::microseconds>(stats.totalDrift).count()
+                          / static_cast<int64_t>(stats.events)
+                : 0;
+        dprintf(fd->data[0],
+                "Continuous property timer: wake-ups %" PRIu64 ", events %" PRIu64
+                ", missed %" PRIu64 ", drift avg %" PRId64 "us, max %" PRId64 "us\n",
+                stats.wakeUps, stats.events, stats.missedEvents, avgDriftUs,
+                std::chrono::duration_cast<std::chrono::microseconds>(stats.maxDrift).count());
+    }
     return mVehicleClient->dump(fd, options);
 }
 
@@ -330,6 +376,13 @@ StatusCode EmulatedVehicleHal::unsubscribe(int32_t property) {
     return StatusCode::OK;
 }
 
+bool EmulatedVehicleHal::isReadFromStore(int32_t propId) const {
+    if (propId == OBD2_FREEZE_FRAME || propId == OBD2_FREEZE_FRAME_INFO) {
+        return false;
+    }
+    return mEmulatedUserHal == nullptr || !mEmulatedUserHal->isSupported(propId);
+}
+
 bool EmulatedVehicleHal::isContinuousProperty(int32_t propId) const {
     const VehiclePropConfig* config = mPropStore->getConfigOrNull(propId);
     if (config == nullptr) {
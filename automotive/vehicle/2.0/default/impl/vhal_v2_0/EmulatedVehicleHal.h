@@ -55,6 +55,9 @@ public:
     std::vector<VehiclePropConfig> listProperties() override;
     VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
                             StatusCode* outStatus) override;
+    void getBatch(const std::vector<const VehiclePropValue*>& requests,
+                  std::vector<VehiclePropValuePtr>* outValues,
+                  std::vector<StatusCode>* outStatuses) override;
     StatusCode set(const VehiclePropValue& propValue) override;
     StatusCode subscribe(int32_t property, float sampleRate) override;
     StatusCode unsubscribe(int32_t property) override;
@@ -74,6 +77,7 @@ private:
 
     void onContinuousPropertyTimer(const std::vector<int32_t>& properties);
     bool isContinuousProperty(int32_t propId) const;
+    bool isReadFromStore(int32_t propId) const;
     void initStaticConfig();
     void initObd2LiveFrame(const VehiclePropConfig& propConfig);
     void initObd2FreezeFrame(const VehiclePropConfig& propConfig);
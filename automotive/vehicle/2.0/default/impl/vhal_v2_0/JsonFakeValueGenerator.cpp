@@ -16,6 +16,14 @@
 
 #define LOG_TAG "JsonFakeValueGenerator"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
 #include <fstream>
 #include <type_traits>
 #include <typeinfo>
@@ -33,19 +41,167 @@ namespace V2_0 {
 
 namespace impl {
 
-JsonFakeValueGenerator::JsonFakeValueGenerator(const VehiclePropValue& request) {
-    const auto& v = request.value;
-    const char* file = v.stringValue.c_str();
-    std::ifstream ifs(file);
-    if (!ifs) {
-        ALOGE("%s: couldn't open %s for parsing.", __func__, file);
+namespace {
+
+constexpr char kTraceMagic[8] = {'V', 'H', 'A', 'L', 'T', 'R', 'C', '\0'};
+constexpr uint32_t kTraceVersion = 1;
+// One index entry is written for every kTraceIndexStride records, so a seek decodes at most that
+// many records after the index lookup.
+constexpr uint32_t kTraceIndexStride = 256;
+// Consumed pages of the mapping are dropped once this many bytes have been read past them.
+constexpr size_t kReleaseChunkBytes = 1 << 20;
+
+/**
+ * Binary trace layout, in host byte order:
+ *
+ *     TraceHeader
+ *     TraceRecordHeader, int64Values, int32Values, floatValues, bytes, stringValue, padding
+ *     ... one record per event, each padded to a multiple of 8 bytes ...
+ *     TraceIndexEntry for record 0, kTraceIndexStride, 2 * kTraceIndexStride, ...
+ */
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t indexStride;
+    uint64_t eventCount;
+    uint64_t indexOffset;
+};
+
+struct TraceRecordHeader {
+    int64_t timestamp;
+    int32_t prop;
+    int32_t areaId;
+    uint32_t int64Count;
+    uint32_t int32Count;
+    uint32_t floatCount;
+    uint32_t byteCount;
+    uint32_t stringLength;
+    uint32_t reserved;
+};
+
+struct TraceIndexEntry {
+    int64_t timestamp;
+    uint64_t offset;
+};
+
+uint64_t alignTo8(uint64_t n) {
+    return (n + 7) & ~uint64_t(7);
+}
+
+uint64_t unpaddedPayloadSize(const TraceRecordHeader& header) {
+    return uint64_t(header.int64Count) * sizeof(int64_t) +
+           uint64_t(header.int32Count) * sizeof(int32_t) +
+           uint64_t(header.floatCount) * sizeof(float) + header.byteCount + header.stringLength;
+}
+
+uint64_t recordPayloadSize(const TraceRecordHeader& header) {
+    return alignTo8(unpaddedPayloadSize(header));
+}
+
+template <typename T>
+const uint8_t* readTraceArray(const uint8_t* src, uint32_t count, hidl_vec<T>& dest) {
+    dest.resize(count);
+    if (count > 0) {
+        memcpy(dest.data(), src, count * sizeof(T));
     }
-    mGenCfg = {
-        .index = 0,
-        .events = parseFakeValueJson(ifs),
+    return src + count * sizeof(T);
+}
+
+template <typename T>
+void writeTraceArray(std::ostream& os, const hidl_vec<T>& src) {
+    os.write(reinterpret_cast<const char*>(src.data()), src.size() * sizeof(T));
+}
+
+uint64_t writeTraceRecord(std::ostream& os, const VehiclePropValue& event) {
+    const auto& value = event.value;
+    TraceRecordHeader header = {
+            .timestamp = event.timestamp,
+            .prop = event.prop,
+            .areaId = event.areaId,
+            .int64Count = static_cast<uint32_t>(value.int64Values.size()),
+            .int32Count = static_cast<uint32_t>(value.int32Values.size()),
+            .floatCount = static_cast<uint32_t>(value.floatValues.size()),
+            .byteCount = static_cast<uint32_t>(value.bytes.size()),
+            .stringLength = static_cast<uint32_t>(value.stringValue.size()),
+            .reserved = 0,
     };
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeTraceArray(os, value.int64Values);
+    writeTraceArray(os, value.int32Values);
+    writeTraceArray(os, value.floatValues);
+    writeTraceArray(os, value.bytes);
+    os.write(value.stringValue.c_str(), value.stringValue.size());
+
+    static const char kPadding[8] = {};
+    uint64_t payloadSize = recordPayloadSize(header);
+    os.write(kPadding, payloadSize - unpaddedPayloadSize(header));
+    return sizeof(header) + payloadSize;
+}
+
+bool isJsonSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Returns the end of the top-level array element that starts at |begin|: the ',' or ']' that
+ * follows it, or |end| if the array is truncated. The element itself is not validated, that is
+ * left to Json::Reader.
+ */
+const char* findJsonElementEnd(const char* begin, const char* end) {
+    int depth = 0;
+    bool inString = false;
+    for (const char* p = begin; p < end; p++) {
+        char c = *p;
+        if (inString) {
+            if (c == '\\') {
+                p++;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || (c == ']' && depth > 0)) {
+            depth = depth > 0 ? depth - 1 : 0;
+        } else if (depth == 0 && (c == ',' || c == ']')) {
+            return p;
+        }
+    }
+    return end;
+}
+
+}  // namespace
+
+JsonFakeValueGenerator::JsonFakeValueGenerator(const VehiclePropValue& request) {
+    const auto& v = request.value;
     // Iterate infinitely if repetition number is not provided
     mNumOfIterations = v.int32Values.size() < 2 ? -1 : v.int32Values[1];
+    if (v.floatValues.size() > 0) {
+        if (v.floatValues[0] > 0) {
+            mPlaybackSpeed = v.floatValues[0];
+        } else {
+            ALOGE("%s: playback speed must be positive, got %f, using 1.0", __func__,
+                  v.floatValues[0]);
+        }
+    }
+    if (!mapFile(v.stringValue.c_str())) {
+        return;
+    }
+    setReadOffset(mFirstOffset);
+    mHasNextEvent = readEvent(&mNextEvent, &mNextEventOffset);
+    if (mHasNextEvent && v.int64Values.size() > 0 && !seekTo(v.int64Values[0])) {
+        ALOGE("%s: no event at or after timestamp %" PRId64 " in %s", __func__, v.int64Values[0],
+              v.stringValue.c_str());
+        mHasNextEvent = false;
+    }
+    mStartOffset = mNextEventOffset;
+}
+
+JsonFakeValueGenerator::~JsonFakeValueGenerator() {
+    if (mData != nullptr) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+    }
 }
 
 VehiclePropValue JsonFakeValueGenerator::nextEvent() {
@@ -54,91 +210,340 @@ VehiclePropValue JsonFakeValueGenerator::nextEvent() {
         return generatedValue;
     }
     TimePoint eventTime = Clock::now();
-    if (mGenCfg.index != 0) {
+    if (!mFirstInIteration) {
         // All events (start from 2nd one) are supposed to happen in the future with a delay
-        // equals to the duration between previous and current event.
-        eventTime += Nanos(mGenCfg.events[mGenCfg.index].timestamp -
-                           mGenCfg.events[mGenCfg.index - 1].timestamp);
+        // equals to the duration between previous and current event, scaled by playback speed.
+        eventTime += Nanos(static_cast<int64_t>((mNextEvent.timestamp - mPrevTimestamp) /
+                                                static_cast<double>(mPlaybackSpeed)));
     }
-    generatedValue = mGenCfg.events[mGenCfg.index];
+    mPrevTimestamp = mNextEvent.timestamp;
+    generatedValue = std::move(mNextEvent);
     generatedValue.timestamp = eventTime.time_since_epoch().count();
+    mFirstInIteration = false;
 
-    mGenCfg.index++;
-    if (mGenCfg.index == mGenCfg.events.size()) {
-        mGenCfg.index = 0;
+    mHasNextEvent = readEvent(&mNextEvent, &mNextEventOffset);
+    if (!mHasNextEvent) {
         if (mNumOfIterations > 0) {
             mNumOfIterations--;
         }
+        if (mNumOfIterations != 0) {
+            setReadOffset(mStartOffset);
+            mFirstInIteration = true;
+            mHasNextEvent = readEvent(&mNextEvent, &mNextEventOffset);
+        }
     }
     return generatedValue;
 }
 
 bool JsonFakeValueGenerator::hasNext() {
-    return mNumOfIterations != 0 && mGenCfg.events.size() > 0;
+    return mNumOfIterations != 0 && mHasNextEvent;
 }
 
-std::vector<VehiclePropValue> JsonFakeValueGenerator::parseFakeValueJson(std::istream& is) {
-    std::vector<VehiclePropValue> fakeVhalEvents;
+bool JsonFakeValueGenerator::seekTo(int64_t timestamp) {
+    if (mData == nullptr) {
+        return false;
+    }
+    size_t savedOffset = mReadOffset;
+    // JSON has no index, so a seek there parses every event from the beginning of the file.
+    setReadOffset(mIsBinaryTrace ? findBinaryRecord(timestamp) : mFirstOffset);
+    VehiclePropValue event;
+    size_t eventOffset;
+    while (readEvent(&event, &eventOffset)) {
+        if (event.timestamp >= timestamp) {
+            mNextEvent = std::move(event);
+            mNextEventOffset = eventOffset;
+            mHasNextEvent = true;
+            mFirstInIteration = true;
+            return true;
+        }
+    }
+    setReadOffset(savedOffset);
+    return false;
+}
 
-    Json::Reader reader;
-    Json::Value rawEvents;
-    if (!reader.parse(is, rawEvents)) {
-        ALOGE("%s: Failed to parse fake data JSON file. Error: %s", __func__,
-              reader.getFormattedErrorMessages().c_str());
-        return fakeVhalEvents;
+bool JsonFakeValueGenerator::convertToBinaryTrace(const std::string& jsonPath,
+                                                  const std::string& tracePath) {
+    VehiclePropValue request;
+    request.value.stringValue = jsonPath;
+    JsonFakeValueGenerator generator(request);
+    if (generator.mData == nullptr) {
+        return false;
+    }
+    std::ofstream os(tracePath, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        ALOGE("%s: couldn't open %s for writing.", __func__, tracePath.c_str());
+        return false;
     }
 
-    for (Json::Value::ArrayIndex i = 0; i < rawEvents.size(); i++) {
-        Json::Value rawEvent = rawEvents[i];
-        if (!rawEvent.isObject()) {
-            ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
-                  rawEvent.toStyledString().c_str());
-            continue;
+    TraceHeader header = {};
+    memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+    header.version = kTraceVersion;
+    header.indexStride = kTraceIndexStride;
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<TraceIndexEntry> index;
+    uint64_t offset = sizeof(header);
+    VehiclePropValue event;
+    size_t eventOffset;
+    generator.setReadOffset(generator.mFirstOffset);
+    while (generator.readEvent(&event, &eventOffset)) {
+        if (header.eventCount % kTraceIndexStride == 0) {
+            index.push_back({event.timestamp, offset});
         }
-        if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
-            rawEvent["timestamp"].empty()) {
-            ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
-                  rawEvent.toStyledString().c_str());
+        offset += writeTraceRecord(os, event);
+        header.eventCount++;
+    }
+    header.indexOffset = offset;
+    os.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(TraceIndexEntry));
+    os.seekp(0);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.flush();
+    if (!os) {
+        ALOGE("%s: failed to write %s.", __func__, tracePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool JsonFakeValueGenerator::mapFile(const char* file) {
+    int fd = TEMP_FAILURE_RETRY(open(file, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("%s: couldn't open %s for parsing.", __func__, file);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ALOGE("%s: %s is empty or can't be read.", __func__, file);
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ALOGE("%s: couldn't map %s, errno: %d", __func__, file, errno);
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    mData = static_cast<const uint8_t*>(data);
+    mSize = st.st_size;
+
+    if (mSize >= sizeof(TraceHeader) && memcmp(mData, kTraceMagic, sizeof(kTraceMagic)) == 0) {
+        mIsBinaryTrace = true;
+        if (!openBinaryTrace()) {
+            ALOGE("%s: %s is not a valid binary trace.", __func__, file);
+            return false;
+        }
+        return true;
+    }
+    if (!openJson()) {
+        ALOGE("%s: Failed to parse fake data JSON file %s, expected an array of events.",
+              __func__, file);
+        return false;
+    }
+    return true;
+}
+
+bool JsonFakeValueGenerator::openBinaryTrace() {
+    TraceHeader header;
+    memcpy(&header, mData, sizeof(header));
+    if (header.version != kTraceVersion || header.indexStride != kTraceIndexStride ||
+        header.indexOffset < sizeof(header) || header.indexOffset > mSize) {
+        return false;
+    }
+    uint64_t indexCount = (header.eventCount + kTraceIndexStride - 1) / kTraceIndexStride;
+    if (indexCount > (mSize - header.indexOffset) / sizeof(TraceIndexEntry)) {
+        return false;
+    }
+    mFirstOffset = sizeof(header);
+    mEndOffset = header.indexOffset;
+    mIndexOffset = header.indexOffset;
+    mIndexCount = indexCount;
+    return true;
+}
+
+bool JsonFakeValueGenerator::openJson() {
+    const char* data = reinterpret_cast<const char*>(mData);
+    size_t offset = 0;
+    // Skip the UTF-8 byte order mark, if any.
+    if (mSize >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        offset = 3;
+    }
+    while (offset < mSize && isJsonSpace(data[offset])) {
+        offset++;
+    }
+    if (offset == mSize || data[offset] != '[') {
+        return false;
+    }
+    mFirstOffset = offset + 1;
+    mEndOffset = mSize;
+    return true;
+}
+
+bool JsonFakeValueGenerator::readEvent(VehiclePropValue* event, size_t* eventOffset) {
+    return mIsBinaryTrace ? readBinaryEvent(event, eventOffset)
+                          : readJsonEvent(event, eventOffset);
+}
+
+bool JsonFakeValueGenerator::readBinaryEvent(VehiclePropValue* event, size_t* eventOffset) {
+    if (mEndOffset - mReadOffset < sizeof(TraceRecordHeader)) {
+        return false;
+    }
+    TraceRecordHeader header;
+    memcpy(&header, mData + mReadOffset, sizeof(header));
+    uint64_t payloadSize = recordPayloadSize(header);
+    if (payloadSize > mEndOffset - mReadOffset - sizeof(header)) {
+        ALOGE("%s: truncated record at offset %zu, stopping.", __func__, mReadOffset);
+        mReadOffset = mEndOffset;
+        return false;
+    }
+    const uint8_t* payload = mData + mReadOffset + sizeof(header);
+    *eventOffset = mReadOffset;
+    mReadOffset += sizeof(header) + payloadSize;
+
+    VehiclePropValue value = {
+            .timestamp = header.timestamp,
+            .areaId = header.areaId,
+            .prop = header.prop,
+    };
+    payload = readTraceArray(payload, header.int64Count, value.value.int64Values);
+    payload = readTraceArray(payload, header.int32Count, value.value.int32Values);
+    payload = readTraceArray(payload, header.floatCount, value.value.floatValues);
+    payload = readTraceArray(payload, header.byteCount, value.value.bytes);
+    value.value.stringValue =
+            std::string(reinterpret_cast<const char*>(payload), header.stringLength);
+    *event = std::move(value);
+
+    releaseConsumedPages();
+    return true;
+}
+
+bool JsonFakeValueGenerator::readJsonEvent(VehiclePropValue* event, size_t* eventOffset) {
+    const char* data = reinterpret_cast<const char*>(mData);
+    while (true) {
+        size_t begin = mReadOffset;
+        while (begin < mEndOffset && (isJsonSpace(data[begin]) || data[begin] == ',')) {
+            begin++;
+        }
+        if (begin == mEndOffset || data[begin] == ']') {
+            mReadOffset = begin;
+            return false;
+        }
+        const char* end = findJsonElementEnd(data + begin, data + mEndOffset);
+        mReadOffset = end - data;
+
+        Json::Value rawEvent;
+        bool parsed = mJsonReader.parse(data + begin, end, rawEvent, false /* collectComments */);
+        releaseConsumedPages();
+        if (!parsed) {
+            ALOGE("%s: Failed to parse fake data JSON event at offset %zu. Error: %s", __func__,
+                  begin, mJsonReader.getFormattedErrorMessages().c_str());
             continue;
         }
-        VehiclePropValue event = {
-                .timestamp = rawEvent["timestamp"].asInt64(),
-                .areaId = rawEvent["areaId"].asInt(),
-                .prop = rawEvent["prop"].asInt(),
-        };
-
-        Json::Value rawEventValue = rawEvent["value"];
-        auto& value = event.value;
-        switch (getPropType(event.prop)) {
-            case VehiclePropertyType::BOOLEAN:
-            case VehiclePropertyType::INT32:
-                value.int32Values.resize(1);
-                value.int32Values[0] = rawEventValue.asInt();
-                break;
-            case VehiclePropertyType::INT64:
-                value.int64Values.resize(1);
-                value.int64Values[0] = rawEventValue.asInt64();
-                break;
-            case VehiclePropertyType::FLOAT:
-                value.floatValues.resize(1);
-                value.floatValues[0] = rawEventValue.asFloat();
-                break;
-            case VehiclePropertyType::STRING:
-                value.stringValue = rawEventValue.asString();
-                break;
-            case VehiclePropertyType::MIXED:
-                copyMixedValueJson(value, rawEventValue);
-                if (isDiagnosticProperty(event.prop)) {
-                    value.bytes = generateDiagnosticBytes(value);
-                }
-                break;
-            default:
-                ALOGE("%s: unsupported type for property: 0x%x", __func__, event.prop);
-                continue;
-        }
-        fakeVhalEvents.push_back(event);
-    }
-    return fakeVhalEvents;
+        if (parseJsonEvent(rawEvent, event)) {
+            *eventOffset = begin;
+            return true;
+        }
+    }
+}
+
+void JsonFakeValueGenerator::setReadOffset(size_t offset) {
+    mReadOffset = offset;
+    if (offset < mReleasedOffset) {
+        mReleasedOffset = offset & ~(static_cast<size_t>(getpagesize()) - 1);
+    }
+}
+
+void JsonFakeValueGenerator::releaseConsumedPages() {
+    size_t consumed = mReadOffset & ~(static_cast<size_t>(getpagesize()) - 1);
+    if (consumed >= mReleasedOffset + kReleaseChunkBytes) {
+        madvise(const_cast<uint8_t*>(mData) + mReleasedOffset, consumed - mReleasedOffset,
+                MADV_DONTNEED);
+        mReleasedOffset = consumed;
+    }
+}
+
+size_t JsonFakeValueGenerator::findBinaryRecord(int64_t timestamp) const {
+    auto entryAt = [this](size_t i) {
+        TraceIndexEntry entry;
+        memcpy(&entry, mData + mIndexOffset + i * sizeof(TraceIndexEntry), sizeof(entry));
+        return entry;
+    };
+    // Find the first stride that starts at or after |timestamp|; the event may still be at the
+    // end of the stride before it.
+    size_t lo = 0;
+    size_t hi = mIndexCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entryAt(mid).timestamp < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t offset = lo == 0 ? mFirstOffset : static_cast<size_t>(entryAt(lo - 1).offset);
+
+    // Step over the earlier records of that stride without decoding their values.
+    TraceRecordHeader header;
+    while (mEndOffset - offset >= sizeof(header)) {
+        memcpy(&header, mData + offset, sizeof(header));
+        uint64_t payloadSize = recordPayloadSize(header);
+        if (header.timestamp >= timestamp || payloadSize > mEndOffset - offset - sizeof(header)) {
+            break;
+        }
+        offset += sizeof(header) + payloadSize;
+    }
+    return offset;
+}
+
+bool JsonFakeValueGenerator::parseJsonEvent(const Json::Value& rawEvent, VehiclePropValue* out) {
+    if (!rawEvent.isObject()) {
+        ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
+        rawEvent["timestamp"].empty()) {
+        ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    VehiclePropValue event = {
+            .timestamp = rawEvent["timestamp"].asInt64(),
+            .areaId = rawEvent["areaId"].asInt(),
+            .prop = rawEvent["prop"].asInt(),
+    };
+
+    const Json::Value& rawEventValue = rawEvent["value"];
+    auto& value = event.value;
+    switch (getPropType(event.prop)) {
+        case VehiclePropertyType::BOOLEAN:
+        case VehiclePropertyType::INT32:
+            value.int32Values.resize(1);
+            value.int32Values[0] = rawEventValue.asInt();
+            break;
+        case VehiclePropertyType::INT64:
+            value.int64Values.resize(1);
+            value.int64Values[0] = rawEventValue.asInt64();
+            break;
+        case VehiclePropertyType::FLOAT:
+            value.floatValues.resize(1);
+            value.floatValues[0] = rawEventValue.asFloat();
+            break;
+        case VehiclePropertyType::STRING:
+            value.stringValue = rawEventValue.asString();
+            break;
+        case VehiclePropertyType::MIXED:
+            copyMixedValueJson(value, rawEventValue);
+            if (isDiagnosticProperty(event.prop)) {
+                value.bytes = generateDiagnosticBytes(value);
+            }
+            break;
+        default:
+            ALOGE("%s: unsupported type for property: 0x%x", __func__, event.prop);
+            return false;
+    }
+    *out = std::move(event);
+    return true;
 }
 
 void JsonFakeValueGenerator::copyMixedValueJson(VehiclePropValue::RawValue& dest,
@@ -19,6 +19,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <string>
 
 #include <json/json.h>
 
@@ -32,23 +33,61 @@ namespace V2_0 {
 
 namespace impl {
 
+/**
+ * Replays VHAL events from a file. Two formats are accepted:
+ *
+ *  - A JSON array of events, as documented for FakeDataCommand::StartJson. The file is mapped and
+ *    parsed one array element at a time, so start-up cost and memory use do not depend on the
+ *    number of events.
+ *  - A binary trace produced by convertToBinaryTrace(). Records are decoded straight out of the
+ *    mapping and an index at the end of the file makes seekTo() cheap on long traces.
+ *
+ * Only the upcoming event is kept in memory. Mapped pages the replay has moved past are dropped
+ * periodically, so the resident set stays small even for multi-hour drive logs.
+ */
 class JsonFakeValueGenerator : public FakeValueGenerator {
-private:
-    struct GeneratorCfg {
-        size_t index;
-        std::vector<VehiclePropValue> events;
-    };
-
 public:
     JsonFakeValueGenerator(const VehiclePropValue& request);
-    ~JsonFakeValueGenerator() = default;
+    ~JsonFakeValueGenerator();
+
+    JsonFakeValueGenerator(const JsonFakeValueGenerator&) = delete;
+    JsonFakeValueGenerator& operator=(const JsonFakeValueGenerator&) = delete;
 
     VehiclePropValue nextEvent();
 
     bool hasNext();
 
+    /**
+     * Moves the replay to the first event whose timestamp in the trace is not less than
+     * |timestamp|. Events must be ordered by timestamp. Returns false and leaves the position
+     * unchanged if there is no such event. Must not be called once the generator is registered.
+     */
+    bool seekTo(int64_t timestamp);
+
+    /**
+     * Converts a JSON fake value file into the binary trace format. Events that fail to parse are
+     * dropped, the same way they are skipped during a JSON replay.
+     */
+    static bool convertToBinaryTrace(const std::string& jsonPath, const std::string& tracePath);
+
 private:
-    std::vector<VehiclePropValue> parseFakeValueJson(std::istream& is);
+    bool mapFile(const char* file);
+    bool openBinaryTrace();
+    bool openJson();
+
+    /**
+     * Reads the next valid event at or after the read position, stores the offset at which it
+     * begins in |eventOffset| and moves the read position past it.
+     */
+    bool readEvent(VehiclePropValue* event, size_t* eventOffset);
+    bool readBinaryEvent(VehiclePropValue* event, size_t* eventOffset);
+    bool readJsonEvent(VehiclePropValue* event, size_t* eventOffset);
+    void setReadOffset(size_t offset);
+    void releaseConsumedPages();
+    // Returns the offset of the first record at or after |timestamp| in a binary trace.
+    size_t findBinaryRecord(int64_t timestamp) const;
+
+    bool parseJsonEvent(const Json::Value& rawEvent, VehiclePropValue* event);
     void copyMixedValueJson(VehiclePropValue::RawValue& dest, const Json::Value& jsonValue);
 
     template <typename T>
@@ -59,7 +98,24 @@ private:
     void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
 
 private:
-    GeneratorCfg mGenCfg;
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    bool mIsBinaryTrace = false;
+    size_t mFirstOffset = 0;     // Offset of the first event in the file.
+    size_t mEndOffset = 0;       // Offset past the last event in the file.
+    size_t mIndexOffset = 0;     // Binary traces only: offset and size of the seek index.
+    size_t mIndexCount = 0;
+    size_t mStartOffset = 0;     // Every iteration starts here, after the initial seek.
+    size_t mReadOffset = 0;      // Offset past mNextEvent.
+    size_t mReleasedOffset = 0;  // Pages below this offset have been dropped.
+    Json::Reader mJsonReader;
+
+    VehiclePropValue mNextEvent;
+    size_t mNextEventOffset = 0;
+    bool mHasNextEvent = false;
+    bool mFirstInIteration = true;
+    int64_t mPrevTimestamp = 0;
+    float mPlaybackSpeed = 1.0f;
     int32_t mNumOfIterations;
 };
 
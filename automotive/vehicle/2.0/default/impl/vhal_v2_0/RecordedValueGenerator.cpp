@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RecordedValueGenerator"
+
+#include <log/log.h>
+
+#include "RecordedValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+RecordedValueGenerator::RecordedValueGenerator(const VehiclePropValue& request) {
+    const auto& v = request.value;
+    // Iterate infinitely if repetition number is not provided
+    mNumOfIterations = v.int32Values.size() < 2 ? -1 : v.int32Values[1];
+    if (mReader.open(v.stringValue)) {
+        mHasNextEvent = mReader.next(&mNextEvent);
+    }
+}
+
+VehiclePropValue RecordedValueGenerator::nextEvent() {
+    VehiclePropValue generatedValue;
+    if (!hasNext()) {
+        return generatedValue;
+    }
+    TimePoint eventTime = Clock::now();
+    if (!mFirstInIteration) {
+        // Keep the delay the value had to the previous one when it was recorded.
+        eventTime += Nanos(mNextEvent.timestamp - mPrevTimestamp);
+    }
+    mPrevTimestamp = mNextEvent.timestamp;
+    generatedValue = std::move(mNextEvent);
+    generatedValue.timestamp = eventTime.time_since_epoch().count();
+    mFirstInIteration = false;
+
+    mHasNextEvent = mReader.next(&mNextEvent);
+    if (!mHasNextEvent) {
+        if (mNumOfIterations > 0) {
+            mNumOfIterations--;
+        }
+        if (mNumOfIterations != 0 && mReader.rewind()) {
+            mFirstInIteration = true;
+            mHasNextEvent = mReader.next(&mNextEvent);
+        }
+    }
+    return generatedValue;
+}
+
+bool RecordedValueGenerator::hasNext() {
+    return mNumOfIterations != 0 && mHasNextEvent;
+}
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_RecordedValueGenerator_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_RecordedValueGenerator_H_
+
+#include <vhal_v2_0/VehiclePropValueRecorder.h>
+
+#include "FakeValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Replays a log written by VehiclePropValueRecorder, e.g. through the --start-recording debug
+ * command. Values keep the order and relative timing they were recorded with.
+ */
+class RecordedValueGenerator : public FakeValueGenerator {
+public:
+    RecordedValueGenerator(const VehiclePropValue& request);
+    ~RecordedValueGenerator() = default;
+
+    VehiclePropValue nextEvent();
+
+    bool hasNext();
+
+private:
+    VehiclePropValueLogReader mReader;
+    VehiclePropValue mNextEvent;
+    bool mHasNextEvent = false;
+    bool mFirstInIteration = true;
+    int64_t mPrevTimestamp = 0;
+    int32_t mNumOfIterations;
+};
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_RecordedValueGenerator_H_
@@ -22,12 +22,19 @@
 #include <log/log.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "SocketComm.h"
 
 // Socket to use when communicating with Host PC
 static constexpr int DEBUG_SOCKET = 33452;
 
+static constexpr size_t MSG_HEADER_LEN = 4;
+
+// Enough for a few hundred property values, the buffer grows for larger messages.
+static constexpr size_t RX_BUFFER_SIZE = 64 * 1024;
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -140,80 +147,74 @@ void SocketComm::removeClosedConnections() {
 }
 
 SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd)
-    : CommConn(messageProcessor), mSockFd(sfd) {}
+    : CommConn(messageProcessor), mSockFd(sfd), mRxBuffer(RX_BUFFER_SIZE) {}
 
-/**
- * Reads, in a loop, exactly numBytes from the given fd. If the connection is closed, returns
- * an empty buffer, otherwise will return exactly the given number of bytes.
- */
-std::vector<uint8_t> readExactly(int fd, int numBytes) {
-    std::vector<uint8_t> buffer(numBytes);
-    int totalRead = 0;
-    int offset = 0;
-    while (totalRead < numBytes) {
-        int numRead = ::read(fd, &buffer.data()[offset], numBytes - offset);
-        if (numRead == 0) {
-            buffer.resize(0);
-            return buffer;
-        }
-
-        totalRead += numRead;
+bool SocketConn::fill(size_t numBytes) {
+    if (mRxEnd - mRxBegin >= numBytes) {
+        return true;
     }
-    return buffer;
-}
 
-/**
- * Reads an int, guaranteed to be non-zero, from the given fd. If the connection is closed, returns
- * -1.
- */
-int32_t readInt(int fd) {
-    std::vector<uint8_t> buffer = readExactly(fd, sizeof(int32_t));
-    if (buffer.size() == 0) {
-        return -1;
+    // Move the unread bytes to the front, the caller is done with the previous message by now.
+    memmove(mRxBuffer.data(), mRxBuffer.data() + mRxBegin, mRxEnd - mRxBegin);
+    mRxEnd -= mRxBegin;
+    mRxBegin = 0;
+    if (mRxBuffer.size() < numBytes) {
+        mRxBuffer.resize(numBytes);
     }
 
-    int32_t value = *reinterpret_cast<int32_t*>(buffer.data());
-    return ntohl(value);
+    while (mRxEnd < numBytes) {
+        ssize_t numRead = ::read(mSockFd, mRxBuffer.data() + mRxEnd, mRxBuffer.size() - mRxEnd);
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead <= 0) {
+            return false;
+        }
+        mRxEnd += numRead;
+    }
+    return true;
 }
 
-std::vector<uint8_t> SocketConn::read() {
-    int32_t msgSize = readInt(mSockFd);
-    if (msgSize <= 0) {
+bool SocketConn::read(const uint8_t** data, size_t* size) {
+    int32_t msgSize = -1;
+    if (fill(MSG_HEADER_LEN)) {
+        uint32_t msgLen;
+        memcpy(&msgLen, mRxBuffer.data() + mRxBegin, MSG_HEADER_LEN);
+        msgSize = static_cast<int32_t>(ntohl(msgLen));
+    }
+    if (msgSize <= 0 || !fill(MSG_HEADER_LEN + msgSize)) {
         ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
-        return std::vector<uint8_t>();
+        return false;
     }
 
-    return readExactly(mSockFd, msgSize);
+    *data = mRxBuffer.data() + mRxBegin + MSG_HEADER_LEN;
+    *size = static_cast<size_t>(msgSize);
+    mRxBegin += MSG_HEADER_LEN + msgSize;
+    return true;
 }
 
 void SocketConn::stop() {
     if (mSockFd > 0) {
+        // Unblocks the read thread, close() alone doesn't.
+        shutdown(mSockFd, SHUT_RDWR);
+        CommConn::stop();
         close(mSockFd);
         mSockFd = -1;
     }
 }
 
 int SocketConn::write(const std::vector<uint8_t>& data) {
-    static constexpr int MSG_HEADER_LEN = 4;
-    int retVal = 0;
-    union {
-        uint32_t msgLen;
-        uint8_t msgLenBytes[MSG_HEADER_LEN];
-    };
-
-    // Prepare header for the message
-    msgLen = static_cast<uint32_t>(data.size());
-    msgLen = htonl(msgLen);
-
-    if (mSockFd > 0) {
-        retVal = ::write(mSockFd, msgLenBytes, MSG_HEADER_LEN);
-
-        if (retVal == MSG_HEADER_LEN) {
-            retVal = ::write(mSockFd, data.data(), data.size());
-        }
+    if (mSockFd <= 0) {
+        return 0;
     }
 
-    return retVal;
+    // Prepare header for the message, it is sent together with the message in one syscall.
+    uint32_t msgLen = htonl(static_cast<uint32_t>(data.size()));
+    struct iovec iov[] = {
+            {.iov_base = &msgLen, .iov_len = MSG_HEADER_LEN},
+            {.iov_base = const_cast<uint8_t*>(data.data()), .iov_len = data.size()},
+    };
+    return ::writev(mSockFd, iov, 2);
 }
 
 }  // impl
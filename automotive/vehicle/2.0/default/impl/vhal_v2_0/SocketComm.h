@@ -79,6 +79,9 @@ class SocketComm {
 
 /**
  * SocketConn represents a single connection to a client.
+ *
+ * Every message is framed by its length as a 4 byte big-endian integer. Received data is buffered,
+ * so a client that sends several messages back to back has them all read with one syscall.
  */
 class SocketConn : public CommConn {
    public:
@@ -86,12 +89,15 @@ class SocketConn : public CommConn {
     virtual ~SocketConn() = default;
 
     /**
-     * Blocking call to read data from the connection.
+     * Blocking call to read the next message from the connection.
+     *
+     * @param data Set to the serialized protobuf data received from emulator. It points into the
+     *              receive buffer and stays valid until the next read().
+     * @param size Set to the size of the data.
      *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * @return bool False if the connection was closed or some other error occurred.
      */
-    std::vector<uint8_t> read() override;
+    bool read(const uint8_t** data, size_t* size) override;
 
     /**
      * Closes a connection if it is open.
@@ -110,7 +116,18 @@ class SocketConn : public CommConn {
     inline bool isOpen() override { return mSockFd > 0; }
 
    private:
+    /**
+     * Blocks until at least numBytes unread bytes are buffered, receiving as many bytes as are
+     * available.
+     *
+     * @return bool False if the connection was closed before.
+     */
+    bool fill(size_t numBytes);
+
     int mSockFd;
+    std::vector<uint8_t> mRxBuffer;
+    size_t mRxBegin = 0;  // Offset of the first unread byte in mRxBuffer.
+    size_t mRxEnd = 0;  // Offset past the last received byte in mRxBuffer.
 };
 
 }  // impl
@@ -37,6 +37,10 @@ namespace V2_0 {
 
 namespace impl {
 
+// Set while a batched SET_PROPERTY_CMD is processed on this thread, values the HAL reports
+// meanwhile are collected in it and sent in one message.
+static thread_local vhal_proto::EmulatorMessage* tCoalescedMsg = nullptr;
+
 VehicleEmulator::VehicleEmulator(EmulatedVehicleHalIface* hal) : mHal{hal} {
     mHal->registerEmulator(this);
 
@@ -63,12 +67,20 @@ VehicleEmulator::~VehicleEmulator() {
  * changed.
  */
 void VehicleEmulator::doSetValueFromClient(const VehiclePropValue& propValue) {
+    if (tCoalescedMsg != nullptr) {
+        populateProtoVehiclePropValue(tCoalescedMsg->add_value(), &propValue);
+        return;
+    }
+
     vhal_proto::EmulatorMessage msg;
     vhal_proto::VehiclePropValue* val = msg.add_value();
     populateProtoVehiclePropValue(val, &propValue);
     msg.set_status(vhal_proto::RESULT_OK);
     msg.set_msg_type(vhal_proto::SET_PROPERTY_ASYNC);
+    sendMessage(msg);
+}
 
+void VehicleEmulator::sendMessage(EmulatorMessage const& msg) {
     mSocketComm->sendMessage(msg);
     if (mPipeComm) {
         mPipeComm->sendMessage(msg);
@@ -150,9 +162,7 @@ void VehicleEmulator::doGetPropertyAll(VehicleEmulator::EmulatorMessage const& /
     }
 }
 
-void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMsg,
-                                    VehicleEmulator::EmulatorMessage& respMsg) {
-    vhal_proto::VehiclePropValue protoVal = rxMsg.value(0);
+bool VehicleEmulator::setPropertyFromProto(vhal_proto::VehiclePropValue const& protoVal) {
     VehiclePropValue val = {
             .timestamp = elapsedRealtimeNano(),
             .areaId = protoVal.area_id(),
@@ -160,8 +170,6 @@ void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMs
             .status = (VehiclePropertyStatus)protoVal.status(),
     };
 
-    respMsg.set_msg_type(vhal_proto::SET_PROPERTY_RESP);
-
     // Copy value data if it is set.  This automatically handles complex data types if needed.
     if (protoVal.has_string_value()) {
         val.value.stringValue = protoVal.string_value().c_str();
@@ -187,7 +195,37 @@ void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMs
                                                      protoVal.float_values().end() };
     }
 
-    bool halRes = mHal->setPropertyFromVehicle(val);
+    return mHal->setPropertyFromVehicle(val);
+}
+
+/**
+ * A SET_PROPERTY_CMD may carry several values, e.g. when a recorded drive is replayed. They are
+ * all set, the response is RESULT_OK only if all of them were, and the updates the HAL reports
+ * back are coalesced into a single SET_PROPERTY_ASYNC message.
+ */
+void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMsg,
+                                    VehicleEmulator::EmulatorMessage& respMsg) {
+    respMsg.set_msg_type(vhal_proto::SET_PROPERTY_RESP);
+
+    bool batched = rxMsg.value_size() > 1;
+    EmulatorMessage asyncMsg;
+    if (batched) {
+        asyncMsg.set_status(vhal_proto::RESULT_OK);
+        asyncMsg.set_msg_type(vhal_proto::SET_PROPERTY_ASYNC);
+        tCoalescedMsg = &asyncMsg;
+    }
+
+    bool halRes = rxMsg.value_size() > 0;
+    for (const auto& protoVal : rxMsg.value()) {
+        halRes = setPropertyFromProto(protoVal) && halRes;
+    }
+
+    if (batched) {
+        tCoalescedMsg = nullptr;
+        if (asyncMsg.value_size() > 0) {
+            sendMessage(asyncMsg);
+        }
+    }
     respMsg.set_status(halRes ? vhal_proto::RESULT_OK : vhal_proto::ERROR_INVALID_PROPERTY);
 }
 
@@ -84,6 +84,8 @@ class VehicleEmulator : public MessageProcessor {
     void doGetProperty(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
     void doGetPropertyAll(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
     void doSetProperty(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
+    bool setPropertyFromProto(vhal_proto::VehiclePropValue const& protoVal);
+    void sendMessage(EmulatorMessage const& msg);
     void populateProtoVehicleConfig(vhal_proto::VehiclePropConfig* protoCfg,
                                     const VehiclePropConfig& cfg);
     void populateProtoVehiclePropValue(vhal_proto::VehiclePropValue* protoVal,
@@ -27,6 +27,7 @@
 #include "JsonFakeValueGenerator.h"
 #include "LinearFakeValueGenerator.h"
 #include "Obd2SensorStore.h"
+#include "RecordedValueGenerator.h"
 
 namespace android::hardware::automotive::vehicle::V2_0::impl {
 
@@ -134,6 +135,27 @@ StatusCode VehicleHalServer::handleGenerateFakeDataRequest(const VehiclePropValu
             getGenerator()->unregisterGenerator(cookie);
             break;
         }
+        case FakeDataCommand::StartReplay: {
+            LOG(INFO) << __func__ << ", FakeDataCommand::StartReplay";
+            if (v.stringValue.empty()) {
+                LOG(ERROR) << __func__ << ": path to recorded log is missing";
+                return StatusCode::INVALID_ARG;
+            }
+            int32_t cookie = std::hash<std::string>()(v.stringValue);
+            getGenerator()->registerGenerator(cookie,
+                                              std::make_unique<RecordedValueGenerator>(request));
+            break;
+        }
+        case FakeDataCommand::StopReplay: {
+            LOG(INFO) << __func__ << ", FakeDataCommand::StopReplay";
+            if (v.stringValue.empty()) {
+                LOG(ERROR) << __func__ << ": path to recorded log is missing";
+                return StatusCode::INVALID_ARG;
+            }
+            int32_t cookie = std::hash<std::string>()(v.stringValue);
+            getGenerator()->unregisterGenerator(cookie);
+            break;
+        }
         case FakeDataCommand::KeyPress: {
             LOG(INFO) << __func__ << ", FakeDataCommand::KeyPress";
             int32_t keyCode = request.value.int32Values[2];
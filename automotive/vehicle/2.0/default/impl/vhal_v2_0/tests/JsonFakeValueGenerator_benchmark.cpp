@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/JsonFakeValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+using android::base::TemporaryFile;
+
+/** A drive trace with |numEvents| speed samples taken every 10ms, in JSON and binary form. */
+struct DriveTrace {
+    TemporaryFile json;
+    TemporaryFile binary;
+};
+
+const DriveTrace& getDriveTrace(size_t numEvents) {
+    static std::map<size_t, std::unique_ptr<DriveTrace>> traces;
+    auto& trace = traces[numEvents];
+    if (trace == nullptr) {
+        trace = std::make_unique<DriveTrace>();
+        std::string json = "[";
+        for (size_t i = 0; i < numEvents; i++) {
+            json += (i == 0 ? "\n" : ",\n");
+            json += "{\"timestamp\": " + std::to_string(i * 10000000) +
+                    ", \"areaId\": 0, \"prop\": 291504647, \"value\": " + std::to_string(i % 120) +
+                    ".5}";
+        }
+        json += "\n]\n";
+        android::base::WriteStringToFile(json, trace->json.path);
+        JsonFakeValueGenerator::convertToBinaryTrace(trace->json.path, trace->binary.path);
+    }
+    return *trace;
+}
+
+VehiclePropValue startJsonRequest(const char* path) {
+    VehiclePropValue request;
+    request.value.int32Values = hidl_vec<int32_t>{2 /* StartJson */};
+    request.value.stringValue = path;
+    return request;
+}
+
+/** Time until the first event of a trace with state.range(0) events is available. */
+void BM_OpenJson(benchmark::State& state) {
+    VehiclePropValue request = startJsonRequest(getDriveTrace(state.range(0)).json.path);
+    for (auto _ : state) {
+        JsonFakeValueGenerator generator(request);
+        benchmark::DoNotOptimize(generator.nextEvent());
+    }
+}
+BENCHMARK(BM_OpenJson)->Arg(1000)->Arg(100000);
+
+void BM_OpenBinaryTrace(benchmark::State& state) {
+    VehiclePropValue request = startJsonRequest(getDriveTrace(state.range(0)).binary.path);
+    for (auto _ : state) {
+        JsonFakeValueGenerator generator(request);
+        benchmark::DoNotOptimize(generator.nextEvent());
+    }
+}
+BENCHMARK(BM_OpenBinaryTrace)->Arg(1000)->Arg(100000);
+
+void BM_ReplayJson(benchmark::State& state) {
+    JsonFakeValueGenerator generator(startJsonRequest(getDriveTrace(10000).json.path));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(generator.nextEvent());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReplayJson);
+
+void BM_ReplayBinaryTrace(benchmark::State& state) {
+    JsonFakeValueGenerator generator(startJsonRequest(getDriveTrace(10000).binary.path));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(generator.nextEvent());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReplayBinaryTrace);
+
+/** Seeking to a random point of a trace with state.range(0) events. */
+void BM_SeekBinaryTrace(benchmark::State& state) {
+    const int64_t numEvents = state.range(0);
+    JsonFakeValueGenerator generator(startJsonRequest(getDriveTrace(numEvents).binary.path));
+    int64_t target = 0;
+    for (auto _ : state) {
+        target = (target + 7919 * 10000000LL) % (numEvents * 10000000LL);
+        benchmark::DoNotOptimize(generator.seekTo(target));
+    }
+}
+BENCHMARK(BM_SeekBinaryTrace)->Arg(100000);
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
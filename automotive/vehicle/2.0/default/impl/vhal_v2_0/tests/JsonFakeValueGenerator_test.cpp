@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sstream>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/JsonFakeValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+using android::base::TemporaryFile;
+using android::base::WriteStringToFile;
+
+constexpr int32_t kSpeedProp = static_cast<int32_t>(VehicleProperty::PERF_VEHICLE_SPEED);
+constexpr int32_t kGearProp = static_cast<int32_t>(VehicleProperty::GEAR_SELECTION);
+constexpr int32_t kMakeProp = static_cast<int32_t>(VehicleProperty::INFO_MAKE);
+constexpr int32_t kLiveFrameProp = static_cast<int32_t>(VehicleProperty::OBD2_LIVE_FRAME);
+
+std::string speedEventJson(int64_t timestamp, float speed) {
+    std::ostringstream os;
+    os << "{\"timestamp\": " << timestamp << ", \"areaId\": 0, \"prop\": " << kSpeedProp
+       << ", \"value\": " << speed << "}";
+    return os.str();
+}
+
+/** Writes |numEvents| speed events, |interval| nanoseconds apart, with the value set to i. */
+std::string speedTraceJson(size_t numEvents, int64_t interval) {
+    std::string json = "[";
+    for (size_t i = 0; i < numEvents; i++) {
+        json += (i == 0 ? "\n" : ",\n") + speedEventJson(i * interval, i);
+    }
+    return json + "\n]\n";
+}
+
+VehiclePropValue startJsonRequest(const char* path) {
+    VehiclePropValue request;
+    request.value.int32Values = hidl_vec<int32_t>{2 /* StartJson */};
+    request.value.stringValue = path;
+    return request;
+}
+
+std::vector<VehiclePropValue> drain(JsonFakeValueGenerator& generator, size_t maxEvents) {
+    std::vector<VehiclePropValue> events;
+    while (generator.hasNext() && events.size() < maxEvents) {
+        events.push_back(generator.nextEvent());
+    }
+    return events;
+}
+
+TEST(JsonFakeValueGeneratorTest, replaysEventsInOrder) {
+    TemporaryFile file;
+    std::ostringstream json;
+    json << "[" << speedEventJson(1000, 12.5f) << ",\n"
+         << "{\"timestamp\": 2000, \"areaId\": 0, \"prop\": " << kGearProp << ", \"value\": 4},\n"
+         << "{\"timestamp\": 3000, \"areaId\": 0, \"prop\": " << kMakeProp
+         << ", \"value\": \"a \\\"quoted\\\" [make], {x}\"}]";
+    ASSERT_TRUE(WriteStringToFile(json.str(), file.path));
+
+    JsonFakeValueGenerator generator(startJsonRequest(file.path));
+    auto events = drain(generator, 3);
+
+    ASSERT_EQ(3u, events.size());
+    EXPECT_EQ(kSpeedProp, events[0].prop);
+    ASSERT_EQ(1u, events[0].value.floatValues.size());
+    EXPECT_EQ(12.5f, events[0].value.floatValues[0]);
+    EXPECT_EQ(kGearProp, events[1].prop);
+    ASSERT_EQ(1u, events[1].value.int32Values.size());
+    EXPECT_EQ(4, events[1].value.int32Values[0]);
+    EXPECT_EQ(kMakeProp, events[2].prop);
+    EXPECT_EQ("a \"quoted\" [make], {x}", std::string(events[2].value.stringValue));
+    // Each event is scheduled relative to the time the previous one was produced.
+    EXPECT_GE(events[1].timestamp - events[0].timestamp, 1000);
+}
+
+TEST(JsonFakeValueGeneratorTest, skipsInvalidEvents) {
+    TemporaryFile file;
+    std::ostringstream json;
+    json << "[ 42, " << speedEventJson(0, 1) << ", {\"timestamp\": 1, \"prop\": " << kSpeedProp
+         << "}, {\"timestamp\": 2, \"prop\": }, " << speedEventJson(3, 2) << " ]";
+    ASSERT_TRUE(WriteStringToFile(json.str(), file.path));
+
+    VehiclePropValue request = startJsonRequest(file.path);
+    request.value.int32Values = hidl_vec<int32_t>{2, 1};
+    JsonFakeValueGenerator generator(request);
+    auto events = drain(generator, 10);
+
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(1.0f, events[0].value.floatValues[0]);
+    EXPECT_EQ(2.0f, events[1].value.floatValues[0]);
+}
+
+TEST(JsonFakeValueGeneratorTest, rejectsMissingOrMalformedFile) {
+    JsonFakeValueGenerator missing(startJsonRequest("/does/not/exist.json"));
+    EXPECT_FALSE(missing.hasNext());
+
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile(speedEventJson(0, 1), file.path));
+    JsonFakeValueGenerator notAnArray(startJsonRequest(file.path));
+    EXPECT_FALSE(notAnArray.hasNext());
+}
+
+TEST(JsonFakeValueGeneratorTest, stopsAfterIterations) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile(speedTraceJson(2, 1000), file.path));
+
+    VehiclePropValue request = startJsonRequest(file.path);
+    request.value.int32Values = hidl_vec<int32_t>{2, 3};
+    JsonFakeValueGenerator generator(request);
+    auto events = drain(generator, 100);
+
+    ASSERT_EQ(6u, events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_EQ(static_cast<float>(i % 2), events[i].value.floatValues[0]);
+    }
+}
+
+TEST(JsonFakeValueGeneratorTest, playbackSpeedScalesDelays) {
+    TemporaryFile file;
+    constexpr int64_t kInterval = 4000000000;  // 4s in the trace.
+    ASSERT_TRUE(WriteStringToFile(speedTraceJson(2, kInterval), file.path));
+
+    VehiclePropValue request = startJsonRequest(file.path);
+    request.value.floatValues = hidl_vec<float>{8.0f};
+    JsonFakeValueGenerator generator(request);
+    auto events = drain(generator, 2);
+
+    ASSERT_EQ(2u, events.size());
+    int64_t delay = events[1].timestamp - events[0].timestamp;
+    EXPECT_GE(delay, kInterval / 8);
+    EXPECT_LT(delay, kInterval / 2);
+}
+
+TEST(JsonFakeValueGeneratorTest, startTimestampAppliesToEveryIteration) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile(speedTraceJson(10, 1000), file.path));
+
+    VehiclePropValue request = startJsonRequest(file.path);
+    request.value.int32Values = hidl_vec<int32_t>{2, 2};
+    request.value.int64Values = hidl_vec<int64_t>{6500};
+    JsonFakeValueGenerator generator(request);
+    auto events = drain(generator, 100);
+
+    ASSERT_EQ(6u, events.size());
+    EXPECT_EQ(7.0f, events[0].value.floatValues[0]);
+    EXPECT_EQ(9.0f, events[2].value.floatValues[0]);
+    EXPECT_EQ(7.0f, events[3].value.floatValues[0]);
+
+    request.value.int64Values = hidl_vec<int64_t>{100000};
+    JsonFakeValueGenerator pastEnd(request);
+    EXPECT_FALSE(pastEnd.hasNext());
+}
+
+TEST(JsonFakeValueGeneratorTest, binaryTraceMatchesJson) {
+    TemporaryFile jsonFile;
+    std::ostringstream json;
+    json << "[" << speedEventJson(0, 3.25f) << ",\n"
+         << "{\"timestamp\": 10, \"areaId\": 0, \"prop\": " << kMakeProp
+         << ", \"value\": \"make\"},\n"
+         << "{\"timestamp\": 20, \"areaId\": 0, \"prop\": " << kLiveFrameProp
+         << ", \"value\": {\"int32Values\": [0, 1, 0, 7], \"floatValues\": [0.0, 2.5],"
+         << " \"int64Values\": [123456789012], \"stringValue\": \"frame\"}}]";
+    ASSERT_TRUE(WriteStringToFile(json.str(), jsonFile.path));
+    TemporaryFile traceFile;
+    ASSERT_TRUE(JsonFakeValueGenerator::convertToBinaryTrace(jsonFile.path, traceFile.path));
+
+    VehiclePropValue request = startJsonRequest(jsonFile.path);
+    request.value.int32Values = hidl_vec<int32_t>{2, 1};
+    JsonFakeValueGenerator fromJson(request);
+    request.value.stringValue = traceFile.path;
+    JsonFakeValueGenerator fromTrace(request);
+    auto expected = drain(fromJson, 10);
+    auto actual = drain(fromTrace, 10);
+
+    ASSERT_EQ(3u, expected.size());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].prop, actual[i].prop);
+        EXPECT_EQ(expected[i].areaId, actual[i].areaId);
+        EXPECT_EQ(expected[i].value.int32Values, actual[i].value.int32Values);
+        EXPECT_EQ(expected[i].value.int64Values, actual[i].value.int64Values);
+        EXPECT_EQ(expected[i].value.floatValues, actual[i].value.floatValues);
+        EXPECT_EQ(expected[i].value.bytes, actual[i].value.bytes);
+        EXPECT_EQ(std::string(expected[i].value.stringValue),
+                  std::string(actual[i].value.stringValue));
+    }
+    EXPECT_GT(actual[2].value.bytes.size(), 0u);
+}
+
+TEST(JsonFakeValueGeneratorTest, seekToInBinaryTrace) {
+    TemporaryFile jsonFile;
+    ASSERT_TRUE(WriteStringToFile(speedTraceJson(2000, 1000), jsonFile.path));
+    TemporaryFile traceFile;
+    ASSERT_TRUE(JsonFakeValueGenerator::convertToBinaryTrace(jsonFile.path, traceFile.path));
+
+    JsonFakeValueGenerator generator(startJsonRequest(traceFile.path));
+    for (int64_t target : {0, 1, 255000, 256000, 256001, 1998000}) {
+        ASSERT_TRUE(generator.seekTo(target)) << target;
+        float expected = (target + 999) / 1000;
+        EXPECT_EQ(expected, generator.nextEvent().value.floatValues[0]) << target;
+        EXPECT_EQ(expected + 1, generator.nextEvent().value.floatValues[0]) << target;
+    }
+
+    ASSERT_TRUE(generator.seekTo(500000));
+    EXPECT_FALSE(generator.seekTo(1999001));
+    EXPECT_EQ(500.0f, generator.nextEvent().value.floatValues[0]);
+}
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/RecordedValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+using android::base::TemporaryFile;
+
+constexpr int32_t kSpeedProp = static_cast<int32_t>(VehicleProperty::PERF_VEHICLE_SPEED);
+
+VehiclePropValue startReplayRequest(const char* path, int32_t iterations) {
+    VehiclePropValue request;
+    request.value.int32Values = hidl_vec<int32_t>{4 /* StartReplay */, iterations};
+    request.value.stringValue = path;
+    return request;
+}
+
+TEST(RecordedValueGeneratorTest, replaysRecordingWithOriginalTiming) {
+    TemporaryFile file;
+    VehiclePropValuePool pool;
+    VehiclePropValueRecorder recorder;
+    ASSERT_TRUE(recorder.start(file.path));
+    const int64_t timestamps[] = {1000000, 2000000, 4000000};
+    for (int64_t timestamp : timestamps) {
+        std::vector<VehiclePropValueRecorder::VehiclePropValuePtr> batch;
+        batch.push_back(pool.obtainFloat(timestamp / 1000000));
+        batch.back()->prop = kSpeedProp;
+        batch.back()->areaId = 0;
+        batch.back()->status = VehiclePropertyStatus::AVAILABLE;
+        batch.back()->timestamp = timestamp;
+        recorder.record(batch);
+    }
+    recorder.stop();
+
+    RecordedValueGenerator generator(startReplayRequest(file.path, 2));
+    std::vector<VehiclePropValue> events;
+    while (generator.hasNext()) {
+        events.push_back(generator.nextEvent());
+    }
+
+    ASSERT_EQ(6u, events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_EQ(kSpeedProp, events[i].prop);
+        EXPECT_EQ(timestamps[i % 3] / 1000000, events[i].value.floatValues[0]);
+    }
+    // Each event is scheduled relative to the time the previous one was produced.
+    EXPECT_GE(events[1].timestamp - events[0].timestamp, 1000000);
+}
+
+TEST(RecordedValueGeneratorTest, missingRecording) {
+    RecordedValueGenerator generator(startReplayRequest("/does/not/exist", -1));
+    EXPECT_FALSE(generator.hasNext());
+}
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
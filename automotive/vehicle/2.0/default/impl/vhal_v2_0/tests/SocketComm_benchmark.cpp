@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/SocketComm.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+/** Acknowledges every message, so only the transport and protobuf costs are measured. */
+class AckProcessor : public MessageProcessor {
+public:
+    void processMessage(vhal_proto::EmulatorMessage const& rxMsg,
+                        vhal_proto::EmulatorMessage& respMsg) override {
+        benchmark::DoNotOptimize(rxMsg.value_size());
+        respMsg.set_msg_type(vhal_proto::SET_PROPERTY_RESP);
+        respMsg.set_status(vhal_proto::RESULT_OK);
+    }
+};
+
+/**
+ * A client replays a drive over a local socket: every iteration sends a SET_PROPERTY_CMD with
+ * state.range(0) float values and a separate thread reads the responses, as the emulator does.
+ */
+void BM_SetPropertyThroughput(benchmark::State& state) {
+    const int valuesPerMessage = state.range(0);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        state.SkipWithError("socketpair() failed");
+        return;
+    }
+    int clientFd = fds[0];
+    AckProcessor processor;
+    SocketConn conn(&processor, fds[1]);
+    conn.start();
+
+    vhal_proto::EmulatorMessage msg;
+    msg.set_msg_type(vhal_proto::SET_PROPERTY_CMD);
+    for (int i = 0; i < valuesPerMessage; i++) {
+        vhal_proto::VehiclePropValue* value = msg.add_value();
+        value->set_prop(0x11600207 + i);  // PERF_VEHICLE_SPEED-like FLOAT properties.
+        value->set_area_id(0);
+        value->set_timestamp(1000000LL * i);
+        value->add_float_values(42.0f);
+    }
+    std::string data = msg.SerializeAsString();
+    uint32_t msgLen = htonl(data.size());
+    data.insert(0, reinterpret_cast<const char*>(&msgLen), sizeof(msgLen));
+
+    std::atomic<int64_t> responses { 0 };
+    std::thread reader([clientFd, &responses] {
+        std::vector<uint8_t> buffer(64 * 1024);
+        // Responses are a fixed size, count them by bytes.
+        vhal_proto::EmulatorMessage resp;
+        resp.set_msg_type(vhal_proto::SET_PROPERTY_RESP);
+        resp.set_status(vhal_proto::RESULT_OK);
+        const size_t respSize = sizeof(uint32_t) + resp.ByteSizeLong();
+        size_t received = 0;
+        ssize_t numRead;
+        while ((numRead = read(clientFd, buffer.data(), buffer.size())) > 0) {
+            received += numRead;
+            responses = received / respSize;
+        }
+    });
+
+    int64_t sent = 0;
+    for (auto _ : state) {
+        if (write(clientFd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+            state.SkipWithError("write() failed");
+            break;
+        }
+        sent++;
+    }
+    while (responses < sent) {
+        std::this_thread::yield();
+    }
+
+    shutdown(clientFd, SHUT_WR);
+    conn.stop();
+    reader.join();
+    close(clientFd);
+    state.SetItemsProcessed(sent * valuesPerMessage);
+}
+
+// Arg is the number of values per message.
+BENCHMARK(BM_SetPropertyThroughput)->Arg(1)->Arg(10)->Arg(100)->UseRealTime();
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/SocketComm.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+using std::chrono::seconds;
+
+/** Records the property ids of received SET_PROPERTY_CMD messages and acknowledges them. */
+class RecordingProcessor : public MessageProcessor {
+public:
+    void processMessage(vhal_proto::EmulatorMessage const& rxMsg,
+                        vhal_proto::EmulatorMessage& respMsg) override {
+        std::lock_guard<std::mutex> g(mLock);
+        for (const auto& value : rxMsg.value()) {
+            mProps.push_back(value.prop());
+        }
+        respMsg.set_msg_type(vhal_proto::SET_PROPERTY_RESP);
+        respMsg.set_status(vhal_proto::RESULT_OK);
+        mCond.notify_all();
+    }
+
+    std::vector<int32_t> waitForProps(size_t count) {
+        std::unique_lock<std::mutex> g(mLock);
+        mCond.wait_for(g, seconds(5), [this, count] { return mProps.size() >= count; });
+        return mProps;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<int32_t> mProps;
+};
+
+std::vector<uint8_t> frame(const vhal_proto::EmulatorMessage& msg) {
+    std::string data = msg.SerializeAsString();
+    uint32_t msgLen = htonl(data.size());
+    std::vector<uint8_t> buffer(sizeof(msgLen) + data.size());
+    memcpy(buffer.data(), &msgLen, sizeof(msgLen));
+    memcpy(buffer.data() + sizeof(msgLen), data.data(), data.size());
+    return buffer;
+}
+
+vhal_proto::EmulatorMessage makeSetMessage(std::vector<int32_t> props, size_t bytesSize = 0) {
+    vhal_proto::EmulatorMessage msg;
+    msg.set_msg_type(vhal_proto::SET_PROPERTY_CMD);
+    for (int32_t prop : props) {
+        vhal_proto::VehiclePropValue* value = msg.add_value();
+        value->set_prop(prop);
+        if (bytesSize > 0) {
+            value->set_bytes_value(std::string(bytesSize, 'x'));
+        }
+    }
+    return msg;
+}
+
+class SocketConnTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        mClientFd = fds[0];
+        mConn = std::make_unique<SocketConn>(&mProcessor, fds[1]);
+        mConn->start();
+    }
+
+    void TearDown() override {
+        mConn->stop();
+        close(mClientFd);
+    }
+
+    void send(const std::vector<uint8_t>& data) {
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), write(mClientFd, data.data(), data.size()));
+    }
+
+    // Reads one framed response.
+    vhal_proto::EmulatorMessage receive() {
+        uint32_t msgLen;
+        EXPECT_EQ(static_cast<ssize_t>(sizeof(msgLen)),
+                  recv(mClientFd, &msgLen, sizeof(msgLen), MSG_WAITALL));
+        std::string data(ntohl(msgLen), '\0');
+        EXPECT_EQ(static_cast<ssize_t>(data.size()),
+                  recv(mClientFd, &data[0], data.size(), MSG_WAITALL));
+        vhal_proto::EmulatorMessage msg;
+        EXPECT_TRUE(msg.ParseFromString(data));
+        return msg;
+    }
+
+    RecordingProcessor mProcessor;
+    std::unique_ptr<SocketConn> mConn;
+    int mClientFd;
+};
+
+TEST_F(SocketConnTest, backToBackMessages) {
+    std::vector<uint8_t> data;
+    for (int32_t prop = 1; prop <= 3; prop++) {
+        auto msg = frame(makeSetMessage({prop}));
+        data.insert(data.end(), msg.begin(), msg.end());
+    }
+    send(data);
+
+    ASSERT_EQ(std::vector<int32_t>({1, 2, 3}), mProcessor.waitForProps(3));
+    for (int i = 0; i < 3; i++) {
+        auto resp = receive();
+        ASSERT_EQ(vhal_proto::SET_PROPERTY_RESP, resp.msg_type());
+        ASSERT_EQ(vhal_proto::RESULT_OK, resp.status());
+    }
+}
+
+TEST_F(SocketConnTest, messageSplitAcrossWrites) {
+    auto data = frame(makeSetMessage({1, 2}));
+    // The header is split as well.
+    send(std::vector<uint8_t>(data.begin(), data.begin() + 2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    send(std::vector<uint8_t>(data.begin() + 2, data.end()));
+
+    ASSERT_EQ(std::vector<int32_t>({1, 2}), mProcessor.waitForProps(2));
+    ASSERT_EQ(vhal_proto::SET_PROPERTY_RESP, receive().msg_type());
+}
+
+TEST_F(SocketConnTest, messageLargerThanReceiveBuffer) {
+    auto data = frame(makeSetMessage({1, 2, 3}, 40 * 1024));
+    auto next = frame(makeSetMessage({4}));
+    data.insert(data.end(), next.begin(), next.end());
+    std::thread writer([this, &data] { send(data); });
+
+    ASSERT_EQ(std::vector<int32_t>({1, 2, 3, 4}), mProcessor.waitForProps(4));
+    writer.join();
+    receive();
+    receive();
+}
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
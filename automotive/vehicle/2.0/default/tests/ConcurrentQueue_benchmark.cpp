@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/ConcurrentQueue.h"
+#include "vhal_v2_0/RingBufferQueue.h"
+
+namespace android {
+
+namespace {
+
+/** Stand-in for a recyclable VehiclePropValue pointer: a movable, heap-owning item. */
+using Item = std::unique_ptr<int64_t>;
+
+constexpr size_t kRingCapacity = 4096;
+constexpr size_t kMaxBatchSize = 100;
+
+template <typename Queue>
+Queue* createQueue();
+
+template <>
+ConcurrentQueue<Item>* createQueue<ConcurrentQueue<Item>>() {
+    return new ConcurrentQueue<Item>();
+}
+
+template <>
+RingBufferQueue<Item>* createQueue<RingBufferQueue<Item>>() {
+    return new RingBufferQueue<Item>(kRingCapacity,
+                                     RingBufferQueue<Item>::OverflowPolicy::COALESCE_BY_KEY,
+                                     [](const Item& item) { return *item % 512; });
+}
+
+/**
+ * Every benchmark thread is a producer pushing items as fast as it can, a BatchingConsumer drains
+ * the queue on its own thread the same way VehicleHalManager does.
+ */
+template <typename Queue>
+class QueueFixture {
+public:
+    static void setUp() {
+        sQueue = createQueue<Queue>();
+        sConsumed = 0;
+        sConsumer = new BatchingConsumer<Item, Queue>();
+        sConsumer->runWithDeadlines(sQueue, kMaxBatchSize, [](const std::vector<Item>& items) {
+            sConsumed += items.size();
+        });
+    }
+
+    static void tearDown() {
+        sConsumer->requestStop();
+        sQueue->deactivate();
+        sConsumer->waitStopped();
+        delete sConsumer;
+        delete sQueue;
+    }
+
+    static Queue* sQueue;
+    static BatchingConsumer<Item, Queue>* sConsumer;
+    static std::atomic<uint64_t> sConsumed;
+};
+
+template <typename Queue>
+Queue* QueueFixture<Queue>::sQueue = nullptr;
+template <typename Queue>
+BatchingConsumer<Item, Queue>* QueueFixture<Queue>::sConsumer = nullptr;
+template <typename Queue>
+std::atomic<uint64_t> QueueFixture<Queue>::sConsumed {0};
+
+template <typename Queue>
+void BM_Push(benchmark::State& state) {
+    using Fixture = QueueFixture<Queue>;
+    if (state.thread_index == 0) Fixture::setUp();
+
+    // Mimics continuous properties: the flush deadline is a batching window ahead.
+    auto budget = std::chrono::milliseconds(state.range(0));
+    int64_t i = state.thread_index;
+    for (auto _ : state) {
+        Fixture::sQueue->push(std::make_unique<int64_t>(i++), Queue::Clock::now() + budget);
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) {
+        state.counters["consumed"] = static_cast<double>(Fixture::sConsumed);
+        Fixture::tearDown();
+    }
+}
+
+// Arg is the latency budget in milliseconds, 0 flushes every item as soon as it is pushed.
+BENCHMARK_TEMPLATE(BM_Push, ConcurrentQueue<Item>)->Arg(0)->Arg(10)->ThreadRange(1, 8)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Push, RingBufferQueue<Item>)->Arg(0)->Arg(10)->ThreadRange(1, 8)
+        ->UseRealTime();
+
+}  // namespace
+
+}  // namespace android
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/ConcurrentQueue.h"
+
+namespace android {
+
+namespace {
+
+using std::chrono::milliseconds;
+
+using Clock = ConcurrentQueue<int>::Clock;
+
+class BatchingConsumerTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        consumer.requestStop();
+        queue.deactivate();
+        consumer.waitStopped();
+    }
+
+    void onBatch(const std::vector<int>& batch) {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            batches.push_back(batch);
+        }
+        cond.notify_all();
+    }
+
+    bool waitForBatches(size_t count, milliseconds timeout) {
+        std::unique_lock<std::mutex> g(lock);
+        return cond.wait_for(g, timeout, [this, count] { return batches.size() >= count; });
+    }
+
+    void startWithDeadlines(size_t maxBatchSize) {
+        consumer.runWithDeadlines(&queue, maxBatchSize,
+                                  std::bind(&BatchingConsumerTest::onBatch, this,
+                                            std::placeholders::_1));
+    }
+
+    void startWithInterval(milliseconds interval) {
+        consumer.run(&queue, interval,
+                     std::bind(&BatchingConsumerTest::onBatch, this, std::placeholders::_1));
+    }
+
+    ConcurrentQueue<int> queue;
+    BatchingConsumer<int> consumer;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::vector<int>> batches;
+};
+
+TEST_F(BatchingConsumerTest, itemWithoutDeadlineIsDeliveredImmediately) {
+    startWithDeadlines(100);
+
+    auto start = Clock::now();
+    queue.push(1);
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    ASSERT_LT(Clock::now() - start, milliseconds(50));
+    ASSERT_EQ(std::vector<int>({1}), batches[0]);
+}
+
+TEST_F(BatchingConsumerTest, itemsAreBatchedUntilDeadline) {
+    startWithDeadlines(100);
+
+    auto start = Clock::now();
+    queue.push(1, start + milliseconds(100));
+    queue.push(2, start + milliseconds(200));
+    queue.push(3, start + milliseconds(300));
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    ASSERT_GE(Clock::now() - start, milliseconds(100));
+    ASSERT_EQ(std::vector<int>({1, 2, 3}), batches[0]);
+}
+
+TEST_F(BatchingConsumerTest, earlierDeadlineFlushesQueuedItems) {
+    startWithDeadlines(100);
+
+    auto start = Clock::now();
+    queue.push(1, start + milliseconds(10000));
+    queue.push(2);
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    ASSERT_LT(Clock::now() - start, milliseconds(1000));
+    ASSERT_EQ(std::vector<int>({1, 2}), batches[0]);
+}
+
+TEST_F(BatchingConsumerTest, fullBatchIsDeliveredBeforeDeadline) {
+    startWithDeadlines(3);
+
+    auto deadline = Clock::now() + milliseconds(10000);
+    for (int i = 0; i < 3; i++) {
+        queue.push(int(i), deadline);
+    }
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    ASSERT_EQ(3u, batches[0].size());
+}
+
+TEST_F(BatchingConsumerTest, stats) {
+    startWithDeadlines(100);
+
+    queue.push(1);
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    queue.push(2, Clock::now() + milliseconds(20));
+    queue.push(3, Clock::now() + milliseconds(20));
+    ASSERT_TRUE(waitForBatches(2, milliseconds(1000)));
+
+    auto stats = consumer.getStats();
+    ASSERT_EQ(2u, stats.batches);
+    ASSERT_EQ(3u, stats.items);
+    ASSERT_EQ(2u, stats.maxBatchSize);
+    ASSERT_GE(stats.maxQueueingDelay, milliseconds(20));
+    ASSERT_GE(stats.totalQueueingDelay, stats.maxQueueingDelay);
+}
+
+TEST_F(BatchingConsumerTest, fixedInterval) {
+    startWithInterval(milliseconds(50));
+
+    auto start = Clock::now();
+    queue.push(1);
+    ASSERT_TRUE(waitForBatches(1, milliseconds(1000)));
+    ASSERT_GE(Clock::now() - start, milliseconds(50));
+}
+
+}  // namespace
+
+}  // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+
+#include <atomic>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/RecurrentTimer.h"
+
+namespace {
+
+using std::chrono::milliseconds;
+
+int64_t threadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Continuous properties are typically sampled at 10 to 100Hz.
+milliseconds intervalOf(int32_t cookie) {
+    return milliseconds(10 + cookie % 10 * 10);
+}
+
+/**
+ * Runs a timer with state.range(0) cookies and reports how much CPU the timer thread uses, which
+ * is what limits the number of continuous properties an emulated HAL can serve.
+ */
+void BM_TimerThreadCpu(benchmark::State& state) {
+    std::atomic<int64_t> timerCpuNs { 0 };
+    std::atomic<int64_t> events { 0 };
+    RecurrentTimer timer([&timerCpuNs, &events](const std::vector<int32_t>& cookies) {
+        events += cookies.size();
+        timerCpuNs = threadCpuTimeNs();  // Called on the timer thread.
+    });
+
+    for (int32_t cookie = 0; cookie < state.range(0); cookie++) {
+        timer.registerRecurrentEvent(intervalOf(cookie), cookie);
+    }
+    std::this_thread::sleep_for(milliseconds(100));
+
+    int64_t startCpuNs = timerCpuNs;
+    int64_t startEvents = events;
+    auto start = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        std::this_thread::sleep_for(milliseconds(100));
+    }
+    auto wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    state.counters["timer_cpu_%"] = 100.0 * (timerCpuNs - startCpuNs) / wallNs;
+    state.counters["events/s"] = 1e9 * (events - startEvents) / wallNs;
+    auto stats = timer.getStats();
+    state.counters["avg_drift_us"] =
+            stats.events > 0 ? stats.totalDrift.count() / 1000.0 / stats.events : 0;
+    state.counters["max_drift_us"] = stats.maxDrift.count() / 1000.0;
+}
+
+BENCHMARK(BM_TimerThreadCpu)->Arg(100)->Arg(1000)->Arg(5000)->Iterations(10)
+        ->Unit(benchmark::kMillisecond);
+
+/** Cost of re-registering a cookie while state.range(0) other cookies are registered. */
+void BM_Register(benchmark::State& state) {
+    RecurrentTimer timer([](const std::vector<int32_t>& /* cookies */) {});
+    for (int32_t cookie = 0; cookie < state.range(0); cookie++) {
+        timer.registerRecurrentEvent(intervalOf(cookie), cookie);
+    }
+
+    int32_t cookie = 0;
+    for (auto _ : state) {
+        timer.registerRecurrentEvent(intervalOf(cookie), cookie);
+        cookie = (cookie + 1) % state.range(0);
+    }
+}
+
+BENCHMARK(BM_Register)->Arg(100)->Arg(5000);
+
+}  // namespace
@@ -70,4 +70,76 @@ TEST(RecurrentTimerTest, multipleIntervals) {
     ASSERT_EQ_WITH_TOLERANCE(20, counter5ms.load(), 5);
 }
 
+TEST(RecurrentTimerTest, unregister) {
+    std::atomic<int64_t> counter { 0L };
+    RecurrentTimer timer([&counter](const std::vector<int32_t>& cookies) {
+        counter += cookies.size();
+    });
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    std::this_thread::sleep_for(milliseconds(20));
+    timer.unregisterRecurrentEvent(0xdead);
+    // Let an in-flight callback finish.
+    std::this_thread::sleep_for(milliseconds(5));
+    int64_t counterAfterUnregister = counter.load();
+    ASSERT_GT(counterAfterUnregister, 0);
+
+    std::this_thread::sleep_for(milliseconds(50));
+    ASSERT_EQ(counterAfterUnregister, counter.load());
+}
+
+TEST(RecurrentTimerTest, reRegisterOverridesInterval) {
+    std::atomic<int64_t> counter { 0L };
+    RecurrentTimer timer([&counter](const std::vector<int32_t>& cookies) {
+        counter += cookies.size();
+    });
+
+    timer.registerRecurrentEvent(milliseconds(50), 0xdead);
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(100, counter.load(), 20);
+}
+
+TEST(RecurrentTimerTest, manyCookies) {
+    constexpr int32_t kNumCookies = 5000;
+    std::vector<std::atomic<int32_t>> counters(kNumCookies);
+    RecurrentTimer timer([&counters](const std::vector<int32_t>& cookies) {
+        for (int32_t cookie : cookies) {
+            counters[cookie]++;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t cookie = 0; cookie < kNumCookies; cookie++) {
+        timer.registerRecurrentEvent(milliseconds(10 + cookie % 2 * 10), cookie);
+    }
+    std::this_thread::sleep_for(milliseconds(200));
+    for (int32_t cookie = 0; cookie < kNumCookies; cookie++) {
+        timer.unregisterRecurrentEvent(cookie);
+    }
+    // Registering thousands of cookies takes a while on slow devices, count it in.
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (int32_t cookie = 0; cookie < kNumCookies; cookie++) {
+        auto interval = milliseconds(10 + cookie % 2 * 10);
+        ASSERT_LE(200 / interval.count() - 2, counters[cookie].load());
+        ASSERT_GE(elapsed / interval + 2, counters[cookie].load());
+    }
+}
+
+TEST(RecurrentTimerTest, stats) {
+    RecurrentTimer timer([](const std::vector<int32_t>& /* cookies */) {});
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    timer.registerRecurrentEvent(milliseconds(2), 0xbeef);
+    std::this_thread::sleep_for(milliseconds(100));
+
+    auto stats = timer.getStats();
+    // Every other wake-up delivers both events.
+    ASSERT_EQ_WITH_TOLERANCE(100u, stats.wakeUps, 20u);
+    ASSERT_EQ_WITH_TOLERANCE(150u, stats.events, 30u);
+    ASSERT_GE(stats.totalDrift, stats.maxDrift);
+    ASSERT_LT(stats.maxDrift, milliseconds(100));
+}
+
 }  // anonymous namespace
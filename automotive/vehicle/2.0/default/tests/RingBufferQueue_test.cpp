@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/RingBufferQueue.h"
+
+namespace android {
+
+namespace {
+
+using std::chrono::milliseconds;
+
+using IntQueue = RingBufferQueue<int>;
+using Clock = IntQueue::Clock;
+
+// Items are (key, value) pairs packed into an int: key in the upper 16 bits.
+int makeItem(int key, int value) {
+    return (key << 16) | value;
+}
+
+int64_t keyOf(const int& item) {
+    return item >> 16;
+}
+
+TEST(RingBufferQueueTest, fifo) {
+    IntQueue queue(4);
+    ASSERT_EQ(4u, queue.capacity());
+    for (int i = 0; i < 3; i++) {
+        queue.push(int(i));
+    }
+    ASSERT_EQ(3u, queue.size());
+    ASSERT_EQ(std::vector<int>({0, 1, 2}), queue.flush());
+    ASSERT_EQ(0u, queue.size());
+}
+
+TEST(RingBufferQueueTest, capacityIsRoundedUp) {
+    IntQueue queue(5);
+    ASSERT_EQ(8u, queue.capacity());
+}
+
+TEST(RingBufferQueueTest, dropOldest) {
+    IntQueue queue(4, IntQueue::OverflowPolicy::DROP_OLDEST);
+    for (int i = 0; i < 6; i++) {
+        queue.push(int(i));
+    }
+    ASSERT_EQ(std::vector<int>({2, 3, 4, 5}), queue.flush());
+    ASSERT_EQ(2u, queue.getDroppedCount());
+}
+
+TEST(RingBufferQueueTest, coalesceByKey) {
+    IntQueue queue(2, IntQueue::OverflowPolicy::COALESCE_BY_KEY, keyOf);
+    queue.push(makeItem(1, 0));
+    queue.push(makeItem(2, 0));
+    // Ring is full, the rest goes to the overflow table and is coalesced by key.
+    queue.push(makeItem(1, 1));
+    queue.push(makeItem(3, 1));
+    queue.push(makeItem(1, 2));
+
+    ASSERT_EQ(std::vector<int>({makeItem(1, 0), makeItem(2, 0), makeItem(1, 2), makeItem(3, 1)}),
+              queue.flush());
+    ASSERT_EQ(1u, queue.getCoalescedCount());
+    ASSERT_EQ(0u, queue.getDroppedCount());
+
+    // Once the overflow table is drained the ring is used again.
+    queue.push(makeItem(1, 3));
+    ASSERT_EQ(std::vector<int>({makeItem(1, 3)}), queue.flush());
+}
+
+TEST(RingBufferQueueTest, flushToReusesVector) {
+    IntQueue queue(4);
+    std::vector<int> items;
+    items.reserve(4);
+    const int* data = items.data();
+
+    queue.push(1);
+    queue.flushTo(&items);
+    ASSERT_EQ(std::vector<int>({1}), items);
+    items.clear();
+    queue.push(2);
+    queue.flushTo(&items);
+    ASSERT_EQ(std::vector<int>({2}), items);
+    ASSERT_EQ(data, items.data());
+}
+
+TEST(RingBufferQueueTest, multipleProducers) {
+    constexpr int kProducers = 4;
+    constexpr int kItemsPerProducer = 20000;
+    IntQueue queue(64);
+
+    // The last producer to finish pushes an end marker, which is queued after all other items.
+    std::atomic<int> producersDone { 0 };
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++) {
+        producers.emplace_back([&queue, &producersDone, p] {
+            for (int i = 0; i < kItemsPerProducer; i++) {
+                queue.push(makeItem(p, i % 0x8000));
+            }
+            if (++producersDone == kProducers) {
+                queue.push(makeItem(kProducers, 0));
+            }
+        });
+    }
+
+    uint64_t received = 0;
+    bool done = false;
+    std::vector<int> lastValue(kProducers, -1);
+    std::vector<int> items;
+    while (!done) {
+        queue.waitForBatch(1);
+        items.clear();
+        queue.flushTo(&items);
+        for (int item : items) {
+            int producer = keyOf(item);
+            if (producer == kProducers) {
+                done = true;
+                continue;
+            }
+            int value = item & 0xffff;
+            // Items of one producer are never reordered, even when some are dropped.
+            if (value != 0) {
+                ASSERT_LT(lastValue[producer], value);
+            }
+            lastValue[producer] = value;
+            received++;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    ASSERT_EQ(0u, queue.size());
+    ASSERT_EQ(uint64_t(kProducers * kItemsPerProducer), received + queue.getDroppedCount());
+}
+
+TEST(RingBufferQueueTest, waitForBatchHonorsDeadline) {
+    IntQueue queue(16);
+    auto start = Clock::now();
+    queue.push(1, start + milliseconds(50));
+    queue.waitForBatch(10);
+    ASSERT_GE(Clock::now() - start, milliseconds(50));
+    ASSERT_EQ(1u, queue.flush().size());
+}
+
+TEST(RingBufferQueueTest, producerWakesUpConsumer) {
+    IntQueue queue(16);
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.push(1);
+    });
+    queue.waitForItems();
+    ASSERT_EQ(1u, queue.flush().size());
+    producer.join();
+}
+
+TEST(RingBufferQueueTest, deactivateWakesUpConsumer) {
+    IntQueue queue(16);
+    std::thread deactivator([&queue] {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.deactivate();
+    });
+    queue.waitForItems();
+    deactivator.join();
+    queue.push(1);
+    ASSERT_EQ(0u, queue.flush().size());
+}
+
+TEST(RingBufferQueueTest, batchingConsumer) {
+    IntQueue queue(16);
+    BatchingConsumer<int, IntQueue> consumer;
+    std::atomic<int> received { 0 };
+    consumer.runWithDeadlines(&queue, 8, [&received](const std::vector<int>& items) {
+        received += items.size();
+    });
+
+    for (int i = 0; i < 100; i++) {
+        queue.push(int(i), Clock::now() + milliseconds(5));
+    }
+    // The producer is faster than the consumer, so some items may have been dropped.
+    for (int i = 0; i < 100 && received + queue.getDroppedCount() < 100; i++) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+
+    consumer.requestStop();
+    queue.deactivate();
+    consumer.waitStopped();
+
+    ASSERT_EQ(100u, received + queue.getDroppedCount());
+    ASSERT_GT(received, 0);
+}
+
+}  // namespace
+
+}  // namespace android
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/SubscriptionManager.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kNumProperties = 200;
+constexpr size_t kBatchSize = 100;
+
+int32_t propAt(int32_t index) {
+    return (0x1000 + index) | VehiclePropertyGroup::VENDOR | VehiclePropertyType::FLOAT
+           | VehicleArea::GLOBAL;
+}
+
+class NoopCallback : public IVehicleCallback {
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& /* values */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySet(const VehiclePropValue& /* value */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySetError(StatusCode /* errorCode */,
+                                    int32_t /* propId */,
+                                    int32_t /* areaId */) override {
+        return Return<void>();
+    }
+};
+
+/**
+ * Distributes batches of events to state.range(0) clients that are all subscribed to
+ * kNumProperties properties. With state.range(1) set, every other client asked for a tenth of the
+ * event rate, so its events are decimated.
+ */
+void BM_DistributeValuesToClients(benchmark::State& state) {
+    SubscriptionManager manager([](int32_t /* propId */) {});
+    std::vector<sp<IVehicleCallback>> callbacks;
+    for (int64_t client = 0; client < state.range(0); client++) {
+        hidl_vec<SubscribeOptions> options;
+        options.resize(kNumProperties);
+        bool decimated = state.range(1) && client % 2 == 1;
+        for (int32_t i = 0; i < kNumProperties; i++) {
+            options[i] = SubscribeOptions {
+                .propId = propAt(i),
+                .sampleRate = decimated ? 10.0f : 100.0f,
+                .flags = SubscribeFlags::EVENTS_FROM_CAR,
+            };
+        }
+        callbacks.push_back(new NoopCallback());
+        std::list<SubscribeOptions> updatedOptions;
+        manager.addOrUpdateSubscription(client + 1, callbacks.back(), options, &updatedOptions);
+    }
+
+    VehiclePropValuePool valuePool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (size_t i = 0; i < kBatchSize; i++) {
+        auto value = valuePool.obtainFloat(0.0f);
+        value->prop = propAt(i * 7 % kNumProperties);
+        values.push_back(std::move(value));
+    }
+
+    // Every batch is 10ms after the previous one, as if properties were updated at 100Hz.
+    int64_t timestamp = 0;
+    std::vector<HalClientValues> clientValues;
+    for (auto _ : state) {
+        timestamp += 10000000;
+        for (auto& value : values) {
+            value->timestamp = timestamp;
+        }
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+        benchmark::DoNotOptimize(clientValues.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// Args are the number of clients and whether half of them get decimated events.
+BENCHMARK(BM_DistributeValuesToClients)
+        ->Args({1, 0})->Args({4, 0})->Args({16, 0})
+        ->Args({4, 1})->Args({16, 1});
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
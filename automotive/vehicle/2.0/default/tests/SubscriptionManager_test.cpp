@@ -72,6 +72,28 @@ public:
         return callbacks;
     }
 
+    std::vector<recyclable_ptr<VehiclePropValue>> makeValues(
+            std::initializer_list<std::pair<int32_t, int64_t>> propsAndTimestamps) {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        for (const auto& propAndTimestamp : propsAndTimestamps) {
+            auto value = valuePool.obtainInt32(0);
+            value->prop = propAndTimestamp.first;
+            value->timestamp = propAndTimestamp.second;
+            values.push_back(std::move(value));
+        }
+        return values;
+    }
+
+    static size_t countValuesFor(const std::vector<HalClientValues>& clientValues,
+                                 const sp<IVehicleCallback>& callback) {
+        for (const auto& cv : clientValues) {
+            if (cv.client != nullptr && cv.client->getCallback() == callback) {
+                return cv.values.size();
+            }
+        }
+        return 0;
+    }
+
     std::list<sp<HalClient>> clientsToProp1() {
         return manager.getSubscribedClients(PROP1, SubscribeFlags::EVENTS_FROM_CAR);
     }
@@ -95,6 +117,8 @@ public:
         lastUnsubscribedProperty = -1;
     }
 
+    VehiclePropValuePool valuePool;
+
 private:
     int lastUnsubscribedProperty;
 };
@@ -188,6 +212,90 @@ TEST_F(SubscriptionManagerTest, unsubscribe) {
     assertLastUnsubscribedProperty(PROP1);
 }
 
+TEST_F(SubscriptionManagerTest, distributeValuesToClients) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp1, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(2, cb2, subscrToProp1and2, &updatedOptions));
+
+    std::vector<HalClientValues> clientValues;
+    manager.distributeValuesToClients(makeValues({{PROP1, 1}, {PROP2, 1}, {PROP1, 2}}),
+                                      SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+    ASSERT_EQ(2u, countValuesFor(clientValues, cb1));
+    ASSERT_EQ(3u, countValuesFor(clientValues, cb2));
+    const VehiclePropValue* const* cb2Buffer = nullptr;
+    for (const auto& cv : clientValues) {
+        if (cv.client->getCallback() == cb2) {
+            cb2Buffer = cv.values.data();
+        }
+    }
+
+    // Buffers are reused and cleared between batches.
+    manager.distributeValuesToClients(makeValues({{PROP2, 3}}), SubscribeFlags::EVENTS_FROM_CAR,
+                                      &clientValues);
+    ASSERT_EQ(0u, countValuesFor(clientValues, cb1));
+    ASSERT_EQ(1u, countValuesFor(clientValues, cb2));
+    for (const auto& cv : clientValues) {
+        if (cv.client->getCallback() == cb2) {
+            ASSERT_EQ(cb2Buffer, cv.values.data());
+        }
+    }
+
+    manager.distributeValuesToClients(makeValues({{PROP1, 4}}),
+                                      SubscribeFlags::EVENTS_FROM_ANDROID, &clientValues);
+    ASSERT_EQ(0u, countValuesFor(clientValues, cb1));
+    ASSERT_EQ(0u, countValuesFor(clientValues, cb2));
+}
+
+TEST_F(SubscriptionManagerTest, sampleRateDecimation) {
+    constexpr int64_t kMs = 1000000;
+    hidl_vec<SubscribeOptions> fast = {SubscribeOptions{
+            .propId = PROP1, .sampleRate = 100, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    hidl_vec<SubscribeOptions> slow = {SubscribeOptions{
+            .propId = PROP1, .sampleRate = 10, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(1, cb1, fast, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(2, cb2, slow, &updatedOptions));
+
+    // One second of 100Hz events with some jitter.
+    size_t cb1Events = 0;
+    size_t cb2Events = 0;
+    std::vector<HalClientValues> clientValues;
+    for (int64_t i = 1; i <= 100; i++) {
+        int64_t jitter = (i % 3 - 1) * kMs / 2;
+        manager.distributeValuesToClients(makeValues({{PROP1, i * 10 * kMs + jitter}}),
+                                          SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+        cb1Events += countValuesFor(clientValues, cb1);
+        cb2Events += countValuesFor(clientValues, cb2);
+    }
+    ASSERT_EQ(100u, cb1Events);
+    ASSERT_EQ(10u, cb2Events);
+}
+
+TEST_F(SubscriptionManagerTest, resubscribeAfterUnsubscribe) {
+    hidl_vec<SubscribeOptions> fast = {SubscribeOptions{
+            .propId = PROP1, .sampleRate = 100, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(1, cb1, fast, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp2, &updatedOptions));
+    manager.unsubscribe(1, PROP1);
+    assertLastUnsubscribedProperty(PROP1);
+    ASSERT_TRUE(clientsToProp1().empty());
+
+    // Previous sample rate must not be merged into the new subscription.
+    hidl_vec<SubscribeOptions> slow = {SubscribeOptions{
+            .propId = PROP1, .sampleRate = 1, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(1, cb1, slow, &updatedOptions));
+    ASSERT_ALL_EXISTS({cb1}, extractCallbacks(clientsToProp1()));
+
+    std::vector<HalClientValues> clientValues;
+    manager.distributeValuesToClients(makeValues({{PROP1, 1000}, {PROP1, 20000000}}),
+                                      SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+    ASSERT_EQ(1u, countValuesFor(clientValues, cb1));
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
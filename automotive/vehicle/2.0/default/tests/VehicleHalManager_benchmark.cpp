@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/VehicleHalManager.h"
+#include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
+
+// Car service reads every property and area once while booting.
+constexpr int32_t kNumProperties = 200;
+constexpr int32_t kNumAreas = 5;
+constexpr int32_t kFirstProp =
+        0x0100 | VehiclePropertyGroup::VENDOR | VehiclePropertyType::INT32 | VehicleArea::SEAT;
+
+/** Serves all values from a VehiclePropertyStore, like EmulatedVehicleHal. */
+class StoreVehicleHal : public VehicleHal {
+public:
+    StoreVehicleHal() {
+        for (int32_t i = 0; i < kNumProperties; i++) {
+            VehiclePropConfig config {};
+            config.prop = kFirstProp + i;
+            config.access = VehiclePropertyAccess::READ_WRITE;
+            config.changeMode = VehiclePropertyChangeMode::ON_CHANGE;
+            config.areaConfigs.resize(kNumAreas);
+            for (int32_t area = 0; area < kNumAreas; area++) {
+                config.areaConfigs[area].areaId = 1 << area;
+            }
+            mStore.registerProperty(config);
+            mConfigs.push_back(config);
+
+            VehiclePropValue value {};
+            value.prop = config.prop;
+            value.value.int32Values = hidl_vec<int32_t> { i };
+            for (int32_t area = 0; area < kNumAreas; area++) {
+                value.areaId = 1 << area;
+                mStore.writeValue(value, true);
+            }
+        }
+    }
+
+    std::vector<VehiclePropConfig> listProperties() override { return mConfigs; }
+
+    VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
+                            StatusCode* outStatus) override {
+        auto value = mStore.readValueOrNull(requestedPropValue);
+        *outStatus = value != nullptr ? StatusCode::OK : StatusCode::INVALID_ARG;
+        return value != nullptr ? getValuePool()->obtain(*value) : nullptr;
+    }
+
+    void getBatch(const std::vector<const VehiclePropValue*>& requests,
+                  std::vector<VehiclePropValuePtr>* outValues,
+                  std::vector<StatusCode>* outStatuses) override {
+        *outValues = mStore.readValuesOrNull(requests, getValuePool());
+        outStatuses->resize(requests.size());
+        for (size_t i = 0; i < outValues->size(); i++) {
+            (*outStatuses)[i] = (*outValues)[i] != nullptr ? StatusCode::OK
+                                                           : StatusCode::INVALID_ARG;
+        }
+    }
+
+    StatusCode set(const VehiclePropValue& value) override {
+        return mStore.writeValue(value, false) ? StatusCode::OK : StatusCode::INVALID_ARG;
+    }
+    StatusCode subscribe(int32_t, float) override { return StatusCode::OK; }
+    StatusCode unsubscribe(int32_t) override { return StatusCode::OK; }
+
+protected:
+    VehiclePropertyStore mStore;
+    std::vector<VehiclePropConfig> mConfigs;
+};
+
+/** Every get waits for a round trip to the vehicle. */
+class RemoteVehicleHal : public StoreVehicleHal {
+public:
+    static constexpr std::chrono::microseconds kRoundTrip { 100 };
+
+    explicit RemoteVehicleHal(size_t maxConcurrentGets) : mMaxConcurrentGets(maxConcurrentGets) {}
+
+    VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
+                            StatusCode* outStatus) override {
+        std::this_thread::sleep_for(kRoundTrip);
+        return StoreVehicleHal::get(requestedPropValue, outStatus);
+    }
+
+    void getBatch(const std::vector<const VehiclePropValue*>& requests,
+                  std::vector<VehiclePropValuePtr>* outValues,
+                  std::vector<StatusCode>* outStatuses) override {
+        VehicleHal::getBatch(requests, outValues, outStatuses);
+    }
+
+    size_t getMaxConcurrentGets() const override { return mMaxConcurrentGets; }
+
+private:
+    const size_t mMaxConcurrentGets;
+};
+
+std::vector<VehiclePropValue> makeRequests(int32_t numProperties) {
+    std::vector<VehiclePropValue> requests;
+    for (int32_t i = 0; i < numProperties; i++) {
+        for (int32_t area = 0; area < kNumAreas; area++) {
+            VehiclePropValue request {};
+            request.prop = kFirstProp + i;
+            request.areaId = 1 << area;
+            requests.push_back(request);
+        }
+    }
+    return requests;
+}
+
+void getOneByOne(VehicleHalManager* manager, const std::vector<VehiclePropValue>& requests) {
+    for (const auto& request : requests) {
+        manager->get(request, [](StatusCode status, const VehiclePropValue& value) {
+            benchmark::DoNotOptimize(status);
+            benchmark::DoNotOptimize(value);
+        });
+    }
+}
+
+void getBatched(VehicleHalManager* manager, const std::vector<VehiclePropValue>& requests) {
+    std::vector<VehiclePropValuePtr> values;
+    std::vector<StatusCode> statuses;
+    manager->getBatch(requests, &values, &statuses);
+    benchmark::DoNotOptimize(values);
+}
+
+/** All 1000 boot-time gets served from the store, one HIDL-style get() at a time. */
+void BM_BootGets_OneByOne(benchmark::State& state) {
+    StoreVehicleHal hal;
+    VehicleHalManager manager(&hal);
+    auto requests = makeRequests(kNumProperties);
+    for (auto _ : state) {
+        getOneByOne(&manager, requests);
+    }
+    state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_BootGets_OneByOne);
+
+void BM_BootGets_Batched(benchmark::State& state) {
+    StoreVehicleHal hal;
+    VehicleHalManager manager(&hal);
+    auto requests = makeRequests(kNumProperties);
+    for (auto _ : state) {
+        getBatched(&manager, requests);
+    }
+    state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_BootGets_Batched);
+
+/** 100 gets that each wait for the vehicle; state.range(0) is getMaxConcurrentGets(). */
+void BM_RemoteGets_OneByOne(benchmark::State& state) {
+    RemoteVehicleHal hal(state.range(0));
+    VehicleHalManager manager(&hal);
+    auto requests = makeRequests(100 / kNumAreas);
+    for (auto _ : state) {
+        getOneByOne(&manager, requests);
+    }
+    state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_RemoteGets_OneByOne)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+void BM_RemoteGets_Batched(benchmark::State& state) {
+    RemoteVehicleHal hal(state.range(0));
+    VehicleHalManager manager(&hal);
+    auto requests = makeRequests(100 / kNumAreas);
+    for (auto _ : state) {
+        getBatched(&manager, requests);
+    }
+    state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_RemoteGets_Batched)
+        ->Arg(1)->Arg(4)->Arg(8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
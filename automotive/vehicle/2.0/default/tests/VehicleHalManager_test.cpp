@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
 #include <unordered_map>
 #include <iostream>
+#include <mutex>
 
 #include <android-base/macros.h>
 #include <utils/SystemClock.h>
@@ -140,6 +142,38 @@ private:
     std::unordered_map<int64_t, VehiclePropValue> mValues;
 };
 
+// Gets wait for each other like gets that wait for the vehicle would, see getBatch_Concurrent.
+class ConcurrentGetsVehicleHal : public MockedVehicleHal {
+public:
+    VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
+                            StatusCode* outStatus) override {
+        {
+            std::unique_lock<std::mutex> g(mLock);
+            maxActiveGets = std::max(maxActiveGets, ++mActiveGets);
+            mCond.notify_all();
+            mCond.wait_for(g, std::chrono::seconds(1), [this] { return maxActiveGets > 1; });
+            mActiveGets--;
+        }
+        *outStatus = StatusCode::OK;
+        auto value = getValuePool()->obtainInt32(requestedPropValue.areaId);
+        value->prop = requestedPropValue.prop;
+        value->areaId = requestedPropValue.areaId;
+        return value;
+    }
+
+    size_t getMaxConcurrentGets() const override {
+        return 4;
+    }
+
+public:
+    int maxActiveGets = 0;
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    int mActiveGets = 0;
+};
+
 class VehicleHalManagerTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -437,6 +471,92 @@ TEST_F(VehicleHalManagerTest, set_Retriable) {
     ASSERT_TRUE(actualValue.value.int32Values[0]);
 }
 
+TEST_F(VehicleHalManagerTest, getBatch) {
+    std::vector<VehiclePropValue> requests(5);
+    requests[0].prop = toInt(VehicleProperty::INFO_MAKE);
+    requests[1].prop = toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE);  // Write-only.
+    requests[2].prop = toInt(VehicleProperty::MIRROR_Z_MOVE);  // Unknown.
+    requests[3].prop = kCustomComplexProperty;
+    requests[4].prop = toInt(VehicleProperty::INFO_MAKE);
+
+    std::vector<VehicleHalManager::VehiclePropValuePtr> values;
+    std::vector<StatusCode> statuses;
+    manager->getBatch(requests, &values, &statuses);
+    ASSERT_EQ(5u, values.size());
+    ASSERT_EQ(5u, statuses.size());
+
+    ASSERT_EQ(StatusCode::OK, statuses[0]);
+    ASSERT_STREQ(kCarMake, values[0]->value.stringValue.c_str());
+    ASSERT_EQ(StatusCode::ACCESS_DENIED, statuses[1]);
+    ASSERT_EQ(nullptr, values[1].get());
+    ASSERT_EQ(StatusCode::INVALID_ARG, statuses[2]);
+    ASSERT_EQ(nullptr, values[2].get());
+    ASSERT_EQ(StatusCode::OK, statuses[3]);
+    ASSERT_EQ(kCustomComplexProperty, values[3]->prop);
+    ASSERT_EQ(3u, values[3]->value.bytes.size());
+    ASSERT_EQ(StatusCode::OK, statuses[4]);
+    ASSERT_STREQ(kCarMake, values[4]->value.stringValue.c_str());
+}
+
+TEST_F(VehicleHalManagerTest, setBatch) {
+    const auto PROP = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const auto AREA1 = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const auto AREA2 = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    std::vector<VehiclePropValue> values;
+    for (int32_t area : {AREA1, AREA2}) {
+        auto value = objectPool->obtainInt32(area * 10);
+        value->prop = PROP;
+        value->areaId = area;
+        values.push_back(*value);
+    }
+    auto readOnly = objectPool->obtainString("Other Car");
+    readOnly->prop = toInt(VehicleProperty::INFO_MAKE);
+    readOnly->areaId = 0;
+    values.push_back(*readOnly);
+    values.push_back(values[0]);
+    values.back().prop = toInt(VehicleProperty::MIRROR_Z_MOVE);
+
+    auto statuses = manager->setBatch(values);
+    ASSERT_EQ(4u, statuses.size());
+    ASSERT_EQ(StatusCode::OK, statuses[0]);
+    ASSERT_EQ(StatusCode::OK, statuses[1]);
+    ASSERT_EQ(StatusCode::ACCESS_DENIED, statuses[2]);
+    ASSERT_EQ(StatusCode::INVALID_ARG, statuses[3]);
+
+    for (int32_t area : {AREA1, AREA2}) {
+        invokeGet(PROP, area);
+        ASSERT_EQ(StatusCode::OK, actualStatusCode);
+        ASSERT_EQ(area * 10, actualValue.value.int32Values[0]);
+    }
+    invokeGet(toInt(VehicleProperty::INFO_MAKE), 0);
+    ASSERT_STREQ(kCarMake, actualValue.value.stringValue.c_str());
+}
+
+TEST_F(VehicleHalManagerTest, getBatch_Concurrent) {
+    ConcurrentGetsVehicleHal concurrentHal;
+    VehicleHalManager concurrentManager(&concurrentHal);
+
+    // Large enough to be split across all 4 threads.
+    std::vector<VehiclePropValue> requests(32);
+    for (size_t i = 0; i < requests.size(); i++) {
+        requests[i].prop = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+        requests[i].areaId = i;
+    }
+    std::vector<VehicleHalManager::VehiclePropValuePtr> values;
+    std::vector<StatusCode> statuses;
+    concurrentManager.getBatch(requests, &values, &statuses);
+
+    ASSERT_GT(concurrentHal.maxActiveGets, 1);
+    ASSERT_LE(concurrentHal.maxActiveGets, 4);
+    ASSERT_EQ(32u, values.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        ASSERT_EQ(StatusCode::OK, statuses[i]);
+        ASSERT_EQ(static_cast<int32_t>(i), values[i]->areaId);
+        ASSERT_EQ(static_cast<int32_t>(i), values[i]->value.int32Values[0]);
+    }
+}
+
 TEST(HalClientVectorTest, basic) {
     HalClientVector clients;
     sp<IVehicleCallback> callback1 = new MockedVehicleCallback();
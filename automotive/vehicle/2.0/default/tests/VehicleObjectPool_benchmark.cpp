@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/VehicleObjectPool.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using Mode = VehiclePropValuePool::Mode;
+
+VehiclePropValuePool* getPool(Mode mode) {
+    static VehiclePropValuePool perTypePool(4, Mode::PER_TYPE);
+    static VehiclePropValuePool slabPool(4, Mode::SLAB);
+    return mode == Mode::SLAB ? &slabPool : &perTypePool;
+}
+
+/**
+ * Copies a FLOAT_VEC value of state.range(1) elements into a pooled value and releases it, the
+ * way events are passed from the HAL to VehicleHalManager.
+ */
+void BM_ObtainCopy(benchmark::State& state) {
+    VehiclePropValuePool* pool = getPool(static_cast<Mode>(state.range(0)));
+    VehiclePropValue src;
+    src.prop = toInt(VehicleProperty::INFO_FUEL_CAPACITY);
+    src.value.floatValues.resize(state.range(1));
+
+    for (auto _ : state) {
+        auto value = pool->obtain(src);
+        benchmark::DoNotOptimize(value.get());
+    }
+}
+
+// Args are the pool mode and the vector size.
+BENCHMARK(BM_ObtainCopy)
+        ->Args({static_cast<int>(Mode::PER_TYPE), 1})->Args({static_cast<int>(Mode::SLAB), 1})
+        ->Args({static_cast<int>(Mode::PER_TYPE), 16})->Args({static_cast<int>(Mode::SLAB), 16})
+        ->ThreadRange(1, 4);
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -21,6 +21,7 @@
 #include <utils/SystemClock.h>
 
 #include "vhal_v2_0/VehicleObjectPool.h"
+#include "vhal_v2_0/VehicleUtils.h"
 
 namespace android {
 namespace hardware {
@@ -49,6 +50,8 @@ private:
         stats->Obtained = 0;
         stats->Created = 0;
         stats->Recycled = 0;
+        stats->CacheHits = 0;
+        stats->CacheMisses = 0;
     }
 
 public:
@@ -122,6 +125,88 @@ TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
                                  // Typically it takes about 0.1s on Nexus6P.
 }
 
+TEST_F(VehicleObjectPoolTest, slabRecyclesBySizeClass) {
+    VehiclePropValuePool slabPool(4, VehiclePropValuePool::Mode::SLAB);
+    auto value = slabPool.obtain(VehiclePropertyType::INT32_VEC, 3);
+    value->value.int32Values[2] = 42;
+    void* raw = value.get();
+    value.reset();
+
+    // A FLOAT_VEC of 4 has the same payload size class as an INT32_VEC of 3.
+    value = slabPool.obtain(VehiclePropertyType::FLOAT_VEC, 4);
+    ASSERT_EQ(raw, value.get());
+    ASSERT_EQ(0u, value->value.int32Values.size());
+    ASSERT_EQ(std::vector<float>({0.0f, 0.0f, 0.0f, 0.0f}),
+              std::vector<float>(value->value.floatValues));
+
+    // Vectors too large for PER_TYPE mode are recycled as well.
+    auto bytes = slabPool.obtain(VehiclePropertyType::BYTES,
+                                 VehiclePropValuePool::kMaxSlabPayloadBytes);
+    raw = bytes.get();
+    bytes.reset();
+    ASSERT_EQ(raw, slabPool.obtain(VehiclePropertyType::BYTES, 600).get());
+
+    ASSERT_EQ(4u, stats->Obtained);
+    ASSERT_EQ(stats->Obtained, stats->CacheHits + stats->CacheMisses);
+    ASSERT_GE(stats->CacheHits, 2u);
+    ASSERT_GT(stats->BytesResident, 0u);
+}
+
+TEST_F(VehicleObjectPoolTest, slabDisposesLargePayloads) {
+    VehiclePropValuePool slabPool(4, VehiclePropValuePool::Mode::SLAB);
+    auto value = slabPool.obtain(VehiclePropertyType::INT64_VEC,
+                                 VehiclePropValuePool::kMaxSlabPayloadBytes / sizeof(int64_t) + 1);
+    ASSERT_EQ(VehiclePropValuePool::kMaxSlabPayloadBytes / sizeof(int64_t) + 1,
+              value->value.int64Values.size());
+    slabPool.obtain(VehiclePropertyType::STRING);
+
+    ASSERT_EQ(0u, stats->Obtained);
+}
+
+TEST_F(VehicleObjectPoolTest, slabValueResizedByUser) {
+    VehiclePropValuePool slabPool(4, VehiclePropValuePool::Mode::SLAB);
+    auto value = slabPool.obtain(VehiclePropertyType::INT32_VEC, 2);
+    void* raw = value.get();
+    value->value.int32Values.resize(100);
+    value->value.int32Values[99] = 1;
+    value.reset();
+
+    value = slabPool.obtain(VehiclePropertyType::INT32_VEC, 2);
+    ASSERT_EQ(raw, value.get());
+    ASSERT_EQ(std::vector<int32_t>({0, 0}), std::vector<int32_t>(value->value.int32Values));
+}
+
+TEST_F(VehicleObjectPoolTest, slabCopiesSource) {
+    VehiclePropValuePool slabPool(4, VehiclePropValuePool::Mode::SLAB);
+    VehiclePropValue src;
+    src.prop = toInt(VehicleProperty::INFO_FUEL_CAPACITY);
+    src.timestamp = 1;
+    src.value.floatValues = hidl_vec<float>{1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    auto value = slabPool.obtain(src);
+    ASSERT_EQ(src, *value);
+    ASSERT_NE(src.value.floatValues.data(), value->value.floatValues.data());
+}
+
+TEST_F(VehicleObjectPoolTest, slabValuesMoveAcrossThreads) {
+    constexpr int kValues = 1000;
+    VehiclePropValuePool slabPool(4, VehiclePropValuePool::Mode::SLAB);
+
+    // Values are obtained on one thread and recycled on others, some of them
+    // end up in the shared depot and come back.
+    for (int round = 0; round < 3; round++) {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        for (int i = 0; i < kValues; i++) {
+            values.push_back(slabPool.obtain(VehiclePropertyType::INT32_VEC, i % 8 + 1));
+        }
+        std::thread releaser([&values] { values.clear(); });
+        releaser.join();
+    }
+
+    ASSERT_EQ(static_cast<uint32_t>(3 * kValues), stats->Obtained);
+    ASSERT_EQ(stats->Obtained, stats->CacheHits + stats->CacheMisses);
+    ASSERT_LT(stats->Created, stats->Obtained);
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
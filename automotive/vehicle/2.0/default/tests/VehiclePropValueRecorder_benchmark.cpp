@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/VehiclePropValueRecorder.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using android::base::TemporaryFile;
+using VehiclePropValuePtr = VehiclePropValueRecorder::VehiclePropValuePtr;
+
+/** A batch like the ones CONTINUOUS properties produce: floats sampled every 10ms. */
+std::vector<VehiclePropValuePtr> makeBatch(VehiclePropValuePool* pool, size_t size) {
+    std::vector<VehiclePropValuePtr> batch;
+    for (size_t i = 0; i < size; i++) {
+        auto value = pool->obtainFloat(i * 0.5f);
+        value->prop = 0x11600207 + i;  // PERF_VEHICLE_SPEED-like FLOAT properties.
+        value->areaId = 0;
+        value->status = VehiclePropertyStatus::AVAILABLE;
+        value->timestamp = 10000000LL * i;
+        batch.push_back(std::move(value));
+    }
+    return batch;
+}
+
+/** Cost of recording a batch of state.range(0) values on the batching consumer thread. */
+void BM_RecordBatch(benchmark::State& state) {
+    VehiclePropValuePool pool;
+    auto batch = makeBatch(&pool, state.range(0));
+    TemporaryFile file;
+    VehiclePropValueRecorder recorder;
+    recorder.start(file.path);
+    for (auto _ : state) {
+        for (auto& value : batch) {
+            value->timestamp += 10000000LL;
+        }
+        recorder.record(batch);
+    }
+    recorder.stop();
+    auto stats = recorder.getStats();
+    state.SetItemsProcessed(state.iterations() * batch.size());
+    state.counters["bytesPerValue"] =
+            static_cast<double>(stats.bytesWritten) / std::max<uint64_t>(stats.values, 1);
+    state.counters["droppedBatches"] = stats.droppedBatches;
+}
+BENCHMARK(BM_RecordBatch)->Arg(1)->Arg(10)->Arg(100);
+
+/** Only the isRecording() check is paid while no recording is in progress. */
+void BM_RecordBatchStopped(benchmark::State& state) {
+    VehiclePropValuePool pool;
+    auto batch = makeBatch(&pool, 10);
+    VehiclePropValueRecorder recorder;
+    for (auto _ : state) {
+        if (recorder.isRecording()) {
+            recorder.record(batch);
+        }
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_RecordBatchStopped);
+
+void BM_ReadLog(benchmark::State& state) {
+    VehiclePropValuePool pool;
+    auto batch = makeBatch(&pool, 100);
+    TemporaryFile file;
+    VehiclePropValueRecorder recorder;
+    recorder.start(file.path);
+    for (int i = 0; i < 1000; i++) {
+        recorder.record(batch);
+    }
+    recorder.stop();
+
+    VehiclePropValueLogReader reader;
+    reader.open(file.path);
+    VehiclePropValue value;
+    for (auto _ : state) {
+        if (!reader.next(&value)) {
+            reader.rewind();
+            reader.next(&value);
+        }
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadLog);
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
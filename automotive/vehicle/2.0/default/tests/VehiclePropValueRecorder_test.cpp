@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehiclePropValueRecorder.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using android::base::TemporaryFile;
+using VehiclePropValuePtr = VehiclePropValueRecorder::VehiclePropValuePtr;
+
+class VehiclePropValueRecorderTest : public ::testing::Test {
+protected:
+    VehiclePropValuePtr makeValue(int32_t prop, int64_t timestamp) {
+        auto value = mPool.obtain(getPropType(prop));
+        value->prop = prop;
+        value->areaId = 0;
+        value->status = VehiclePropertyStatus::AVAILABLE;
+        value->timestamp = timestamp;
+        return value;
+    }
+
+    std::vector<VehiclePropValue> readAll(const char* path) {
+        std::vector<VehiclePropValue> values;
+        VehiclePropValueLogReader reader;
+        if (!reader.open(path)) {
+            return values;
+        }
+        VehiclePropValue value;
+        while (reader.next(&value)) {
+            values.push_back(value);
+        }
+        return values;
+    }
+
+    VehiclePropValuePool mPool;
+    TemporaryFile mFile;
+};
+
+constexpr int32_t kInt32Prop = 0x11400100;   // SYSTEM, GLOBAL, INT32
+constexpr int32_t kInt64Prop = 0x11500101;   // SYSTEM, GLOBAL, INT64
+constexpr int32_t kFloatProp = 0x11600102;   // SYSTEM, GLOBAL, FLOAT
+constexpr int32_t kStringProp = 0x11100103;  // SYSTEM, GLOBAL, STRING
+constexpr int32_t kMixedProp = 0x21e00104;   // VENDOR, GLOBAL, MIXED
+
+TEST_F(VehiclePropValueRecorderTest, roundTrip) {
+    std::vector<VehiclePropValuePtr> batch1;
+    batch1.push_back(makeValue(kInt32Prop, 1000));
+    batch1.back()->value.int32Values[0] = -7;
+    batch1.back()->areaId = 0x0101;
+    batch1.push_back(makeValue(kInt64Prop, 900));  // Timestamps may go backwards.
+    batch1.back()->value.int64Values[0] = -1234567890123;
+    batch1.back()->status = VehiclePropertyStatus::UNAVAILABLE;
+    batch1.push_back(makeValue(kFloatProp, 5000));
+    batch1.back()->value.floatValues[0] = 3.5f;
+
+    std::vector<VehiclePropValuePtr> batch2;
+    batch2.push_back(makeValue(kStringProp, 6000));
+    batch2.back()->value.stringValue = "hello";
+    batch2.push_back(makeValue(kMixedProp, 7000));
+    auto& mixed = batch2.back()->value;
+    mixed.int32Values = hidl_vec<int32_t>{1, -2, 3};
+    mixed.int64Values = hidl_vec<int64_t>{INT64_MIN, INT64_MAX};
+    mixed.floatValues = hidl_vec<float>{0.5f};
+    mixed.bytes = hidl_vec<uint8_t>{0, 0xff};
+    mixed.stringValue = "mixed";
+    // A scalar property that doesn't hold exactly one value.
+    batch2.push_back(makeValue(kInt32Prop, 8000));
+    batch2.back()->value.int32Values = hidl_vec<int32_t>{1, 2};
+
+    VehiclePropValueRecorder recorder;
+    ASSERT_TRUE(recorder.start(mFile.path));
+    recorder.record(batch1);
+    recorder.record(batch2);
+    recorder.stop();
+
+    auto stats = recorder.getStats();
+    EXPECT_EQ(2u, stats.batches);
+    EXPECT_EQ(6u, stats.values);
+    EXPECT_EQ(0u, stats.droppedBatches);
+    struct stat st;
+    ASSERT_EQ(0, stat(mFile.path, &st));
+    EXPECT_EQ(static_cast<uint64_t>(st.st_size), stats.bytesWritten);
+
+    auto values = readAll(mFile.path);
+    ASSERT_EQ(6u, values.size());
+    size_t i = 0;
+    for (const auto* batch : {&batch1, &batch2}) {
+        for (const auto& expected : *batch) {
+            EXPECT_TRUE(*expected == values[i])
+                    << "value " << i << ": " << toString(*expected) << " vs "
+                    << toString(values[i]);
+            i++;
+        }
+    }
+}
+
+TEST_F(VehiclePropValueRecorderTest, scalarValuesAreCompact) {
+    std::vector<VehiclePropValuePtr> batch;
+    for (int i = 0; i < 100; i++) {
+        batch.push_back(makeValue(kFloatProp, 1000000000LL + i * 10000000LL));
+        batch.back()->value.floatValues[0] = i;
+    }
+    VehiclePropValueRecorder recorder;
+    ASSERT_TRUE(recorder.start(mFile.path));
+    recorder.record(batch);
+    recorder.stop();
+
+    // 4 bytes of timestamp delta, 5 of prop, 1 each for area, status and layout, 4 of float, plus
+    // the magic, the frame header and the first timestamp.
+    EXPECT_LE(recorder.getStats().bytesWritten, 16u + 100u * 16u);
+    EXPECT_EQ(100u, readAll(mFile.path).size());
+}
+
+TEST_F(VehiclePropValueRecorderTest, truncatedLogEndsAtLastCompleteFrame) {
+    VehiclePropValueRecorder recorder;
+    ASSERT_TRUE(recorder.start(mFile.path));
+    for (int i = 0; i < 3; i++) {
+        std::vector<VehiclePropValuePtr> batch;
+        batch.push_back(makeValue(kInt32Prop, i));
+        batch.back()->value.int32Values[0] = i;
+        recorder.record(batch);
+    }
+    recorder.stop();
+
+    struct stat st;
+    ASSERT_EQ(0, stat(mFile.path, &st));
+    ASSERT_EQ(0, truncate(mFile.path, st.st_size - 1));
+    auto values = readAll(mFile.path);
+    ASSERT_EQ(2u, values.size());
+    EXPECT_EQ(1, values[1].value.int32Values[0]);
+}
+
+TEST_F(VehiclePropValueRecorderTest, notRecordingUntilStarted) {
+    VehiclePropValueRecorder recorder;
+    EXPECT_FALSE(recorder.isRecording());
+    std::vector<VehiclePropValuePtr> batch;
+    batch.push_back(makeValue(kInt32Prop, 1));
+    recorder.record(batch);
+    EXPECT_EQ(0u, recorder.getStats().values);
+
+    ASSERT_TRUE(recorder.start(mFile.path));
+    EXPECT_TRUE(recorder.isRecording());
+    recorder.stop();
+    EXPECT_FALSE(recorder.isRecording());
+    recorder.record(batch);
+    EXPECT_EQ(0u, recorder.getStats().values);
+    EXPECT_TRUE(readAll(mFile.path).empty());
+}
+
+TEST_F(VehiclePropValueRecorderTest, readerRejectsOtherFilesAndRewinds) {
+    ASSERT_TRUE(android::base::WriteStringToFile("[]", mFile.path));
+    VehiclePropValueLogReader reader;
+    EXPECT_FALSE(reader.open(mFile.path));
+    EXPECT_FALSE(reader.open("/does/not/exist"));
+
+    VehiclePropValueRecorder recorder;
+    ASSERT_TRUE(recorder.start(mFile.path));
+    std::vector<VehiclePropValuePtr> batch;
+    batch.push_back(makeValue(kInt32Prop, 10));
+    batch.push_back(makeValue(kInt32Prop, 20));
+    recorder.record(batch);
+    recorder.stop();
+
+    ASSERT_TRUE(reader.open(mFile.path));
+    VehiclePropValue value;
+    ASSERT_TRUE(reader.next(&value));
+    ASSERT_TRUE(reader.next(&value));
+    EXPECT_EQ(20, value.timestamp);
+    EXPECT_FALSE(reader.next(&value));
+    ASSERT_TRUE(reader.rewind());
+    ASSERT_TRUE(reader.next(&value));
+    EXPECT_EQ(10, value.timestamp);
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using StorageMode = VehiclePropertyStore::StorageMode;
+
+constexpr int32_t kNumProperties = 300;
+constexpr int32_t kNumAreas = 4;
+
+int32_t propAt(int32_t index) {
+    return (0x1000 + index) | VehiclePropertyGroup::VENDOR | VehiclePropertyType::FLOAT
+           | VehicleArea::SEAT;
+}
+
+/**
+ * Store shared by all threads of a benchmark run, pre-populated with kNumProperties continuous
+ * properties with kNumAreas areas each.
+ */
+VehiclePropertyStore* gStore = nullptr;
+
+void setUpStore(StorageMode mode) {
+    gStore = new VehiclePropertyStore(mode);
+    for (int32_t i = 0; i < kNumProperties; i++) {
+        VehiclePropConfig config {};
+        config.prop = propAt(i);
+        config.access = VehiclePropertyAccess::READ_WRITE;
+        config.changeMode = VehiclePropertyChangeMode::CONTINUOUS;
+        gStore->registerProperty(config);
+
+        VehiclePropValue value {};
+        value.prop = config.prop;
+        value.value.floatValues = std::vector<float> { 0.0f };
+        for (int32_t area = 0; area < kNumAreas; area++) {
+            value.areaId = 1 << area;
+            gStore->writeValue(value, true);
+        }
+    }
+}
+
+void tearDownStore() {
+    delete gStore;
+    gStore = nullptr;
+}
+
+StorageMode modeOf(const benchmark::State& state) {
+    return state.range(0) ? StorageMode::INDEXED : StorageMode::SORTED_MAP;
+}
+
+/** Every thread reads values of all properties in a loop, like Car service polling. */
+void BM_Read(benchmark::State& state) {
+    if (state.thread_index == 0) setUpStore(modeOf(state));
+
+    int32_t i = state.thread_index;
+    for (auto _ : state) {
+        auto value = gStore->readValueOrNull(propAt(i % kNumProperties), 1 << (i % kNumAreas));
+        benchmark::DoNotOptimize(value);
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) tearDownStore();
+}
+
+/**
+ * Thread 0 acts as a generator writing all properties, the remaining threads read them. Only the
+ * writer is measured, so this shows how much readers slow down property updates.
+ */
+void BM_WriteWithReaders(benchmark::State& state) {
+    if (state.thread_index == 0) setUpStore(modeOf(state));
+
+    VehiclePropValue value {};
+    value.value.floatValues = std::vector<float> { 0.0f };
+    int32_t i = 0;
+    for (auto _ : state) {
+        if (state.thread_index == 0) {
+            value.prop = propAt(i % kNumProperties);
+            value.areaId = 1 << (i % kNumAreas);
+            value.timestamp = i;
+            value.value.floatValues[0] = i;
+            benchmark::DoNotOptimize(gStore->writeValue(value, true));
+        } else {
+            auto read = gStore->readValueOrNull(propAt(i % kNumProperties), 1 << (i % kNumAreas));
+            benchmark::DoNotOptimize(read);
+        }
+        i++;
+    }
+    if (state.thread_index == 0) state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) tearDownStore();
+}
+
+/** Writers of different properties, e.g. several generators or the emulator feeding values. */
+void BM_ConcurrentWrites(benchmark::State& state) {
+    if (state.thread_index == 0) setUpStore(modeOf(state));
+
+    VehiclePropValue value {};
+    value.areaId = 1;
+    value.value.floatValues = std::vector<float> { 0.0f };
+    int64_t i = 0;
+    for (auto _ : state) {
+        value.prop = propAt((state.thread_index + i * state.threads) % kNumProperties);
+        value.timestamp = i;
+        benchmark::DoNotOptimize(gStore->writeValue(value, true));
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) tearDownStore();
+}
+
+// Arg(0) is the map-backed store, Arg(1) the indexed one.
+BENCHMARK(BM_Read)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_WriteWithReaders)->Arg(0)->Arg(1)->ThreadRange(2, 8)->UseRealTime();
+BENCHMARK(BM_ConcurrentWrites)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
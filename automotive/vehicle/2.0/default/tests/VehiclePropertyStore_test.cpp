@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+using StorageMode = VehiclePropertyStore::StorageMode;
+
+constexpr int32_t kGlobalProp =
+        0x0101 | VehiclePropertyGroup::VENDOR | VehiclePropertyType::INT32 | VehicleArea::GLOBAL;
+constexpr int32_t kSeatProp =
+        0x0102 | VehiclePropertyGroup::VENDOR | VehiclePropertyType::INT32 | VehicleArea::SEAT;
+constexpr int32_t kTokenProp =
+        0x0103 | VehiclePropertyGroup::VENDOR | VehiclePropertyType::MIXED | VehicleArea::GLOBAL;
+constexpr int32_t kUnknownProp =
+        0x0104 | VehiclePropertyGroup::VENDOR | VehiclePropertyType::INT32 | VehicleArea::GLOBAL;
+
+VehiclePropConfig makeConfig(int32_t prop) {
+    VehiclePropConfig config {};
+    config.prop = prop;
+    config.access = VehiclePropertyAccess::READ_WRITE;
+    config.changeMode = VehiclePropertyChangeMode::ON_CHANGE;
+    return config;
+}
+
+VehiclePropValue makeValue(int32_t prop, int32_t area, int32_t value, int64_t timestamp) {
+    VehiclePropValue propValue {};
+    propValue.prop = prop;
+    propValue.areaId = area;
+    propValue.timestamp = timestamp;
+    propValue.value.int32Values = std::vector<int32_t> { value };
+    return propValue;
+}
+
+class VehiclePropertyStoreTest : public ::testing::TestWithParam<StorageMode> {
+protected:
+    void SetUp() override {
+        store.reset(new VehiclePropertyStore(GetParam()));
+        store->registerProperty(makeConfig(kSeatProp));
+        store->registerProperty(makeConfig(kGlobalProp));
+        store->registerProperty(makeConfig(kTokenProp), [](const VehiclePropValue& value) {
+            return value.value.int64Values.size() > 0 ? value.value.int64Values[0] : 0;
+        });
+    }
+
+    std::unique_ptr<VehiclePropertyStore> store;
+};
+
+TEST_P(VehiclePropertyStoreTest, configs) {
+    ASSERT_EQ(3u, store->getAllConfigs().size());
+    ASSERT_NE(nullptr, store->getConfigOrNull(kSeatProp));
+    ASSERT_EQ(kSeatProp, store->getConfigOrNull(kSeatProp)->prop);
+    ASSERT_EQ(nullptr, store->getConfigOrNull(kUnknownProp));
+}
+
+TEST_P(VehiclePropertyStoreTest, manyProperties) {
+    constexpr int32_t kNumProperties = 500;
+    for (int32_t i = 0; i < kNumProperties; i++) {
+        store->registerProperty(makeConfig(kUnknownProp + 1 + i));
+        ASSERT_TRUE(store->writeValue(makeValue(kUnknownProp + 1 + i, 0, i, 1), true));
+    }
+    ASSERT_EQ(kNumProperties + 3u, store->getAllConfigs().size());
+    for (int32_t i = 0; i < kNumProperties; i++) {
+        auto value = store->readValueOrNull(kUnknownProp + 1 + i);
+        ASSERT_NE(nullptr, value.get());
+        ASSERT_EQ(i, value->value.int32Values[0]);
+    }
+    ASSERT_EQ(nullptr, store->getConfigOrNull(kUnknownProp));
+}
+
+TEST_P(VehiclePropertyStoreTest, writeAndRead) {
+    ASSERT_FALSE(store->writeValue(makeValue(kUnknownProp, 0, 1, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 42, 1), true));
+
+    auto value = store->readValueOrNull(kGlobalProp);
+    ASSERT_NE(nullptr, value.get());
+    ASSERT_EQ(42, value->value.int32Values[0]);
+
+    // Area is ignored for global properties.
+    value = store->readValueOrNull(makeValue(kGlobalProp, 7, 0, 0));
+    ASSERT_NE(nullptr, value.get());
+    ASSERT_EQ(42, value->value.int32Values[0]);
+
+    ASSERT_EQ(nullptr, store->readValueOrNull(kSeatProp, 1).get());
+}
+
+TEST_P(VehiclePropertyStoreTest, batchRead) {
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 42, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 1, 1, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 2, 2, 1), true));
+
+    auto seat2 = makeValue(kSeatProp, 2, 0, 0);
+    auto seat4 = makeValue(kSeatProp, 4, 0, 0);
+    auto unknown = makeValue(kUnknownProp, 0, 0, 0);
+    auto global = makeValue(kGlobalProp, 7, 0, 0);
+    VehiclePropValuePool pool;
+    auto values = store->readValuesOrNull({&seat2, &seat4, &unknown, &global}, &pool);
+    ASSERT_EQ(4u, values.size());
+    ASSERT_NE(nullptr, values[0].get());
+    ASSERT_EQ(2, values[0]->value.int32Values[0]);
+    ASSERT_EQ(nullptr, values[1].get());
+    ASSERT_EQ(nullptr, values[2].get());
+    ASSERT_NE(nullptr, values[3].get());
+    ASSERT_EQ(42, values[3]->value.int32Values[0]);
+
+    ASSERT_TRUE(store->readValuesOrNull({}, &pool).empty());
+}
+
+TEST_P(VehiclePropertyStoreTest, outdatedValueIsDropped) {
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 1, 10, 100), true));
+    ASSERT_FALSE(store->writeValue(makeValue(kSeatProp, 1, 11, 99), true));
+    ASSERT_EQ(10, store->readValueOrNull(kSeatProp, 1)->value.int32Values[0]);
+
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 1, 12, 100), true));
+    ASSERT_EQ(12, store->readValueOrNull(kSeatProp, 1)->value.int32Values[0]);
+}
+
+TEST_P(VehiclePropertyStoreTest, statusIsOnlyUpdatedOnRequest) {
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 1, 1), true));
+
+    auto unavailable = makeValue(kGlobalProp, 0, 2, 2);
+    unavailable.status = VehiclePropertyStatus::UNAVAILABLE;
+    ASSERT_TRUE(store->writeValue(unavailable, false));
+    auto value = store->readValueOrNull(kGlobalProp);
+    ASSERT_EQ(VehiclePropertyStatus::AVAILABLE, value->status);
+    ASSERT_EQ(2, value->value.int32Values[0]);
+
+    unavailable.timestamp = 3;
+    ASSERT_TRUE(store->writeValue(unavailable, true));
+    ASSERT_EQ(VehiclePropertyStatus::UNAVAILABLE, store->readValueOrNull(kGlobalProp)->status);
+}
+
+TEST_P(VehiclePropertyStoreTest, valuesAreSortedByPropAndArea) {
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 4, 4, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 0, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 1, 1, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 2, 2, 1), true));
+
+    auto seatValues = store->readValuesForProperty(kSeatProp);
+    ASSERT_EQ(3u, seatValues.size());
+    ASSERT_EQ(1, seatValues[0].areaId);
+    ASSERT_EQ(2, seatValues[1].areaId);
+    ASSERT_EQ(4, seatValues[2].areaId);
+
+    auto allValues = store->readAllValues();
+    ASSERT_EQ(4u, allValues.size());
+    ASSERT_EQ(kGlobalProp, allValues[0].prop);
+    ASSERT_EQ(kSeatProp, allValues[1].prop);
+}
+
+TEST_P(VehiclePropertyStoreTest, tokens) {
+    for (int64_t token : {3, 1, 2}) {
+        auto value = makeValue(kTokenProp, 0, static_cast<int32_t>(token), 1);
+        value.value.int64Values = std::vector<int64_t> { token };
+        ASSERT_TRUE(store->writeValue(value, true));
+    }
+    ASSERT_EQ(3u, store->readValuesForProperty(kTokenProp).size());
+    ASSERT_EQ(2, store->readValueOrNull(kTokenProp, 0, 2)->value.int32Values[0]);
+
+    auto toRemove = makeValue(kTokenProp, 0, 0, 0);
+    toRemove.value.int64Values = std::vector<int64_t> { 2 };
+    store->removeValue(toRemove);
+    ASSERT_EQ(nullptr, store->readValueOrNull(kTokenProp, 0, 2).get());
+    ASSERT_EQ(2u, store->readValuesForProperty(kTokenProp).size());
+
+    store->removeValuesForProperty(kTokenProp);
+    ASSERT_EQ(0u, store->readValuesForProperty(kTokenProp).size());
+}
+
+TEST_P(VehiclePropertyStoreTest, concurrentReadersAndWriters) {
+    constexpr int kWrites = 10000;
+    std::atomic<bool> done { false };
+
+    std::thread reader([this, &done] {
+        int32_t last = -1;
+        while (!done) {
+            auto value = store->readValueOrNull(kSeatProp, 1);
+            if (value.get() == nullptr) continue;
+            // Values are written in increasing order, readers must never see them go back.
+            ASSERT_LE(last, value->value.int32Values[0]);
+            last = value->value.int32Values[0];
+        }
+    });
+
+    for (int i = 0; i < kWrites; i++) {
+        ASSERT_TRUE(store->writeValue(makeValue(kSeatProp, 1, i, i), true));
+    }
+    done = true;
+    reader.join();
+
+    ASSERT_EQ(kWrites - 1, store->readValueOrNull(kSeatProp, 1)->value.int32Values[0]);
+}
+
+INSTANTIATE_TEST_SUITE_P(StorageModes, VehiclePropertyStoreTest,
+                         ::testing::Values(StorageMode::SORTED_MAP, StorageMode::INDEXED));
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
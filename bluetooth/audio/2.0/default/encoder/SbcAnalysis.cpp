@@ -0,0 +1,110 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SbcAnalysis.h"
+
+#include <math.h>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace sbc {
+
+namespace {
+
+// The first half of the windows, Proto_4_40 and Proto_8_80 in the A2DP
+// specification. The second half mirrors it, with the sign of every other
+// group of 2M coefficients flipped.
+constexpr double kProto4[21] = {
+    0.00000000E+00,  5.36548976E-04,  1.49188357E-03,  2.73370904E-03,
+    3.83720193E-03,  3.89205149E-03,  1.86581691E-03,  -3.06012286E-03,
+    1.09137620E-02,  2.04385087E-02,  2.88757392E-02,  3.21939290E-02,
+    2.58767811E-02,  6.13245186E-03,  -2.88217274E-02, -7.76463494E-02,
+    1.35593274E-01,  1.94987841E-01,  2.46636662E-01,  2.81828203E-01,
+    2.94315332E-01};
+
+constexpr double kProto8[41] = {
+    0.00000000E+00,  1.56575398E-04,  3.43256425E-04,  5.54620202E-04,
+    8.23919506E-04,  1.13992507E-03,  1.47640169E-03,  1.78371725E-03,
+    2.01182542E-03,  2.10371989E-03,  1.99454554E-03,  1.61656283E-03,
+    9.02154502E-04,  -1.78805361E-04, -1.64973098E-03, -3.49717454E-03,
+    5.65949473E-03,  8.02941163E-03,  1.04584443E-02,  1.27472335E-02,
+    1.46525263E-02,  1.59045603E-02,  1.62208471E-02,  1.53184106E-02,
+    1.29371806E-02,  8.85757540E-03,  2.92408442E-03,  -4.91578024E-03,
+    -1.46404076E-02, -2.61098752E-02, -3.90751381E-02, -5.31873032E-02,
+    6.79989431E-02,  8.29847578E-02,  9.75753918E-02,  1.11196689E-01,
+    1.23264548E-01,  1.33264415E-01,  1.40753505E-01,  1.45389847E-01,
+    1.46955068E-01};
+
+void FillWindow(const double* proto, int subbands, float* window) {
+  const int length = 10 * subbands;
+  auto sign = [subbands](int i) { return (i / (2 * subbands)) % 2 ? -1 : 1; };
+  for (int i = 0; i < length; i++) {
+    window[i] = i <= length / 2
+                    ? proto[i]
+                    : proto[length - i] * sign(length - i) * sign(i);
+  }
+}
+
+void FillMatrix(int subbands, float* matrix) {
+  for (int i = 0; i < 2 * subbands; i++) {
+    for (int k = 0; k < subbands; k++) {
+      matrix[i * subbands + k] =
+          cos((k + 0.5) * (i - subbands / 2) * M_PI / subbands);
+    }
+  }
+}
+
+AnalysisTables MakeTables() {
+  AnalysisTables tables;
+  FillWindow(kProto4, 4, tables.window4);
+  FillWindow(kProto8, 8, tables.window8);
+  FillMatrix(4, tables.matrix4);
+  FillMatrix(8, tables.matrix8);
+  return tables;
+}
+
+}  // namespace
+
+const AnalysisTables& GetAnalysisTables() {
+  static const AnalysisTables tables = MakeTables();
+  return tables;
+}
+
+void AnalyzeScalar(const float* x, const float* window, const float* matrix,
+                   int subbands, float* out) {
+  const int n = 2 * subbands;
+  float y[16];
+  for (int i = 0; i < n; i++) {
+    float acc = window[i] * x[i];
+    for (int j = 1; j < 5; j++) {
+      acc += window[i + j * n] * x[i + j * n];
+    }
+    y[i] = acc;
+  }
+  for (int k = 0; k < subbands; k++) {
+    float acc = y[0] * matrix[k];
+    for (int i = 1; i < n; i++) {
+      acc += y[i] * matrix[i * subbands + k];
+    }
+    out[k] = acc;
+  }
+}
+
+}  // namespace sbc
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
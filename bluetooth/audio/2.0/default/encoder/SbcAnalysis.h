@@ -0,0 +1,63 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace sbc {
+
+// The analysis filter bank of the SBC encoder, for M = 4 or 8 subbands:
+//
+//   Y[i] = sum(j = 0..4) C[i + 2Mj] * X[i + 2Mj]                 for i < 2M
+//   S[k] = sum(i = 0..2M-1) cos((k + 0.5) * (i - M/2) * pi/M) * Y[i]  for k < M
+//
+// where X holds the last 10M input samples of a channel, the newest first, C
+// is the window of the A2DP specification and S are the subband samples.
+struct AnalysisTables {
+  float window4[40];
+  float window8[80];
+  // The cosines, at [i * M + k] so SIMD lanes compute neighbouring subbands
+  float matrix4[8 * 4];
+  float matrix8[16 * 8];
+};
+
+const AnalysisTables& GetAnalysisTables();
+
+// Computes the subband samples of a block. All kernels do the same
+// operations in the same order, so their output is exactly the same as long
+// as the compiler doesn't fuse multiplies and adds.
+using AnalyzeFn = void (*)(const float* x, const float* window,
+                           const float* matrix, int subbands, float* out);
+
+void AnalyzeScalar(const float* x, const float* window, const float* matrix,
+                   int subbands, float* out);
+
+#if defined(__i386__) || defined(__x86_64__)
+void AnalyzeSse2(const float* x, const float* window, const float* matrix,
+                 int subbands, float* out);
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+void AnalyzeNeon(const float* x, const float* window, const float* matrix,
+                 int subbands, float* out);
+#endif
+
+}  // namespace sbc
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
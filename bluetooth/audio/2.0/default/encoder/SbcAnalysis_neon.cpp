@@ -0,0 +1,53 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SbcAnalysis.h"
+
+#include <arm_neon.h>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace sbc {
+
+// Four windowed sums, then four subbands at a time. Multiplies and adds are
+// separate instructions, to round like the scalar kernel.
+void AnalyzeNeon(const float* x, const float* window, const float* matrix,
+                 int subbands, float* out) {
+  const int n = 2 * subbands;
+  float y[16];
+  for (int i = 0; i < n; i += 4) {
+    float32x4_t acc = vmulq_f32(vld1q_f32(window + i), vld1q_f32(x + i));
+    for (int j = 1; j < 5; j++) {
+      acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(window + i + j * n),
+                                     vld1q_f32(x + i + j * n)));
+    }
+    vst1q_f32(y + i, acc);
+  }
+  for (int k = 0; k < subbands; k += 4) {
+    float32x4_t acc = vmulq_n_f32(vld1q_f32(matrix + k), y[0]);
+    for (int i = 1; i < n; i++) {
+      acc = vaddq_f32(acc,
+                      vmulq_n_f32(vld1q_f32(matrix + i * subbands + k), y[i]));
+    }
+    vst1q_f32(out + k, acc);
+  }
+}
+
+}  // namespace sbc
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
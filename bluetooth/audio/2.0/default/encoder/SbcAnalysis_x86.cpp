@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SbcAnalysis.h"
+
+#include <emmintrin.h>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace sbc {
+
+// Four windowed sums, then four subbands at a time
+__attribute__((target("sse2"))) void AnalyzeSse2(const float* x,
+                                                 const float* window,
+                                                 const float* matrix,
+                                                 int subbands, float* out) {
+  const int n = 2 * subbands;
+  float y[16];
+  for (int i = 0; i < n; i += 4) {
+    __m128 acc = _mm_mul_ps(_mm_loadu_ps(window + i), _mm_loadu_ps(x + i));
+    for (int j = 1; j < 5; j++) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(window + i + j * n),
+                                       _mm_loadu_ps(x + i + j * n)));
+    }
+    _mm_storeu_ps(y + i, acc);
+  }
+  for (int k = 0; k < subbands; k += 4) {
+    __m128 acc = _mm_mul_ps(_mm_set1_ps(y[0]), _mm_loadu_ps(matrix + k));
+    for (int i = 1; i < n; i++) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(y[i]),
+                                       _mm_loadu_ps(matrix + i * subbands + k)));
+    }
+    _mm_storeu_ps(out + k, acc);
+  }
+}
+
+}  // namespace sbc
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -0,0 +1,466 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SbcEncoder.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+namespace {
+
+constexpr uint8_t kSyncWord = 0x9c;
+
+// Offsets of the loudness bit allocation, by sampling frequency and subband
+constexpr int kLoudnessOffset4[4][4] = {
+    {-1, 0, 0, 0}, {-2, 0, 0, 1}, {-2, 0, 0, 1}, {-2, 0, 0, 1}};
+constexpr int kLoudnessOffset8[4][8] = {{-2, 0, 0, 0, 0, 0, 0, 1},
+                                        {-3, 0, 0, 0, 0, 0, 1, 2},
+                                        {-4, 0, 0, 0, 0, 0, 1, 2},
+                                        {-4, 0, 0, 0, 0, 0, 1, 2}};
+
+int SampleRateIndex(uint32_t sample_rate) {
+  switch (sample_rate) {
+    case 16000:
+      return 0;
+    case 32000:
+      return 1;
+    case 44100:
+      return 2;
+    case 48000:
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+int ChannelCount(SbcChannelMode channel_mode) {
+  return channel_mode == SbcChannelMode::MONO ? 1 : 2;
+}
+
+// Smallest scale factor with |sample| < 2^(scale factor + 1), up to 15
+int ScaleFactor(float max_abs) {
+  int scale_factor = 0;
+  while (scale_factor < 15 && max_abs >= static_cast<float>(2 << scale_factor)) {
+    scale_factor++;
+  }
+  return scale_factor;
+}
+
+// Distributes bitpool bits over subbands, in the order of the A2DP
+// specification: by subband, and by channel within a subband when both
+// channels share the bitpool
+void AllocateSlots(const int* bitneed, int* bits, int count, int bitpool) {
+  int max_bitneed = 0;
+  for (int s = 0; s < count; s++) {
+    max_bitneed = std::max(max_bitneed, bitneed[s]);
+  }
+
+  int bitcount = 0;
+  int slicecount = 0;
+  int bitslice = max_bitneed + 1;
+  do {
+    bitslice--;
+    bitcount += slicecount;
+    slicecount = 0;
+    for (int s = 0; s < count; s++) {
+      if (bitneed[s] > bitslice + 1 && bitneed[s] < bitslice + 16) {
+        slicecount++;
+      } else if (bitneed[s] == bitslice + 1) {
+        slicecount += 2;
+      }
+    }
+  } while (bitcount + slicecount < bitpool);
+  if (bitcount + slicecount == bitpool) {
+    bitcount += slicecount;
+    bitslice--;
+  }
+
+  for (int s = 0; s < count; s++) {
+    bits[s] = bitneed[s] < bitslice + 2
+                  ? 0
+                  : std::min(bitneed[s] - bitslice, 16);
+  }
+  for (int s = 0; bitcount < bitpool && s < count; s++) {
+    if (bits[s] >= 2 && bits[s] < 16) {
+      bits[s]++;
+      bitcount++;
+    } else if (bitneed[s] == bitslice + 1 && bitpool > bitcount + 1) {
+      bits[s] = 2;
+      bitcount += 2;
+    }
+  }
+  for (int s = 0; bitcount < bitpool && s < count; s++) {
+    if (bits[s] < 16) {
+      bits[s]++;
+      bitcount++;
+    }
+  }
+}
+
+class BitWriter {
+ public:
+  explicit BitWriter(uint8_t* data) : data_(data) {}
+
+  // value must fit in bits, which is at most 16
+  void Write(uint32_t value, int bits) {
+    cache_ = (cache_ << bits) | value;
+    cached_bits_ += bits;
+    while (cached_bits_ >= 8) {
+      cached_bits_ -= 8;
+      *data_++ = cache_ >> cached_bits_;
+    }
+  }
+
+  // Pads the last byte with zeros
+  void Flush() {
+    if (cached_bits_ > 0) {
+      *data_++ = cache_ << (8 - cached_bits_);
+      cached_bits_ = 0;
+    }
+  }
+
+  uint8_t* GetData() const { return data_; }
+
+ private:
+  uint8_t* data_;
+  uint32_t cache_ = 0;
+  int cached_bits_ = 0;
+};
+
+// CRC-8 of the header after the sync word, and of the first bits after the
+// CRC field, with the polynomial x^8 + x^4 + x^3 + x^2 + 1
+uint8_t FrameCrc(const uint8_t* frame, size_t bits) {
+  uint8_t crc = 0x0f;
+  auto feed = [&crc](uint8_t byte, int count) {
+    for (int i = 7; i > 7 - count; i--) {
+      const bool bit = ((byte >> i) & 1) != (crc >> 7);
+      crc <<= 1;
+      if (bit) crc ^= 0x1d;
+    }
+  };
+  feed(frame[1], 8);
+  feed(frame[2], 8);
+  for (size_t i = 0; i < bits / 8; i++) {
+    feed(frame[4 + i], 8);
+  }
+  if (bits % 8) {
+    feed(frame[4 + bits / 8], bits % 8);
+  }
+  return crc;
+}
+
+sbc::AnalyzeFn GetAnalyzeFn(SbcSimdLevel level) {
+  const auto supported = GetSbcSupportedSimdLevels();
+  if (std::find(supported.begin(), supported.end(), level) ==
+      supported.end()) {
+    return nullptr;
+  }
+  switch (level) {
+#if defined(__i386__) || defined(__x86_64__)
+    case SbcSimdLevel::SSE2:
+      return sbc::AnalyzeSse2;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    case SbcSimdLevel::NEON:
+      return sbc::AnalyzeNeon;
+#endif
+    default:
+      return sbc::AnalyzeScalar;
+  }
+}
+
+}  // namespace
+
+bool IsSbcConfigValid(const SbcConfig& config) {
+  // 16 bits per subband for each channel, or for both channels when they
+  // share the bitpool, and 250 at most
+  const bool shared = config.channel_mode == SbcChannelMode::STEREO ||
+                      config.channel_mode == SbcChannelMode::JOINT_STEREO;
+  const int max_bitpool =
+      std::min(250, config.subbands * (shared ? 32 : 16));
+  return SampleRateIndex(config.sample_rate) >= 0 &&
+         (config.blocks == 4 || config.blocks == 8 || config.blocks == 12 ||
+          config.blocks == 16) &&
+         (config.subbands == 4 || config.subbands == 8) &&
+         config.channel_mode <= SbcChannelMode::JOINT_STEREO &&
+         config.alloc_method <= SbcAllocMethod::SNR && config.bitpool >= 2 &&
+         config.bitpool <= max_bitpool;
+}
+
+size_t SbcFrameLength(const SbcConfig& config) {
+  const int channels = ChannelCount(config.channel_mode);
+  size_t data_bits;
+  switch (config.channel_mode) {
+    case SbcChannelMode::MONO:
+    case SbcChannelMode::DUAL:
+      data_bits = config.blocks * channels * config.bitpool;
+      break;
+    case SbcChannelMode::STEREO:
+      data_bits = config.blocks * config.bitpool;
+      break;
+    case SbcChannelMode::JOINT_STEREO:
+    default:
+      data_bits = config.subbands + config.blocks * config.bitpool;
+      break;
+  }
+  return 4 + (4 * config.subbands * channels) / 8 + (data_bits + 7) / 8;
+}
+
+uint32_t SbcBitRate(const SbcConfig& config) {
+  return 8 * SbcFrameLength(config) * config.sample_rate /
+         (config.subbands * config.blocks);
+}
+
+std::vector<SbcSimdLevel> GetSbcSupportedSimdLevels() {
+  std::vector<SbcSimdLevel> levels = {SbcSimdLevel::NONE};
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) levels.push_back(SbcSimdLevel::SSE2);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  levels.push_back(SbcSimdLevel::NEON);
+#endif
+  return levels;
+}
+
+std::unique_ptr<SbcEncoder> SbcEncoder::Create(const SbcConfig& config) {
+  return Create(config, GetSbcSupportedSimdLevels().back());
+}
+
+std::unique_ptr<SbcEncoder> SbcEncoder::Create(const SbcConfig& config,
+                                               SbcSimdLevel simd_level) {
+  sbc::AnalyzeFn analyze = GetAnalyzeFn(simd_level);
+  if (!IsSbcConfigValid(config) || analyze == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<SbcEncoder>(new SbcEncoder(config, analyze));
+}
+
+SbcEncoder::SbcEncoder(const SbcConfig& config, sbc::AnalyzeFn analyze)
+    : config_(config),
+      analyze_(analyze),
+      channels_(ChannelCount(config.channel_mode)),
+      frame_length_(SbcFrameLength(config)) {
+  const sbc::AnalysisTables& tables = sbc::GetAnalysisTables();
+  window_ = config.subbands == 4 ? tables.window4 : tables.window8;
+  matrix_ = config.subbands == 4 ? tables.matrix4 : tables.matrix8;
+  for (int ch = 0; ch < channels_; ch++) {
+    history_[ch].resize((kHistoryBlocks + 10) * config.subbands);
+  }
+  Reset();
+}
+
+void SbcEncoder::Reset() {
+  for (int ch = 0; ch < channels_; ch++) {
+    std::fill(history_[ch].begin(), history_[ch].end(), 0.0f);
+  }
+  history_pos_ = kHistoryBlocks * config_.subbands;
+}
+
+void SbcEncoder::EncodeFrame(const int16_t* pcm, uint8_t* frame) {
+  Analyze(pcm);
+  ComputeScaleFactors();
+  if (config_.channel_mode == SbcChannelMode::JOINT_STEREO) {
+    SelectJointSubbands();
+  } else {
+    join_ = 0;
+  }
+  AllocateBits();
+  Pack(frame);
+}
+
+void SbcEncoder::Analyze(const int16_t* pcm) {
+  const int subbands = config_.subbands;
+  const int kept = 9 * subbands;
+  for (int blk = 0; blk < config_.blocks; blk++) {
+    // Make room for a new block in front of the last 9 ones
+    if (history_pos_ < subbands) {
+      const int end = history_[0].size();
+      for (int ch = 0; ch < channels_; ch++) {
+        memmove(&history_[ch][end - kept], &history_[ch][history_pos_],
+                kept * sizeof(float));
+      }
+      history_pos_ = end - kept;
+    }
+    history_pos_ -= subbands;
+
+    const int16_t* block = pcm + blk * subbands * channels_;
+    for (int ch = 0; ch < channels_; ch++) {
+      float* x = &history_[ch][history_pos_];
+      for (int i = 0; i < subbands; i++) {
+        x[i] = block[(subbands - 1 - i) * channels_ + ch];
+      }
+      analyze_(x, window_, matrix_, subbands, sb_sample_[blk][ch]);
+    }
+  }
+}
+
+void SbcEncoder::ComputeScaleFactors() {
+  for (int ch = 0; ch < channels_; ch++) {
+    for (int sb = 0; sb < config_.subbands; sb++) {
+      float max_abs = 0.0f;
+      for (int blk = 0; blk < config_.blocks; blk++) {
+        max_abs = std::max(max_abs, fabsf(sb_sample_[blk][ch][sb]));
+      }
+      scale_factor_[ch][sb] = ScaleFactor(max_abs);
+    }
+  }
+}
+
+// Codes a subband as mid and side when it takes smaller scale factors than
+// left and right, which the last subband never is
+void SbcEncoder::SelectJointSubbands() {
+  join_ = 0;
+  for (int sb = 0; sb < config_.subbands - 1; sb++) {
+    float max_mid = 0.0f;
+    float max_side = 0.0f;
+    for (int blk = 0; blk < config_.blocks; blk++) {
+      const float left = sb_sample_[blk][0][sb];
+      const float right = sb_sample_[blk][1][sb];
+      max_mid = std::max(max_mid, fabsf((left + right) * 0.5f));
+      max_side = std::max(max_side, fabsf((left - right) * 0.5f));
+    }
+    const int scale_factor_mid = ScaleFactor(max_mid);
+    const int scale_factor_side = ScaleFactor(max_side);
+    if (scale_factor_mid + scale_factor_side >=
+        scale_factor_[0][sb] + scale_factor_[1][sb]) {
+      continue;
+    }
+
+    join_ |= 1 << sb;
+    scale_factor_[0][sb] = scale_factor_mid;
+    scale_factor_[1][sb] = scale_factor_side;
+    for (int blk = 0; blk < config_.blocks; blk++) {
+      const float left = sb_sample_[blk][0][sb];
+      const float right = sb_sample_[blk][1][sb];
+      sb_sample_[blk][0][sb] = (left + right) * 0.5f;
+      sb_sample_[blk][1][sb] = (left - right) * 0.5f;
+    }
+  }
+}
+
+void SbcEncoder::AllocateBits() {
+  const int subbands = config_.subbands;
+  const int rate_index = SampleRateIndex(config_.sample_rate);
+  const int* offset = subbands == 4 ? kLoudnessOffset4[rate_index]
+                                    : kLoudnessOffset8[rate_index];
+  const bool shared = config_.channel_mode == SbcChannelMode::STEREO ||
+                      config_.channel_mode == SbcChannelMode::JOINT_STEREO;
+
+  // Bits needed per subband, in the order they are allocated in
+  int bitneed[kMaxChannels * kMaxSubbands] = {};
+  int bits[kMaxChannels * kMaxSubbands];
+  auto slot = [shared, subbands](int ch, int sb) {
+    return shared ? sb * 2 + ch : ch * subbands + sb;
+  };
+  for (int ch = 0; ch < channels_; ch++) {
+    for (int sb = 0; sb < subbands; sb++) {
+      const int scale_factor = scale_factor_[ch][sb];
+      int need;
+      if (config_.alloc_method == SbcAllocMethod::SNR) {
+        need = scale_factor;
+      } else if (scale_factor == 0) {
+        need = -5;
+      } else {
+        const int loudness = scale_factor - offset[sb];
+        need = loudness > 0 ? loudness / 2 : loudness;
+      }
+      bitneed[slot(ch, sb)] = need;
+    }
+  }
+
+  if (shared) {
+    AllocateSlots(bitneed, bits, 2 * subbands, config_.bitpool);
+  } else {
+    for (int ch = 0; ch < channels_; ch++) {
+      AllocateSlots(bitneed + ch * subbands, bits + ch * subbands, subbands,
+                    config_.bitpool);
+    }
+  }
+  for (int ch = 0; ch < channels_; ch++) {
+    for (int sb = 0; sb < subbands; sb++) {
+      bits_[ch][sb] = bits[slot(ch, sb)];
+    }
+  }
+}
+
+size_t SbcEncoder::Pack(uint8_t* frame) {
+  const int subbands = config_.subbands;
+  frame[0] = kSyncWord;
+  frame[1] = SampleRateIndex(config_.sample_rate) << 6 |
+             (config_.blocks / 4 - 1) << 4 |
+             static_cast<int>(config_.channel_mode) << 2 |
+             static_cast<int>(config_.alloc_method) << 1 | (subbands == 8);
+  frame[2] = config_.bitpool;
+
+  BitWriter writer(frame + 4);
+  size_t crc_bits = 0;
+  if (config_.channel_mode == SbcChannelMode::JOINT_STEREO) {
+    for (int sb = 0; sb < subbands; sb++) {
+      writer.Write((join_ >> sb) & 1, 1);
+    }
+    crc_bits += subbands;
+  }
+  for (int ch = 0; ch < channels_; ch++) {
+    for (int sb = 0; sb < subbands; sb++) {
+      writer.Write(scale_factor_[ch][sb], 4);
+    }
+  }
+  crc_bits += 4 * subbands * channels_;
+
+  // Quantize to floor((sample / 2^(scale factor + 1) + 1) * levels / 2),
+  // levels being 2^bits - 1
+  float scale[kMaxChannels][kMaxSubbands];
+  for (int ch = 0; ch < channels_; ch++) {
+    for (int sb = 0; sb < subbands; sb++) {
+      const int levels = (1 << bits_[ch][sb]) - 1;
+      scale[ch][sb] = levels * 0.5f / (2 << scale_factor_[ch][sb]);
+    }
+  }
+  for (int blk = 0; blk < config_.blocks; blk++) {
+    for (int ch = 0; ch < channels_; ch++) {
+      for (int sb = 0; sb < subbands; sb++) {
+        const int bits = bits_[ch][sb];
+        if (bits == 0) {
+          continue;
+        }
+        const int levels = (1 << bits) - 1;
+        const float level = sb_sample_[blk][ch][sb] * scale[ch][sb] +
+                            levels * 0.5f;
+        // Clips the samples too loud for scale factor 15
+        const int quantized =
+            std::min(std::max(static_cast<int>(level), 0), levels - 1);
+        writer.Write(quantized, bits);
+      }
+    }
+  }
+  writer.Flush();
+  // What the allocation left of the bitpool, if every subband got 16 bits
+  memset(writer.GetData(), 0, frame + frame_length_ - writer.GetData());
+
+  frame[3] = FrameCrc(frame, crc_bits);
+  return frame_length_;
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
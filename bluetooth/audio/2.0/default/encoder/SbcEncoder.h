@@ -0,0 +1,115 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "SbcAnalysis.h"
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+enum class SbcChannelMode : uint8_t { MONO, DUAL, STEREO, JOINT_STEREO };
+enum class SbcAllocMethod : uint8_t { LOUDNESS, SNR };
+
+// The parameters of an SBC stream, as negotiated in the A2DP codec
+// capabilities
+struct SbcConfig {
+  uint32_t sample_rate;  // 16000, 32000, 44100 or 48000 Hz
+  SbcChannelMode channel_mode;
+  uint8_t blocks;    // 4, 8, 12 or 16
+  uint8_t subbands;  // 4 or 8
+  SbcAllocMethod alloc_method;
+  uint8_t bitpool;  // 2 to 16 per subband and channel, up to 250
+};
+
+bool IsSbcConfigValid(const SbcConfig& config);
+// Size of an encoded frame in bytes, and the bit rate it makes, for a valid
+// configuration
+size_t SbcFrameLength(const SbcConfig& config);
+uint32_t SbcBitRate(const SbcConfig& config);
+
+// SIMD levels of the subband analysis, the same output at each of them
+enum class SbcSimdLevel { NONE, SSE2, NEON };
+// Levels supported by the CPU, the best one last
+std::vector<SbcSimdLevel> GetSbcSupportedSimdLevels();
+
+// Software SBC encoder, as specified in the A2DP specification. It takes
+// interleaved 16 bits PCM, one or two channels depending on the channel mode,
+// and makes one SBC frame out of each blocks * subbands PCM frames.
+class SbcEncoder {
+ public:
+  // @return: nullptr if the configuration or the SIMD level isn't supported
+  static std::unique_ptr<SbcEncoder> Create(const SbcConfig& config);
+  static std::unique_ptr<SbcEncoder> Create(const SbcConfig& config,
+                                            SbcSimdLevel simd_level);
+
+  const SbcConfig& GetConfig() const { return config_; }
+  size_t GetPcmBytesPerFrame() const {
+    return config_.blocks * config_.subbands * channels_ * sizeof(int16_t);
+  }
+  size_t GetFrameLength() const { return frame_length_; }
+
+  // Encodes GetPcmBytesPerFrame() bytes of PCM into a frame of
+  // GetFrameLength() bytes
+  void EncodeFrame(const int16_t* pcm, uint8_t* frame);
+
+  // Forgets the past input, to start an unrelated stream
+  void Reset();
+
+ private:
+  static constexpr int kMaxChannels = 2;
+  static constexpr int kMaxBlocks = 16;
+  static constexpr int kMaxSubbands = 8;
+  // Blocks of history kept before moving them back to the end of the buffer
+  static constexpr int kHistoryBlocks = 64;
+
+  SbcEncoder(const SbcConfig& config, sbc::AnalyzeFn analyze);
+
+  void Analyze(const int16_t* pcm);
+  void ComputeScaleFactors();
+  void SelectJointSubbands();
+  void AllocateBits();
+  size_t Pack(uint8_t* frame);
+
+  const SbcConfig config_;
+  const sbc::AnalyzeFn analyze_;
+  const float* window_;
+  const float* matrix_;
+  const int channels_;
+  const size_t frame_length_;
+
+  // The input of the filter bank for each channel: the last 10 * subbands
+  // samples start at history_pos_, the newest first
+  std::vector<float> history_[kMaxChannels];
+  int history_pos_;
+
+  // The frame being encoded
+  float sb_sample_[kMaxBlocks][kMaxChannels][kMaxSubbands];
+  int scale_factor_[kMaxChannels][kMaxSubbands];
+  int bits_[kMaxChannels][kMaxSubbands];
+  uint8_t join_;  // Bit per subband, the first one the highest
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SbcEncoderStage.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+namespace {
+
+uint64_t ThreadCpuTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace
+
+std::unique_ptr<SbcEncoderStage> SbcEncoderStage::Create(
+    std::unique_ptr<SbcEncoder> encoder, size_t buffer_bytes,
+    size_t max_packet_bytes, FramesCallback callback) {
+  if (encoder == nullptr || callback == nullptr ||
+      buffer_bytes < encoder->GetPcmBytesPerFrame() ||
+      max_packet_bytes < encoder->GetFrameLength()) {
+    return nullptr;
+  }
+  return std::unique_ptr<SbcEncoderStage>(
+      new SbcEncoderStage(std::move(encoder), buffer_bytes, max_packet_bytes,
+                          std::move(callback)));
+}
+
+SbcEncoderStage::SbcEncoderStage(std::unique_ptr<SbcEncoder> encoder,
+                                 size_t buffer_bytes, size_t max_packet_bytes,
+                                 FramesCallback callback)
+    : encoder_(std::move(encoder)),
+      pcm_frame_bytes_(encoder_->GetPcmBytesPerFrame()),
+      frame_length_(encoder_->GetFrameLength()),
+      max_packet_frames_(max_packet_bytes / frame_length_),
+      callback_(std::move(callback)),
+      ring_(buffer_bytes),
+      pcm_frame_(pcm_frame_bytes_ / sizeof(int16_t)),
+      packet_(max_packet_frames_ * frame_length_) {
+  worker_ = std::thread(&SbcEncoderStage::Run, this);
+}
+
+SbcEncoderStage::~SbcEncoderStage() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_one();
+  worker_.join();
+}
+
+size_t SbcEncoderStage::Write(const void* pcm, size_t bytes) {
+  const uint8_t* src = static_cast<const uint8_t*>(pcm);
+  bool frame_ready;
+  size_t accepted;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    accepted = std::min(bytes, ring_.size() - fill_);
+    size_t write_pos = (read_pos_ + fill_) % ring_.size();
+    size_t first = std::min(accepted, ring_.size() - write_pos);
+    memcpy(ring_.data() + write_pos, src, first);
+    memcpy(ring_.data(), src + first, accepted - first);
+    fill_ += accepted;
+    stats_.dropped_bytes += bytes - accepted;
+    frame_ready = fill_ >= pcm_frame_bytes_;
+  }
+  if (frame_ready) work_cv_.notify_one();
+  return accepted;
+}
+
+void SbcEncoderStage::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  flush_requested_ = true;
+  work_cv_.notify_one();
+  flushed_cv_.wait(lock, [this] { return !flush_requested_ || stopping_; });
+}
+
+SbcEncoderStage::Stats SbcEncoderStage::GetStats() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return stats_;
+}
+
+void SbcEncoderStage::TakePcmFrameLocked() {
+  uint8_t* dst = reinterpret_cast<uint8_t*>(pcm_frame_.data());
+  size_t first = std::min(pcm_frame_bytes_, ring_.size() - read_pos_);
+  memcpy(dst, ring_.data() + read_pos_, first);
+  memcpy(dst + first, ring_.data(), pcm_frame_bytes_ - first);
+  read_pos_ = (read_pos_ + pcm_frame_bytes_) % ring_.size();
+  fill_ -= pcm_frame_bytes_;
+}
+
+void SbcEncoderStage::DeliverPacket() {
+  callback_(packet_.data(), packet_frames_ * frame_length_, packet_frames_);
+  packet_frames_ = 0;
+}
+
+void SbcEncoderStage::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this] {
+      return stopping_ || flush_requested_ || fill_ >= pcm_frame_bytes_;
+    });
+    if (stopping_) break;
+
+    // Encode everything buffered, delivering each packet as it fills up
+    while (!stopping_ && fill_ >= pcm_frame_bytes_) {
+      TakePcmFrameLocked();
+      lock.unlock();
+      uint64_t start_ns = ThreadCpuTimeNs();
+      encoder_->EncodeFrame(pcm_frame_.data(),
+                            packet_.data() + packet_frames_ * frame_length_);
+      uint64_t encode_ns = ThreadCpuTimeNs() - start_ns;
+      bool packet_full = ++packet_frames_ == max_packet_frames_;
+      if (packet_full) DeliverPacket();
+      lock.lock();
+      stats_.frames++;
+      stats_.encode_ns += encode_ns;
+      stats_.max_encode_ns = std::max(stats_.max_encode_ns, encode_ns);
+      if (packet_full) stats_.packets++;
+    }
+    if (stopping_) break;
+
+    if (flush_requested_) {
+      if (packet_frames_ > 0) {
+        lock.unlock();
+        DeliverPacket();
+        lock.lock();
+        stats_.packets++;
+      }
+      flush_requested_ = false;
+      flushed_cv_.notify_all();
+    }
+  }
+  // Wake up a Flush() that will never complete
+  flushed_cv_.notify_all();
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SbcEncoder.h"
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+// Runs an SbcEncoder on a dedicated thread. The writer only copies PCM into a
+// ring buffer, and the frames come out of the worker in packets of up to
+// max_packet_bytes, as many whole frames as fit.
+class SbcEncoderStage {
+ public:
+  // Called on the worker thread with count frames, back to back
+  using FramesCallback =
+      std::function<void(const uint8_t* frames, size_t bytes, size_t count)>;
+
+  struct Stats {
+    uint64_t frames;
+    uint64_t packets;
+    // Thread CPU time spent in SbcEncoder::EncodeFrame
+    uint64_t encode_ns;
+    uint64_t max_encode_ns;
+    // PCM refused by Write() because the ring buffer was full
+    uint64_t dropped_bytes;
+  };
+
+  // @param buffer_bytes: size of the PCM ring buffer, at least one frame of PCM
+  // @param max_packet_bytes: at least one encoded frame
+  // @return: nullptr if the sizes are too small for the encoder
+  static std::unique_ptr<SbcEncoderStage> Create(
+      std::unique_ptr<SbcEncoder> encoder, size_t buffer_bytes,
+      size_t max_packet_bytes, FramesCallback callback);
+  // Stops the worker. PCM not encoded yet and frames not delivered yet are
+  // lost; call Flush() first to keep them.
+  ~SbcEncoderStage();
+
+  SbcEncoderStage(const SbcEncoderStage&) = delete;
+  SbcEncoderStage& operator=(const SbcEncoderStage&) = delete;
+
+  const SbcEncoder& GetEncoder() const { return *encoder_; }
+
+  // Never blocks on the encoder
+  // @return: the number of bytes accepted, the rest is counted as dropped
+  size_t Write(const void* pcm, size_t bytes);
+
+  // Waits until every whole frame of PCM written is encoded and delivered,
+  // including a last packet that isn't full. Less than a frame of PCM stays
+  // in the buffer.
+  void Flush();
+
+  Stats GetStats() const;
+
+ private:
+  SbcEncoderStage(std::unique_ptr<SbcEncoder> encoder, size_t buffer_bytes,
+                  size_t max_packet_bytes, FramesCallback callback);
+
+  void Run();
+  // Copies the oldest frame of PCM out of the ring buffer, locked
+  void TakePcmFrameLocked();
+  void DeliverPacket();
+
+  const std::unique_ptr<SbcEncoder> encoder_;
+  const size_t pcm_frame_bytes_;
+  const size_t frame_length_;
+  const size_t max_packet_frames_;
+  const FramesCallback callback_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable flushed_cv_;
+  std::vector<uint8_t> ring_;
+  size_t read_pos_ = 0;
+  size_t fill_ = 0;
+  bool flush_requested_ = false;
+  bool stopping_ = false;
+  Stats stats_ = {};
+
+  // Owned by the worker
+  std::vector<int16_t> pcm_frame_;
+  std::vector<uint8_t> packet_;
+  size_t packet_frames_ = 0;
+
+  std::thread worker_;
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -0,0 +1,776 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SbcAnalysis.h"
+#include "SbcEncoder.h"
+#include "SbcEncoderStage.h"
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+namespace {
+
+constexpr int kLoudnessOffset4[4][4] = {
+    {-1, 0, 0, 0}, {-2, 0, 0, 1}, {-2, 0, 0, 1}, {-2, 0, 0, 1}};
+constexpr int kLoudnessOffset8[4][8] = {{-2, 0, 0, 0, 0, 0, 0, 1},
+                                        {-3, 0, 0, 0, 0, 0, 1, 2},
+                                        {-4, 0, 0, 0, 0, 0, 1, 2},
+                                        {-4, 0, 0, 0, 0, 0, 1, 2}};
+
+int Channels(const SbcConfig& config) {
+  return config.channel_mode == SbcChannelMode::MONO ? 1 : 2;
+}
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t bytes)
+      : data_(data), bits_(bytes * 8) {}
+
+  uint32_t Read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++) {
+      value = value << 1 | ReadBit();
+    }
+    return value;
+  }
+
+  size_t GetPosition() const { return pos_; }
+  size_t GetSize() const { return bits_; }
+
+ private:
+  uint32_t ReadBit() {
+    if (pos_ >= bits_) {
+      ADD_FAILURE() << "Read past the end of the frame";
+      return 0;
+    }
+    uint32_t bit = (data_[pos_ / 8] >> (7 - pos_ % 8)) & 1;
+    pos_++;
+    return bit;
+  }
+
+  const uint8_t* data_;
+  size_t bits_;
+  size_t pos_ = 0;
+};
+
+// The bit allocation of the A2DP specification, written as in its pseudo
+// code rather than like the encoder: one or two channels, each subband by
+// channel within a subband when the bitpool is shared
+void AllocateBits(const SbcConfig& config, int scale_factor[2][8],
+                  int bits[2][8]) {
+  const int subbands = config.subbands;
+  const int rate = config.sample_rate == 16000   ? 0
+                   : config.sample_rate == 32000 ? 1
+                   : config.sample_rate == 44100 ? 2
+                                                 : 3;
+  const int* offset =
+      subbands == 4 ? kLoudnessOffset4[rate] : kLoudnessOffset8[rate];
+  const bool shared = config.channel_mode == SbcChannelMode::STEREO ||
+                      config.channel_mode == SbcChannelMode::JOINT_STEREO;
+  const int channels = Channels(config);
+
+  int bitneed[2][8];
+  for (int ch = 0; ch < channels; ch++) {
+    for (int sb = 0; sb < subbands; sb++) {
+      if (config.alloc_method == SbcAllocMethod::SNR) {
+        bitneed[ch][sb] = scale_factor[ch][sb];
+      } else if (scale_factor[ch][sb] == 0) {
+        bitneed[ch][sb] = -5;
+      } else {
+        int loudness = scale_factor[ch][sb] - offset[sb];
+        bitneed[ch][sb] = loudness > 0 ? loudness / 2 : loudness;
+      }
+    }
+  }
+
+  // Channels allocated together, one group when the bitpool is shared
+  const int groups = shared ? 1 : channels;
+  const int group_channels = shared ? 2 : 1;
+  for (int group = 0; group < groups; group++) {
+    const int first = shared ? 0 : group;
+    int max_bitneed = 0;
+    for (int ch = first; ch < first + group_channels; ch++) {
+      for (int sb = 0; sb < subbands; sb++) {
+        max_bitneed = std::max(max_bitneed, bitneed[ch][sb]);
+      }
+    }
+    int bitcount = 0;
+    int slicecount = 0;
+    int bitslice = max_bitneed + 1;
+    do {
+      bitslice--;
+      bitcount += slicecount;
+      slicecount = 0;
+      for (int ch = first; ch < first + group_channels; ch++) {
+        for (int sb = 0; sb < subbands; sb++) {
+          if (bitneed[ch][sb] > bitslice + 1 &&
+              bitneed[ch][sb] < bitslice + 16) {
+            slicecount++;
+          } else if (bitneed[ch][sb] == bitslice + 1) {
+            slicecount += 2;
+          }
+        }
+      }
+    } while (bitcount + slicecount < config.bitpool);
+    if (bitcount + slicecount == config.bitpool) {
+      bitcount += slicecount;
+      bitslice--;
+    }
+    for (int ch = first; ch < first + group_channels; ch++) {
+      for (int sb = 0; sb < subbands; sb++) {
+        bits[ch][sb] = bitneed[ch][sb] < bitslice + 2
+                           ? 0
+                           : std::min(bitneed[ch][sb] - bitslice, 16);
+      }
+    }
+    int ch = first;
+    int sb = 0;
+    auto next = [&] {
+      if (group_channels == 2 && ch == 0) {
+        ch = 1;
+      } else {
+        ch = first;
+        sb++;
+      }
+    };
+    while (bitcount < config.bitpool && sb < subbands) {
+      if (bits[ch][sb] >= 2 && bits[ch][sb] < 16) {
+        bits[ch][sb]++;
+        bitcount++;
+      } else if (bitneed[ch][sb] == bitslice + 1 &&
+                 config.bitpool > bitcount + 1) {
+        bits[ch][sb] = 2;
+        bitcount += 2;
+      }
+      next();
+    }
+    ch = first;
+    sb = 0;
+    while (bitcount < config.bitpool && sb < subbands) {
+      if (bits[ch][sb] < 16) {
+        bits[ch][sb]++;
+        bitcount++;
+      }
+      next();
+    }
+  }
+}
+
+// Bitwise CRC-8 of the specification, x^8 + x^4 + x^3 + x^2 + 1 starting
+// from 0x0f, over the header after the sync word and the join and scale
+// factor bits
+uint8_t Crc8(const uint8_t* frame, size_t payload_bits) {
+  std::vector<int> bits;
+  for (int byte = 1; byte <= 2; byte++) {
+    for (int i = 7; i >= 0; i--) bits.push_back((frame[byte] >> i) & 1);
+  }
+  for (size_t i = 0; i < payload_bits; i++) {
+    bits.push_back((frame[4 + i / 8] >> (7 - i % 8)) & 1);
+  }
+  uint8_t crc = 0x0f;
+  for (int bit : bits) {
+    const int feedback = bit ^ (crc >> 7);
+    crc = static_cast<uint8_t>(crc << 1);
+    if (feedback) crc ^= 0x1d;
+  }
+  return crc;
+}
+
+// The analysis filter bank of the specification in double precision, to
+// check the subband samples of the encoder against
+class SbcAnalyzer {
+ public:
+  explicit SbcAnalyzer(const SbcConfig& config)
+      : config_(config), channels_(Channels(config)) {
+    const sbc::AnalysisTables& tables = sbc::GetAnalysisTables();
+    window_ = config.subbands == 4 ? tables.window4 : tables.window8;
+    for (auto& x : x_) x.assign(10 * config.subbands, 0.0);
+  }
+
+  // Subband samples of a frame of interleaved PCM, by block and channel
+  void AnalyzeFrame(const int16_t* pcm, double sb_sample[16][2][8]) {
+    const int m = config_.subbands;
+    for (int blk = 0; blk < config_.blocks; blk++) {
+      const int16_t* block = pcm + blk * m * channels_;
+      for (int ch = 0; ch < channels_; ch++) {
+        // Newest sample first
+        std::vector<double>& x = x_[ch];
+        for (int i = 10 * m - 1; i >= m; i--) x[i] = x[i - m];
+        for (int i = 0; i < m; i++) x[m - 1 - i] = block[i * channels_ + ch];
+        double y[16];
+        for (int i = 0; i < 2 * m; i++) {
+          y[i] = 0;
+          for (int k = 0; k < 5; k++) {
+            y[i] += window_[i + k * 2 * m] * x[i + k * 2 * m];
+          }
+        }
+        for (int i = 0; i < m; i++) {
+          sb_sample[blk][ch][i] = 0;
+          for (int k = 0; k < 2 * m; k++) {
+            sb_sample[blk][ch][i] +=
+                cos((i + 0.5) * (k - m / 2) * M_PI / m) * y[k];
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  const SbcConfig config_;
+  const int channels_;
+  const float* window_;
+  std::vector<double> x_[2];
+};
+
+// Decodes SBC frames of a known configuration back to PCM, with the
+// synthesis filter bank of the specification
+class SbcDecoder {
+ public:
+  explicit SbcDecoder(const SbcConfig& config)
+      : config_(config), channels_(Channels(config)) {
+    const sbc::AnalysisTables& tables = sbc::GetAnalysisTables();
+    window_ = config.subbands == 4 ? tables.window4 : tables.window8;
+    for (auto& v : v_) v.assign(20 * config.subbands, 0.0);
+  }
+
+  // Appends the PCM of frame to pcm, interleaved. When expected holds the
+  // subband samples of the encoder input, checks each scale factor and
+  // that each decoded sample is within half a quantization step of it.
+  void DecodeFrame(const uint8_t* frame, size_t length,
+                   std::vector<double>* pcm,
+                   const double (*expected)[2][8] = nullptr) {
+    const int subbands = config_.subbands;
+    ASSERT_EQ(SbcFrameLength(config_), length);
+    ASSERT_EQ(0x9c, frame[0]);
+    BitReader header(frame + 1, 2);
+    const uint32_t rates[] = {16000, 32000, 44100, 48000};
+    ASSERT_EQ(config_.sample_rate, rates[header.Read(2)]);
+    ASSERT_EQ(config_.blocks, (header.Read(2) + 1) * 4);
+    ASSERT_EQ(static_cast<uint32_t>(config_.channel_mode), header.Read(2));
+    ASSERT_EQ(static_cast<uint32_t>(config_.alloc_method), header.Read(1));
+    ASSERT_EQ(config_.subbands, header.Read(1) ? 8 : 4);
+    ASSERT_EQ(config_.bitpool, frame[2]);
+
+    BitReader reader(frame + 4, length - 4);
+    int join[8] = {};
+    if (config_.channel_mode == SbcChannelMode::JOINT_STEREO) {
+      for (int sb = 0; sb < subbands; sb++) join[sb] = reader.Read(1);
+      EXPECT_EQ(0, join[subbands - 1]);
+    }
+    int scale_factor[2][8];
+    for (int ch = 0; ch < channels_; ch++) {
+      for (int sb = 0; sb < subbands; sb++) {
+        scale_factor[ch][sb] = reader.Read(4);
+      }
+    }
+    EXPECT_EQ(Crc8(frame, reader.GetPosition()), frame[3]);
+
+    int bits[2][8];
+    AllocateBits(config_, scale_factor, bits);
+
+    double sb_sample[16][2][8];
+    for (int blk = 0; blk < config_.blocks; blk++) {
+      for (int ch = 0; ch < channels_; ch++) {
+        for (int sb = 0; sb < subbands; sb++) {
+          const int levels = (1 << bits[ch][sb]) - 1;
+          if (bits[ch][sb] == 0) {
+            sb_sample[blk][ch][sb] = 0;
+            continue;
+          }
+          const uint32_t sample = reader.Read(bits[ch][sb]);
+          sb_sample[blk][ch][sb] = (2 << scale_factor[ch][sb]) *
+                                   ((sample * 2.0 + 1.0) / levels - 1.0);
+        }
+      }
+    }
+    // Padding only, all zeros, to the end of the frame
+    while (reader.GetPosition() < reader.GetSize()) {
+      ASSERT_EQ(0u, reader.Read(1)) << "at bit " << reader.GetPosition();
+    }
+    if (expected != nullptr) {
+      CheckSubbands(expected, join, scale_factor, bits, sb_sample);
+    }
+
+    for (int blk = 0; blk < config_.blocks; blk++) {
+      for (int sb = 0; sb < subbands; sb++) {
+        if (!join[sb]) continue;
+        const double mid = sb_sample[blk][0][sb];
+        const double side = sb_sample[blk][1][sb];
+        sb_sample[blk][0][sb] = mid + side;
+        sb_sample[blk][1][sb] = mid - side;
+      }
+      double out[2][8];
+      for (int ch = 0; ch < channels_; ch++) {
+        Synthesize(ch, sb_sample[blk][ch], out[ch]);
+      }
+      for (int i = 0; i < subbands; i++) {
+        for (int ch = 0; ch < channels_; ch++) pcm->push_back(out[ch][i]);
+      }
+    }
+  }
+
+ private:
+  void CheckSubbands(const double (*expected)[2][8], const int* join,
+                     int scale_factor[2][8], int bits[2][8],
+                     double sb_sample[16][2][8]) {
+    for (int ch = 0; ch < channels_; ch++) {
+      for (int sb = 0; sb < config_.subbands; sb++) {
+        double coded[16];
+        double max_abs = 0;
+        for (int blk = 0; blk < config_.blocks; blk++) {
+          coded[blk] = expected[blk][ch][sb];
+          if (join[sb]) {
+            const double left = expected[blk][0][sb];
+            const double right = expected[blk][1][sb];
+            coded[blk] = ch == 0 ? (left + right) / 2 : (left - right) / 2;
+          }
+          max_abs = std::max(max_abs, fabs(coded[blk]));
+        }
+        // Smallest with |x| < 2^(sf + 1), give or take float rounding
+        const int sf = scale_factor[ch][sb];
+        if (sf < 15) {
+          EXPECT_LT(max_abs, ldexp(1.0, sf + 1) * (1 + 1e-5))
+              << "channel " << ch << ", subband " << sb;
+        }
+        if (sf > 0) {
+          EXPECT_GE(max_abs, ldexp(1.0, sf) * (1 - 1e-5))
+              << "channel " << ch << ", subband " << sb;
+        }
+        if (bits[ch][sb] == 0) continue;
+        const double half_step = ldexp(1.0, sf + 1) / ((1 << bits[ch][sb]) - 1);
+        for (int blk = 0; blk < config_.blocks; blk++) {
+          ASSERT_NEAR(coded[blk], sb_sample[blk][ch][sb],
+                      half_step * (1 + 1e-3) + 1e-2)
+              << "channel " << ch << ", subband " << sb << ", block " << blk
+              << ", " << bits[ch][sb] << " bits";
+        }
+      }
+    }
+  }
+
+  void Synthesize(int ch, const double* s, double* x) {
+    const int m = config_.subbands;
+    std::vector<double>& v = v_[ch];
+    for (int i = 20 * m - 1; i >= 2 * m; i--) v[i] = v[i - 2 * m];
+    for (int k = 0; k < 2 * m; k++) {
+      v[k] = 0;
+      for (int i = 0; i < m; i++) {
+        v[k] += cos((i + 0.5) * (k + m / 2) * M_PI / m) * s[i];
+      }
+    }
+    double u[80];
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < m; j++) {
+        u[i * 2 * m + j] = v[i * 4 * m + j];
+        u[i * 2 * m + m + j] = v[i * 4 * m + 3 * m + j];
+      }
+    }
+    // The synthesis window is the analysis one times -M
+    for (int j = 0; j < m; j++) {
+      x[j] = 0;
+      for (int i = 0; i < 10; i++) {
+        x[j] += u[j + m * i] * window_[j + m * i] * -m;
+      }
+    }
+  }
+
+  const SbcConfig config_;
+  const int channels_;
+  const float* window_;
+  std::vector<double> v_[2];
+};
+
+// A tone per channel, loud enough to use most scale factors
+std::vector<int16_t> MakeTones(const SbcConfig& config, size_t frames) {
+  const int channels = Channels(config);
+  std::vector<int16_t> pcm(frames * channels);
+  for (size_t n = 0; n < frames; n++) {
+    for (int ch = 0; ch < channels; ch++) {
+      const double freq = 700.0 + 1300.0 * ch;
+      pcm[n * channels + ch] = static_cast<int16_t>(
+          12000 * sin(2 * M_PI * freq * n / config.sample_rate));
+    }
+  }
+  return pcm;
+}
+
+// Noise and a tone, each at a level drawn per block, so that the scale
+// factors differ across subbands, channels and frames
+std::vector<int16_t> MakeNoise(const SbcConfig& config, size_t frames,
+                               uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> unit(-1.0, 1.0);
+  std::uniform_int_distribution<int> level(0, 13);
+  const int channels = Channels(config);
+  std::vector<int16_t> pcm(frames * channels);
+  double noise_gain[2];
+  double tone_gain[2];
+  double tone_step[2];
+  for (size_t n = 0; n < frames; n++) {
+    if (n % config.subbands == 0) {
+      for (int ch = 0; ch < channels; ch++) {
+        noise_gain[ch] = ldexp(1.0, level(random));
+        tone_gain[ch] = ldexp(1.0, level(random));
+        tone_step[ch] = M_PI * (unit(random) + 1.0) / 2;
+      }
+    }
+    for (int ch = 0; ch < channels; ch++) {
+      pcm[n * channels + ch] = static_cast<int16_t>(
+          noise_gain[ch] * unit(random) +
+          tone_gain[ch] * sin(tone_step[ch] * n));
+    }
+  }
+  return pcm;
+}
+
+std::vector<uint8_t> Encode(SbcEncoder* encoder,
+                            const std::vector<int16_t>& pcm) {
+  const size_t frame_samples = encoder->GetPcmBytesPerFrame() / sizeof(int16_t);
+  const size_t frames = pcm.size() / frame_samples;
+  std::vector<uint8_t> sbc(frames * encoder->GetFrameLength());
+  for (size_t i = 0; i < frames; i++) {
+    encoder->EncodeFrame(&pcm[i * frame_samples],
+                         &sbc[i * encoder->GetFrameLength()]);
+  }
+  return sbc;
+}
+
+// Signal to noise ratio of a channel of decoded against the input, which
+// the analysis and synthesis filter banks delay by 9 * M + 1 samples
+double SnrDb(const std::vector<int16_t>& input,
+             const std::vector<double>& decoded, int channels, int ch,
+             int subbands, size_t skip) {
+  const size_t frames = input.size() / channels;
+  const size_t delay = 9 * subbands + 1;
+  double signal = 0;
+  double noise = 0;
+  for (size_t n = skip; n + delay < frames; n++) {
+    const double in = input[n * channels + ch];
+    const double out = decoded[(n + delay) * channels + ch];
+    signal += in * in;
+    noise += (out - in) * (out - in);
+  }
+  return 10 * log10(signal / noise);
+}
+
+const SbcConfig kHighQuality = {44100, SbcChannelMode::JOINT_STEREO, 16, 8,
+                                SbcAllocMethod::LOUDNESS, 53};
+
+std::vector<SbcConfig> AllModes() {
+  std::vector<SbcConfig> configs;
+  for (auto mode : {SbcChannelMode::MONO, SbcChannelMode::DUAL,
+                    SbcChannelMode::STEREO, SbcChannelMode::JOINT_STEREO}) {
+    for (auto alloc : {SbcAllocMethod::LOUDNESS, SbcAllocMethod::SNR}) {
+      for (uint8_t subbands : {4, 8}) {
+        for (uint8_t blocks : {4, 16}) {
+          for (uint32_t rate : {16000, 48000}) {
+            const bool shared = mode == SbcChannelMode::STEREO ||
+                                mode == SbcChannelMode::JOINT_STEREO;
+            const uint8_t bitpool = subbands * (shared ? 5 : 3);
+            configs.push_back({rate, mode, blocks, subbands, alloc, bitpool});
+          }
+        }
+      }
+    }
+  }
+  return configs;
+}
+
+TEST(SbcEncoderTest, frameLengthAndBitRate) {
+  // The A2DP recommended high and middle quality settings
+  EXPECT_EQ(119u, SbcFrameLength(kHighQuality));
+  EXPECT_EQ(327993u, SbcBitRate(kHighQuality));
+  const SbcConfig middle = {44100, SbcChannelMode::JOINT_STEREO, 16, 8,
+                            SbcAllocMethod::LOUDNESS, 35};
+  EXPECT_EQ(83u, SbcFrameLength(middle));
+  const SbcConfig high48 = {48000, SbcChannelMode::JOINT_STEREO, 16, 8,
+                            SbcAllocMethod::LOUDNESS, 51};
+  EXPECT_EQ(115u, SbcFrameLength(high48));
+  EXPECT_EQ(345000u, SbcBitRate(high48));
+
+  EXPECT_EQ(114u, SbcFrameLength({48000, SbcChannelMode::STEREO, 16, 8,
+                                  SbcAllocMethod::LOUDNESS, 51}));
+  EXPECT_EQ(140u, SbcFrameLength({48000, SbcChannelMode::DUAL, 16, 8,
+                                  SbcAllocMethod::SNR, 32}));
+  EXPECT_EQ(70u, SbcFrameLength({48000, SbcChannelMode::MONO, 16, 8,
+                                 SbcAllocMethod::LOUDNESS, 31}));
+  EXPECT_EQ(42u, SbcFrameLength({16000, SbcChannelMode::MONO, 16, 4,
+                                 SbcAllocMethod::LOUDNESS, 18}));
+  // The join bits of 4 subbands don't make a whole byte
+  EXPECT_EQ(19u, SbcFrameLength({32000, SbcChannelMode::JOINT_STEREO, 4, 4,
+                                 SbcAllocMethod::SNR, 21}));
+}
+
+TEST(SbcEncoderTest, rejectsInvalidConfigs) {
+  SbcConfig config = kHighQuality;
+  config.sample_rate = 22050;
+  EXPECT_EQ(nullptr, SbcEncoder::Create(config));
+  config = kHighQuality;
+  config.blocks = 6;
+  EXPECT_EQ(nullptr, SbcEncoder::Create(config));
+  config = kHighQuality;
+  config.bitpool = 1;
+  EXPECT_EQ(nullptr, SbcEncoder::Create(config));
+  // 16 bits per subband and channel
+  config = {48000, SbcChannelMode::MONO, 16, 4, SbcAllocMethod::SNR, 65};
+  EXPECT_EQ(nullptr, SbcEncoder::Create(config));
+  config.bitpool = 64;
+  EXPECT_NE(nullptr, SbcEncoder::Create(config));
+}
+
+TEST(SbcEncoderTest, header) {
+  auto encoder = SbcEncoder::Create(kHighQuality);
+  ASSERT_NE(nullptr, encoder);
+  auto sbc = Encode(encoder.get(), MakeTones(kHighQuality, 128));
+  ASSERT_EQ(119u, sbc.size());
+  EXPECT_EQ(0x9c, sbc[0]);
+  EXPECT_EQ(0xbd, sbc[1]);
+  EXPECT_EQ(0x35, sbc[2]);
+  // The join bits and 2 x 8 scale factors
+  EXPECT_EQ(Crc8(sbc.data(), 8 + 64), sbc[3]);
+}
+
+// Every frame parses with the allocation of the specification, its CRC
+// matches and the decoded tones are within quantization noise of the input
+TEST(SbcEncoderTest, decodeRoundTrip) {
+  for (const SbcConfig& config :
+       {kHighQuality,
+        {48000, SbcChannelMode::STEREO, 16, 8, SbcAllocMethod::LOUDNESS, 51},
+        {48000, SbcChannelMode::DUAL, 16, 8, SbcAllocMethod::SNR, 32},
+        {32000, SbcChannelMode::MONO, 8, 4, SbcAllocMethod::SNR, 32},
+        {16000, SbcChannelMode::JOINT_STEREO, 12, 4, SbcAllocMethod::LOUDNESS,
+         40}}) {
+    SCOPED_TRACE(testing::Message()
+                 << config.sample_rate << " Hz, mode "
+                 << static_cast<int>(config.channel_mode) << ", bitpool "
+                 << static_cast<int>(config.bitpool));
+    auto encoder = SbcEncoder::Create(config, SbcSimdLevel::NONE);
+    ASSERT_NE(nullptr, encoder);
+    const size_t frame_pcm = config.blocks * config.subbands;
+    const auto input = MakeTones(config, 40 * frame_pcm);
+    const auto sbc = Encode(encoder.get(), input);
+
+    SbcDecoder decoder(config);
+    std::vector<double> decoded;
+    for (size_t i = 0; i < sbc.size(); i += encoder->GetFrameLength()) {
+      ASSERT_NO_FATAL_FAILURE(
+          decoder.DecodeFrame(&sbc[i], encoder->GetFrameLength(), &decoded));
+    }
+    ASSERT_EQ(input.size(), decoded.size());
+    for (int ch = 0; ch < Channels(config); ch++) {
+      EXPECT_GT(SnrDb(input, decoded, Channels(config), ch, config.subbands,
+                      2 * frame_pcm),
+                50.0)
+          << "channel " << ch;
+    }
+  }
+}
+
+// Noise at a low bitpool, so that allocation takes every path of the
+// specification, in every mode. Decoding at this rate says little about
+// the result, so each subband sample is checked against the analysis of
+// the input instead.
+TEST(SbcEncoderTest, decodeAllModes) {
+  uint32_t seed = 0;
+  for (const SbcConfig& config : AllModes()) {
+    auto encoder = SbcEncoder::Create(config, SbcSimdLevel::NONE);
+    ASSERT_NE(nullptr, encoder);
+    constexpr size_t kFrames = 8;
+    const size_t frame_samples =
+        config.blocks * config.subbands * Channels(config);
+    const auto input = MakeNoise(
+        config, kFrames * config.blocks * config.subbands, seed++);
+    const auto sbc = Encode(encoder.get(), input);
+    SbcAnalyzer analyzer(config);
+    SbcDecoder decoder(config);
+    std::vector<double> decoded;
+    for (size_t i = 0; i < kFrames; i++) {
+      double expected[16][2][8];
+      analyzer.AnalyzeFrame(&input[i * frame_samples], expected);
+      ASSERT_NO_FATAL_FAILURE(decoder.DecodeFrame(
+          &sbc[i * encoder->GetFrameLength()], encoder->GetFrameLength(),
+          &decoded, expected));
+    }
+  }
+}
+
+void ExpectSameAnalysis(sbc::AnalyzeFn analyze) {
+  const sbc::AnalysisTables& tables = sbc::GetAnalysisTables();
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> sample(-32768.0f, 32767.0f);
+  for (int subbands : {4, 8}) {
+    const float* window = subbands == 4 ? tables.window4 : tables.window8;
+    const float* matrix = subbands == 4 ? tables.matrix4 : tables.matrix8;
+    for (int round = 0; round < 1000; round++) {
+      float x[80];
+      for (auto& s : x) s = sample(random);
+      float expected[8];
+      float actual[8];
+      sbc::AnalyzeScalar(x, window, matrix, subbands, expected);
+      analyze(x, window, matrix, subbands, actual);
+      ASSERT_EQ(0, memcmp(expected, actual, subbands * sizeof(float)))
+          << subbands << " subbands, round " << round;
+    }
+  }
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+TEST(SbcEncoderTest, sse2AnalysisMatchesScalar) {
+  ExpectSameAnalysis(sbc::AnalyzeSse2);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+TEST(SbcEncoderTest, neonAnalysisMatchesScalar) {
+  ExpectSameAnalysis(sbc::AnalyzeNeon);
+}
+#endif
+
+TEST(SbcEncoderTest, simdLevelsMakeTheSameBitstream) {
+  uint32_t seed = 100;
+  for (const SbcConfig& config : AllModes()) {
+    const auto pcm =
+        MakeNoise(config, 8 * config.blocks * config.subbands, seed++);
+    auto scalar = SbcEncoder::Create(config, SbcSimdLevel::NONE);
+    ASSERT_NE(nullptr, scalar);
+    const auto expected = Encode(scalar.get(), pcm);
+    for (auto level : GetSbcSupportedSimdLevels()) {
+      auto encoder = SbcEncoder::Create(config, level);
+      ASSERT_NE(nullptr, encoder);
+      EXPECT_EQ(expected, Encode(encoder.get(), pcm))
+          << "SIMD level " << static_cast<int>(level);
+    }
+  }
+}
+
+TEST(SbcEncoderTest, resetForgetsHistory) {
+  auto encoder = SbcEncoder::Create(kHighQuality);
+  ASSERT_NE(nullptr, encoder);
+  const auto pcm = MakeTones(kHighQuality, 4 * 128);
+  const auto first = Encode(encoder.get(), pcm);
+  EXPECT_NE(first, Encode(encoder.get(), pcm));
+  encoder->Reset();
+  EXPECT_EQ(first, Encode(encoder.get(), pcm));
+}
+
+struct Packet {
+  std::vector<uint8_t> data;
+  size_t count;
+};
+
+class SbcEncoderStageTest : public testing::Test {
+ protected:
+  std::unique_ptr<SbcEncoderStage> CreateStage(size_t buffer_bytes,
+                                               size_t max_packet_bytes) {
+    return SbcEncoderStage::Create(
+        SbcEncoder::Create(kHighQuality), buffer_bytes, max_packet_bytes,
+        [this](const uint8_t* frames, size_t bytes, size_t count) {
+          packets_.push_back({std::vector<uint8_t>(frames, frames + bytes),
+                              count});
+        });
+  }
+
+  std::vector<uint8_t> Delivered() const {
+    std::vector<uint8_t> all;
+    for (const auto& packet : packets_) {
+      all.insert(all.end(), packet.data.begin(), packet.data.end());
+    }
+    return all;
+  }
+
+  // Only accessed on the worker, or after Flush()
+  std::vector<Packet> packets_;
+};
+
+TEST_F(SbcEncoderStageTest, rejectsSmallSizes) {
+  auto encoder = SbcEncoder::Create(kHighQuality);
+  const size_t pcm_frame = encoder->GetPcmBytesPerFrame();
+  EXPECT_EQ(nullptr, CreateStage(pcm_frame - 1, 1000));
+  EXPECT_EQ(nullptr, CreateStage(pcm_frame, 118));
+  EXPECT_NE(nullptr, CreateStage(pcm_frame, 119));
+}
+
+TEST_F(SbcEncoderStageTest, splitsPacketsAndFlushes) {
+  // Room for 3 frames of 119 bytes, not 4
+  auto stage = CreateStage(64 * 1024, 4 * 119 - 1);
+  ASSERT_NE(nullptr, stage);
+
+  // 10 frames and a half, in writes that don't end on frames
+  const auto pcm = MakeTones(kHighQuality, 10 * 128 + 64);
+  const auto* bytes = reinterpret_cast<const uint8_t*>(pcm.data());
+  const size_t total = pcm.size() * sizeof(int16_t);
+  for (size_t written = 0; written < total;) {
+    const size_t chunk = std::min<size_t>(777, total - written);
+    ASSERT_EQ(chunk, stage->Write(bytes + written, chunk));
+    written += chunk;
+  }
+  stage->Flush();
+
+  ASSERT_EQ(4u, packets_.size());
+  for (size_t i = 0; i < packets_.size(); i++) {
+    const size_t count = i < 3 ? 3 : 1;
+    EXPECT_EQ(count, packets_[i].count);
+    EXPECT_EQ(count * 119, packets_[i].data.size());
+  }
+  auto reference = SbcEncoder::Create(kHighQuality);
+  std::vector<int16_t> whole(pcm.begin(), pcm.begin() + 10 * 128 * 2);
+  EXPECT_EQ(Encode(reference.get(), whole), Delivered());
+
+  auto stats = stage->GetStats();
+  EXPECT_EQ(10u, stats.frames);
+  EXPECT_EQ(4u, stats.packets);
+  EXPECT_EQ(0u, stats.dropped_bytes);
+
+  // The half frame left is encoded once completed
+  ASSERT_EQ(total, stage->Write(bytes, 64 * 2 * sizeof(int16_t)) + total -
+                       64 * 2 * sizeof(int16_t));
+  stage->Flush();
+  ASSERT_EQ(5u, packets_.size());
+  EXPECT_EQ(1u, packets_[4].count);
+  EXPECT_EQ(11u, stage->GetStats().frames);
+
+  // Nothing to deliver
+  stage->Flush();
+  EXPECT_EQ(5u, packets_.size());
+}
+
+TEST_F(SbcEncoderStageTest, countsDroppedBytes) {
+  auto encoder = SbcEncoder::Create(kHighQuality);
+  const size_t buffer_bytes = 4 * encoder->GetPcmBytesPerFrame();
+  auto stage = CreateStage(buffer_bytes, 1000);
+  ASSERT_NE(nullptr, stage);
+
+  std::vector<uint8_t> pcm(3 * buffer_bytes);
+  EXPECT_EQ(buffer_bytes, stage->Write(pcm.data(), pcm.size()));
+  EXPECT_EQ(2 * buffer_bytes, stage->GetStats().dropped_bytes);
+  stage->Flush();
+  EXPECT_EQ(4u, stage->GetStats().frames);
+}
+
+}  // namespace
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
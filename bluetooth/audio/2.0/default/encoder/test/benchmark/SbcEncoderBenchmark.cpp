@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "SbcEncoder.h"
+#include "SbcEncoderStage.h"
+
+using android::bluetooth::audio::SbcAllocMethod;
+using android::bluetooth::audio::SbcChannelMode;
+using android::bluetooth::audio::SbcConfig;
+using android::bluetooth::audio::SbcEncoder;
+using android::bluetooth::audio::SbcEncoderStage;
+using android::bluetooth::audio::SbcSimdLevel;
+
+namespace {
+
+struct NamedConfig {
+  const char* name;
+  SbcConfig config;
+};
+
+// The A2DP recommended high and middle quality settings, and a few others
+// that exercise the other channel modes and the 4 subbands filter bank
+const NamedConfig kConfigs[] = {
+    {"44k1_joint_bp53",
+     {44100, SbcChannelMode::JOINT_STEREO, 16, 8, SbcAllocMethod::LOUDNESS,
+      53}},
+    {"44k1_joint_bp35",
+     {44100, SbcChannelMode::JOINT_STEREO, 16, 8, SbcAllocMethod::LOUDNESS,
+      35}},
+    {"48k_stereo_bp51",
+     {48000, SbcChannelMode::STEREO, 16, 8, SbcAllocMethod::LOUDNESS, 51}},
+    {"48k_dual_bp32",
+     {48000, SbcChannelMode::DUAL, 16, 8, SbcAllocMethod::SNR, 32}},
+    {"16k_mono_sb4_bp18",
+     {16000, SbcChannelMode::MONO, 16, 4, SbcAllocMethod::LOUDNESS, 18}},
+};
+
+// The arguments are SbcSimdLevel and an index in kConfigs
+void configs(benchmark::internal::Benchmark* b) {
+  for (auto level : android::bluetooth::audio::GetSbcSupportedSimdLevels()) {
+    for (size_t i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); i++) {
+      b->Args({static_cast<int>(level), static_cast<int>(i)});
+    }
+  }
+}
+
+// Two tones and some noise, so every subband gets bits
+std::vector<int16_t> makePcm(const SbcConfig& config, int channels,
+                             size_t frames) {
+  std::vector<int16_t> pcm(frames * channels);
+  srand(0);
+  for (size_t n = 0; n < frames; n++) {
+    double t = static_cast<double>(n) / config.sample_rate;
+    for (int ch = 0; ch < channels; ch++) {
+      double value = 8000 * sin(2 * M_PI * (440 + 220 * ch) * t) +
+                     3000 * sin(2 * M_PI * 5000 * t) + rand() % 2001 - 1000;
+      pcm[n * channels + ch] = static_cast<int16_t>(value);
+    }
+  }
+  return pcm;
+}
+
+int channelCount(const SbcConfig& config) {
+  return config.channel_mode == SbcChannelMode::MONO ? 1 : 2;
+}
+
+// Seconds of audio in a frame
+double frameDuration(const SbcConfig& config) {
+  return static_cast<double>(config.blocks * config.subbands) /
+         config.sample_rate;
+}
+
+void BM_EncodeFrame(benchmark::State& state) {
+  const auto level = static_cast<SbcSimdLevel>(state.range(0));
+  const NamedConfig& named = kConfigs[state.range(1)];
+  auto encoder = SbcEncoder::Create(named.config, level);
+  if (encoder == nullptr) {
+    state.SkipWithError("Unsupported configuration");
+    return;
+  }
+
+  // A second of audio, encoded over and over
+  const size_t frame_samples =
+      encoder->GetPcmBytesPerFrame() / sizeof(int16_t);
+  const size_t frames =
+      static_cast<size_t>(1 / frameDuration(named.config)) + 1;
+  const int channels = channelCount(named.config);
+  auto pcm = makePcm(named.config, channels, frames * frame_samples / channels);
+  std::vector<uint8_t> frame(encoder->GetFrameLength());
+
+  size_t index = 0;
+  for (auto _ : state) {
+    encoder->EncodeFrame(&pcm[index * frame_samples], frame.data());
+    benchmark::DoNotOptimize(frame.data());
+    index = (index + 1) % frames;
+  }
+  state.SetLabel(named.name);
+  state.SetBytesProcessed(state.iterations() * encoder->GetPcmBytesPerFrame());
+  // Seconds of audio encoded per second, how many streams a core can take
+  state.counters["x_realtime"] =
+      benchmark::Counter(state.iterations() * frameDuration(named.config),
+                         benchmark::Counter::kIsRate);
+  state.counters["kbps"] = android::bluetooth::audio::SbcBitRate(named.config) /
+                           1000.0;
+}
+BENCHMARK(BM_EncodeFrame)->Apply(configs);
+
+// The cost on the writer side of handing PCM to the encoder thread, in
+// writes of 10 ms like the audio HAL does, and the encoding cost seen by the
+// worker. Each iteration is 10 ms of audio.
+void BM_EncoderStage(benchmark::State& state) {
+  const auto level = static_cast<SbcSimdLevel>(state.range(0));
+  const NamedConfig& named = kConfigs[state.range(1)];
+  // A common A2DP media packet payload
+  constexpr size_t kMaxPacketBytes = 895;
+
+  size_t delivered_bytes = 0;
+  auto stage = SbcEncoderStage::Create(
+      SbcEncoder::Create(named.config, level), 64 * 1024, kMaxPacketBytes,
+      [&delivered_bytes](const uint8_t*, size_t bytes, size_t) {
+        delivered_bytes += bytes;
+      });
+  if (stage == nullptr) {
+    state.SkipWithError("Unsupported configuration");
+    return;
+  }
+
+  const int channels = channelCount(named.config);
+  const size_t write_frames = named.config.sample_rate / 100;
+  auto pcm = makePcm(named.config, channels, write_frames);
+  const size_t write_bytes = pcm.size() * sizeof(int16_t);
+
+  for (auto _ : state) {
+    size_t written = 0;
+    while (written < write_bytes) {
+      written += stage->Write(reinterpret_cast<const uint8_t*>(pcm.data()) +
+                                  written,
+                              write_bytes - written);
+      // Like a full FMQ, wait for the reader and retry
+      if (written < write_bytes) stage->Flush();
+    }
+  }
+  stage->Flush();
+
+  const auto stats = stage->GetStats();
+  state.SetLabel(named.name);
+  state.SetBytesProcessed(state.iterations() * write_bytes);
+  state.counters["encode_us"] =
+      stats.frames ? stats.encode_ns / 1000.0 / stats.frames : 0;
+  state.counters["max_encode_us"] = stats.max_encode_ns / 1000.0;
+  state.counters["packets"] = stats.packets;
+  state.counters["pcm_to_sbc_ratio"] =
+      delivered_bytes ? static_cast<double>(state.iterations() * write_bytes) /
+                            delivered_bytes
+                      : 0;
+}
+BENCHMARK(BM_EncoderStage)->Apply(configs)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -18,6 +18,9 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -44,6 +47,14 @@ AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
 static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// longest wait at once for a reader known to wake NOT_FULL, in case it misses
+static constexpr int kWriteNotifiedWaitMs = 20;
+
+// event flag bits of the data MQ, the same as the audio HAL's
+static constexpr uint32_t kFmqNotEmpty = 1 << 0;
+static constexpr uint32_t kFmqNotFull = 1 << 1;
+// woken by the session to stop a blocked writer when the data path changes
+static constexpr uint32_t kFmqDataPathChanged = 1 << 2;
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -51,7 +62,11 @@ static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      data_path_(nullptr),
+      data_path_generation_(0),
+      write_path_generation_(0) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +94,10 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    {
+      std::lock_guard<std::mutex> stats_guard(write_stats_mutex_);
+      write_stats_ = DataPathWriteStats();
+    }
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -92,6 +111,15 @@ void BluetoothAudioSession::OnSessionEnded() {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   if (IsSessionReady()) {
     ReportSessionStatus();
+    if (data_path_ != nullptr) {
+      DataPathWriteStats stats = GetWriteStats();
+      LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+                << ", " << stats.writes << " write(s) of " << stats.bytes
+                << " byte(s), " << stats.blocked_writes << " blocked for "
+                << stats.blocked_ns / 1000000 << " ms (max "
+                << stats.max_blocked_ns / 1000 << " us), " << stats.overflows
+                << " overflow(s)";
+    }
   }
   audio_config_ = (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH
                        ? kInvalidOffloadAudioConfiguration
@@ -147,23 +175,44 @@ bool BluetoothAudioSession::IsSessionReady() {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   bool dataMQ_valid =
       (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH ||
-       (mDataMQ != nullptr && mDataMQ->isValid()));
+       (data_path_ != nullptr && data_path_->mq->isValid()));
   return stack_iface_ != nullptr && dataMQ_valid;
 }
 
+BluetoothAudioSession::DataPath::~DataPath() {
+  if (event_flag != nullptr) {
+    EventFlag::deleteEventFlag(&event_flag);
+  }
+}
+
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
+  // Whatever happens, a writer must not keep using the old data path, and
+  // shouldn't wait for a reader which may be gone
+  ++data_path_generation_;
+  if (data_path_ != nullptr && data_path_->event_flag != nullptr) {
+    data_path_->event_flag->wake(kFmqDataPathChanged);
+  }
+
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
-    mDataMQ = nullptr;
+    data_path_ = nullptr;
     return true;
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
-  tempDataMQ.reset(new DataMQ(*dataMQ));
-  if (!tempDataMQ || !tempDataMQ->isValid()) {
-    mDataMQ = nullptr;
+  std::shared_ptr<DataPath> tempDataPath = std::make_shared<DataPath>();
+  tempDataPath->mq.reset(new DataMQ(*dataMQ));
+  if (!tempDataPath->mq || !tempDataPath->mq->isValid()) {
+    data_path_ = nullptr;
     return false;
   }
-  mDataMQ = std::move(tempDataMQ);
+  // Without an event flag, writers fall back to polling
+  if (tempDataPath->mq->getEventFlagWord() == nullptr ||
+      EventFlag::createEventFlag(tempDataPath->mq->getEventFlagWord(),
+                                 &tempDataPath->event_flag) != OK) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " DataMQ has no EventFlag";
+    tempDataPath->event_flag = nullptr;
+  }
+  data_path_ = std::move(tempDataPath);
   return true;
 }
 
@@ -366,40 +415,116 @@ void BluetoothAudioSession::UpdateTracksMetadata(
   }
 }
 
-// The control function writes stream to FMQ
+std::shared_ptr<BluetoothAudioSession::DataPath>
+BluetoothAudioSession::AcquireWritePath() {
+  // Fast path: the session hasn't changed since the last write
+  if (write_path_ != nullptr &&
+      data_path_generation_.load(std::memory_order_acquire) ==
+          write_path_generation_) {
+    return write_path_;
+  }
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  write_path_generation_ = data_path_generation_;
+  write_path_ = IsSessionReady() ? data_path_ : nullptr;
+  return write_path_;
+}
+
+void BluetoothAudioSession::RecordWrite(size_t bytes, uint64_t blocked_ns,
+                                        bool overflow) {
+  std::lock_guard<std::mutex> stats_guard(write_stats_mutex_);
+  write_stats_.writes++;
+  write_stats_.bytes += bytes;
+  if (blocked_ns > 0) {
+    write_stats_.blocked_writes++;
+    write_stats_.blocked_ns += blocked_ns;
+    write_stats_.max_blocked_ns =
+        std::max(write_stats_.max_blocked_ns, blocked_ns);
+  }
+  if (overflow) {
+    write_stats_.overflows++;
+  }
+}
+
+// The control function writes stream to FMQ. It doesn't hold mutex_ while
+// waiting for the Bluetooth stack to read, so control calls and the end of the
+// session aren't held up by a full FMQ.
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  std::lock_guard<std::mutex> write_guard(write_mutex_);
+  std::shared_ptr<DataPath> data_path = AcquireWritePath();
+  if (data_path == nullptr) return 0;
+
+  using std::chrono::steady_clock;
+  const steady_clock::time_point deadline =
+      steady_clock::now() + std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
-  do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) break;
-    size_t availableToWrite = mDataMQ->availableToWrite();
+  steady_clock::duration blocked = steady_clock::duration::zero();
+  bool overflow = false;
+  while (totalWritten < bytes) {
+    size_t availableToWrite = data_path->mq->availableToWrite();
     if (availableToWrite) {
       if (availableToWrite > (bytes - totalWritten)) {
         availableToWrite = bytes - totalWritten;
       }
 
-      if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
-                          availableToWrite)) {
+      if (!data_path->mq->write(
+              static_cast<const uint8_t*>(buffer) + totalWritten,
+              availableToWrite)) {
         ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
-        return totalWritten;
+        break;
       }
       totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
-    } else {
+      if (data_path->event_flag != nullptr) {
+        data_path->event_flag->wake(kFmqNotEmpty);
+      }
+      continue;
+    }
+
+    const steady_clock::time_point wait_start = steady_clock::now();
+    if (wait_start >= deadline) {
       ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
-      return totalWritten;
+            kFmqSendTimeoutMs);
+      overflow = true;
+      break;
+    }
+    if (data_path->event_flag != nullptr) {
+      // A reader that never wakes NOT_FULL is only noticed by polling
+      std::chrono::nanoseconds timeout = std::min<std::chrono::nanoseconds>(
+          deadline - wait_start,
+          std::chrono::milliseconds(data_path->reader_notifies
+                                        ? kWriteNotifiedWaitMs
+                                        : kWritePollMs));
+      uint32_t ef_state = 0;
+      data_path->event_flag->wait(kFmqNotFull | kFmqDataPathChanged, &ef_state,
+                                  timeout.count());
+      if (ef_state & kFmqNotFull) {
+        data_path->reader_notifies = true;
+      }
+    } else {
+      usleep(kWritePollMs * 1000);
+    }
+    blocked += steady_clock::now() - wait_start;
+
+    if (data_path_generation_ != write_path_generation_) {
+      LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " changed while writing " << totalWritten << "/" << bytes;
+      break;
     }
-  } while (totalWritten < bytes);
+  }
+
+  RecordWrite(
+      totalWritten,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(blocked).count(),
+      overflow);
   return totalWritten;
 }
 
+DataPathWriteStats BluetoothAudioSession::GetWriteStats() {
+  std::lock_guard<std::mutex> stats_guard(write_stats_mutex_);
+  return write_stats_;
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
@@ -16,10 +16,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +31,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -78,6 +81,19 @@ struct PortStatusCallbacks {
   std::function<void(uint16_t cookie)> session_changed_cb_;
 };
 
+// Statistics of the software data path, for the time the session was started
+struct DataPathWriteStats {
+  uint64_t writes = 0;
+  uint64_t bytes = 0;
+  // writes that had to wait for the Bluetooth stack to read from the FMQ, and
+  // for how long in total and at most
+  uint64_t blocked_writes = 0;
+  uint64_t blocked_ns = 0;
+  uint64_t max_blocked_ns = 0;
+  // writes that timed out before all their data fit
+  uint64_t overflows = 0;
+};
+
 class BluetoothAudioSession {
  private:
   // using recursive_mutex to allow hwbinder to re-enter agian.
@@ -86,14 +102,37 @@ class BluetoothAudioSession {
 
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  // audio data path (FMQ) for software encoding, with the event flag in its
+  // shared memory. Both go together so a writer still blocked on the flag
+  // keeps the memory mapped after the session ends.
+  struct DataPath {
+    std::unique_ptr<DataMQ> mq;
+    EventFlag* event_flag = nullptr;
+    // set once the reader wakes NOT_FULL, so waits needn't poll anymore;
+    // only used by the writer
+    bool reader_notifies = false;
+    ~DataPath();
+  };
+  std::shared_ptr<DataPath> data_path_;
+  // bumped under mutex_ whenever the session starts or ends, so the writer
+  // can keep using its own reference to the data path without taking mutex_
+  // for as long as it stays current
+  std::atomic<uint64_t> data_path_generation_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
   static AudioConfiguration invalidSoftwareAudioConfiguration;
   static AudioConfiguration invalidOffloadAudioConfiguration;
 
+  // serializing writers, as the FMQ allows only one, and protecting the
+  // writer's reference to the data path
+  std::mutex write_mutex_;
+  std::shared_ptr<DataPath> write_path_;
+  uint64_t write_path_generation_;
+
+  std::mutex write_stats_mutex_;
+  DataPathWriteStats write_stats_;
+
   // saving those registered bluetooth_audio's callbacks
   std::unordered_map<uint16_t, std::shared_ptr<struct PortStatusCallbacks>>
       observers_;
@@ -102,6 +141,10 @@ class BluetoothAudioSession {
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
+  // the data path to write to, or nullptr if the session isn't ready. Must be
+  // called with write_mutex_ held.
+  std::shared_ptr<DataPath> AcquireWritePath();
+  void RecordWrite(size_t bytes, uint64_t blocked_ns, bool overflow);
 
  public:
   BluetoothAudioSession(const SessionType& session_type);
@@ -151,9 +194,14 @@ class BluetoothAudioSession {
                                timespec* data_position);
   void UpdateTracksMetadata(const struct source_metadata* source_metadata);
 
-  // The control function writes stream to FMQ
+  // The control function writes stream to FMQ, blocking until all the data
+  // fits, the session ends, or it times out
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The control function is to get the statistics of OutWritePcmData since the
+  // session started
+  DataPathWriteStats GetWriteStats();
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .channelMode = ChannelMode::UNKNOWN,
@@ -136,6 +136,17 @@ class BluetoothAudioSessionControl {
     }
     return 0;
   }
+
+  // The control function is for the bluetooth_audio module to get the
+  // statistics of writing to the FMQ since the session started
+  static DataPathWriteStats GetWriteStats(const SessionType& session_type) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->GetWriteStats();
+    }
+    return DataPathWriteStats();
+  }
 };
 
 }  // namespace audio